@@ -4,9 +4,139 @@ Igor Pavlov
 Public domain */
 
 #include "7zCrc.h"
+#include "CpuArch.h"
 
 #define kCrcPoly 0xEDB88320
-UInt32 g_CrcTable[256];
+#define CRC_NUM_TABLES 8
+
+/* g_CrcTable[0 ... 255] is standard table for CRC_UPDATE_BYTE.
+   Other tables are for slicing-by-8 code. */
+
+UInt32 g_CrcTable[256 * CRC_NUM_TABLES];
+
+typedef UInt32 (MY_FAST_CALL *CRC_FUNC)(UInt32 v, const void *data, size_t size, const UInt32 *table);
+
+#define CRC_UPDATE_BYTE_2(crc, b) (table[((crc) ^ (b)) & 0xFF] ^ ((crc) >> 8))
+
+static UInt32 MY_FAST_CALL CrcUpdateT8(UInt32 v, const void *data, size_t size, const UInt32 *table)
+{
+  const Byte *p = (const Byte *)data;
+  for (; size > 0 && ((unsigned)(ptrdiff_t)p & 3) != 0; size--, p++)
+    v = CRC_UPDATE_BYTE_2(v, *p);
+  for (; size >= 8; size -= 8, p += 8)
+  {
+    UInt32 d;
+    v ^= GetUi32(p);
+    d = GetUi32(p + 4);
+    v =
+        table[0x700 + (v & 0xFF)]
+      ^ table[0x600 + ((v >> 8) & 0xFF)]
+      ^ table[0x500 + ((v >> 16) & 0xFF)]
+      ^ table[0x400 + ((v >> 24))]
+      ^ table[0x300 + (d & 0xFF)]
+      ^ table[0x200 + ((d >> 8) & 0xFF)]
+      ^ table[0x100 + ((d >> 16) & 0xFF)]
+      ^ table[0x000 + ((d >> 24))];
+  }
+  for (; size > 0; size--, p++)
+    v = CRC_UPDATE_BYTE_2(v, *p);
+  return v;
+}
+
+/*
+  PCLMULQDQ version folds four 128-bit lanes in parallel and uses Barrett
+  reduction for the last 64 bits ("Fast CRC Computation for Generic
+  Polynomials Using PCLMULQDQ Instruction", Intel, 2009).
+  Constants are for bit-reflected CRC-32 polynomial 0x04C11DB7.
+*/
+
+#ifdef MY_CPU_AMD64
+#if defined(_MSC_VER) && (_MSC_VER >= 1500)
+#define USE_CRC_CLMUL
+#elif defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define USE_CRC_CLMUL
+#define CRC_CLMUL_ATTRIB __attribute__((target("sse2,pclmul")))
+#endif
+#endif
+
+#ifdef USE_CRC_CLMUL
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#ifndef CRC_CLMUL_ATTRIB
+#define CRC_CLMUL_ATTRIB
+#endif
+
+#define CRC_CLMUL_BLOCK_MIN 64
+
+#define FOLD(x, k, y) _mm_xor_si128(_mm_xor_si128( \
+    _mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), y)
+
+/* (size) must be multiple of 16 and (size >= 64) */
+
+CRC_CLMUL_ATTRIB
+static UInt32 CrcUpdateClmulBlocks(UInt32 v, const Byte *p, size_t size)
+{
+  const __m128i k1k2 = _mm_set_epi32(0x00000001, 0xC6E41596, 0x00000001, 0x54442BD4);
+  const __m128i k3k4 = _mm_set_epi32(0x00000000, 0xCCAA009E, 0x00000001, 0x751997D0);
+  const __m128i k5 = _mm_set_epi32(0, 0, 0x00000001, 0x63CD6124);
+  const __m128i poly = _mm_set_epi32(0x00000001, 0xF7011641, 0x00000001, 0xDB710641);
+  const __m128i mask32 = _mm_set_epi32(0, -1, 0, -1);
+  __m128i x0, x1, x2, x3;
+
+  x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + 0x00)), _mm_cvtsi32_si128((int)v));
+  x1 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+  x2 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+  x3 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+  p += 64;
+  size -= 64;
+
+  for (; size >= 64; size -= 64, p += 64)
+  {
+    x0 = FOLD(x0, k1k2, _mm_loadu_si128((const __m128i *)(p + 0x00)));
+    x1 = FOLD(x1, k1k2, _mm_loadu_si128((const __m128i *)(p + 0x10)));
+    x2 = FOLD(x2, k1k2, _mm_loadu_si128((const __m128i *)(p + 0x20)));
+    x3 = FOLD(x3, k1k2, _mm_loadu_si128((const __m128i *)(p + 0x30)));
+  }
+
+  x0 = FOLD(x0, k3k4, x1);
+  x0 = FOLD(x0, k3k4, x2);
+  x0 = FOLD(x0, k3k4, x3);
+
+  for (; size >= 16; size -= 16, p += 16)
+    x0 = FOLD(x0, k3k4, _mm_loadu_si128((const __m128i *)p));
+
+  /* 128 bits -> 64 bits */
+  x1 = _mm_clmulepi64_si128(x0, k3k4, 0x10);
+  x0 = _mm_xor_si128(_mm_srli_si128(x0, 8), x1);
+  x1 = _mm_srli_si128(x0, 4);
+  x0 = _mm_clmulepi64_si128(_mm_and_si128(x0, mask32), k5, 0x00);
+  x0 = _mm_xor_si128(x0, x1);
+
+  /* Barrett reduction: 64 bits -> 32 bits */
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x0, mask32), poly, 0x10);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x00);
+  x0 = _mm_xor_si128(x0, x1);
+  return (UInt32)_mm_cvtsi128_si32(_mm_srli_si128(x0, 4));
+}
+
+static UInt32 MY_FAST_CALL CrcUpdateClmul(UInt32 v, const void *data, size_t size, const UInt32 *table)
+{
+  const Byte *p = (const Byte *)data;
+  if (size >= CRC_CLMUL_BLOCK_MIN)
+  {
+    size_t size2 = size & ~(size_t)15;
+    v = CrcUpdateClmulBlocks(v, p, size2);
+    p += size2;
+    size -= size2;
+  }
+  return CrcUpdateT8(v, p, size, table);
+}
+
+#endif
+
+static CRC_FUNC g_CrcUpdate = CrcUpdateT8;
 
 void MY_FAST_CALL CrcGenerateTable(void)
 {
@@ -19,17 +149,25 @@ void MY_FAST_CALL CrcGenerateTable(void)
       r = (r >> 1) ^ (kCrcPoly & ~((r & 1) - 1));
     g_CrcTable[i] = r;
   }
+  for (; i < 256 * CRC_NUM_TABLES; i++)
+  {
+    UInt32 r = g_CrcTable[i - 256];
+    g_CrcTable[i] = g_CrcTable[r & 0xFF] ^ (r >> 8);
+  }
+
+  g_CrcUpdate = CrcUpdateT8;
+  #ifdef USE_CRC_CLMUL
+  if (CPU_Is_Pclmul_Supported())
+    g_CrcUpdate = CrcUpdateClmul;
+  #endif
 }
 
 UInt32 MY_FAST_CALL CrcUpdate(UInt32 v, const void *data, size_t size)
 {
-  const Byte *p = (const Byte *)data;
-  for (; size > 0 ; size--, p++)
-    v = CRC_UPDATE_BYTE(v, *p);
-  return v;
+  return g_CrcUpdate(v, data, size, g_CrcTable);
 }
 
 UInt32 MY_FAST_CALL CrcCalc(const void *data, size_t size)
 {
-  return CrcUpdate(CRC_INIT_VAL, data, size) ^ 0xFFFFFFFF;
+  return g_CrcUpdate(CRC_INIT_VAL, data, size, g_CrcTable) ^ 0xFFFFFFFF;
 }
@@ -28,6 +28,12 @@ static Byte Sbox[256] = {
 static UInt32 D[256 * 4];
 static Byte InvS[256];
 
+typedef void (MY_FAST_CALL *AES_CODE_FUNC)(CAesCbc *p, Byte *data, size_t numBlocks);
+
+static void AesCbc_SetFuncs(void);
+static AES_CODE_FUNC g_AesCbc_Encode;
+static AES_CODE_FUNC g_AesCbc_Decode;
+
 static Byte Rcon[11] = { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
 
 #define xtime(x) ((((x) << 1) ^ (((x) & 0x80) != 0 ? 0x1B : 0)) & 0xFF)
@@ -70,6 +76,7 @@ void AesGenTables(void)
       D[0x300 + i] = Ui32(a9, aD, aB, aE);
     }
   }
+  AesCbc_SetFuncs();
 }
 
 #define HT(i, x, s) (T + (x << 8))[gb ## x(s[(i + x) & 3])]
@@ -205,15 +212,9 @@ void AesCbc_Init(CAesCbc *p, const Byte *iv)
     p->prev[i] = GetUi32(iv + i * 4);
 }
 
-SizeT AesCbc_Encode(CAesCbc *p, Byte *data, SizeT size)
+static void MY_FAST_CALL AesCbc_Encode_Table(CAesCbc *p, Byte *data, size_t numBlocks)
 {
-  SizeT i;
-  if (size == 0)
-    return 0;
-  if (size < AES_BLOCK_SIZE)
-    return AES_BLOCK_SIZE;
-  size -= AES_BLOCK_SIZE;
-  for (i = 0; i <= size; i += AES_BLOCK_SIZE, data += AES_BLOCK_SIZE)
+  for (; numBlocks != 0; numBlocks--, data += AES_BLOCK_SIZE)
   {
     p->prev[0] ^= GetUi32(data);
     p->prev[1] ^= GetUi32(data + 4);
@@ -227,19 +228,12 @@ SizeT AesCbc_Encode(CAesCbc *p, Byte *data, SizeT size)
     SetUi32(data + 8,  p->prev[2]);
     SetUi32(data + 12, p->prev[3]);
   }
-  return i;
 }
 
-SizeT AesCbc_Decode(CAesCbc *p, Byte *data, SizeT size)
+static void MY_FAST_CALL AesCbc_Decode_Table(CAesCbc *p, Byte *data, size_t numBlocks)
 {
-  SizeT i;
   UInt32 in[4], out[4];
-  if (size == 0)
-    return 0;
-  if (size < AES_BLOCK_SIZE)
-    return AES_BLOCK_SIZE;
-  size -= AES_BLOCK_SIZE;
-  for (i = 0; i <= size; i += AES_BLOCK_SIZE, data += AES_BLOCK_SIZE)
+  for (; numBlocks != 0; numBlocks--, data += AES_BLOCK_SIZE)
   {
     in[0] = GetUi32(data);
     in[1] = GetUi32(data + 4);
@@ -258,5 +252,143 @@ SizeT AesCbc_Decode(CAesCbc *p, Byte *data, SizeT size)
     p->prev[2] = in[2];
     p->prev[3] = in[3];
   }
-  return i;
+}
+
+/*
+  AES-NI versions use same key schedule as table code:
+  rkey is array of round keys in byte order, and Aes_SetKeyDecode
+  has already applied InvMixColumns to round keys 1 ... numRounds - 1,
+  as AESDEC instruction requires.
+  CBC encoding is serial. CBC decoding of different blocks is independent,
+  so AesCbc_Decode_Intel processes AES_NUM_WAYS blocks at once to hide
+  latency of AESDEC instruction.
+*/
+
+#ifdef MY_CPU_X86_OR_AMD64
+#if defined(_MSC_VER) && (_MSC_VER >= 1500)
+#define USE_AES_NI
+#elif defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define USE_AES_NI
+#define AES_NI_ATTRIB __attribute__((target("sse2,aes")))
+#endif
+#endif
+
+#ifdef USE_AES_NI
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#ifndef AES_NI_ATTRIB
+#define AES_NI_ATTRIB
+#endif
+
+#define AES_NUM_WAYS 8
+
+#define AES_LOAD_KEYS \
+  __m128i k[15]; \
+  unsigned numRounds = p->aes.numRounds2 * 2; \
+  unsigned r; \
+  for (r = 0; r <= numRounds; r++) \
+    k[r] = _mm_loadu_si128((const __m128i *)(p->aes.rkey + r * 4));
+
+AES_NI_ATTRIB
+static void MY_FAST_CALL AesCbc_Encode_Intel(CAesCbc *p, Byte *data, size_t numBlocks)
+{
+  __m128i m = _mm_loadu_si128((const __m128i *)p->prev);
+  AES_LOAD_KEYS
+  for (; numBlocks != 0; numBlocks--, data += AES_BLOCK_SIZE)
+  {
+    m = _mm_xor_si128(m, _mm_loadu_si128((const __m128i *)data));
+    m = _mm_xor_si128(m, k[0]);
+    for (r = 1; r < numRounds; r++)
+      m = _mm_aesenc_si128(m, k[r]);
+    m = _mm_aesenclast_si128(m, k[numRounds]);
+    _mm_storeu_si128((__m128i *)data, m);
+  }
+  _mm_storeu_si128((__m128i *)p->prev, m);
+}
+
+#define AES_OP_8(op) op(0) op(1) op(2) op(3) op(4) op(5) op(6) op(7)
+
+#define AES_DEC_LOAD(i) c ## i = _mm_loadu_si128((const __m128i *)(data + i * AES_BLOCK_SIZE)); \
+    m ## i = _mm_xor_si128(c ## i, key);
+#define AES_DEC_ROUND(i) m ## i = _mm_aesdec_si128(m ## i, key);
+#define AES_DEC_LAST(i) m ## i = _mm_aesdeclast_si128(m ## i, key);
+
+AES_NI_ATTRIB
+static void MY_FAST_CALL AesCbc_Decode_Intel(CAesCbc *p, Byte *data, size_t numBlocks)
+{
+  __m128i iv = _mm_loadu_si128((const __m128i *)p->prev);
+  AES_LOAD_KEYS
+  for (; numBlocks >= AES_NUM_WAYS; numBlocks -= AES_NUM_WAYS, data += AES_NUM_WAYS * AES_BLOCK_SIZE)
+  {
+    __m128i c0, c1, c2, c3, c4, c5, c6, c7;
+    __m128i m0, m1, m2, m3, m4, m5, m6, m7;
+    __m128i key = k[numRounds];
+    AES_OP_8(AES_DEC_LOAD)
+    for (r = numRounds - 1; r != 0; r--)
+    {
+      key = k[r];
+      AES_OP_8(AES_DEC_ROUND)
+    }
+    key = k[0];
+    AES_OP_8(AES_DEC_LAST)
+    _mm_storeu_si128((__m128i *)(data + 0 * AES_BLOCK_SIZE), _mm_xor_si128(m0, iv));
+    _mm_storeu_si128((__m128i *)(data + 1 * AES_BLOCK_SIZE), _mm_xor_si128(m1, c0));
+    _mm_storeu_si128((__m128i *)(data + 2 * AES_BLOCK_SIZE), _mm_xor_si128(m2, c1));
+    _mm_storeu_si128((__m128i *)(data + 3 * AES_BLOCK_SIZE), _mm_xor_si128(m3, c2));
+    _mm_storeu_si128((__m128i *)(data + 4 * AES_BLOCK_SIZE), _mm_xor_si128(m4, c3));
+    _mm_storeu_si128((__m128i *)(data + 5 * AES_BLOCK_SIZE), _mm_xor_si128(m5, c4));
+    _mm_storeu_si128((__m128i *)(data + 6 * AES_BLOCK_SIZE), _mm_xor_si128(m6, c5));
+    _mm_storeu_si128((__m128i *)(data + 7 * AES_BLOCK_SIZE), _mm_xor_si128(m7, c6));
+    iv = c7;
+  }
+  for (; numBlocks != 0; numBlocks--, data += AES_BLOCK_SIZE)
+  {
+    __m128i c = _mm_loadu_si128((const __m128i *)data);
+    __m128i m = _mm_xor_si128(c, k[numRounds]);
+    for (r = numRounds - 1; r != 0; r--)
+      m = _mm_aesdec_si128(m, k[r]);
+    m = _mm_aesdeclast_si128(m, k[0]);
+    _mm_storeu_si128((__m128i *)data, _mm_xor_si128(m, iv));
+    iv = c;
+  }
+  _mm_storeu_si128((__m128i *)p->prev, iv);
+}
+
+#endif
+
+static void AesCbc_SetFuncs(void)
+{
+  g_AesCbc_Encode = AesCbc_Encode_Table;
+  g_AesCbc_Decode = AesCbc_Decode_Table;
+  #ifdef USE_AES_NI
+  if (CPU_Is_Aes_Supported())
+  {
+    g_AesCbc_Encode = AesCbc_Encode_Intel;
+    g_AesCbc_Decode = AesCbc_Decode_Intel;
+  }
+  #endif
+}
+
+SizeT AesCbc_Encode(CAesCbc *p, Byte *data, SizeT size)
+{
+  if (size == 0)
+    return 0;
+  if (size < AES_BLOCK_SIZE)
+    return AES_BLOCK_SIZE;
+  size >>= 4;
+  g_AesCbc_Encode(p, data, size);
+  return size << 4;
+}
+
+SizeT AesCbc_Decode(CAesCbc *p, Byte *data, SizeT size)
+{
+  if (size == 0)
+    return 0;
+  if (size < AES_BLOCK_SIZE)
+    return AES_BLOCK_SIZE;
+  size >>= 4;
+  g_AesCbc_Decode(p, data, size);
+  return size << 4;
 }
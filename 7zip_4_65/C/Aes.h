@@ -16,7 +16,8 @@ typedef struct
   UInt32 rkey[(14 + 1) * 4];
 } CAes;
 
-/* Call AesGenTables one time before other AES functions */
+/* Call AesGenTables one time before other AES functions.
+   It also selects AES-NI code for AesCbc_* functions, if CPU supports it. */
 void AesGenTables(void);
 
 /* keySize = 16 or 24 or 32 (bytes) */
@@ -5,10 +5,22 @@ Public domain */
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #endif
 #include <stdlib.h>
 
 #include "Alloc.h"
+#ifndef _WIN32
+#include "Threads.h"
+#endif
 
 /* #define _SZ_ALLOC_DEBUG */
 
@@ -67,6 +79,8 @@ void MidFree(void *address)
   VirtualFree(address, 0, MEM_RELEASE);
 }
 
+void BigAllocTrim() {}
+
 #ifndef MEM_LARGE_PAGES
 #undef _7ZIP_LARGE_PAGES
 #endif
@@ -124,4 +138,382 @@ void BigFree(void *address)
   VirtualFree(address, 0, MEM_RELEASE);
 }
 
+#else
+
+/*
+POSIX version of BigAlloc:
+  - big blocks are allocated with mmap(). If SetLargePageSize() was called,
+    it tries MAP_HUGETLB pages first. Otherwise it asks kernel for
+    transparent huge pages with madvise(MADV_HUGEPAGE).
+  - BigFree() keeps some freed blocks in small cache, so next encoder
+    (for example, for next folder in 7z update) gets already mapped pages.
+    Each cached block remembers NUMA node of thread that used it.
+    Pages are placed to node of first-touching thread, so we prefer
+    cached blocks from current node.
+  - sizes of mapped blocks are stored in hash table keyed by address, and not
+    in header before block. So power-of-two sizes (dictionary and hash tables)
+    don't need additional page, and MAP_HUGETLB block doesn't need additional huge page.
+    Block that is not in that table was allocated with malloc().
+*/
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define BIG_MMAP_SIZE_MIN ((size_t)1 << 18)
+#define BIG_HUGE_SIZE_MIN ((size_t)1 << 21)
+
+typedef struct
+{
+  void *address; /* 0 : empty slot */
+  size_t mapSize;
+  unsigned hugeTlb;
+} CBigBlock;
+
+static size_t g_LargePageSize = 0;
+
+void SetLargePageSize()
+{
+  #ifdef MAP_HUGETLB
+  FILE *f = fopen("/proc/meminfo", "r");
+  char line[256];
+  if (f == 0)
+    return;
+  while (fgets(line, sizeof(line), f))
+  {
+    unsigned long kb;
+    if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+    {
+      size_t size = (size_t)kb << 10;
+      if (size != 0 && (size & (size - 1)) == 0 && size <= ((size_t)1 << 30))
+        g_LargePageSize = size;
+      break;
+    }
+  }
+  fclose(f);
+  #endif
+}
+
+static unsigned GetNumaNode()
+{
+  #if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, (void *)0) == 0)
+    return node;
+  #endif
+  return 0;
+}
+
+#define BIG_CACHE_NUM_BLOCKS 8
+#define BIG_CACHE_SIZE_MIN ((size_t)1 << 20)
+#define BIG_CACHE_SIZE_MAX ((size_t)1 << (sizeof(size_t) > 4 ? 30 : 28))
+
+/* cached block that was not reused for BIG_CACHE_IDLE_SECONDS is unmapped
+   at next BigAlloc() / BigFree() call or at BigAllocTrim() call */
+#define BIG_CACHE_IDLE_SECONDS 4
+
+typedef struct
+{
+  void *address;
+  size_t mapSize;
+  unsigned node;
+  time_t time;
+} CBigCacheItem;
+
+static CBigCacheItem g_BigCache[BIG_CACHE_NUM_BLOCKS];
+static size_t g_BigCacheTotal = 0;
+
+/* g_BigCacheCs protects g_BigCache and g_BigBlocks */
+static CCriticalSection g_BigCacheCs = PTHREAD_MUTEX_INITIALIZER;
+
+/* g_BigBlocks is hash table (with linear probing) of mapped blocks in use */
+static CBigBlock *g_BigBlocks = 0;
+static size_t g_BigBlocksSize = 0; /* it's 0 or power of 2 */
+static size_t g_BigBlocksNum = 0;
+
+static size_t BigBlocks_GetSlot(const void *address)
+{
+  /* mapped blocks are aligned for page size */
+  UInt32 v = (UInt32)((size_t)address >> 12);
+  return (size_t)(v * (UInt32)0x9E3779B1) & (g_BigBlocksSize - 1);
+}
+
+/* it must be called inside g_BigCacheCs */
+static void BigBlocks_Insert(const CBigBlock *block)
+{
+  size_t i = BigBlocks_GetSlot(block->address);
+  while (g_BigBlocks[i].address != 0)
+    i = (i + 1) & (g_BigBlocksSize - 1);
+  g_BigBlocks[i] = *block;
+  g_BigBlocksNum++;
+}
+
+/* it must be called inside g_BigCacheCs. It returns 0, if there is no memory for table */
+static int BigBlocks_Add(const CBigBlock *block)
+{
+  if ((g_BigBlocksNum + 1) * 2 > g_BigBlocksSize)
+  {
+    CBigBlock *old = g_BigBlocks;
+    size_t oldSize = g_BigBlocksSize;
+    size_t newSize = (oldSize == 0) ? 64 : oldSize * 2;
+    size_t i;
+    CBigBlock *blocks = (CBigBlock *)malloc(newSize * sizeof(CBigBlock));
+    if (blocks == 0)
+      return 0;
+    memset(blocks, 0, newSize * sizeof(CBigBlock));
+    g_BigBlocks = blocks;
+    g_BigBlocksSize = newSize;
+    g_BigBlocksNum = 0;
+    for (i = 0; i < oldSize; i++)
+      if (old[i].address != 0)
+        BigBlocks_Insert(&old[i]);
+    free(old);
+  }
+  BigBlocks_Insert(block);
+  return 1;
+}
+
+/* it must be called inside g_BigCacheCs. It returns 0, if (address) is not mapped block */
+static int BigBlocks_Remove(void *address, CBigBlock *block)
+{
+  size_t mask = g_BigBlocksSize - 1;
+  size_t i, j;
+  if (g_BigBlocksNum == 0)
+    return 0;
+  for (i = BigBlocks_GetSlot(address);; i = (i + 1) & mask)
+  {
+    if (g_BigBlocks[i].address == 0)
+      return 0;
+    if (g_BigBlocks[i].address == address)
+      break;
+  }
+  *block = g_BigBlocks[i];
+  g_BigBlocksNum--;
+  /* we move next blocks of same chain back to free slot */
+  for (j = i;;)
+  {
+    size_t k;
+    j = (j + 1) & mask;
+    if (g_BigBlocks[j].address == 0)
+      break;
+    k = BigBlocks_GetSlot(g_BigBlocks[j].address);
+    if (((j - k) & mask) >= ((j - i) & mask))
+    {
+      g_BigBlocks[i] = g_BigBlocks[j];
+      i = j;
+    }
+  }
+  g_BigBlocks[i].address = 0;
+  return 1;
+}
+
+static time_t BigCache_GetTime()
+{
+  #ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec;
+  #endif
+  return time(0);
+}
+
+/* it must be called inside g_BigCacheCs. It moves idle blocks (or all blocks, if (all != 0))
+   from cache to (blocks) array. It returns number of such blocks. */
+
+static unsigned BigCache_Remove(CBigCacheItem *blocks, time_t now, int all)
+{
+  unsigned i, num = 0;
+  for (i = 0; i < BIG_CACHE_NUM_BLOCKS; i++)
+  {
+    CBigCacheItem *item = &g_BigCache[i];
+    if (item->address == 0)
+      continue;
+    if (!all && now - item->time < BIG_CACHE_IDLE_SECONDS && now >= item->time)
+      continue;
+    blocks[num++] = *item;
+    g_BigCacheTotal -= item->mapSize;
+    item->address = 0;
+  }
+  return num;
+}
+
+static void BigCache_Unmap(const CBigCacheItem *blocks, unsigned num)
+{
+  unsigned i;
+  for (i = 0; i < num; i++)
+    munmap(blocks[i].address, blocks[i].mapSize);
+}
+
+static void *BigCache_Get(size_t mapSize, size_t *resMapSize)
+{
+  CBigCacheItem old[BIG_CACHE_NUM_BLOCKS];
+  unsigned numOld;
+  unsigned node = GetNumaNode();
+  void *res = 0;
+  int i, best = -1;
+  CriticalSection_Enter(&g_BigCacheCs);
+  for (i = 0; i < BIG_CACHE_NUM_BLOCKS; i++)
+  {
+    const CBigCacheItem *item = &g_BigCache[i];
+    /* we don't want to waste more than 1/4 of block */
+    if (item->address == 0 || item->mapSize < mapSize || item->mapSize - mapSize > (item->mapSize >> 2))
+      continue;
+    if (best < 0
+        || (item->node == node && g_BigCache[best].node != node)
+        || ((item->node == node) == (g_BigCache[best].node == node) && item->mapSize < g_BigCache[best].mapSize))
+      best = i;
+  }
+  if (best >= 0)
+  {
+    res = g_BigCache[best].address;
+    *resMapSize = g_BigCache[best].mapSize;
+    g_BigCacheTotal -= g_BigCache[best].mapSize;
+    g_BigCache[best].address = 0;
+  }
+  numOld = (g_BigCacheTotal == 0) ? 0 : BigCache_Remove(old, BigCache_GetTime(), 0);
+  CriticalSection_Leave(&g_BigCacheCs);
+  BigCache_Unmap(old, numOld);
+  return res;
+}
+
+static int BigCache_Put(void *address, size_t mapSize)
+{
+  CBigCacheItem old[BIG_CACHE_NUM_BLOCKS];
+  unsigned numOld;
+  time_t now;
+  int i, res = 0;
+  if (mapSize < BIG_CACHE_SIZE_MIN || mapSize > BIG_CACHE_SIZE_MAX)
+    return 0;
+  now = BigCache_GetTime();
+  CriticalSection_Enter(&g_BigCacheCs);
+  numOld = BigCache_Remove(old, now, 0);
+  /* if cache is over limit, we release the oldest blocks to keep recent block */
+  while (g_BigCacheTotal + mapSize > BIG_CACHE_SIZE_MAX)
+  {
+    int oldest = -1;
+    for (i = 0; i < BIG_CACHE_NUM_BLOCKS; i++)
+      if (g_BigCache[i].address != 0 && (oldest < 0 || g_BigCache[i].time < g_BigCache[oldest].time))
+        oldest = i;
+    old[numOld++] = g_BigCache[oldest];
+    g_BigCacheTotal -= g_BigCache[oldest].mapSize;
+    g_BigCache[oldest].address = 0;
+  }
+  for (i = 0; i < BIG_CACHE_NUM_BLOCKS; i++)
+    if (g_BigCache[i].address == 0)
+    {
+      g_BigCache[i].address = address;
+      g_BigCache[i].mapSize = mapSize;
+      g_BigCache[i].node = GetNumaNode();
+      g_BigCache[i].time = now;
+      g_BigCacheTotal += mapSize;
+      res = 1;
+      break;
+    }
+  CriticalSection_Leave(&g_BigCacheCs);
+  BigCache_Unmap(old, numOld);
+  return res;
+}
+
+void BigAllocTrim()
+{
+  CBigCacheItem old[BIG_CACHE_NUM_BLOCKS];
+  unsigned numOld;
+  CriticalSection_Enter(&g_BigCacheCs);
+  numOld = BigCache_Remove(old, 0, 1);
+  CriticalSection_Leave(&g_BigCacheCs);
+  BigCache_Unmap(old, numOld);
+}
+
+static void *BigMap(size_t size, CBigBlock *block)
+{
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  size_t mapSize;
+  void *res;
+  if (pageSize == 0 || (pageSize & (pageSize - 1)) != 0)
+    pageSize = (size_t)1 << 12;
+  mapSize = (size + pageSize - 1) & ~(pageSize - 1);
+  if (mapSize < size)
+    return 0;
+  block->hugeTlb = 0;
+
+  #ifdef MAP_HUGETLB
+  if (g_LargePageSize != 0 && size >= BIG_HUGE_SIZE_MIN)
+  {
+    size_t hugeSize = (size + g_LargePageSize - 1) & ~(g_LargePageSize - 1);
+    if (hugeSize >= size)
+    {
+      res = mmap(0, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (res != MAP_FAILED)
+      {
+        block->mapSize = hugeSize;
+        block->hugeTlb = 1;
+        return res;
+      }
+    }
+  }
+  #endif
+
+  res = BigCache_Get(mapSize, &block->mapSize);
+  if (res != 0)
+    return res;
+  
+  res = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (res == MAP_FAILED)
+    return 0;
+  #ifdef MADV_HUGEPAGE
+  if (size >= BIG_HUGE_SIZE_MIN)
+    madvise(res, mapSize, MADV_HUGEPAGE);
+  #endif
+  block->mapSize = mapSize;
+  return res;
+}
+
+void *BigAlloc(size_t size)
+{
+  if (size == 0)
+    return 0;
+  #ifdef _SZ_ALLOC_DEBUG
+  fprintf(stderr, "\nAlloc_Big %10d bytes;  count = %10d", size, g_allocCountBig++);
+  #endif
+  if (size >= BIG_MMAP_SIZE_MIN)
+  {
+    CBigBlock block;
+    block.address = BigMap(size, &block);
+    if (block.address != 0)
+    {
+      int added;
+      CriticalSection_Enter(&g_BigCacheCs);
+      added = BigBlocks_Add(&block);
+      CriticalSection_Leave(&g_BigCacheCs);
+      if (added)
+        return block.address;
+      munmap(block.address, block.mapSize);
+    }
+  }
+  return malloc(size);
+}
+
+void BigFree(void *address)
+{
+  CBigBlock block;
+  int mapped;
+  #ifdef _SZ_ALLOC_DEBUG
+  if (address != 0)
+    fprintf(stderr, "\nFree_Big; count = %10d", --g_allocCountBig);
+  #endif
+  if (address == 0)
+    return;
+  CriticalSection_Enter(&g_BigCacheCs);
+  mapped = BigBlocks_Remove(address, &block);
+  CriticalSection_Leave(&g_BigCacheCs);
+  if (!mapped)
+  {
+    free(address);
+    return;
+  }
+  if (!block.hugeTlb && BigCache_Put(address, block.mapSize))
+    return;
+  munmap(address, block.mapSize);
+}
+
 #endif
@@ -11,21 +11,29 @@ Public domain */
 void *MyAlloc(size_t size);
 void MyFree(void *address);
 
-#ifdef _WIN32
+/* SetLargePageSize() enables large pages for BigAlloc():
+     Windows: MEM_LARGE_PAGES (it requires SeLockMemoryPrivilege)
+     Linux:   MAP_HUGETLB (it requires reserved pages in /proc/sys/vm/nr_hugepages) */
 
 void SetLargePageSize();
 
-void *MidAlloc(size_t size);
-void MidFree(void *address);
 void *BigAlloc(size_t size);
 void BigFree(void *address);
 
+/* BigAllocTrim() releases blocks that BigFree() keeps in cache (POSIX only).
+   Idle blocks are also released by next BigAlloc() / BigFree() call. */
+
+void BigAllocTrim();
+
+#ifdef _WIN32
+
+void *MidAlloc(size_t size);
+void MidFree(void *address);
+
 #else
 
 #define MidAlloc(size) MyAlloc(size)
 #define MidFree(address) MyFree(address)
-#define BigAlloc(size) MyAlloc(size)
-#define BigFree(address) MyFree(address)
 
 #endif
 
@@ -13,6 +13,16 @@
 #define k_BCJ 0x03030103
 #define k_BCJ2 0x0303011B
 
+#define IsJcc(b0, b1) ((b0) == 0x0F && ((b1) & 0xF0) == 0x80)
+#define IsJ(b0, b1) ((b1 & 0xFE) == 0xE8 || IsJcc(b0, b1))
+
+#define kNumTopBits 24
+#define kTopValue ((UInt32)1 << kNumTopBits)
+
+#define kNumBitModelTotalBits 11
+#define kBitModelTotal (1 << kNumBitModelTotalBits)
+#define kNumMoveBits 5
+
 static SRes SzDecodeLzma(CSzCoderInfo *coder, UInt64 inSize, ILookInStream *inStream,
     Byte *outBuffer, SizeT outSize, ISzAlloc *allocMain)
 {
@@ -252,3 +262,384 @@ SRes SzDecode(const UInt64 *packSizes, const CSzFolder *folder,
     IAlloc_Free(allocMain, tempBuf[i]);
   return res;
 }
+
+/* ---------- Streaming Interface ---------- */
+
+static void SzCoderDec_Construct(CSzCoderDec *p)
+{
+  LzmaDec_Construct(&p->lzma);
+  p->isLzma = 0;
+  p->buf = 0;
+  p->bufPos = 0;
+  p->bufLim = 0;
+}
+
+static void SzCoderDec_Free(CSzCoderDec *p, ISzAlloc *alloc)
+{
+  if (p->isLzma)
+  {
+    LzmaDec_FreeProbs(&p->lzma, alloc);
+    IAlloc_Free(alloc, p->lzma.dic);
+    p->lzma.dic = 0;
+  }
+  IAlloc_Free(alloc, p->buf);
+  SzCoderDec_Construct(p);
+}
+
+static SRes SzCoderDec_Init(CSzCoderDec *p, const CSzCoderInfo *coder,
+    UInt64 packPos, UInt64 packSize, UInt64 unpackSize, int useBuf, ISzAlloc *alloc)
+{
+  p->packPos = packPos;
+  p->packRem = packSize;
+  p->unpackRem = unpackSize;
+  if (coder != 0 && coder->MethodID == k_LZMA)
+  {
+    CLzmaProps props;
+    UInt32 dicBufSize;
+    p->isLzma = 1;
+    RINOK(LzmaProps_Decode(&props, coder->Props.data, (unsigned)coder->Props.size));
+    RINOK(LzmaDec_AllocateProbs(&p->lzma, coder->Props.data, (unsigned)coder->Props.size, alloc));
+    /* the window doesn't need to be larger than unpacked data */
+    dicBufSize = props.dicSize;
+    if (dicBufSize < ((UInt32)1 << 12))
+      dicBufSize = ((UInt32)1 << 12);
+    if (unpackSize < dicBufSize)
+      dicBufSize = (unpackSize == 0 ? 1 : (UInt32)unpackSize);
+    p->lzma.dic = (Byte *)IAlloc_Alloc(alloc, dicBufSize);
+    if (p->lzma.dic == 0)
+      return SZ_ERROR_MEM;
+    p->lzma.dicBufSize = dicBufSize;
+    LzmaDec_Init(&p->lzma);
+  }
+  else if (coder != 0 && packSize != unpackSize)
+    return SZ_ERROR_DATA;
+  if (useBuf)
+  {
+    p->buf = (Byte *)IAlloc_Alloc(alloc, SZ_FOLDER_DEC_BUF_SIZE);
+    if (p->buf == 0)
+      return SZ_ERROR_MEM;
+  }
+  return SZ_OK;
+}
+
+static SRes SzCoderDec_Look(CSzCoderDec *p, const void **buf, size_t *size)
+{
+  if (*size > p->packRem)
+    *size = (size_t)p->packRem;
+  if (*size == 0)
+    return SZ_OK;
+  if (*p->inPos != p->packPos)
+  {
+    RINOK(LookInStream_SeekTo(p->inStream, p->packPos));
+    *p->inPos = p->packPos;
+  }
+  return p->inStream->Look((void *)p->inStream, (void **)buf, size);
+}
+
+static SRes SzCoderDec_Skip(CSzCoderDec *p, size_t size)
+{
+  p->packPos += size;
+  p->packRem -= size;
+  *p->inPos += size;
+  return p->inStream->Skip((void *)p->inStream, size);
+}
+
+static SRes SzCoderDec_Read(CSzCoderDec *p, Byte *data, size_t *size)
+{
+  size_t rem = *size;
+  *size = 0;
+  if (rem > p->unpackRem)
+    rem = (size_t)p->unpackRem;
+  while (rem != 0)
+  {
+    const void *inBuf = 0;
+    size_t inSize = (1 << 18);
+    RINOK(SzCoderDec_Look(p, &inBuf, &inSize));
+    if (!p->isLzma)
+    {
+      if (inSize == 0)
+        return SZ_ERROR_INPUT_EOF;
+      if (inSize > rem)
+        inSize = rem;
+      memcpy(data, inBuf, inSize);
+      RINOK(SzCoderDec_Skip(p, inSize));
+      data += inSize;
+      rem -= inSize;
+      *size += inSize;
+      p->unpackRem -= inSize;
+    }
+    else
+    {
+      SizeT inProcessed = inSize, outProcessed = rem;
+      ELzmaStatus status;
+      int isLast = (rem == p->unpackRem);
+      RINOK(LzmaDec_DecodeToBuf(&p->lzma, data, &outProcessed, (const Byte *)inBuf, &inProcessed,
+          isLast ? LZMA_FINISH_END : LZMA_FINISH_ANY, &status));
+      RINOK(SzCoderDec_Skip(p, inProcessed));
+      data += outProcessed;
+      rem -= outProcessed;
+      *size += outProcessed;
+      p->unpackRem -= outProcessed;
+      if (p->unpackRem == 0)
+      {
+        if (inProcessed != inSize ||
+            (status != LZMA_STATUS_FINISHED_WITH_MARK &&
+             status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK))
+          return SZ_ERROR_DATA;
+        break;
+      }
+      if (inProcessed == 0 && outProcessed == 0)
+        return SZ_ERROR_DATA;
+    }
+  }
+  return SZ_OK;
+}
+
+/* it reads new data to buffer after unread bytes. It returns 0 in bufLim - bufPos, if there is no data */
+static SRes SzCoderDec_FillBuf(CSzCoderDec *p)
+{
+  size_t size;
+  size_t rem = p->bufLim - p->bufPos;
+  memmove(p->buf, p->buf + p->bufPos, rem);
+  p->bufPos = 0;
+  p->bufLim = rem;
+  size = SZ_FOLDER_DEC_BUF_SIZE - rem;
+  RINOK(SzCoderDec_Read(p, p->buf + rem, &size));
+  p->bufLim += size;
+  return SZ_OK;
+}
+
+void SzFolderDec_Construct(CSzFolderDec *p)
+{
+  unsigned i;
+  for (i = 0; i < 4; i++)
+    SzCoderDec_Construct(&p->coders[i]);
+  p->numCoders = 0;
+}
+
+void SzFolderDec_Free(CSzFolderDec *p, ISzAlloc *allocMain)
+{
+  unsigned i;
+  for (i = 0; i < 4; i++)
+    SzCoderDec_Free(&p->coders[i], allocMain);
+  p->numCoders = 0;
+}
+
+SRes SzFolderDec_Init(CSzFolderDec *p, const UInt64 *packSizes, const CSzFolder *folder,
+    ILookInStream *inStream, UInt64 startPos, ISzAlloc *allocMain)
+{
+  unsigned i;
+  SzFolderDec_Free(p, allocMain);
+  RINOK(CheckSupportedFolder(folder));
+  p->inPos = (UInt64)(Int64)-1;
+  p->unpackRem = SzFolder_GetUnpackSize((CSzFolder *)folder);
+  p->ip = 0;
+  for (i = 0; i < 4; i++)
+  {
+    p->coders[i].inStream = inStream;
+    p->coders[i].inPos = &p->inPos;
+  }
+  if (folder->NumCoders == 4)
+  {
+    /* coders[0] - main stream, coders[1] - call stream, coders[2] - jump stream,
+       coders[3] - range coder stream. See SzDecode2() for indexes of streams. */
+    static const unsigned coderIndex[3] = { 2, 1, 0 };
+    static const unsigned packIndex[4] = { 0, 2, 3, 1 };
+    p->filter = 2;
+    p->numCoders = 4;
+    for (i = 0; i < 4; i++)
+    {
+      UInt32 si = packIndex[i];
+      const CSzCoderInfo *coder = (i < 3 ? &folder->Coders[coderIndex[i]] : 0);
+      UInt64 unpackSize = (i < 3 ? folder->UnpackSizes[coderIndex[i]] : packSizes[si]);
+      RINOK(SzCoderDec_Init(&p->coders[i], coder, startPos + GetSum(packSizes, si),
+          packSizes[si], unpackSize, 1, allocMain));
+    }
+    {
+      CSzCoderDec *rc = &p->coders[3];
+      RINOK(SzCoderDec_FillBuf(rc));
+      if (rc->bufLim < 5)
+        return SZ_ERROR_DATA;
+      p->code = 0;
+      p->range = 0xFFFFFFFF;
+      for (i = 0; i < 5; i++)
+        p->code = (p->code << 8) | rc->buf[rc->bufPos++];
+    }
+    for (i = 0; i < sizeof(p->probs) / sizeof(p->probs[0]); i++)
+      p->probs[i] = kBitModelTotal >> 1;
+    p->prevByte = 0;
+    p->numDestBytes = 0;
+    return SZ_OK;
+  }
+  p->filter = (folder->NumCoders == 2 ? 1 : 0);
+  p->numCoders = 1;
+  x86_Convert_Init(p->x86State);
+  p->bufConv = 0;
+  return SzCoderDec_Init(&p->coders[0], &folder->Coders[0], startPos,
+      packSizes[0], folder->UnpackSizes[0], p->filter != 0, allocMain);
+}
+
+static SRes SzFolderDec_ReadBcj(CSzFolderDec *p, Byte *data, size_t *size)
+{
+  CSzCoderDec *c = &p->coders[0];
+  size_t rem = *size;
+  *size = 0;
+  while (rem != 0)
+  {
+    size_t cur = p->bufConv - c->bufPos;
+    if (cur != 0)
+    {
+      if (cur > rem)
+        cur = rem;
+      memcpy(data, c->buf + c->bufPos, cur);
+      c->bufPos += cur;
+      data += cur;
+      rem -= cur;
+      *size += cur;
+      continue;
+    }
+    {
+      size_t prevLim = c->bufLim - c->bufPos;
+      RINOK(SzCoderDec_FillBuf(c));
+      if (c->bufLim == 0)
+        break;
+      if (c->bufLim == prevLim)
+      {
+        /* end of stream: last bytes are not converted by BCJ */
+        p->bufConv = c->bufLim;
+        continue;
+      }
+      p->bufConv = x86_Convert(c->buf, c->bufLim, p->ip, &p->x86State, 0);
+      p->ip += (UInt32)p->bufConv;
+    }
+  }
+  return SZ_OK;
+}
+
+#define BCJ2_READ_BYTE(c, b) \
+  if (c->bufPos == c->bufLim) { RINOK(SzCoderDec_FillBuf(c)); \
+    if (c->bufPos == c->bufLim) return SZ_ERROR_DATA; } \
+  b = c->buf[c->bufPos++];
+
+static SRes SzFolderDec_ReadBcj2(CSzFolderDec *p, Byte *data, size_t *size)
+{
+  CSzCoderDec *mainStream = &p->coders[0];
+  CSzCoderDec *rc = &p->coders[3];
+  size_t rem = *size;
+  *size = 0;
+  if (rem > p->unpackRem)
+    rem = (size_t)p->unpackRem;
+  
+  while (rem != 0)
+  {
+    Byte b;
+    UInt16 *prob;
+    UInt32 bound;
+    
+    if (p->numDestBytes != 0)
+    {
+      *data++ = p->destBytes[4 - p->numDestBytes--];
+      p->ip++;
+      p->unpackRem--;
+      (*size)++;
+      rem--;
+      continue;
+    }
+
+    {
+      const Byte *src;
+      size_t lim, i;
+      int isJump = 0;
+      Byte prevByte = p->prevByte;
+      if (mainStream->bufPos == mainStream->bufLim)
+      {
+        RINOK(SzCoderDec_FillBuf(mainStream));
+        if (mainStream->bufPos == mainStream->bufLim)
+          return SZ_ERROR_DATA;
+      }
+      src = mainStream->buf + mainStream->bufPos;
+      lim = mainStream->bufLim - mainStream->bufPos;
+      if (lim > rem)
+        lim = rem;
+      for (i = 0; i < lim; i++)
+      {
+        b = src[i];
+        data[i] = b;
+        if (IsJ(prevByte, b))
+        {
+          isJump = 1;
+          i++;
+          break;
+        }
+        prevByte = b;
+      }
+      p->prevByte = prevByte;
+      mainStream->bufPos += i;
+      data += i;
+      rem -= i;
+      *size += i;
+      p->ip += (UInt32)i;
+      p->unpackRem -= i;
+      if (!isJump)
+        continue;
+      /* BCJ2 doesn't encode jump, if it's last byte of output */
+      if (p->unpackRem == 0)
+        break;
+    }
+
+    b = data[-1];
+    if (b == 0xE8)
+      prob = p->probs + p->prevByte;
+    else if (b == 0xE9)
+      prob = p->probs + 256;
+    else
+      prob = p->probs + 257;
+    
+    bound = (p->range >> kNumBitModelTotalBits) * *prob;
+    if (p->code < bound)
+    {
+      p->range = bound;
+      *prob = (UInt16)(*prob + ((kBitModelTotal - *prob) >> kNumMoveBits));
+      p->prevByte = b;
+    }
+    else
+    {
+      UInt32 dest;
+      unsigned i;
+      CSzCoderDec *c = (b == 0xE8 ? &p->coders[1] : &p->coders[2]);
+      p->range -= bound;
+      p->code -= bound;
+      *prob = (UInt16)(*prob - (*prob >> kNumMoveBits));
+      dest = 0;
+      for (i = 0; i < 4; i++)
+      {
+        Byte v;
+        BCJ2_READ_BYTE(c, v);
+        dest = (dest << 8) | v;
+      }
+      dest -= p->ip + 4;
+      p->destBytes[0] = (Byte)dest;
+      p->destBytes[1] = (Byte)(dest >> 8);
+      p->destBytes[2] = (Byte)(dest >> 16);
+      p->destBytes[3] = p->prevByte = (Byte)(dest >> 24);
+      p->numDestBytes = 4;
+    }
+    if (p->range < kTopValue)
+    {
+      Byte v;
+      BCJ2_READ_BYTE(rc, v);
+      p->range <<= 8;
+      p->code = (p->code << 8) | v;
+    }
+  }
+  return SZ_OK;
+}
+
+SRes SzFolderDec_Read(CSzFolderDec *p, Byte *data, size_t *size)
+{
+  if (p->filter == 2)
+    return SzFolderDec_ReadBcj2(p, data, size);
+  if (p->filter == 1)
+    return SzFolderDec_ReadBcj(p, data, size);
+  return SzCoderDec_Read(&p->coders[0], data, size);
+}
@@ -4,10 +4,79 @@
 #ifndef __7Z_DECODE_H
 #define __7Z_DECODE_H
 
+#include "../../LzmaDec.h"
+
 #include "7zItem.h"
 
 SRes SzDecode(const UInt64 *packSizes, const CSzFolder *folder,
     ILookInStream *stream, UInt64 startPos,
     Byte *outBuffer, size_t outSize, ISzAlloc *allocMain);
 
+/* ---------- Streaming Interface ---------- */
+
+/*
+CSzFolderDec decodes folder sequentially with bounded memory:
+  LZMA coder uses window of dictionary size (but not larger than unpack size of coder),
+  BCJ and BCJ2 filters use buffers of SZ_FOLDER_DEC_BUF_SIZE bytes.
+It reads packed streams with LookInStream_SeekTo() / Look() / Skip(),
+so nobody else can use inStream between SzFolderDec_Init() and last SzFolderDec_Read().
+
+Returns:
+  SZ_OK
+  SZ_ERROR_DATA - Data error
+  SZ_ERROR_MEM  - Memory allocation error
+  SZ_ERROR_UNSUPPORTED - Unsupported method or folder structure
+  SZ_ERROR_INPUT_EOF - It needs more bytes in input stream
+*/
+
+#define SZ_FOLDER_DEC_BUF_SIZE (1 << 16)
+
+typedef struct
+{
+  ILookInStream *inStream;
+  UInt64 *inPos;      /* current position of inStream shared by all coders of folder */
+  UInt64 packPos;
+  UInt64 packRem;
+  UInt64 unpackRem;
+  int isLzma;
+  CLzmaDec lzma;
+
+  /* buffer of unpacked data for filter */
+  Byte *buf;
+  size_t bufPos;
+  size_t bufLim;
+} CSzCoderDec;
+
+typedef struct
+{
+  CSzCoderDec coders[4];
+  unsigned numCoders;
+  unsigned filter;    /* 0 - no filter, 1 - BCJ, 2 - BCJ2 */
+  UInt64 inPos;
+  UInt64 unpackRem;
+  UInt32 ip;
+
+  /* BCJ */
+  UInt32 x86State;
+  size_t bufConv;     /* coders[0].buf[bufPos, bufConv) contains converted data */
+
+  /* BCJ2 */
+  UInt32 range;
+  UInt32 code;
+  Byte prevByte;
+  unsigned numDestBytes;
+  Byte destBytes[4];
+  UInt16 probs[2 + 256];
+} CSzFolderDec;
+
+void SzFolderDec_Construct(CSzFolderDec *p);
+SRes SzFolderDec_Init(CSzFolderDec *p, const UInt64 *packSizes, const CSzFolder *folder,
+    ILookInStream *inStream, UInt64 startPos, ISzAlloc *allocMain);
+
+/* SzFolderDec_Read reads up to (*size) bytes of unpacked data.
+   (*size) < (input *size) only at the end of folder */
+SRes SzFolderDec_Read(CSzFolderDec *p, Byte *data, size_t *size);
+
+void SzFolderDec_Free(CSzFolderDec *p, ISzAlloc *allocMain);
+
 #endif
@@ -91,3 +91,153 @@ SRes SzAr_Extract(
   }
   return res;
 }
+
+void SzFolderIter_Construct(CSzFolderIter *p)
+{
+  SzFolderDec_Construct(&p->dec);
+  p->db = 0;
+  p->fileIndex = (UInt32)-1;
+  p->numFilesRem = 0;
+  p->fileRem = 0;
+}
+
+void SzFolderIter_Free(CSzFolderIter *p, ISzAlloc *allocMain)
+{
+  SzFolderDec_Free(&p->dec, allocMain);
+  p->fileIndex = (UInt32)-1;
+  p->numFilesRem = 0;
+  p->fileRem = 0;
+}
+
+SRes SzFolderIter_Open(CSzFolderIter *p, const CSzArEx *db, ILookInStream *inStream,
+    UInt32 folderIndex, ISzAlloc *allocMain)
+{
+  const CSzFolder *folder = db->db.Folders + folderIndex;
+  SzFolderIter_Free(p, allocMain);
+  p->db = db;
+  p->folderIndex = folderIndex;
+  p->nextFileIndex = db->FolderStartFileIndex[folderIndex];
+  p->numFilesRem = folder->NumUnpackStreams;
+  p->folderCrc = CRC_INIT_VAL;
+  return SzFolderDec_Init(&p->dec, db->db.PackSizes + db->FolderStartPackStreamIndex[folderIndex],
+      folder, inStream, SzArEx_GetFolderStreamPos(db, folderIndex, 0), allocMain);
+}
+
+static SRes SzFolderIter_ReadFolder(CSzFolderIter *p, Byte *data, size_t *size)
+{
+  size_t rem = *size;
+  RINOK(SzFolderDec_Read(&p->dec, data, size));
+  if (*size != rem)
+    return SZ_ERROR_DATA;
+  p->folderCrc = CrcUpdate(p->folderCrc, data, *size);
+  return SZ_OK;
+}
+
+SRes SzFolderIter_Read(CSzFolderIter *p, void *data, size_t *size)
+{
+  const CSzFileItem *file;
+  if (*size > p->fileRem)
+    *size = (size_t)p->fileRem;
+  if (*size == 0)
+    return SZ_OK;
+  RINOK(SzFolderIter_ReadFolder(p, (Byte *)data, size));
+  p->fileCrc = CrcUpdate(p->fileCrc, data, *size);
+  p->fileRem -= *size;
+  file = p->db->db.Files + p->fileIndex;
+  if (p->fileRem == 0 && file->FileCRCDefined && CRC_GET_DIGEST(p->fileCrc) != file->FileCRC)
+    return SZ_ERROR_CRC;
+  return SZ_OK;
+}
+
+SRes SzFolderIter_Next(CSzFolderIter *p, UInt32 *fileIndex)
+{
+  const CSzArEx *db = p->db;
+  *fileIndex = (UInt32)-1;
+  while (p->fileRem != 0)
+  {
+    Byte buf[1 << 10];
+    size_t size = sizeof(buf);
+    if (size > p->fileRem)
+      size = (size_t)p->fileRem;
+    RINOK(SzFolderIter_ReadFolder(p, buf, &size));
+    p->fileRem -= size;
+  }
+  if (p->numFilesRem == 0)
+  {
+    const CSzFolder *folder = db->db.Folders + p->folderIndex;
+    p->fileIndex = (UInt32)-1;
+    if (!folder->UnpackCRCDefined)
+      return SZ_OK;
+    /* CRC of folder covers data after last file also */
+    for (;;)
+    {
+      Byte buf[1 << 10];
+      size_t size = sizeof(buf);
+      RINOK(SzFolderDec_Read(&p->dec, buf, &size));
+      if (size == 0)
+        break;
+      p->folderCrc = CrcUpdate(p->folderCrc, buf, size);
+    }
+    if (CRC_GET_DIGEST(p->folderCrc) != folder->UnpackCRC)
+      return SZ_ERROR_CRC;
+    return SZ_OK;
+  }
+  for (;; p->nextFileIndex++)
+  {
+    if (p->nextFileIndex >= db->db.NumFiles)
+      return SZ_ERROR_ARCHIVE;
+    if (db->FileIndexToFolderIndexMap[p->nextFileIndex] == p->folderIndex)
+      break;
+  }
+  p->numFilesRem--;
+  p->fileIndex = p->nextFileIndex++;
+  p->fileRem = db->db.Files[p->fileIndex].Size;
+  p->fileCrc = CRC_INIT_VAL;
+  *fileIndex = p->fileIndex;
+  return SZ_OK;
+}
+
+SRes SzAr_ExtractFolder(
+    const CSzArEx *db,
+    ILookInStream *inStream,
+    UInt32 folderIndex,
+    ISzExtractCallback *callback,
+    ISzAlloc *allocMain)
+{
+  CSzFolderIter iter;
+  SRes res;
+  Byte *buf = (Byte *)IAlloc_Alloc(allocMain, SZ_FOLDER_DEC_BUF_SIZE);
+  if (buf == 0)
+    return SZ_ERROR_MEM;
+  SzFolderIter_Construct(&iter);
+  res = SzFolderIter_Open(&iter, db, inStream, folderIndex, allocMain);
+  while (res == SZ_OK)
+  {
+    UInt32 fileIndex;
+    ISeqOutStream *outStream = 0;
+    SRes fileRes = SZ_OK;
+    res = SzFolderIter_Next(&iter, &fileIndex);
+    if (res != SZ_OK || fileIndex == (UInt32)-1)
+      break;
+    res = callback->GetStream(callback, fileIndex, &outStream);
+    while (res == SZ_OK)
+    {
+      size_t size = SZ_FOLDER_DEC_BUF_SIZE;
+      res = SzFolderIter_Read(&iter, buf, &size);
+      if (res == SZ_ERROR_CRC)
+      {
+        fileRes = res;
+        res = SZ_OK;
+      }
+      if (res != SZ_OK || size == 0)
+        break;
+      if (outStream != 0 && outStream->Write(outStream, buf, size) != size)
+        res = SZ_ERROR_WRITE;
+    }
+    if (res == SZ_OK)
+      res = callback->SetResult(callback, fileIndex, fileRes);
+  }
+  SzFolderIter_Free(&iter, allocMain);
+  IAlloc_Free(allocMain, buf);
+  return res;
+}
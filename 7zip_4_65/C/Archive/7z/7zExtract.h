@@ -4,6 +4,7 @@
 #ifndef __7Z_EXTRACT_H
 #define __7Z_EXTRACT_H
 
+#include "7zDecode.h"
 #include "7zIn.h"
 
 /*
@@ -38,4 +39,62 @@ SRes SzAr_Extract(
     ISzAlloc *allocMain,
     ISzAlloc *allocTemp);
 
+/* ---------- Streaming extraction ---------- */
+
+/*
+  CSzFolderIter extracts files of one folder (solid block) in one pass.
+  It doesn't allocate buffer for whole folder (see CSzFolderDec), so
+  it can extract big solid blocks with small amount of memory.
+
+  SzFolderIter_Open(folderIndex) - starts decoding of folder.
+  SzFolderIter_Next() - goes to next file of folder. It skips remaining
+      data of current file. It returns (*fileIndex = (UInt32)-1) after last file
+      of folder, and it checks CRC of folder then.
+  SzFolderIter_Read() - reads data of current file. (*size = 0) means end of file.
+      It returns SZ_ERROR_CRC after last byte of file, if CRC of file is wrong.
+
+  Files without data stream (empty files and directories) are not in folders.
+  inStream must not be used by other code until folder is finished.
+*/
+
+typedef struct
+{
+  const CSzArEx *db;
+  CSzFolderDec dec;
+  UInt32 folderIndex;
+  UInt32 fileIndex;      /* current file */
+  UInt32 nextFileIndex;  /* index in db->db.Files to search next file of folder */
+  UInt32 numFilesRem;    /* number of files of folder after current file */
+  UInt64 fileRem;        /* unread size of current file */
+  UInt32 fileCrc;
+  UInt32 folderCrc;
+} CSzFolderIter;
+
+void SzFolderIter_Construct(CSzFolderIter *p);
+SRes SzFolderIter_Open(CSzFolderIter *p, const CSzArEx *db, ILookInStream *inStream,
+    UInt32 folderIndex, ISzAlloc *allocMain);
+SRes SzFolderIter_Next(CSzFolderIter *p, UInt32 *fileIndex);
+SRes SzFolderIter_Read(CSzFolderIter *p, void *data, size_t *size);
+void SzFolderIter_Free(CSzFolderIter *p, ISzAlloc *allocMain);
+
+/*
+  SzAr_ExtractFolder extracts all files of folder via callback:
+    GetStream() returns output stream for file, or NULL, if file must be skipped.
+    SetResult() is called after data of file: res is SZ_OK or SZ_ERROR_CRC.
+  If some callback function returns error, SzAr_ExtractFolder stops and returns that error.
+*/
+
+typedef struct
+{
+  SRes (*GetStream)(void *p, UInt32 fileIndex, ISeqOutStream **outStream);
+  SRes (*SetResult)(void *p, UInt32 fileIndex, SRes res);
+} ISzExtractCallback;
+
+SRes SzAr_ExtractFolder(
+    const CSzArEx *db,
+    ILookInStream *inStream,
+    UInt32 folderIndex,
+    ISzExtractCallback *callback,
+    ISzAlloc *allocMain);
+
 #endif
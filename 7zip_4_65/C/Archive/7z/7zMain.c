@@ -167,19 +167,22 @@ int MY_CDECL main(int numargs, char *args[])
       UInt32 i;
 
       /*
-      if you need cache, use these 3 variables.
-      if you use external function, you can make these variable as static.
+      Files are extracted with CSzFolderIter: each folder (solid block) is
+      decoded in one pass, and it doesn't need buffer for whole folder.
       */
-      UInt32 blockIndex = 0xFFFFFFFF; /* it can have any value before first call (if outBuffer = 0) */
-      Byte *outBuffer = 0; /* it must be 0 before first call for each new archive. */
-      size_t outBufferSize = 0;  /* it can have any value before first call (if outBuffer = 0) */
+      CSzFolderIter iter;
+      UInt32 folderIndex = (UInt32)-1; /* folder that is opened in iter */
+      Byte *buf = (Byte *)IAlloc_Alloc(&allocImp, SZ_FOLDER_DEC_BUF_SIZE);
+      if (buf == 0)
+        res = SZ_ERROR_MEM;
+      SzFolderIter_Construct(&iter);
 
       printf("\n");
-      for (i = 0; i < db.db.NumFiles; i++)
+      for (i = 0; i < db.db.NumFiles && res == SZ_OK; i++)
       {
-        size_t offset;
-        size_t outSizeProcessed;
+        CSzFile outFile;
         CSzFileItem *f = db.db.Files + i;
+        UInt32 fileFolderIndex = db.FileIndexToFolderIndexMap[i];
         if (f->IsDir)
           printf("Directory ");
         else
@@ -192,16 +195,35 @@ int MY_CDECL main(int numargs, char *args[])
           printf("\n");
           continue;
         }
-        res = SzAr_Extract(&db, &lookStream.s, i,
-            &blockIndex, &outBuffer, &outBufferSize,
-            &offset, &outSizeProcessed,
-            &allocImp, &allocTempImp);
-        if (res != SZ_OK)
-          break;
+        if (fileFolderIndex != (UInt32)-1 && fileFolderIndex != folderIndex)
+        {
+          if (folderIndex != (UInt32)-1)
+          {
+            /* it checks CRC of previous folder */
+            UInt32 fileIndex;
+            res = SzFolderIter_Next(&iter, &fileIndex);
+            if (res != SZ_OK)
+              break;
+          }
+          folderIndex = fileFolderIndex;
+          res = SzFolderIter_Open(&iter, &db, &lookStream.s, folderIndex, &allocImp);
+          if (res != SZ_OK)
+            break;
+        }
+        if (fileFolderIndex != (UInt32)-1)
+        {
+          UInt32 fileIndex;
+          res = SzFolderIter_Next(&iter, &fileIndex);
+          if (res != SZ_OK)
+            break;
+          if (fileIndex != i)
+          {
+            res = SZ_ERROR_ARCHIVE;
+            break;
+          }
+        }
         if (!testCommand)
         {
-          CSzFile outFile;
-          size_t processedSize;
           char *fileName = f->Name;
           size_t nameLen = strlen(f->Name);
           for (; nameLen > 0; nameLen--)
@@ -217,24 +239,44 @@ int MY_CDECL main(int numargs, char *args[])
             res = SZ_ERROR_FAIL;
             break;
           }
-          processedSize = outSizeProcessed;
-          if (File_Write(&outFile, outBuffer + offset, &processedSize) != 0 ||
-              processedSize != outSizeProcessed)
-          {
-            PrintError("can not write output file");
-            res = SZ_ERROR_FAIL;
+        }
+        while (fileFolderIndex != (UInt32)-1)
+        {
+          size_t size = SZ_FOLDER_DEC_BUF_SIZE;
+          res = SzFolderIter_Read(&iter, buf, &size);
+          if (res != SZ_OK || size == 0)
             break;
+          if (!testCommand)
+          {
+            size_t processedSize = size;
+            if (File_Write(&outFile, buf, &processedSize) != 0 ||
+                processedSize != size)
+            {
+              PrintError("can not write output file");
+              res = SZ_ERROR_FAIL;
+              break;
+            }
           }
-          if (File_Close(&outFile))
+        }
+        if (!testCommand)
+        {
+          if (File_Close(&outFile) && res == SZ_OK)
           {
             PrintError("can not close output file");
             res = SZ_ERROR_FAIL;
-            break;
           }
         }
+        if (res != SZ_OK)
+          break;
         printf("\n");
       }
-      IAlloc_Free(&allocImp, outBuffer);
+      if (res == SZ_OK && folderIndex != (UInt32)-1)
+      {
+        UInt32 fileIndex;
+        res = SzFolderIter_Next(&iter, &fileIndex);
+      }
+      SzFolderIter_Free(&iter, &allocImp);
+      IAlloc_Free(&allocImp, buf);
     }
     else
     {
@@ -0,0 +1,146 @@
+/* CpuArch.c -- CPU specific code
+2026-10-18 : Public domain */
+
+#include "CpuArch.h"
+
+#ifdef MY_CPU_X86_OR_AMD64
+
+#if defined(_MSC_VER)
+#if (_MSC_VER >= 1400)
+#include <intrin.h>
+#endif
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+#if !defined(MY_CPU_AMD64) && defined(_MSC_VER)
+/* 80386 and early 80486 have no CPUID instruction: we check ID bit (21) in EFLAGS */
+static Bool CheckCpuid(void)
+{
+  UInt32 a, b;
+  __asm
+  {
+    pushfd
+    pop EAX
+    mov EDX, EAX
+    xor EAX, (1 << 21)
+    push EAX
+    popfd
+    pushfd
+    pop EAX
+    push EDX
+    popfd
+    mov a, EAX
+    mov b, EDX
+  }
+  return (a != b) ? True : False;
+}
+#else
+#define CheckCpuid() True
+#endif
+
+/* subfunction (ECX) is 0 */
+
+static void MyCPUID(UInt32 function, UInt32 *a, UInt32 *b, UInt32 *c, UInt32 *d)
+{
+  #if defined(_MSC_VER) && (_MSC_VER < 1400)
+  UInt32 a2, b2, c2, d2;
+  __asm
+  {
+    mov EAX, function
+    xor ECX, ECX
+    cpuid
+    mov a2, EAX
+    mov b2, EBX
+    mov c2, ECX
+    mov d2, EDX
+  }
+  *a = a2;
+  *b = b2;
+  *c = c2;
+  *d = d2;
+  #elif defined(_MSC_VER)
+  int regs[4];
+  #if (_MSC_VER >= 1600)
+  __cpuidex(regs, (int)function, 0);
+  #else
+  __cpuid(regs, (int)function);
+  #endif
+  *a = (UInt32)regs[0];
+  *b = (UInt32)regs[1];
+  *c = (UInt32)regs[2];
+  *d = (UInt32)regs[3];
+  #else
+  unsigned int ra = 0, rb = 0, rc = 0, rd = 0;
+  __cpuid_count(function, 0, ra, rb, rc, rd);
+  *a = ra;
+  *b = rb;
+  *c = rc;
+  *d = rd;
+  #endif
+}
+
+Bool x86cpuid_CheckAndRead(Cx86cpuid *p)
+{
+  if (!CheckCpuid())
+    return False;
+  MyCPUID(0, &p->maxFunc, &p->vendor[0], &p->vendor[2], &p->vendor[1]);
+  if (p->maxFunc < 1)
+    return False;
+  MyCPUID(1, &p->ver, &p->b, &p->c, &p->d);
+  return True;
+}
+
+Bool CPU_Is_Sse2_Supported(void)
+{
+  #ifdef MY_CPU_AMD64
+  return True;
+  #else
+  Cx86cpuid p;
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  /* SSE2 (bit 26 of EDX) */
+  return ((p.d >> 26) & 1) != 0;
+  #endif
+}
+
+Bool CPU_Is_Pclmul_Supported(void)
+{
+  Cx86cpuid p;
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  /* PCLMULQDQ (bit 1 of ECX) and SSE2 (bit 26 of EDX) */
+  return ((p.c >> 1) & 1) != 0 && ((p.d >> 26) & 1) != 0;
+}
+
+Bool CPU_Is_Aes_Supported(void)
+{
+  Cx86cpuid p;
+  if (!x86cpuid_CheckAndRead(&p))
+    return False;
+  /* AES-NI (bit 25 of ECX) and SSE2 (bit 26 of EDX) */
+  return ((p.c >> 25) & 1) != 0 && ((p.d >> 26) & 1) != 0;
+}
+
+Bool CPU_Is_Sha_Supported(void)
+{
+  Cx86cpuid p;
+  if (!x86cpuid_CheckAndRead(&p) || p.maxFunc < 7)
+    return False;
+  /* SSSE3 (bit 9 of ECX) and SSE4.1 (bit 19 of ECX) are used with SHA instructions */
+  if (((p.c >> 9) & 1) == 0 || ((p.c >> 19) & 1) == 0)
+    return False;
+  #if defined(_MSC_VER) && (_MSC_VER >= 1400) && (_MSC_VER < 1600)
+  /* __cpuid() doesn't set subfunction (ECX) for leaf 7 */
+  return False;
+  #else
+  {
+    UInt32 a, b, c, d;
+    MyCPUID(7, &a, &b, &c, &d);
+    /* SHA extensions (bit 29 of EBX) */
+    return ((b >> 29) & 1) != 0;
+  }
+  #endif
+}
+
+#endif
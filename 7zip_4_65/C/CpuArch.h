@@ -6,6 +6,16 @@ Public domain */
 #ifndef __CPUARCH_H
 #define __CPUARCH_H
 
+#include "Types.h"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+#define MY_CPU_AMD64
+#endif
+
+#if defined(MY_CPU_AMD64) || defined(_M_IX86) || defined(__i386__)
+#define MY_CPU_X86_OR_AMD64
+#endif
+
 /*
 LITTLE_ENDIAN_UNALIGN means:
   1) CPU is LITTLE_ENDIAN
@@ -66,4 +76,27 @@ about these properties of platform.
 
 #define GetBe16(p) (((UInt16)((const Byte *)(p))[0] << 8) | ((const Byte *)(p))[1])
 
+#ifdef MY_CPU_X86_OR_AMD64
+
+typedef struct
+{
+  UInt32 maxFunc;
+  UInt32 vendor[3];
+  UInt32 ver;
+  UInt32 b;
+  UInt32 c;
+  UInt32 d;
+} Cx86cpuid;
+
+Bool x86cpuid_CheckAndRead(Cx86cpuid *p);
+
+Bool CPU_Is_Sse2_Supported(void);
+
+/* these functions check both CPUID feature bits and SSE2 support */
+Bool CPU_Is_Pclmul_Supported(void);
+Bool CPU_Is_Aes_Supported(void);
+Bool CPU_Is_Sha_Supported(void);
+
+#endif
+
 #endif
@@ -722,6 +722,15 @@ void Hc3Zip_MatchFinder_Skip(CMatchFinder *p, UInt32 num)
   while (--num != 0);
 }
 
+void MatchFinder_MoveNoInsert(CMatchFinder *p, UInt32 num)
+{
+  do
+  {
+    MOVE_POS
+  }
+  while (--num != 0);
+}
+
 void MatchFinder_CreateVTable(CMatchFinder *p, IMatchFinder *vTable)
 {
   vTable->Init = (Mf_Init_Func)MatchFinder_Init;
@@ -104,4 +104,7 @@ UInt32 Hc3Zip_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances);
 void Bt3Zip_MatchFinder_Skip(CMatchFinder *p, UInt32 num);
 void Hc3Zip_MatchFinder_Skip(CMatchFinder *p, UInt32 num);
 
+/* it moves position without inserting (num) positions to hash table (for fast modes) */
+void MatchFinder_MoveNoInsert(CMatchFinder *p, UInt32 num);
+
 #endif
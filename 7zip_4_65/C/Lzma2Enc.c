@@ -0,0 +1,655 @@
+/* Lzma2Enc.c -- LZMA2 Encoder
+2026-10-18 : Public domain */
+
+#include <string.h>
+
+#include "Lzma2Enc.h"
+
+#ifdef COMPRESS_MT
+#include "Threads.h"
+#endif
+
+#define LZMA2_CONTROL_LZMA (1 << 7)
+#define LZMA2_CONTROL_COPY_NO_RESET 2
+#define LZMA2_CONTROL_COPY_RESET_DIC 1
+#define LZMA2_CONTROL_EOF 0
+
+#define LZMA2_LCLP_MAX 4
+
+#define LZMA2_DIC_SIZE_FROM_PROP(p) (((UInt32)2 | ((p) & 1)) << ((p) / 2 + 11))
+
+#define LZMA2_PACK_SIZE_MAX (1 << 16)
+#define LZMA2_COPY_CHUNK_SIZE LZMA2_PACK_SIZE_MAX
+#define LZMA2_UNPACK_SIZE_MAX (1 << 21)
+#define LZMA2_KEEP_WINDOW_SIZE LZMA2_UNPACK_SIZE_MAX
+
+#define LZMA2_CHUNK_SIZE_COMPRESSED_MAX ((1 << 16) + 16)
+
+/* these LzmaEnc functions are exported for LZMA2 only */
+
+SRes LzmaEnc_PrepareForLzma2(CLzmaEncHandle pp, ISeqInStream *inStream, UInt32 keepWindowSize,
+    ISzAlloc *alloc, ISzAlloc *allocBig);
+SRes LzmaEnc_MemPrepare(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
+    UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig);
+SRes LzmaEnc_CodeOneMemBlock(CLzmaEncHandle pp, Bool reInit,
+    Byte *dest, size_t *destLen, UInt32 desiredPackSize, UInt32 *unpackSize);
+const Byte *LzmaEnc_GetCurBuf(CLzmaEncHandle pp);
+void LzmaEnc_Finish(CLzmaEncHandle pp);
+void LzmaEnc_SaveState(CLzmaEncHandle pp);
+void LzmaEnc_RestoreState(CLzmaEncHandle pp);
+
+/* ---------- CLzma2EncInt ---------- */
+
+typedef struct
+{
+  CLzmaEncHandle enc;
+  UInt64 srcPos;
+  Byte props;
+  Bool needInitState;
+  Bool needInitProp;
+} CLzma2EncInt;
+
+static SRes Lzma2EncInt_Init(CLzma2EncInt *p, const CLzma2EncProps *props)
+{
+  Byte propsEncoded[LZMA_PROPS_SIZE];
+  SizeT propsSize = LZMA_PROPS_SIZE;
+  RINOK(LzmaEnc_SetProps(p->enc, &props->lzmaProps));
+  RINOK(LzmaEnc_WriteProperties(p->enc, propsEncoded, &propsSize));
+  p->srcPos = 0;
+  p->props = propsEncoded[0];
+  p->needInitState = True;
+  p->needInitProp = True;
+  return SZ_OK;
+}
+
+/*
+  Encodes one LZMA2 chunk (up to LZMA2_UNPACK_SIZE_MAX bytes of input).
+  If (outStream != NULL), the chunk is written to outStream,
+  else it's stored to outBuf and (*packSizeRes) is the size of stored data.
+  If LZMA can't make the data smaller, the data is stored in COPY chunks.
+*/
+
+static SRes Lzma2EncInt_EncodeSubblock(CLzma2EncInt *p, Byte *outBuf,
+    size_t *packSizeRes, ISeqOutStream *outStream)
+{
+  size_t packSizeLimit = *packSizeRes;
+  size_t packSize = packSizeLimit;
+  UInt32 unpackSize = LZMA2_UNPACK_SIZE_MAX;
+  unsigned lzHeaderSize = 5 + (p->needInitProp ? 1 : 0);
+  Bool useCopyBlock;
+  SRes res;
+
+  *packSizeRes = 0;
+  if (packSize < lzHeaderSize)
+    return SZ_ERROR_OUTPUT_EOF;
+  packSize -= lzHeaderSize;
+
+  LzmaEnc_SaveState(p->enc);
+  res = LzmaEnc_CodeOneMemBlock(p->enc, p->needInitState,
+      outBuf + lzHeaderSize, &packSize, LZMA2_PACK_SIZE_MAX, &unpackSize);
+
+  if (unpackSize == 0)
+    return res;
+
+  if (res == SZ_OK)
+    useCopyBlock = (packSize + 2 >= unpackSize || packSize > (1 << 16));
+  else
+  {
+    if (res != SZ_ERROR_OUTPUT_EOF)
+      return res;
+    res = SZ_OK;
+    useCopyBlock = True;
+  }
+
+  if (useCopyBlock)
+  {
+    size_t destPos = 0;
+    while (unpackSize > 0)
+    {
+      UInt32 u = (unpackSize < LZMA2_COPY_CHUNK_SIZE) ? unpackSize : LZMA2_COPY_CHUNK_SIZE;
+      if (packSizeLimit - destPos < u + 3)
+        return SZ_ERROR_OUTPUT_EOF;
+      outBuf[destPos++] = (Byte)(p->srcPos == 0 ? LZMA2_CONTROL_COPY_RESET_DIC : LZMA2_CONTROL_COPY_NO_RESET);
+      outBuf[destPos++] = (Byte)((u - 1) >> 8);
+      outBuf[destPos++] = (Byte)(u - 1);
+      memcpy(outBuf + destPos, LzmaEnc_GetCurBuf(p->enc) - unpackSize, u);
+      unpackSize -= u;
+      destPos += u;
+      p->srcPos += u;
+      if (outStream)
+      {
+        *packSizeRes += destPos;
+        if (outStream->Write(outStream, outBuf, destPos) != destPos)
+          return SZ_ERROR_WRITE;
+        destPos = 0;
+      }
+      else
+        *packSizeRes = destPos;
+    }
+    LzmaEnc_RestoreState(p->enc);
+    return SZ_OK;
+  }
+  {
+    size_t destPos = 0;
+    UInt32 u = unpackSize - 1;
+    UInt32 pm = (UInt32)(packSize - 1);
+    unsigned mode = (p->srcPos == 0) ? 3 : (p->needInitState ? (p->needInitProp ? 2 : 1) : 0);
+
+    outBuf[destPos++] = (Byte)(LZMA2_CONTROL_LZMA | (mode << 5) | ((u >> 16) & 0x1F));
+    outBuf[destPos++] = (Byte)(u >> 8);
+    outBuf[destPos++] = (Byte)u;
+    outBuf[destPos++] = (Byte)(pm >> 8);
+    outBuf[destPos++] = (Byte)pm;
+
+    if (p->needInitProp)
+      outBuf[destPos++] = p->props;
+
+    p->needInitProp = False;
+    p->needInitState = False;
+    destPos += packSize;
+    p->srcPos += unpackSize;
+
+    if (outStream)
+      if (outStream->Write(outStream, outBuf, destPos) != destPos)
+        return SZ_ERROR_WRITE;
+    *packSizeRes = destPos;
+    return SZ_OK;
+  }
+}
+
+/* ---------- Lzma2 Props ---------- */
+
+void Lzma2EncProps_Init(CLzma2EncProps *p)
+{
+  LzmaEncProps_Init(&p->lzmaProps);
+  p->numTotalThreads = -1;
+  p->numBlockThreads = -1;
+  p->blockSize = 0;
+}
+
+void Lzma2EncProps_Normalize(CLzma2EncProps *p)
+{
+  int t1, t1n, t2, t3;
+  {
+    CLzmaEncProps lzmaProps = p->lzmaProps;
+    LzmaEncProps_Normalize(&lzmaProps);
+    t1n = lzmaProps.numThreads;
+  }
+
+  t1 = p->lzmaProps.numThreads;
+  t2 = p->numBlockThreads;
+  t3 = p->numTotalThreads;
+
+  #ifndef COMPRESS_MT
+  t2 = 1;
+  #endif
+
+  if (t2 > LZMA2_NUM_BLOCK_THREADS_MAX)
+    t2 = LZMA2_NUM_BLOCK_THREADS_MAX;
+
+  if (t3 <= 0)
+  {
+    if (t2 <= 0)
+      t2 = 1;
+    t3 = t1n * t2;
+  }
+  else if (t2 <= 0)
+  {
+    t2 = t3 / t1n;
+    if (t2 == 0)
+    {
+      t1 = 1;
+      t2 = t3;
+    }
+    if (t2 > LZMA2_NUM_BLOCK_THREADS_MAX)
+      t2 = LZMA2_NUM_BLOCK_THREADS_MAX;
+  }
+  else if (t1 <= 0)
+  {
+    t1 = t3 / t2;
+    if (t1 == 0)
+      t1 = 1;
+  }
+  else
+    t3 = t1n * t2;
+
+  p->lzmaProps.numThreads = t1;
+  p->numBlockThreads = t2;
+  p->numTotalThreads = t3;
+  LzmaEncProps_Normalize(&p->lzmaProps);
+
+  if (p->blockSize == 0)
+  {
+    UInt32 dictSize = p->lzmaProps.dictSize;
+    UInt64 blockSize = (UInt64)dictSize << 2;
+    const UInt32 kMinSize = (UInt32)1 << 20;
+    const UInt32 kMaxSize = (UInt32)1 << 28;
+    if (blockSize < kMinSize) blockSize = kMinSize;
+    if (blockSize > kMaxSize) blockSize = kMaxSize;
+    if (blockSize < dictSize) blockSize = dictSize;
+    p->blockSize = (size_t)blockSize;
+  }
+}
+
+/* ---------- Lzma2 ---------- */
+
+#ifdef COMPRESS_MT
+
+struct _CLzma2Enc;
+
+typedef struct
+{
+  struct _CLzma2Enc *parent;
+  unsigned index;
+  CThread thread;
+  CAutoResetEvent canRead;
+  CAutoResetEvent canWrite;
+  Byte *inBuf;
+  Byte *outBuf;
+} CLzma2EncThread;
+
+#endif
+
+typedef struct _CLzma2Enc
+{
+  CLzma2EncProps props;
+
+  Byte *outBuf;
+
+  ISzAlloc *alloc;
+  ISzAlloc *allocBig;
+
+  CLzma2EncInt coders[LZMA2_NUM_BLOCK_THREADS_MAX];
+
+  #ifdef COMPRESS_MT
+  CLzma2EncThread threads[LZMA2_NUM_BLOCK_THREADS_MAX];
+  unsigned numThreads;
+  size_t allocatedBlockSize;
+  size_t destBlockSize;
+
+  ISeqInStream *inStream;
+  ISeqOutStream *outStream;
+  ICompressProgress *progress;
+  UInt64 inSize;
+  UInt64 outSize;
+
+  Bool stopReading;
+  Bool stopWriting;
+  SRes res;
+  CCriticalSection cs;
+  #endif
+} CLzma2Enc;
+
+static SRes Lzma2Enc_EncodeMt1(CLzma2EncInt *p, CLzma2Enc *mainEncoder,
+    ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress)
+{
+  UInt64 packTotal = 0;
+  SRes res = SZ_OK;
+
+  if (mainEncoder->outBuf == 0)
+  {
+    mainEncoder->outBuf = (Byte *)IAlloc_Alloc(mainEncoder->alloc, LZMA2_CHUNK_SIZE_COMPRESSED_MAX);
+    if (mainEncoder->outBuf == 0)
+      return SZ_ERROR_MEM;
+  }
+  RINOK(Lzma2EncInt_Init(p, &mainEncoder->props));
+  RINOK(LzmaEnc_PrepareForLzma2(p->enc, inStream, LZMA2_KEEP_WINDOW_SIZE,
+      mainEncoder->alloc, mainEncoder->allocBig));
+  for (;;)
+  {
+    size_t packSize = LZMA2_CHUNK_SIZE_COMPRESSED_MAX;
+    res = Lzma2EncInt_EncodeSubblock(p, mainEncoder->outBuf, &packSize, outStream);
+    if (res != SZ_OK)
+      break;
+    packTotal += packSize;
+    if (progress && progress->Progress(progress, p->srcPos, packTotal) != SZ_OK)
+    {
+      res = SZ_ERROR_PROGRESS;
+      break;
+    }
+    if (packSize == 0)
+      break;
+  }
+  LzmaEnc_Finish(p->enc);
+  if (res == SZ_OK)
+  {
+    Byte b = LZMA2_CONTROL_EOF;
+    if (outStream->Write(outStream, &b, 1) != 1)
+      return SZ_ERROR_WRITE;
+  }
+  return res;
+}
+
+#ifdef COMPRESS_MT
+
+/*
+  Block threads pass two tokens around the ring of threads:
+  (canRead) - the right to read next block from inStream,
+  (canWrite) - the right to write next packed block to outStream.
+  Both tokens go in the same order, so packed blocks are written
+  in the order in which source blocks were read.
+*/
+
+static void Lzma2EncMt_SetError(CLzma2Enc *p, SRes res)
+{
+  CriticalSection_Enter(&p->cs);
+  if (p->res == SZ_OK)
+    p->res = res;
+  p->stopReading = True;
+  p->stopWriting = True;
+  CriticalSection_Leave(&p->cs);
+}
+
+static SRes Lzma2EncMt_ReadBlock(ISeqInStream *inStream, Byte *data, size_t *size)
+{
+  size_t rem = *size;
+  *size = 0;
+  while (rem != 0)
+  {
+    size_t cur = rem;
+    RINOK(inStream->Read(inStream, data, &cur));
+    if (cur == 0)
+      break;
+    data += cur;
+    *size += cur;
+    rem -= cur;
+  }
+  return SZ_OK;
+}
+
+static SRes Lzma2EncMt_EncodeBlock(CLzma2Enc *p, CLzma2EncInt *coder,
+    const Byte *src, size_t srcSize, Byte *dest, size_t *destSize)
+{
+  size_t destLim = *destSize;
+  SRes res;
+  *destSize = 0;
+  RINOK(Lzma2EncInt_Init(coder, &p->props));
+  RINOK(LzmaEnc_MemPrepare(coder->enc, src, srcSize, LZMA2_KEEP_WINDOW_SIZE,
+      p->alloc, p->allocBig));
+  res = SZ_OK;
+  while (coder->srcPos < srcSize)
+  {
+    size_t packSize = destLim - *destSize;
+    res = Lzma2EncInt_EncodeSubblock(coder, dest + *destSize, &packSize, NULL);
+    if (res != SZ_OK)
+      break;
+    *destSize += packSize;
+    if (packSize == 0)
+    {
+      res = SZ_ERROR_FAIL;
+      break;
+    }
+  }
+  LzmaEnc_Finish(coder->enc);
+  return res;
+}
+
+static THREAD_FUNC_RET_TYPE THREAD_FUNC_CALL_TYPE Lzma2EncMt_ThreadFunc(void *pp)
+{
+  CLzma2EncThread *t = (CLzma2EncThread *)pp;
+  CLzma2Enc *p = t->parent;
+  CLzma2EncThread *next = &p->threads[(t->index + 1) % p->numThreads];
+  CLzma2EncInt *coder = &p->coders[t->index];
+
+  for (;;)
+  {
+    size_t srcSize = p->props.blockSize;
+    size_t destSize = p->destBlockSize;
+    Bool isLast;
+    SRes res;
+
+    Event_Wait(&t->canRead);
+    if (p->stopReading)
+    {
+      Event_Set(&next->canRead);
+      return 0;
+    }
+    res = Lzma2EncMt_ReadBlock(p->inStream, t->inBuf, &srcSize);
+    isLast = (srcSize != p->props.blockSize);
+    if (res != SZ_OK)
+      Lzma2EncMt_SetError(p, SZ_ERROR_READ);
+    else if (isLast)
+      p->stopReading = True;
+    Event_Set(&next->canRead);
+
+    if (res == SZ_OK && srcSize != 0)
+    {
+      res = Lzma2EncMt_EncodeBlock(p, coder, t->inBuf, srcSize, t->outBuf, &destSize);
+      if (res != SZ_OK)
+        Lzma2EncMt_SetError(p, res);
+    }
+    else
+      destSize = 0;
+    if (res == SZ_OK && isLast)
+      t->outBuf[destSize++] = LZMA2_CONTROL_EOF;
+
+    Event_Wait(&t->canWrite);
+    if (res == SZ_OK && !p->stopWriting)
+    {
+      if (p->outStream->Write(p->outStream, t->outBuf, destSize) != destSize)
+        Lzma2EncMt_SetError(p, SZ_ERROR_WRITE);
+      else
+      {
+        p->inSize += srcSize;
+        p->outSize += destSize;
+        if (p->progress && p->progress->Progress(p->progress, p->inSize, p->outSize) != SZ_OK)
+          Lzma2EncMt_SetError(p, SZ_ERROR_PROGRESS);
+      }
+    }
+    Event_Set(&next->canWrite);
+
+    /* the thread exits only after it passes (canRead) with (stopReading) set,
+       so the ring of (canRead) events is never broken */
+  }
+}
+
+static void Lzma2EncMt_FreeBuffers(CLzma2Enc *p)
+{
+  unsigned i;
+  for (i = 0; i < LZMA2_NUM_BLOCK_THREADS_MAX; i++)
+  {
+    CLzma2EncThread *t = &p->threads[i];
+    IAlloc_Free(p->alloc, t->inBuf);
+    IAlloc_Free(p->alloc, t->outBuf);
+    t->inBuf = 0;
+    t->outBuf = 0;
+  }
+  p->allocatedBlockSize = 0;
+}
+
+static SRes Lzma2EncMt_Encode(CLzma2Enc *p,
+    ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress)
+{
+  unsigned i, numCreated;
+  size_t blockSize = p->props.blockSize;
+  WRes wres = 0;
+
+  p->destBlockSize = blockSize + (blockSize >> 10) + 16;
+  if (p->destBlockSize < blockSize)
+    return SZ_ERROR_PARAM;
+
+  if (p->allocatedBlockSize != blockSize)
+    Lzma2EncMt_FreeBuffers(p);
+
+  p->numThreads = (unsigned)p->props.numBlockThreads;
+  for (i = 0; i < p->numThreads; i++)
+  {
+    CLzma2EncThread *t = &p->threads[i];
+    if (t->inBuf == 0)
+    {
+      t->inBuf = (Byte *)IAlloc_Alloc(p->alloc, blockSize);
+      if (t->inBuf == 0)
+        return SZ_ERROR_MEM;
+    }
+    if (t->outBuf == 0)
+    {
+      t->outBuf = (Byte *)IAlloc_Alloc(p->alloc, p->destBlockSize);
+      if (t->outBuf == 0)
+        return SZ_ERROR_MEM;
+    }
+    p->allocatedBlockSize = blockSize;
+  }
+
+  p->inStream = inStream;
+  p->outStream = outStream;
+  p->progress = progress;
+  p->inSize = 0;
+  p->outSize = 0;
+  p->stopReading = False;
+  p->stopWriting = False;
+  p->res = SZ_OK;
+
+  if (CriticalSection_Init(&p->cs) != 0)
+    return SZ_ERROR_THREAD;
+
+  for (i = 0; i < p->numThreads; i++)
+  {
+    CLzma2EncThread *t = &p->threads[i];
+    t->parent = p;
+    t->index = i;
+    Thread_Construct(&t->thread);
+    Event_Construct(&t->canRead);
+    Event_Construct(&t->canWrite);
+  }
+
+  for (i = 0; i < p->numThreads && wres == 0; i++)
+  {
+    CLzma2EncThread *t = &p->threads[i];
+    wres = AutoResetEvent_CreateNotSignaled(&t->canRead);
+    if (wres == 0)
+      wres = AutoResetEvent_CreateNotSignaled(&t->canWrite);
+  }
+
+  numCreated = 0;
+  if (wres == 0)
+    for (; numCreated < p->numThreads; numCreated++)
+    {
+      CLzma2EncThread *t = &p->threads[numCreated];
+      wres = Thread_Create(&t->thread, Lzma2EncMt_ThreadFunc, t);
+      if (wres != 0)
+        break;
+    }
+
+  if (numCreated != 0)
+  {
+    if (wres != 0)
+    {
+      /* the ring is broken: the threads must exit without any work */
+      p->stopReading = True;
+      p->stopWriting = True;
+    }
+    Event_Set(&p->threads[0].canRead);
+    Event_Set(&p->threads[0].canWrite);
+    for (i = 0; i < numCreated; i++)
+      Thread_Wait(&p->threads[i].thread);
+  }
+
+  for (i = 0; i < p->numThreads; i++)
+  {
+    CLzma2EncThread *t = &p->threads[i];
+    if (Thread_WasCreated(&t->thread))
+      Thread_Close(&t->thread);
+    Event_Close(&t->canRead);
+    Event_Close(&t->canWrite);
+  }
+  CriticalSection_Delete(&p->cs);
+
+  if (wres != 0)
+    return SZ_ERROR_THREAD;
+  return p->res;
+}
+
+#endif
+
+CLzma2EncHandle Lzma2Enc_Create(ISzAlloc *alloc, ISzAlloc *allocBig)
+{
+  CLzma2Enc *p = (CLzma2Enc *)alloc->Alloc(alloc, sizeof(CLzma2Enc));
+  if (p != 0)
+  {
+    unsigned i;
+    Lzma2EncProps_Init(&p->props);
+    Lzma2EncProps_Normalize(&p->props);
+    p->outBuf = 0;
+    p->alloc = alloc;
+    p->allocBig = allocBig;
+    for (i = 0; i < LZMA2_NUM_BLOCK_THREADS_MAX; i++)
+      p->coders[i].enc = 0;
+    #ifdef COMPRESS_MT
+    for (i = 0; i < LZMA2_NUM_BLOCK_THREADS_MAX; i++)
+    {
+      p->threads[i].inBuf = 0;
+      p->threads[i].outBuf = 0;
+    }
+    p->allocatedBlockSize = 0;
+    #endif
+  }
+  return p;
+}
+
+void Lzma2Enc_Destroy(CLzma2EncHandle pp)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  unsigned i;
+  for (i = 0; i < LZMA2_NUM_BLOCK_THREADS_MAX; i++)
+  {
+    CLzma2EncInt *t = &p->coders[i];
+    if (t->enc)
+    {
+      LzmaEnc_Destroy(t->enc, p->alloc, p->allocBig);
+      t->enc = 0;
+    }
+  }
+  #ifdef COMPRESS_MT
+  Lzma2EncMt_FreeBuffers(p);
+  #endif
+  IAlloc_Free(p->alloc, p->outBuf);
+  IAlloc_Free(p->alloc, pp);
+}
+
+SRes Lzma2Enc_SetProps(CLzma2EncHandle pp, const CLzma2EncProps *props)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  CLzmaEncProps lzmaProps = props->lzmaProps;
+  LzmaEncProps_Normalize(&lzmaProps);
+  if (lzmaProps.lc + lzmaProps.lp > LZMA2_LCLP_MAX)
+    return SZ_ERROR_PARAM;
+  p->props = *props;
+  Lzma2EncProps_Normalize(&p->props);
+  return SZ_OK;
+}
+
+Byte Lzma2Enc_WriteProperties(CLzma2EncHandle pp)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  unsigned i;
+  UInt32 dicSize = LzmaEncProps_GetDictSize(&p->props.lzmaProps);
+  for (i = 0; i < 40; i++)
+    if (dicSize <= LZMA2_DIC_SIZE_FROM_PROP(i))
+      break;
+  return (Byte)i;
+}
+
+SRes Lzma2Enc_Encode(CLzma2EncHandle pp,
+    ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  int i;
+
+  for (i = 0; i < p->props.numBlockThreads; i++)
+  {
+    CLzma2EncInt *t = &p->coders[i];
+    if (t->enc == NULL)
+    {
+      t->enc = LzmaEnc_Create(p->alloc);
+      if (t->enc == NULL)
+        return SZ_ERROR_MEM;
+    }
+  }
+
+  #ifdef COMPRESS_MT
+  if (p->props.numBlockThreads > 1)
+    return Lzma2EncMt_Encode(p, outStream, inStream, progress);
+  #endif
+
+  return Lzma2Enc_EncodeMt1(&p->coders[0], p, outStream, inStream, progress);
+}
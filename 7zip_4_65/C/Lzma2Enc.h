@@ -0,0 +1,52 @@
+/* Lzma2Enc.h -- LZMA2 Encoder
+2026-10-18 : Public domain */
+
+#ifndef __LZMA2ENC_H
+#define __LZMA2ENC_H
+
+#include "LzmaEnc.h"
+
+#define LZMA2_NUM_BLOCK_THREADS_MAX 32
+
+typedef struct
+{
+  CLzmaEncProps lzmaProps;
+  size_t blockSize;     /* 0 - default (4 * dictSize, 1 MB ... 256 MB) */
+  int numBlockThreads;  /* 1 ... LZMA2_NUM_BLOCK_THREADS_MAX, -1 - auto */
+  int numTotalThreads;  /* -1 - auto */
+} CLzma2EncProps;
+
+void Lzma2EncProps_Init(CLzma2EncProps *p);
+void Lzma2EncProps_Normalize(CLzma2EncProps *p);
+
+/* ---------- CLzma2EncHandle Interface ---------- */
+
+/* Lzma2Enc_* functions can return the following exit codes:
+Returns:
+  SZ_OK           - OK
+  SZ_ERROR_MEM    - Memory allocation error
+  SZ_ERROR_PARAM  - Incorrect paramater in props
+  SZ_ERROR_WRITE  - Write callback error
+  SZ_ERROR_READ   - Read callback error
+  SZ_ERROR_PROGRESS - some break from progress callback
+  SZ_ERROR_THREAD - errors in multithreading functions (only for Mt version)
+*/
+
+/*
+  The input is split into blocks of (blockSize) bytes. Each block starts
+  with dictionary reset, so the blocks are coded independently and
+  (numBlockThreads) blocks are compressed at the same time.
+  Each block thread can additionally use LZMA's own match finder thread
+  (lzmaProps.numThreads = 2), so numTotalThreads = numBlockThreads * lzmaProps.numThreads.
+*/
+
+typedef void * CLzma2EncHandle;
+
+CLzma2EncHandle Lzma2Enc_Create(ISzAlloc *alloc, ISzAlloc *allocBig);
+void Lzma2Enc_Destroy(CLzma2EncHandle p);
+SRes Lzma2Enc_SetProps(CLzma2EncHandle p, const CLzma2EncProps *props);
+Byte Lzma2Enc_WriteProperties(CLzma2EncHandle p);
+SRes Lzma2Enc_Encode(CLzma2EncHandle p,
+    ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress);
+
+#endif
@@ -2181,6 +2181,7 @@ SRes LzmaEnc_Encode(CLzmaEncHandle pp, ISeqOutStream *outStream, ISeqInStream *i
   int i = 0;
   for (i = 0; i < 16; i++)
     allocaDummy[i] = (Byte)i;
+  (void)allocaDummy;
   #endif
 
   RINOK(LzmaEnc_Prepare(pp, inStream, outStream, alloc, allocBig));
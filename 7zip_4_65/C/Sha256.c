@@ -2,7 +2,10 @@
 2008-11-06 : Igor Pavlov : Public domain
 This code is based on public domain code from Wei Dai's Crypto++ library. */
 
+#include <string.h>
+
 #include "Sha256.h"
+#include "CpuArch.h"
 #include "RotateDefs.h"
 
 /* define it for speed optimization */
@@ -144,54 +147,163 @@ static void Sha256_Transform(UInt32 *state, const UInt32 *data)
 #undef s0
 #undef s1
 
-static void Sha256_WriteByteBlock(CSha256 *p)
+typedef void (*SHA256_BLOCKS_FUNC)(UInt32 *state, const Byte *data, size_t numBlocks);
+
+static void Sha256_UpdateBlocks(UInt32 *state, const Byte *data, size_t numBlocks)
 {
   UInt32 data32[16];
-  unsigned i;
-  for (i = 0; i < 16; i++)
-    data32[i] =
-      ((UInt32)(p->buffer[i * 4    ]) << 24) +
-      ((UInt32)(p->buffer[i * 4 + 1]) << 16) +
-      ((UInt32)(p->buffer[i * 4 + 2]) <<  8) +
-      ((UInt32)(p->buffer[i * 4 + 3]));
-  Sha256_Transform(p->state, data32);
+  for (; numBlocks != 0; numBlocks--, data += 64)
+  {
+    unsigned i;
+    for (i = 0; i < 16; i++)
+      data32[i] = GetBe32(data + i * 4);
+    Sha256_Transform(state, data32);
+  }
+}
+
+/*
+  SHA-NI version (x86 SHA extensions) is based on public domain code
+  from Intel's "Intel SHA Extensions" paper and Jeffrey Walton's SHA-Intrinsics.
+  The state is kept in ABEF / CDGH order, as SHA256RNDS2 instruction requires.
+*/
+
+#ifdef MY_CPU_X86_OR_AMD64
+#if defined(_MSC_VER) && (_MSC_VER >= 1900)
+#define USE_SHA_NI
+#elif defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define USE_SHA_NI
+#define SHA_NI_ATTRIB __attribute__((target("sse4.1,sha")))
+#endif
+#endif
+
+#ifdef USE_SHA_NI
+
+#include <immintrin.h>
+
+#ifndef SHA_NI_ATTRIB
+#define SHA_NI_ATTRIB
+#endif
+
+#define SHA_K(i) _mm_loadu_si128((const __m128i *)(K + (i) * 4))
+
+#define SHA_RNDS4(i, m) \
+    msg = _mm_add_epi32(m, SHA_K(i)); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    msg = _mm_shuffle_epi32(msg, 0x0E); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+#define SHA_MSG2(m, mPrev, mNext) \
+    mNext = _mm_add_epi32(mNext, _mm_alignr_epi8(m, mPrev, 4)); \
+    mNext = _mm_sha256msg2_epu32(mNext, m);
+
+#define SHA_MSG1(m, mPrev) mPrev = _mm_sha256msg1_epu32(mPrev, m);
+
+#define SHA_LOAD(i, m) m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + (i) * 16)), mask);
+
+SHA_NI_ATTRIB
+static void Sha256_UpdateBlocks_Intel(UInt32 *state, const Byte *data, size_t numBlocks)
+{
+  const __m128i mask = _mm_set_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+  __m128i state0, state1, msg, tmp;
+  __m128i m0, m1, m2, m3;
+
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1); /* CDAB */
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); /* EFGH */
+  state0 = _mm_alignr_epi8(tmp, state1, 8); /* ABEF */
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0); /* CDGH */
+
+  for (; numBlocks != 0; numBlocks--, data += 64)
+  {
+    __m128i state0Save = state0;
+    __m128i state1Save = state1;
+
+    SHA_LOAD(0, m0)  SHA_RNDS4( 0, m0)
+    SHA_LOAD(1, m1)  SHA_RNDS4( 1, m1)  SHA_MSG1(m1, m0)
+    SHA_LOAD(2, m2)  SHA_RNDS4( 2, m2)  SHA_MSG1(m2, m1)
+    SHA_LOAD(3, m3)  SHA_RNDS4( 3, m3)  SHA_MSG2(m3, m2, m0)  SHA_MSG1(m3, m2)
+    SHA_RNDS4( 4, m0)  SHA_MSG2(m0, m3, m1)  SHA_MSG1(m0, m3)
+    SHA_RNDS4( 5, m1)  SHA_MSG2(m1, m0, m2)  SHA_MSG1(m1, m0)
+    SHA_RNDS4( 6, m2)  SHA_MSG2(m2, m1, m3)  SHA_MSG1(m2, m1)
+    SHA_RNDS4( 7, m3)  SHA_MSG2(m3, m2, m0)  SHA_MSG1(m3, m2)
+    SHA_RNDS4( 8, m0)  SHA_MSG2(m0, m3, m1)  SHA_MSG1(m0, m3)
+    SHA_RNDS4( 9, m1)  SHA_MSG2(m1, m0, m2)  SHA_MSG1(m1, m0)
+    SHA_RNDS4(10, m2)  SHA_MSG2(m2, m1, m3)  SHA_MSG1(m2, m1)
+    SHA_RNDS4(11, m3)  SHA_MSG2(m3, m2, m0)  SHA_MSG1(m3, m2)
+    SHA_RNDS4(12, m0)  SHA_MSG2(m0, m3, m1)  SHA_MSG1(m0, m3)
+    SHA_RNDS4(13, m1)  SHA_MSG2(m1, m0, m2)
+    SHA_RNDS4(14, m2)  SHA_MSG2(m2, m1, m3)
+    SHA_RNDS4(15, m3)
+
+    state0 = _mm_add_epi32(state0, state0Save);
+    state1 = _mm_add_epi32(state1, state1Save);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B); /* FEBA */
+  state1 = _mm_shuffle_epi32(state1, 0xB1); /* DCHG */
+  _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0)); /* DCBA */
+  _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8)); /* EFGH */
+}
+
+#endif
+
+static SHA256_BLOCKS_FUNC g_Sha256_UpdateBlocks = Sha256_UpdateBlocks;
+
+void Sha256Prepare(void)
+{
+  g_Sha256_UpdateBlocks = Sha256_UpdateBlocks;
+  #ifdef USE_SHA_NI
+  if (CPU_Is_Sha_Supported())
+    g_Sha256_UpdateBlocks = Sha256_UpdateBlocks_Intel;
+  #endif
 }
 
 void Sha256_Update(CSha256 *p, const Byte *data, size_t size)
 {
-  UInt32 curBufferPos = (UInt32)p->count & 0x3F;
-  while (size > 0)
+  unsigned pos = (unsigned)p->count & 0x3F;
+  p->count += size;
+  if (pos != 0)
   {
-    p->buffer[curBufferPos++] = *data++;
-    p->count++;
-    size--;
-    if (curBufferPos == 64)
+    unsigned num = 64 - pos;
+    if (size < num)
     {
-      curBufferPos = 0;
-      Sha256_WriteByteBlock(p);
+      memcpy(p->buffer + pos, data, size);
+      return;
     }
+    memcpy(p->buffer + pos, data, num);
+    data += num;
+    size -= num;
+    g_Sha256_UpdateBlocks(p->state, p->buffer, 1);
+  }
+  if (size >= 64)
+  {
+    size_t numBlocks = size >> 6;
+    g_Sha256_UpdateBlocks(p->state, data, numBlocks);
+    numBlocks <<= 6;
+    data += numBlocks;
+    size -= numBlocks;
   }
+  memcpy(p->buffer, data, size);
 }
 
 void Sha256_Final(CSha256 *p, Byte *digest)
 {
   UInt64 lenInBits = (p->count << 3);
-  UInt32 curBufferPos = (UInt32)p->count & 0x3F;
+  unsigned pos = (unsigned)p->count & 0x3F;
   unsigned i;
-  p->buffer[curBufferPos++] = 0x80;
-  while (curBufferPos != (64 - 8))
+  p->buffer[pos++] = 0x80;
+  if (pos > 64 - 8)
   {
-    curBufferPos &= 0x3F;
-    if (curBufferPos == 0)
-      Sha256_WriteByteBlock(p);
-    p->buffer[curBufferPos++] = 0;
+    memset(p->buffer + pos, 0, 64 - pos);
+    g_Sha256_UpdateBlocks(p->state, p->buffer, 1);
+    pos = 0;
   }
+  memset(p->buffer + pos, 0, 64 - 8 - pos);
   for (i = 0; i < 8; i++)
   {
-    p->buffer[curBufferPos++] = (Byte)(lenInBits >> 56);
+    p->buffer[64 - 8 + i] = (Byte)(lenInBits >> 56);
     lenInBits <<= 8;
   }
-  Sha256_WriteByteBlock(p);
+  g_Sha256_UpdateBlocks(p->state, p->buffer, 1);
 
   for (i = 0; i < 8; i++)
   {
@@ -15,6 +15,10 @@ typedef struct
   Byte buffer[64];
 } CSha256;
 
+/* Sha256Prepare selects SHA-NI code, if CPU supports it.
+   Call it one time before other functions. Portable code is used without it. */
+void Sha256Prepare(void);
+
 void Sha256_Init(CSha256 *p);
 void Sha256_Update(CSha256 *p, const Byte *data, size_t size);
 void Sha256_Final(CSha256 *p, Byte *digest);
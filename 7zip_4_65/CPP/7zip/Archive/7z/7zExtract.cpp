@@ -12,6 +12,16 @@
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/LimitedStreams.h"
 
+#if defined(COMPRESS_MT) && !defined(_7Z_VOL)
+#define _7Z_EXTRACT_MT
+#endif
+
+#ifdef _7Z_EXTRACT_MT
+#include "../../Common/LockedStream.h"
+#include "../../Common/MtThreadPool.h"
+#include "../../Common/StreamUtils.h"
+#endif
+
 namespace NArchive {
 namespace N7z {
 
@@ -44,6 +54,232 @@ struct CExtractFolderInfo
   };
 };
 
+#ifdef _7Z_EXTRACT_MT
+
+/*
+  Multi-threaded extraction: folders are independent, so worker threads
+  decode folders (one CDecoder per thread) into memory buffers, and the main
+  thread passes the buffers to CFolderOutStream in the original order.
+  So IArchiveExtractCallback gets the same calls in the same order and CRC
+  checking stays in CFolderOutStream.
+  Only folders up to kMtFolderSizeMax are decoded that way, and no more than
+  (2 * numThreads) folders are buffered at the same time.
+  Bigger folders are decoded by main thread directly to CFolderOutStream.
+*/
+
+static const UInt64 kMtFolderSizeMax = (UInt64)1 << 24;
+
+// It writes to fixed buffer and skips the data after end of buffer,
+// as CFolderOutStream skips the data after last file of folder.
+
+class CFolderBufferOutStream:
+  public ISequentialOutStream,
+  public CMyUnknownImp
+{
+  Byte *_buffer;
+  size_t _size;
+  size_t _pos;
+public:
+  void Init(Byte *buffer, size_t size)
+  {
+    _buffer = buffer;
+    _size = size;
+    _pos = 0;
+  }
+  size_t GetPos() const { return _pos; }
+
+  MY_UNKNOWN_IMP
+
+  STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
+};
+
+STDMETHODIMP CFolderBufferOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  size_t rem = _size - _pos;
+  if (size < rem)
+    rem = (size_t)size;
+  memcpy(_buffer + _pos, data, rem);
+  _pos += rem;
+  if (processedSize != NULL)
+    *processedSize = size;
+  return S_OK;
+}
+
+class CMtFolderProgress:
+  public ICompressProgressInfo,
+  public CMyUnknownImp
+{
+public:
+  const bool *Stop;
+
+  MY_UNKNOWN_IMP
+
+  STDMETHOD(SetRatioInfo)(const UInt64 * /* inSize */, const UInt64 * /* outSize */)
+    { return *Stop ? E_ABORT : S_OK; }
+};
+
+#ifndef _NO_CRYPTO
+
+// Worker threads and main thread can ask password at the same time.
+// We call real callback only once and then return same result to all callers.
+
+class CMtGetTextPassword:
+  public ICryptoGetTextPassword,
+  public CMyUnknownImp
+{
+  CMyComPtr<ICryptoGetTextPassword> _getTextPassword;
+  NWindows::NSynchronization::CCriticalSection _criticalSection;
+  bool _wasCalled;
+  HRESULT _result;
+  CMyComBSTR _password;
+public:
+  void Init(ICryptoGetTextPassword *getTextPassword)
+  {
+    _getTextPassword = getTextPassword;
+    _wasCalled = false;
+  }
+
+  MY_UNKNOWN_IMP
+
+  STDMETHOD(CryptoGetTextPassword)(BSTR *password);
+};
+
+STDMETHODIMP CMtGetTextPassword::CryptoGetTextPassword(BSTR *password)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+  if (!_wasCalled)
+  {
+    _result = _getTextPassword->CryptoGetTextPassword(&_password);
+    _wasCalled = true;
+  }
+  if (_result != S_OK)
+    return _result;
+  *password = _password.MyCopy();
+  return S_OK;
+}
+
+#endif
+
+struct CMtFolderJob
+{
+  CNum FolderIndex;
+  UInt64 UnpackSize;
+  CByteBuffer Buffer;
+  size_t Size;
+  HRESULT Result;
+  bool WasDecoded;
+};
+
+// Jobs are not reused: there is one job for each folder, and the main thread
+// starts new job only after it releases the buffer of previous job.
+
+class CMtFolderDecoder: public CMtJobQueue
+{
+  void DecodeJob(CMtFolderJob &job, CDecoder &decoder, IInStream *inStream,
+      ICompressProgressInfo *progress, CFolderBufferOutStream *outStreamSpec);
+public:
+  #ifdef EXTERNAL_CODECS
+  ICompressCodecsInfo *codecsInfo;
+  const CObjectVector<CCodecInfoEx> *externalCodecs;
+  #endif
+  const CArchiveDatabaseEx *Db;
+  CLockedInStream LockedInStream;
+  #ifndef _NO_CRYPTO
+  CMyComPtr<ICryptoGetTextPassword> GetTextPassword;
+  #endif
+  CObjectVector<CMtFolderJob> Jobs;
+
+  ~CMtFolderDecoder() { StopAndWait(); }
+  HRESULT Create(UInt32 numThreads);
+  void ReleaseJob(int jobIndex);
+  void ThreadFunc();
+};
+
+HRESULT CMtFolderDecoder::Create(UInt32 numThreads)
+{
+  RINOK(CMtJobQueue::Create(numThreads, Jobs.Size()));
+  UInt32 numBuffers = numThreads * 2;
+  while (GetNumStarted() < (UInt64)Jobs.Size() && GetNumStarted() < numBuffers)
+    StartJob();
+  return S_OK;
+}
+
+void CMtFolderDecoder::ReleaseJob(int jobIndex)
+{
+  Jobs[jobIndex].Buffer.Free();
+  if (GetNumStarted() < (UInt64)Jobs.Size())
+    StartJob();
+}
+
+void CMtFolderDecoder::DecodeJob(CMtFolderJob &job, CDecoder &decoder, IInStream *inStream,
+    ICompressProgressInfo *progress, CFolderBufferOutStream *outStreamSpec)
+{
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  try
+  {
+    job.Buffer.SetCapacity((size_t)job.UnpackSize);
+  }
+  catch(...)
+  {
+    // main thread will decode that folder without buffer
+    return;
+  }
+  outStreamSpec->Init(job.Buffer, (size_t)job.UnpackSize);
+  job.WasDecoded = true;
+  try
+  {
+    #ifndef _NO_CRYPTO
+    bool passwordIsDefined;
+    #endif
+    job.Result = decoder.Decode(
+        EXTERNAL_CODECS_LOC_VARS
+        inStream,
+        Db->GetFolderStreamPos(job.FolderIndex, 0),
+        &Db->PackSizes[Db->FolderStartPackStreamIndex[job.FolderIndex]],
+        Db->Folders[job.FolderIndex],
+        outStream,
+        progress
+        #ifndef _NO_CRYPTO
+        , GetTextPassword, passwordIsDefined
+        #endif
+        , true, 1);
+  }
+  catch(...)
+  {
+    // single-threaded code reports data error for exception in decoder
+    job.Result = S_FALSE;
+  }
+  job.Size = outStreamSpec->GetPos();
+}
+
+void CMtFolderDecoder::ThreadFunc()
+{
+  CDecoder decoder(
+    #ifdef _ST_MODE
+    false
+    #else
+    true
+    #endif
+    );
+
+  CLockedInStreamImp *inStreamSpec = new CLockedInStreamImp;
+  CMyComPtr<IInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(&LockedInStream);
+
+  CMtFolderProgress *progressSpec = new CMtFolderProgress;
+  CMyComPtr<ICompressProgressInfo> progress = progressSpec;
+  progressSpec->Stop = &_stop;
+
+  int jobIndex;
+  while (GetJob(jobIndex))
+  {
+    DecodeJob(Jobs[jobIndex], decoder, inStream, progress, new CFolderBufferOutStream);
+    JobFinished(jobIndex);
+  }
+}
+
+#endif
+
 STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
     Int32 testModeSpec, IArchiveExtractCallback *extractCallbackSpec)
 {
@@ -158,6 +394,75 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
+  #ifndef _NO_CRYPTO
+  CMyComPtr<ICryptoGetTextPassword> getTextPassword;
+  if (extractCallback)
+    extractCallback.QueryInterface(IID_ICryptoGetTextPassword, &getTextPassword);
+  #endif
+
+  #ifndef _7Z_VOL
+  CMyComPtr<IInStream> inStream = _inStream;
+  #endif
+
+  #ifdef _7Z_EXTRACT_MT
+  CMtFolderDecoder mtDecoder;
+  CIntVector jobIndexes;
+  if (_numThreads > 1)
+  {
+    for (int i = 0; i < extractFolderInfoVector.Size(); i++)
+    {
+      const CExtractFolderInfo &efi = extractFolderInfoVector[i];
+      int jobIndex = -1;
+      if (efi.FileIndex == kNumNoIndex && efi.UnpackSize <= kMtFolderSizeMax)
+      {
+        CMtFolderJob job;
+        job.FolderIndex = efi.FolderIndex;
+        job.UnpackSize = efi.UnpackSize;
+        job.Size = 0;
+        job.Result = S_OK;
+        job.WasDecoded = false;
+        jobIndex = mtDecoder.Jobs.Add(job);
+      }
+      jobIndexes.Add(jobIndex);
+    }
+    if (mtDecoder.Jobs.Size() > 1)
+    {
+      // all threads (including main thread) must read archive via one CLockedInStream
+      mtDecoder.LockedInStream.Init(_inStream);
+      CLockedInStreamImp *inStreamSpec = new CLockedInStreamImp;
+      inStream = inStreamSpec;
+      inStreamSpec->Init(&mtDecoder.LockedInStream);
+
+      #ifdef EXTERNAL_CODECS
+      mtDecoder.codecsInfo = _codecsInfo;
+      mtDecoder.externalCodecs = &_externalCodecs;
+      #endif
+      mtDecoder.Db = &_db;
+      #ifndef _NO_CRYPTO
+      if (getTextPassword)
+      {
+        CMtGetTextPassword *getTextPasswordSpec = new CMtGetTextPassword;
+        CMyComPtr<ICryptoGetTextPassword> getTextPasswordMt = getTextPasswordSpec;
+        getTextPasswordSpec->Init(getTextPassword);
+        getTextPassword = getTextPasswordMt;
+      }
+      mtDecoder.GetTextPassword = getTextPassword;
+      #endif
+      UInt32 numThreads = _numThreads;
+      if (numThreads > (UInt32)mtDecoder.Jobs.Size())
+        numThreads = mtDecoder.Jobs.Size();
+      // if threads can't be created, we decode all folders in main thread
+      if (mtDecoder.Create(numThreads) != S_OK)
+      {
+        mtDecoder.StopAndWait();
+        jobIndexes.Clear();
+      }
+    }
+    else
+      jobIndexes.Clear();
+  }
+  #endif
+
   for(int i = 0; i < extractFolderInfoVector.Size(); i++,
       currentTotalUnpacked += totalFolderUnpacked,
       currentTotalPacked += totalFolderPacked)
@@ -210,37 +515,62 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
     CNum packStreamIndex = db.FolderStartPackStreamIndex[folderIndex];
     UInt64 folderStartPackPos = db.GetFolderStreamPos(folderIndex, 0);
 
-    #ifndef _NO_CRYPTO
-    CMyComPtr<ICryptoGetTextPassword> getTextPassword;
-    if (extractCallback)
-      extractCallback.QueryInterface(IID_ICryptoGetTextPassword, &getTextPassword);
+    #ifdef _7Z_EXTRACT_MT
+    int jobIndex = jobIndexes.IsEmpty() ? -1 : jobIndexes[i];
+    if (jobIndex >= 0)
+    {
+      // jobs are finished in order of folders
+      RINOK(mtDecoder.WaitJob(jobIndex));
+      if (!mtDecoder.Jobs[jobIndex].WasDecoded)
+      {
+        // worker thread couldn't allocate the buffer, so main thread decodes that folder.
+        // The buffer slot must be returned, or worker threads will stop after numBuffers such folders.
+        mtDecoder.ReleaseJob(jobIndex);
+        jobIndex = -1;
+      }
+    }
     #endif
 
     try
     {
-      #ifndef _NO_CRYPTO
-      bool passwordIsDefined;
+      HRESULT result;
+      #ifdef _7Z_EXTRACT_MT
+      if (jobIndex >= 0)
+      {
+        const CMtFolderJob &job = mtDecoder.Jobs[jobIndex];
+        HRESULT writeResult = WriteStream(outStream, job.Buffer, job.Size);
+        result = job.Result;
+        mtDecoder.ReleaseJob(jobIndex);
+        jobIndex = -1;
+        RINOK(writeResult);
+      }
+      else
       #endif
+      {
+        #ifndef _NO_CRYPTO
+        bool passwordIsDefined;
+        #endif
 
-      HRESULT result = decoder.Decode(
-          EXTERNAL_CODECS_VARS
-          #ifdef _7Z_VOL
-          volume.Stream,
-          #else
-          _inStream,
-          #endif
-          folderStartPackPos,
-          &db.PackSizes[packStreamIndex],
-          folderInfo,
-          outStream,
-          progress
-          #ifndef _NO_CRYPTO
-          , getTextPassword, passwordIsDefined
-          #endif
-          #ifdef COMPRESS_MT
-          , true, _numThreads
-          #endif
-          );
+        result = decoder.Decode(
+            EXTERNAL_CODECS_VARS
+            #ifdef _7Z_VOL
+            volume.Stream,
+            #else
+            inStream,
+            #endif
+            folderStartPackPos,
+            &db.PackSizes[packStreamIndex],
+            folderInfo,
+            outStream,
+            progress
+            #ifndef _NO_CRYPTO
+            , getTextPassword, passwordIsDefined
+            #endif
+            #ifdef COMPRESS_MT
+            , true, _numThreads
+            #endif
+            );
+      }
 
       if (result == S_FALSE)
       {
@@ -262,6 +592,10 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
     }
     catch(...)
     {
+      #ifdef _7Z_EXTRACT_MT
+      if (jobIndex >= 0)
+        mtDecoder.ReleaseJob(jobIndex);
+      #endif
       RINOK(folderOutStream->FlushCorrupted(NArchive::NExtract::NOperationResult::kDataError));
       continue;
     }
@@ -7,6 +7,14 @@
 namespace NArchive {
 namespace N7z {
 
+class CCallbackLock
+{
+  NWindows::NSynchronization::CCriticalSection *_cs;
+public:
+  CCallbackLock(NWindows::NSynchronization::CCriticalSection *cs): _cs(cs) { if (_cs) _cs->Enter(); }
+  ~CCallbackLock() { if (_cs) _cs->Leave(); }
+};
+
 CFolderInStream::CFolderInStream()
 {
   _inStreamWithHashSpec = new CSequentialInStreamWithCRC;
@@ -14,9 +22,11 @@ CFolderInStream::CFolderInStream()
 }
 
 void CFolderInStream::Init(IArchiveUpdateCallback *updateCallback,
-    const UInt32 *fileIndices, UInt32 numFiles)
+    const UInt32 *fileIndices, UInt32 numFiles,
+    NWindows::NSynchronization::CCriticalSection *callbackCS)
 {
   _updateCallback = updateCallback;
+  _callbackCS = callbackCS;
   _numFiles = numFiles;
   _fileIndex = 0;
   _fileIndices = fileIndices;
@@ -34,7 +44,11 @@ HRESULT CFolderInStream::OpenStream()
   {
     _currentSizeIsDefined = false;
     CMyComPtr<ISequentialInStream> stream;
-    HRESULT result = _updateCallback->GetStream(_fileIndices[_fileIndex], &stream);
+    HRESULT result;
+    {
+      CCallbackLock lock(_callbackCS);
+      result = _updateCallback->GetStream(_fileIndices[_fileIndex], &stream);
+    }
     if (result != S_OK && result != S_FALSE)
       return result;
     _fileIndex++;
@@ -42,7 +56,10 @@ HRESULT CFolderInStream::OpenStream()
     _inStreamWithHashSpec->Init();
     if (!stream)
     {
-      RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+      {
+        CCallbackLock lock(_callbackCS);
+        RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+      }
       Sizes.Add(0);
       Processed.Add(result == S_OK);
       AddDigest();
@@ -71,7 +88,10 @@ void CFolderInStream::AddDigest()
 
 HRESULT CFolderInStream::CloseStream()
 {
-  RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+  {
+    CCallbackLock lock(_callbackCS);
+    RINOK(_updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK));
+  }
   _inStreamWithHashSpec->ReleaseStream();
   _fileIsOpen = false;
   Processed.Add(true);
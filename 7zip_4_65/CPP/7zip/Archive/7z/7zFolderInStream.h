@@ -6,6 +6,8 @@
 #include "7zItem.h"
 #include "7zHeader.h"
 
+#include "../../../Windows/Synchronization.h"
+
 #include "../IArchive.h"
 #include "../Common/InStreamWithCRC.h"
 #include "../../IStream.h"
@@ -32,6 +34,7 @@ private:
   CSequentialInStreamWithCRC *_inStreamWithHashSpec;
   CMyComPtr<ISequentialInStream> _inStreamWithHash;
   CMyComPtr<IArchiveUpdateCallback> _updateCallback;
+  NWindows::NSynchronization::CCriticalSection *_callbackCS;
 
   bool _currentSizeIsDefined;
   UInt64 _currentSize;
@@ -47,8 +50,11 @@ private:
   HRESULT CloseStream();
   void AddDigest();
 public:
+  // if (callbackCS) is not NULL, (updateCallback) is called only inside that critical section
+  // (the stream is read by coder thread of multithreaded update).
   void Init(IArchiveUpdateCallback *updateCallback,
-      const UInt32 *fileIndices, UInt32 numFiles);
+      const UInt32 *fileIndices, UInt32 numFiles,
+      NWindows::NSynchronization::CCriticalSection *callbackCS = NULL);
   CRecordVector<bool> Processed;
   CRecordVector<UInt32> CRCs;
   CRecordVector<UInt64> Sizes;
@@ -38,6 +38,10 @@ CHandler::CHandler()
   _totalPackSize = 0;
   _recoveredFileCount = 0;
   _recoveredUncompressedFileSize = 0;
+  _recoveryGroupSize = 0;
+  _recoveryGroupTime = 0;
+  _recoveryGroupStartTime = 0;
+  _keepHeaderChain = false;
 
   #ifndef _NO_CRYPTO
   _passwordIsDefined = false;
@@ -180,6 +184,7 @@ static UString GetStringForSizeValue(UInt32 value)
 
 static const UInt64 k_Copy = 0x0;
 static const UInt64 k_LZMA  = 0x030101;
+static const UInt64 k_LZMA2 = 0x21;
 static const UInt64 k_PPMD  = 0x030401;
 
 static wchar_t GetHex(Byte value)
@@ -229,9 +234,21 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID,  PROPVARIANT *va
   switch(propID)
   {
     case kpidPath:
-      if (!item.Name.IsEmpty())
-        prop = NItemName::GetOSName(item.Name);
+    {
+      // path is copied from name table to BSTR directly
+      unsigned len = _db.Names.GetLen(item.NameRef);
+      if (len != 0)
+      {
+        BSTR s = ::SysAllocStringByteLen(NULL, len * sizeof(OLECHAR));
+        if (s == 0)
+          return E_OUTOFMEMORY;
+        _db.Names.GetChars(item.NameRef, s, WCHAR_PATH_SEPARATOR);
+        prop.vt = VT_BSTR;
+        prop.wReserved1 = 0;
+        prop.bstrVal = s;
+      }
       break;
+    }
     case kpidIsDir:  prop = item.IsDir; break;
     case kpidSize:
     {
@@ -298,6 +315,19 @@ STDMETHODIMP CHandler::GetProperty(UInt32 index, PROPID propID,  PROPVARIANT *va
                     methodsString += GetStringForSizeValue(dicSize);
                   }
                 }
+                else if (coderInfo.MethodID == k_LZMA2)
+                {
+                  if (coderInfo.Props.GetCapacity() >= 1)
+                  {
+                    Byte prop = *(const Byte *)coderInfo.Props;
+                    if (prop < 40)
+                    {
+                      methodsString += L":";
+                      UInt32 dicSize = (((UInt32)2 | (prop & 1)) << (prop / 2 + 11));
+                      methodsString += GetStringForSizeValue(dicSize);
+                    }
+                  }
+                }
                 else if (coderInfo.MethodID == k_PPMD)
                 {
                   if (coderInfo.Props.GetCapacity() >= 5)
@@ -458,6 +488,9 @@ STDMETHODIMP CHandler::Close()
   _inStream.Release();
   _db.Clear();
   _newDB.Clear();
+  #ifndef EXTRACT_ONLY
+  _updateSession.Clear();
+  #endif
   return S_OK;
   COM_TRY_END
 }
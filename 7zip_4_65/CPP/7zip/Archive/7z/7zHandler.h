@@ -12,6 +12,7 @@
 #include "7zOut.h"
 
 #include "7zCompressionMode.h"
+#include "7zNameIndex.h"
 
 #include "../../Common/CreateCoder.h"
 #include "../../Common/FileStreams.h"
@@ -19,6 +20,7 @@
 
 #ifndef EXTRACT_ONLY
 #include "../Common/HandlerOut.h"
+#include "7zUpdate.h"
 #endif
 
 namespace NArchive {
@@ -66,6 +68,53 @@ struct CRecoveryIndex
   }
 };
 
+/*
+Recovery journal:
+  Signature (8 bytes)
+  Records. Each record is written with one write call:
+    UInt32 Crc  - CRC of Size and Data
+    UInt32 Size
+    Data[Size]  - new items of all CArchiveDatabase vectors since previous record
+Integers are little-endian, names are zero-terminated UTF-16LE.
+Replay stops at first record that is incomplete or has bad CRC.
+
+Group commit mode (RGB / RGT / RCOC properties):
+  records are collected in memory and written and flushed together when
+  the group reaches RGB bytes, when RGT milliseconds have passed since the
+  first record of group, or when the last item of record is COC entry
+  (its name starts with RCOC). RGB and RGT require RCOC, so COC entries
+  are always flushed at once and still reach the journal at the same
+  points as before. Replay drops everything after last COC entry anyway.
+  There is no timer: RGT is checked when a record is added, so it limits
+  the delay in records, not in wall time. If the writer stalls, the group
+  stays in memory until next record, checkpoint or close.
+*/
+
+const UInt32 kRecoveryRecordHeaderSize = 8;
+
+// It can hold several records: records of group commit
+
+class CRecoveryRecordWriter
+{
+  CByteBuffer _buffer;
+  size_t _pos;
+  size_t _recordStart;
+  void Reserve(size_t size);
+public:
+  CRecoveryRecordWriter(): _pos(0), _recordStart(0) {}
+  void Clear() { _pos = 0; }
+  size_t GetSize() const { return _pos; }
+  const Byte *GetData() const { return _buffer; }
+  void BeginRecord();
+  void EndRecord();
+  void WriteByte(Byte b);
+  void WriteBool(bool b) { WriteByte(b ? 1 : 0); }
+  void WriteUInt32(UInt32 value);
+  void WriteUInt64(UInt64 value);
+  void WriteBytes(const void *data, size_t size);
+  void WriteString(const UString &s);
+};
+
 class CHandler:
   #ifndef EXTRACT_ONLY
   public NArchive::COutHandler,
@@ -76,6 +125,7 @@ class CHandler:
   #endif
   #ifndef EXTRACT_ONLY
   public IOutArchive,
+  public IUpdateCommitCallback,
   #endif
   PUBLIC_ISetCompressCodecsInfo
   public CMyUnknownImp
@@ -109,6 +159,10 @@ public:
 	UString& itemStatFilter,
 	UString& cocEntryFilter);
   HRESULT SetRecoveryOption(UString& recoveryFileName);
+  #ifndef EXTRACT_ONLY
+  HRESULT WriteCheckpoint(IArchiveUpdateCallback *updateCallback, bool compact);
+  HRESULT FolderCommitted();
+  #endif
   unsigned long long GetFileCount();
   unsigned long long GetTotalPackSize();
   unsigned long long GetRecoveredFileCount();
@@ -120,36 +174,20 @@ public:
 
 private:
   HRESULT UpdateRecoveryData();
+  void CommitRecoveryData();
+  bool IsRecoveryGroupMode() const { return _recoveryGroupSize != 0 || _recoveryGroupTime != 0 || !_recoveryCocPrefix.IsEmpty(); }
 
-  void ReadRecoveryStartPosData(std::ifstream& recoveryStream, CUInt64DefVector& startPos);
-  void ReadRecoveryCTimeData(std::ifstream& recoveryStream, CUInt64DefVector& cTime);
-  void ReadRecoveryMTimeData(std::ifstream& recoveryStream, CUInt64DefVector& mTime);
-  void ReadRecoveryATimeData(std::ifstream& recoveryStream, CUInt64DefVector& aTime);
-  void ReadRecoveryPackCRCsDefinedData(std::ifstream& recoveryStream, CRecordVector<bool>& packCRCsDefined);
-  void ReadRecoveryPackCRCsData(std::ifstream& recoveryStream, CRecordVector<UInt32>& packCRCs);
-  void ReadRecoveryPackSizesData(std::ifstream& recoveryStream, CRecordVector<UInt64>& packSizes);
-  void ReadRecoveryNumUnpackStreamsVectorData(std::ifstream& recoveryStream, CRecordVector<CNum>& numUnpackStreamsVector);
-  void ReadRecoveryIsAntiData(std::ifstream& recoveryStream, CRecordVector<bool>& isAnti);
-  void ReadRecoveryFilesData(std::ifstream& recoveryStream, CObjectVector<CFileItem>& files);
-  void ReadRecoveryFoldersData(std::ifstream& recoveryStream, CObjectVector<CFolder>& folders);
-
-  void WriteRecoveryStartPosData();
-  void WriteRecoveryCTimeData();
-  void WriteRecoveryMTimeData();
-  void WriteRecoveryATimeData();
-  void WriteRecoveryPackCRCsDefinedData();
-  void WriteRecoveryPackCRCsData();
-  void WriteRecoveryPackSizesData();
-  void WriteRecoveryNumUnpackStreamsVectorData();
-  void WriteRecoveryIsAntiData();
-  void WriteRecoveryFilesData();
-  void WriteRecoveryFoldersData();
-
-  bool IsItemFiltered(UString& item, CObjectVector<UString> &filterDirs);
+  void WriteRecoveryRecord();
+  // folders that were written to recovery journal; checkpoint must not remove them
+  int GetNumJournaledFolders() const { return _recoveryStreamOut.is_open() ? _recoveryIndex.lastRecoveryFoldersIndexToUpdate : 0; }
+
+  void MoveFileToTrash(int index);
+  HRESULT MoveDirToTrash(const UString &path);
 
   CMyComPtr<IInStream> _inStream;
   NArchive::N7z::CArchiveDatabaseEx _db;
   NArchive::N7z::CArchiveDatabase _newDB;
+  CNameIndex _nameIndex;   // names of _newDB.Files
   NArchive::N7z::COutArchive _archive;
 
   unsigned long long _totalPackSize;
@@ -161,6 +199,14 @@ private:
   std::fstream _recoveryStreamOut;
 
   CRecoveryIndex _recoveryIndex;
+  CRecoveryRecordWriter _recoveryRecord;
+  UInt32 _recoveryGroupSize;
+  UInt32 _recoveryGroupTime;
+  UString _recoveryCocPrefix;
+  UInt32 _recoveryGroupStartTime;
+
+  bool _keepHeaderChain;   // HSEG: final (numItems == 0) call writes delta header block too.
+                           // Only this handler can open such archive (see NID::kChainedHeader).
 
   #ifndef _NO_CRYPTO
   bool _passwordIsDefined;
@@ -177,8 +223,14 @@ private:
   #else
   
   CRecordVector<CBind> _binds;
+  CUpdateSession _updateSession; // UpdateItems() calls until final (numItems == 0) call
+  UString _sessionPropsKey;      // SetProperties() values that were used for _updateSession encoders
 
   HRESULT SetPassword(CCompressionMethodMode &methodMode, IArchiveUpdateCallback *updateCallback);
+  HRESULT SetUpdateOptions(IArchiveUpdateCallback *updateCallback, UInt32 numItems,
+      CCompressionMethodMode &methodMode,
+      CCompressionMethodMode &headerMethod,
+      CUpdateOptions &options);
 
   HRESULT SetCompressionMethod(CCompressionMethodMode &method,
       CObjectVector<COneMethodInfo> &methodsInfo
@@ -5,6 +5,7 @@
 #include "../../../Windows/PropVariant.h"
 
 #include "../../../Common/ComTry.h"
+#include "../../../Common/IntToString.h"
 #include "../../../Common/StringToInt.h"
 
 #include "../../ICoder.h"
@@ -16,6 +17,12 @@
 #include "7zOut.h"
 #include "7zUpdate.h"
 
+extern "C"
+{
+#include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
+}
+
 using namespace NWindows;
 
 namespace NArchive {
@@ -26,7 +33,9 @@ static const wchar_t *kCopyMethod = L"Copy";
 static const wchar_t *kDefaultMethodName = kLZMAMethodName;
 
 static const wchar_t *kTrashFolderName = L"Trash/";
-static const wchar_t *kRecoverySignature = L"D7ZR";
+// Version 2 of journal: CRC-protected records
+static const UInt32 kRecoverySignatureSize = 8;
+static const Byte kRecoverySignature[kRecoverySignatureSize] = { 'D', '7', 'Z', 'R', 0x1A, 0x0A, 2, 0 };
 
 static const UInt32 kLzmaAlgorithmX5 = 1;
 static const wchar_t *kLzmaMatchFinderForHeaders = L"BT2";
@@ -206,6 +215,36 @@ static HRESULT GetTime(IArchiveUpdateCallback *updateCallback, int index, bool w
   return S_OK;
 }
 
+void CHandler::MoveFileToTrash(int index)
+{
+  CFileItem &file = _newDB.Files[index];
+
+  // Rename the folder path
+  UString name;
+  _newDB.GetPath(index, name);
+  _nameIndex.Remove(name, index);
+  name = kTrashFolderName + name;
+  _newDB.SetPath(index, name);
+  _nameIndex.Add(name, index);
+  _archive.NotifyFileChanged(index);
+
+  // Erase recovery record starting from this position
+  Int64 currentEndOfRecoveryRecord = _recoveryStreamOut.tellp();
+  // Erase everything from this point on
+  if (currentEndOfRecoveryRecord > file.RecoveryRecordPos
+      && file.RecoveryRecordPos > 0)
+  {
+    _recoveryStreamOut.seekp(file.RecoveryRecordPos);
+    size_t emptySize = (size_t)(currentEndOfRecoveryRecord - file.RecoveryRecordPos);
+    CByteBuffer emptyChars;
+    emptyChars.SetCapacity(emptySize);
+    memset(emptyChars, 0, emptySize);
+    _recoveryStreamOut.write(reinterpret_cast <const char*> ((const Byte *)emptyChars), emptySize);
+    _recoveryStreamOut.flush();
+    _recoveryStreamOut.seekp(file.RecoveryRecordPos);
+  }
+}
+
 HRESULT CHandler::MoveItemToTrash(UString &path)
 {
   COM_TRY_BEGIN
@@ -213,529 +252,320 @@ HRESULT CHandler::MoveItemToTrash(UString &path)
   if (!_recoveryStreamOut.is_open())
     return E_FAIL;
 
-  for (int i = 0; i < _newDB.Files.Size(); i++)
-  {
-    if (path == _newDB.Files[i].Name)
-	{
-      if(_newDB.Files.Size() > i)
-	  {
-        // Rename the folder path
-	    _newDB.Files[i].Name = kTrashFolderName + path;
-
-        // Erase recovery record starting from this position
-        Int64 currentEndOfRecoveryRecord = _recoveryStreamOut.tellp();
-        // Erase everything from this point on
-        if (currentEndOfRecoveryRecord > _newDB.Files[i].RecoveryRecordPos
-            && _newDB.Files[i].RecoveryRecordPos > 0)
-        {
-          _recoveryStreamOut.seekp(_newDB.Files[i].RecoveryRecordPos);
-          size_t emptySize = (size_t)(currentEndOfRecoveryRecord - _newDB.Files[i].RecoveryRecordPos);
-          char* emptyChars = (char*)malloc(emptySize);
-          memset(emptyChars, 0, emptySize);
-          _recoveryStreamOut.write(emptyChars, emptySize);
-          _recoveryStreamOut.flush();
-          _recoveryStreamOut.seekp(_newDB.Files[i].RecoveryRecordPos);
-        }
-	  }
+  CommitRecoveryData();
 
-      return S_OK;
-	}
+  _nameIndex.Update(_newDB);
+  int index = _nameIndex.Find(path);
+  if (index >= 0 && !_newDB.Files[index].IsDir)
+  {
+    MoveFileToTrash(index);
+    return S_OK;
   }
-  return S_FALSE;
+  // directory is moved with all its items, so they don't stay without parent
+  return MoveDirToTrash(path);
   COM_TRY_END
 }
 
-bool CHandler::IsItemFiltered(UString& item, CObjectVector<UString> &filterDirs)
+static int CompareIndexes(const int *p1, const int *p2, void * /* param */)
 {
-  for (int filterIndex = 0; filterIndex < filterDirs.Size(); ++filterIndex)
-  {
-    if (item.Left(filterDirs[filterIndex].Length()) == filterDirs[filterIndex])
-      return true;
-  }
-
-  return false;
+  return MyCompare(*p1, *p2);
 }
 
-void CHandler::ReadRecoveryStartPosData(std::ifstream& recoveryStream, CUInt64DefVector& startPos)
-{
-  int startPosSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&startPosSize), sizeof(startPosSize));
-  for (int currStartPos = 0; currStartPos < startPosSize; ++currStartPos)
-  {
-    bool startPosDefined;
-    UInt64 startPosValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&startPosDefined), sizeof(startPosDefined));
-    recoveryStream.read(reinterpret_cast <char*> (&startPosValue), sizeof(startPosValue));
-
-    startPos.ReserveDown();
-    startPos.SetItem(currStartPos, startPosDefined, startPosValue);
-  }
-}
+// It moves item (path) and all items in (path/) to trash.
+// _nameIndex must be updated already.
 
-void CHandler::ReadRecoveryCTimeData(std::ifstream& recoveryStream, CUInt64DefVector& cTime)
+HRESULT CHandler::MoveDirToTrash(const UString &path)
 {
-  int cTimeSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&cTimeSize), sizeof(cTimeSize));
-  for (int currCTime = 0; currCTime < cTimeSize; ++currCTime)
-  {
-    bool cTimeDefined;
-    UInt64 cTimeValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&cTimeDefined), sizeof(cTimeDefined));
-    recoveryStream.read(reinterpret_cast <char*> (&cTimeValue), sizeof(cTimeValue));
+  // "dir/" and "dir" are same directory. Item names use '/' as separator.
+  UString dirPath = NItemName::MakeLegalName(path);
+  while (!dirPath.IsEmpty() && dirPath[dirPath.Length() - 1] == L'/')
+    dirPath.Delete(dirPath.Length() - 1);
+  if (dirPath.IsEmpty())
+    return S_FALSE;
 
-    cTime.ReserveDown();
-    cTime.SetItem(currCTime, cTimeDefined, cTimeValue);
-  }
+  CIntVector indexes;
+  _nameIndex.GetSubtree(dirPath, indexes);
+  if (indexes.IsEmpty())
+    return S_FALSE;
+  indexes.Sort(CompareIndexes, 0);
+  for (int i = 0; i < indexes.Size(); i++)
+    MoveFileToTrash(indexes[i]);
+  return S_OK;
 }
 
-void CHandler::ReadRecoveryMTimeData(std::ifstream& recoveryStream, CUInt64DefVector& mTime)
+void CRecoveryRecordWriter::Reserve(size_t size)
 {
-  int mTimeSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&mTimeSize), sizeof(mTimeSize));
-  for (int currMTime = 0; currMTime < mTimeSize; ++currMTime)
-  {
-    bool mTimeDefined;
-    UInt64 mTimeValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&mTimeDefined), sizeof(mTimeDefined));
-    recoveryStream.read(reinterpret_cast <char*> (&mTimeValue), sizeof(mTimeValue));
-
-    mTime.ReserveDown();
-    mTime.SetItem(currMTime, mTimeDefined, mTimeValue);
-  }
+  size_t newSize = _pos + size;
+  if (newSize <= _buffer.GetCapacity())
+    return;
+  size_t capacity = _buffer.GetCapacity() * 2;
+  if (capacity < newSize)
+    capacity = newSize;
+  if (capacity < (1 << 12))
+    capacity = (1 << 12);
+  _buffer.SetCapacity(capacity);
 }
 
-void CHandler::ReadRecoveryATimeData(std::ifstream& recoveryStream, CUInt64DefVector& aTime)
+void CRecoveryRecordWriter::WriteByte(Byte b)
 {
-  int aTimeSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&aTimeSize), sizeof(aTimeSize));
-  for (int currATime = 0; currATime < aTimeSize; ++currATime)
-  {
-    bool aTimeDefined;
-    UInt64 aTimeValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&aTimeDefined), sizeof(aTimeDefined));
-    recoveryStream.read(reinterpret_cast <char*> (&aTimeValue), sizeof(aTimeValue));
-
-    aTime.ReserveDown();
-    aTime.SetItem(currATime, aTimeDefined, aTimeValue);
-  }
+  Reserve(1);
+  _buffer[_pos++] = b;
 }
 
-void CHandler::ReadRecoveryPackCRCsDefinedData(std::ifstream& recoveryStream, CRecordVector<bool>& packCRCsDefined)
+void CRecoveryRecordWriter::WriteUInt32(UInt32 value)
 {
-  int packCRCsDefinedSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&packCRCsDefinedSize), sizeof(packCRCsDefinedSize));
-  for (int currPackCRCsDefined = 0; currPackCRCsDefined < packCRCsDefinedSize; ++currPackCRCsDefined)
-  {
-    bool packCRCsDefinedValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&packCRCsDefinedValue), sizeof(packCRCsDefinedValue));
-
-    packCRCsDefined.Add(packCRCsDefinedValue);
-  }
+  Reserve(4);
+  for (int i = 0; i < 4; i++, value >>= 8)
+    _buffer[_pos++] = (Byte)value;
 }
 
-void CHandler::ReadRecoveryPackCRCsData(std::ifstream& recoveryStream, CRecordVector<UInt32>& packCRCs)
+void CRecoveryRecordWriter::WriteUInt64(UInt64 value)
 {
-  int packCRCsSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&packCRCsSize), sizeof(packCRCsSize));
-  for (int currPackCRCs = 0; currPackCRCs < packCRCsSize; ++currPackCRCs)
-  {
-    UInt32 packCRCsValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&packCRCsValue), sizeof(packCRCsValue));
-
-    packCRCs.Add(packCRCsValue);
-  }
+  Reserve(8);
+  for (int i = 0; i < 8; i++, value >>= 8)
+    _buffer[_pos++] = (Byte)value;
 }
 
-void CHandler::ReadRecoveryPackSizesData(std::ifstream& recoveryStream, CRecordVector<UInt64>& packSizes)
+void CRecoveryRecordWriter::WriteBytes(const void *data, size_t size)
 {
-  int packSizesSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&packSizesSize), sizeof(packSizesSize));
-  for (int currPackSize = 0; currPackSize < packSizesSize; ++currPackSize)
-  {
-    UInt64 packSizesValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&packSizesValue), sizeof(packSizesValue));
-
-    packSizes.Add(packSizesValue);
-  }
+  Reserve(size);
+  memcpy((Byte *)_buffer + _pos, data, size);
+  _pos += size;
 }
 
-void CHandler::ReadRecoveryNumUnpackStreamsVectorData(std::ifstream& recoveryStream, CRecordVector<CNum>& numUnpackStreamsVector)
+void CRecoveryRecordWriter::WriteString(const UString &s)
 {
-  int numUnpackStreamsVectorSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&numUnpackStreamsVectorSize), sizeof(numUnpackStreamsVectorSize));
-  for (int currNumUnpackStreamsVector = 0; currNumUnpackStreamsVector < numUnpackStreamsVectorSize; ++currNumUnpackStreamsVector)
+  int len = s.Length();
+  Reserve((len + 1) * 2);
+  for (int i = 0; i <= len; i++)
   {
-    CNum numUnpackStreamsVectorValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&numUnpackStreamsVectorValue), sizeof(numUnpackStreamsVectorValue));
-
-    numUnpackStreamsVector.Add(numUnpackStreamsVectorValue);
+    wchar_t c = s[i];
+    _buffer[_pos++] = (Byte)c;
+    _buffer[_pos++] = (Byte)(c >> 8);
   }
 }
 
-void CHandler::ReadRecoveryIsAntiData(std::ifstream& recoveryStream, CRecordVector<bool>& isAnti)
+void CRecoveryRecordWriter::BeginRecord()
 {
-  int isAntiSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&isAntiSize), sizeof(isAntiSize));
-  for (int currIsAnti = 0; currIsAnti < isAntiSize; ++currIsAnti)
-  {
-    bool isAntiValue;
-
-    recoveryStream.read(reinterpret_cast <char*> (&isAntiValue), sizeof(isAntiValue));
-
-    isAnti.Add(isAntiValue);
-  }
+  Reserve(kRecoveryRecordHeaderSize);
+  _recordStart = _pos;
+  _pos += kRecoveryRecordHeaderSize;
 }
 
-void CHandler::ReadRecoveryFilesData(std::ifstream& recoveryStream, CObjectVector<CFileItem>& files)
+void CRecoveryRecordWriter::EndRecord()
 {
-  int filesSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&filesSize), sizeof(filesSize));
-  for (int currFile = 0; currFile < filesSize; ++currFile)
-  {
-    CFileItem fileItem;
-      
-    //    Attrib
-    recoveryStream.read(reinterpret_cast <char*> (&fileItem.Attrib), sizeof(fileItem.Attrib));
-    //    AttribDefined
-    recoveryStream.read(reinterpret_cast <char*> (&fileItem.AttribDefined), sizeof(fileItem.AttribDefined));
-    //    Crc
-    recoveryStream.read(reinterpret_cast <char*> (&fileItem.Crc), sizeof(fileItem.Crc));
-    //    CrcDefined
-    recoveryStream.read(reinterpret_cast <char*> (&fileItem.CrcDefined), sizeof(fileItem.CrcDefined));
-    //    HasStream
-    recoveryStream.read(reinterpret_cast <char*> (&fileItem.HasStream), sizeof(fileItem.HasStream));
-    //    IsDir
-    recoveryStream.read(reinterpret_cast <char*> (&fileItem.IsDir), sizeof(fileItem.IsDir));
-    //    Length of name including null terminated character
-    UInt32 nameLength = 0;
-    recoveryStream.read(reinterpret_cast <char*> (&nameLength), sizeof(nameLength));
-    //    Name - UString - wchar_t*
-    UString name;
-    wchar_t* nameBuffer = name.GetBuffer(nameLength);
-    recoveryStream.read(reinterpret_cast <char*> (nameBuffer), sizeof(wchar_t) * nameLength);
-    fileItem.Name = nameBuffer;
-    //    Size
-    recoveryStream.read(reinterpret_cast <char*> (&fileItem.Size), sizeof(fileItem.Size));
-
-    files.Add(fileItem);
-  }
+  Byte *buf = (Byte *)_buffer + _recordStart;
+  SetUi32(buf + 4, (UInt32)(_pos - _recordStart - kRecoveryRecordHeaderSize));
+  SetUi32(buf, CrcCalc(buf + 4, _pos - _recordStart - 4));
 }
 
-void CHandler::ReadRecoveryFoldersData(std::ifstream& recoveryStream, CObjectVector<CFolder>& folders)
+static void WriteRecoveryDefVector(CRecoveryRecordWriter &record, const CUInt64DefVector &v, int &startIndex)
 {
-  int foldersSize = 0;
-  recoveryStream.read(reinterpret_cast <char*> (&foldersSize), sizeof(foldersSize));
-  for (int currFolder = 0; currFolder < foldersSize; ++currFolder)
+  record.WriteUInt32(v.Defined.Size() - startIndex);
+  for (int i = startIndex; i < v.Defined.Size(); i++)
   {
-    CFolder folderItem;
-
-    //     BindPairs
-    // =============================================
-    int bindPairsSize = 0;
-    recoveryStream.read(reinterpret_cast <char*> (&bindPairsSize), sizeof(bindPairsSize));
-    for(int currBindPair = 0; currBindPair < bindPairsSize; ++currBindPair)
-    {
-      CBindPair bindPair;
-      //     InIndex
-      recoveryStream.read(reinterpret_cast <char*> (&bindPair.InIndex), sizeof(bindPair.InIndex));
-      //     OutIdex
-      recoveryStream.read(reinterpret_cast <char*> (&bindPair.OutIndex), sizeof(bindPair.OutIndex));
-
-      folderItem.BindPairs.Add(bindPair);
-    }
-    //    Coders
-    // =============================================
-    int codersSize = 0;
-    recoveryStream.read(reinterpret_cast <char*> (&codersSize), sizeof(codersSize));
-    for(int currCoder = 0; currCoder < codersSize; ++currCoder)
-    {
-      CCoderInfo coder;
-
-      //      MethodID
-      recoveryStream.read(reinterpret_cast <char*> (&coder.MethodID), sizeof(coder.MethodID));
-      //      NumInStreams
-      recoveryStream.read(reinterpret_cast <char*> (&coder.NumInStreams), sizeof(coder.NumInStreams));
-      //      NumOutStreams
-      recoveryStream.read(reinterpret_cast <char*> (&coder.NumOutStreams), sizeof(coder.NumOutStreams));
-      //      Props
-      int bufferCapacity = 0;
-      recoveryStream.read(reinterpret_cast <char*> (&bufferCapacity), sizeof(bufferCapacity));
-      coder.Props.SetCapacity(bufferCapacity);
-      if (bufferCapacity != 0)
-        recoveryStream.read(reinterpret_cast <char*> (&coder.Props[0]), bufferCapacity);
-
-      folderItem.Coders.Add(coder);
-    }
-    //    PackStreams
-    int packStreamsSize = 0;
-    recoveryStream.read(reinterpret_cast <char*> (&packStreamsSize), sizeof(packStreamsSize));
-    for(int currPackStream = 0; currPackStream < packStreamsSize; ++currPackStream)
-    {
-      CNum packStream;
-      recoveryStream.read(reinterpret_cast <char*> (&packStream), sizeof(packStream));
-
-      folderItem.PackStreams.Add(packStream);
-    }
-    //    UnpackCRC
-    recoveryStream.read(reinterpret_cast <char*> (&folderItem.UnpackCRC), sizeof(folderItem.UnpackCRC));
-    //    UnpackCRCDefined
-    recoveryStream.read(reinterpret_cast <char*> (&folderItem.UnpackCRCDefined), sizeof(folderItem.UnpackCRCDefined));
-    //    UnpackSizes
-    int unpackSizesSize = 0;
-    recoveryStream.read(reinterpret_cast <char*> (&unpackSizesSize), sizeof(unpackSizesSize));
-    for(int currUnpackSize = 0; currUnpackSize < unpackSizesSize; ++currUnpackSize)
-    {
-      UInt64 unpackSize;
-      recoveryStream.read(reinterpret_cast <char*> (&unpackSize), sizeof(unpackSize));
-
-      folderItem.UnpackSizes.Add(unpackSize);
-    }
-
-    folders.Add(folderItem);
+    UInt64 value;
+    record.WriteBool(v.GetItem(i, value));
+    record.WriteUInt64(value);
   }
+  startIndex = v.Defined.Size();
 }
 
-void CHandler::WriteRecoveryStartPosData()
-{
-  int startPosSize = _newDB.StartPos.Defined.Size() - _recoveryIndex.lastRecoveryStartPosIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&startPosSize), sizeof(startPosSize));
-  for (int currStartPos = _recoveryIndex.lastRecoveryStartPosIndexToUpdate; currStartPos < _newDB.StartPos.Defined.Size(); ++currStartPos)
-  {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.StartPos.Defined[currStartPos]), sizeof(_newDB.StartPos.Defined[currStartPos]));
-    if (_newDB.StartPos.Defined[currStartPos])
-    {
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.StartPos.Values[currStartPos]), sizeof(_newDB.StartPos.Values[currStartPos]));
-    }
-    else
-    {
-      UInt64 noValue = 0;
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&noValue), sizeof(noValue));
-    }
-  }
-
-  _recoveryIndex.lastRecoveryStartPosIndexToUpdate = _newDB.StartPos.Defined.Size();
-}
-
-void CHandler::WriteRecoveryCTimeData()
+static void ReadRecoveryDefVector(CInByte2 &inByte, CUInt64DefVector &v)
 {
-  int cTimeSize = _newDB.CTime.Defined.Size() - _recoveryIndex.lastRecoveryCTimeIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&cTimeSize), sizeof(cTimeSize));
-  for (int currCTime = _recoveryIndex.lastRecoveryCTimeIndexToUpdate; currCTime < _newDB.CTime.Defined.Size(); ++currCTime)
+  UInt32 num = inByte.ReadUInt32();
+  for (UInt32 i = 0; i < num; i++)
   {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.CTime.Defined[currCTime]), sizeof(_newDB.CTime.Defined[currCTime]));
-    if (_newDB.CTime.Defined[currCTime])
-    {
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.CTime.Values[currCTime]), sizeof(_newDB.CTime.Values[currCTime]));
-    }
-    else
-    {
-      UInt64 noValue = 0;
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&noValue), sizeof(noValue));
-    }
+    bool defined = (inByte.ReadByte() != 0);
+    UInt64 value = inByte.ReadUInt64();
+    v.SetItem(v.Defined.Size(), defined, value);
   }
-
-  _recoveryIndex.lastRecoveryCTimeIndexToUpdate = _newDB.CTime.Defined.Size();
 }
 
-void CHandler::WriteRecoveryMTimeData()
+void CHandler::WriteRecoveryRecord()
 {
-  int mTimeSize = _newDB.MTime.Defined.Size() - _recoveryIndex.lastRecoveryMTimeIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&mTimeSize), sizeof(mTimeSize));
-  for (int currMTime = _recoveryIndex.lastRecoveryMTimeIndexToUpdate; currMTime < _newDB.MTime.Defined.Size(); ++currMTime)
+  CRecoveryRecordWriter &record = _recoveryRecord;
+  CRecoveryIndex &ri = _recoveryIndex;
+  int i;
+
+  record.BeginRecord();
+
+  WriteRecoveryDefVector(record, _newDB.StartPos, ri.lastRecoveryStartPosIndexToUpdate);
+  WriteRecoveryDefVector(record, _newDB.CTime, ri.lastRecoveryCTimeIndexToUpdate);
+  WriteRecoveryDefVector(record, _newDB.MTime, ri.lastRecoveryMTimeIndexToUpdate);
+  WriteRecoveryDefVector(record, _newDB.ATime, ri.lastRecoveryATimeIndexToUpdate);
+
+  record.WriteUInt32(_newDB.PackCRCsDefined.Size() - ri.lastRecoveryPackCRCsDefinedIndexToUpdate);
+  for (i = ri.lastRecoveryPackCRCsDefinedIndexToUpdate; i < _newDB.PackCRCsDefined.Size(); i++)
+    record.WriteBool(_newDB.PackCRCsDefined[i]);
+  ri.lastRecoveryPackCRCsDefinedIndexToUpdate = _newDB.PackCRCsDefined.Size();
+
+  record.WriteUInt32(_newDB.PackCRCs.Size() - ri.lastRecoveryPackCRCsIndexToUpdate);
+  for (i = ri.lastRecoveryPackCRCsIndexToUpdate; i < _newDB.PackCRCs.Size(); i++)
+    record.WriteUInt32(_newDB.PackCRCs[i]);
+  ri.lastRecoveryPackCRCsIndexToUpdate = _newDB.PackCRCs.Size();
+
+  record.WriteUInt32(_newDB.PackSizes.Size() - ri.lastRecoveryPackSizesIndexToUpdate);
+  for (i = ri.lastRecoveryPackSizesIndexToUpdate; i < _newDB.PackSizes.Size(); i++)
+    record.WriteUInt64(_newDB.PackSizes[i]);
+  ri.lastRecoveryPackSizesIndexToUpdate = _newDB.PackSizes.Size();
+
+  record.WriteUInt32(_newDB.NumUnpackStreamsVector.Size() - ri.lastRecoveryNumUnpackStreamsVectorIndexToUpdate);
+  for (i = ri.lastRecoveryNumUnpackStreamsVectorIndexToUpdate; i < _newDB.NumUnpackStreamsVector.Size(); i++)
+    record.WriteUInt32(_newDB.NumUnpackStreamsVector[i]);
+  ri.lastRecoveryNumUnpackStreamsVectorIndexToUpdate = _newDB.NumUnpackStreamsVector.Size();
+
+  record.WriteUInt32(_newDB.IsAnti.Size() - ri.lastRecoveryIsAntiIndexToUpdate);
+  for (i = ri.lastRecoveryIsAntiIndexToUpdate; i < _newDB.IsAnti.Size(); i++)
+    record.WriteBool(_newDB.IsAnti[i]);
+  ri.lastRecoveryIsAntiIndexToUpdate = _newDB.IsAnti.Size();
+
+  record.WriteUInt32(_newDB.Files.Size() - ri.lastRecoveryFilesIndexToUpdate);
+  UString name;
+  for (i = ri.lastRecoveryFilesIndexToUpdate; i < _newDB.Files.Size(); i++)
   {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.MTime.Defined[currMTime]), sizeof(_newDB.MTime.Defined[currMTime]));
-    if (_newDB.MTime.Defined[currMTime])
-    {
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.MTime.Values[currMTime]), sizeof(_newDB.MTime.Values[currMTime]));
-    }
-    else
-    {
-      UInt64 noValue = 0;
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&noValue), sizeof(noValue));
-    }
+    const CFileItem &file = _newDB.Files[i];
+    record.WriteUInt32(file.Attrib);
+    record.WriteBool(file.AttribDefined);
+    record.WriteUInt32(file.Crc);
+    record.WriteBool(file.CrcDefined);
+    record.WriteBool(file.HasStream);
+    record.WriteBool(file.IsDir);
+    _newDB.GetPath(i, name);
+    record.WriteString(name);
+    record.WriteUInt64(file.Size);
   }
+  ri.lastRecoveryFilesIndexToUpdate = _newDB.Files.Size();
 
-  _recoveryIndex.lastRecoveryMTimeIndexToUpdate = _newDB.MTime.Defined.Size();
-}
-
-void CHandler::WriteRecoveryATimeData()
-{
-  int aTimeSize = _newDB.ATime.Defined.Size() - _recoveryIndex.lastRecoveryATimeIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&aTimeSize), sizeof(aTimeSize));
-  for (int currATime = _recoveryIndex.lastRecoveryATimeIndexToUpdate; currATime < _newDB.ATime.Defined.Size(); ++currATime)
+  record.WriteUInt32(_newDB.Folders.Size() - ri.lastRecoveryFoldersIndexToUpdate);
+  for (i = ri.lastRecoveryFoldersIndexToUpdate; i < _newDB.Folders.Size(); i++)
   {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.ATime.Defined[currATime]), sizeof(_newDB.ATime.Defined[currATime]));
-    if (_newDB.ATime.Defined[currATime])
+    const CFolder &folder = _newDB.Folders[i];
+    int j;
+    record.WriteUInt32(folder.BindPairs.Size());
+    for (j = 0; j < folder.BindPairs.Size(); j++)
     {
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.ATime.Values[currATime]), sizeof(_newDB.ATime.Values[currATime]));
+      record.WriteUInt32(folder.BindPairs[j].InIndex);
+      record.WriteUInt32(folder.BindPairs[j].OutIndex);
     }
-    else
+    record.WriteUInt32(folder.Coders.Size());
+    for (j = 0; j < folder.Coders.Size(); j++)
     {
-      UInt64 noValue = 0;
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&noValue), sizeof(noValue));
+      const CCoderInfo &coder = folder.Coders[j];
+      record.WriteUInt64(coder.MethodID);
+      record.WriteUInt32(coder.NumInStreams);
+      record.WriteUInt32(coder.NumOutStreams);
+      record.WriteUInt32((UInt32)coder.Props.GetCapacity());
+      record.WriteBytes(coder.Props, coder.Props.GetCapacity());
     }
+    record.WriteUInt32(folder.PackStreams.Size());
+    for (j = 0; j < folder.PackStreams.Size(); j++)
+      record.WriteUInt32(folder.PackStreams[j]);
+    record.WriteUInt32(folder.UnpackCRC);
+    record.WriteBool(folder.UnpackCRCDefined);
+    record.WriteUInt32(folder.UnpackSizes.Size());
+    for (j = 0; j < folder.UnpackSizes.Size(); j++)
+      record.WriteUInt64(folder.UnpackSizes[j]);
   }
+  ri.lastRecoveryFoldersIndexToUpdate = _newDB.Folders.Size();
 
-  _recoveryIndex.lastRecoveryATimeIndexToUpdate = _newDB.ATime.Defined.Size();
+  record.EndRecord();
 }
 
-void CHandler::WriteRecoveryPackCRCsDefinedData()
-{
-  int packCRCsDefinedSize = _newDB.PackCRCsDefined.Size() - _recoveryIndex.lastRecoveryPackCRCsDefinedIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&packCRCsDefinedSize), sizeof(packCRCsDefinedSize));
-  for (int currPackCRCsDefined = _recoveryIndex.lastRecoveryPackCRCsDefinedIndexToUpdate; currPackCRCsDefined < _newDB.PackCRCsDefined.Size(); ++currPackCRCsDefined)
-  {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.PackCRCsDefined[currPackCRCsDefined]), sizeof(_newDB.PackCRCsDefined[currPackCRCsDefined]));
-  }
-
-  _recoveryIndex.lastRecoveryPackCRCsDefinedIndexToUpdate = _newDB.PackCRCsDefined.Size();
-}
+// It appends the items of record to db.
 
-void CHandler::WriteRecoveryPackCRCsData()
+static void ReadRecoveryRecord(CInByte2 &inByte, CArchiveDatabase &db)
 {
-  int packCRCsSize = _newDB.PackCRCs.Size() - _recoveryIndex.lastRecoveryPackCRCsIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&packCRCsSize), sizeof(packCRCsSize));
-  for (int currPackCRCs = _recoveryIndex.lastRecoveryPackCRCsIndexToUpdate; currPackCRCs < _newDB.PackCRCs.Size(); ++currPackCRCs)
-  {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.PackCRCs[currPackCRCs]), sizeof(_newDB.PackCRCs[currPackCRCs]));
-  }
+  UInt32 num, i;
 
-  _recoveryIndex.lastRecoveryPackCRCsIndexToUpdate = _newDB.PackCRCs.Size();
-}
+  ReadRecoveryDefVector(inByte, db.StartPos);
+  ReadRecoveryDefVector(inByte, db.CTime);
+  ReadRecoveryDefVector(inByte, db.MTime);
+  ReadRecoveryDefVector(inByte, db.ATime);
 
-void CHandler::WriteRecoveryPackSizesData()
-{
-  int packSizesSize = _newDB.PackSizes.Size() - _recoveryIndex.lastRecoveryPackSizesIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&packSizesSize), sizeof(packSizesSize));
-  for (int currPackSize = _recoveryIndex.lastRecoveryPackSizesIndexToUpdate; currPackSize < _newDB.PackSizes.Size(); ++currPackSize)
-  {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.PackSizes[currPackSize]), sizeof(_newDB.PackSizes[currPackSize]));
-    _totalPackSize += _newDB.PackSizes[currPackSize];
-  }
-
-  _recoveryIndex.lastRecoveryPackSizesIndexToUpdate = _newDB.PackSizes.Size();
-}
+  num = inByte.ReadUInt32();
+  for (i = 0; i < num; i++)
+    db.PackCRCsDefined.Add(inByte.ReadByte() != 0);
 
-void CHandler::WriteRecoveryNumUnpackStreamsVectorData()
-{
-  int numUnpackStreamsVectorSize = _newDB.NumUnpackStreamsVector.Size() - _recoveryIndex.lastRecoveryNumUnpackStreamsVectorIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&numUnpackStreamsVectorSize), sizeof(numUnpackStreamsVectorSize));
-  for (int currNumUnpackStreamsVector = _recoveryIndex.lastRecoveryNumUnpackStreamsVectorIndexToUpdate; currNumUnpackStreamsVector < _newDB.NumUnpackStreamsVector.Size(); ++currNumUnpackStreamsVector)
-  {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.NumUnpackStreamsVector[currNumUnpackStreamsVector]), sizeof(_newDB.NumUnpackStreamsVector[currNumUnpackStreamsVector]));
-  }
+  num = inByte.ReadUInt32();
+  for (i = 0; i < num; i++)
+    db.PackCRCs.Add(inByte.ReadUInt32());
 
-  _recoveryIndex.lastRecoveryNumUnpackStreamsVectorIndexToUpdate = _newDB.NumUnpackStreamsVector.Size();
-}
+  num = inByte.ReadUInt32();
+  for (i = 0; i < num; i++)
+    db.PackSizes.Add(inByte.ReadUInt64());
 
-void CHandler::WriteRecoveryIsAntiData()
-{
-  int isAntiSize = _newDB.IsAnti.Size() - _recoveryIndex.lastRecoveryIsAntiIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&isAntiSize), sizeof(isAntiSize));
-  for (int currIsAnti = _recoveryIndex.lastRecoveryIsAntiIndexToUpdate; currIsAnti < _newDB.IsAnti.Size(); ++currIsAnti)
-  {
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.IsAnti[currIsAnti]), sizeof(_newDB.IsAnti[currIsAnti]));
-  }
+  num = inByte.ReadUInt32();
+  for (i = 0; i < num; i++)
+    db.NumUnpackStreamsVector.Add(inByte.ReadUInt32());
 
-  _recoveryIndex.lastRecoveryIsAntiIndexToUpdate = _newDB.IsAnti.Size();
-}
+  num = inByte.ReadUInt32();
+  for (i = 0; i < num; i++)
+    db.IsAnti.Add(inByte.ReadByte() != 0);
 
-void CHandler::WriteRecoveryFilesData()
-{
-  int filesSize = _newDB.Files.Size() - _recoveryIndex.lastRecoveryFilesIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&filesSize), sizeof(filesSize));
-  for (int currFile = _recoveryIndex.lastRecoveryFilesIndexToUpdate; currFile < _newDB.Files.Size(); ++currFile)
+  num = inByte.ReadUInt32();
+  UString name;
+  for (i = 0; i < num; i++)
   {
-    //    Attrib
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].Attrib), sizeof(_newDB.Files[currFile].Attrib));
-    //    AttribDefined
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].AttribDefined), sizeof(_newDB.Files[currFile].AttribDefined));
-    //    Crc
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].Crc), sizeof(_newDB.Files[currFile].Crc));
-    //    CrcDefined
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].CrcDefined), sizeof(_newDB.Files[currFile].CrcDefined));
-    //    HasStream
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].HasStream), sizeof(_newDB.Files[currFile].HasStream));
-    //    IsDir
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].IsDir), sizeof(_newDB.Files[currFile].IsDir));
-    //    Length of name including null terminated character
-    UInt32 nameLength = _newDB.Files[currFile].Name.Length() + 1;
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&nameLength), sizeof(nameLength));
-    //    Name - UString - wchar_t*
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].Name[0]), sizeof(wchar_t) * nameLength);
-    //    Size
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Files[currFile].Size), sizeof(_newDB.Files[currFile].Size));
+    int fileIndex = db.Files.Add(CFileItem());
+    CFileItem &file = db.Files[fileIndex];
+    file.Attrib = inByte.ReadUInt32();
+    file.AttribDefined = (inByte.ReadByte() != 0);
+    file.Crc = inByte.ReadUInt32();
+    file.CrcDefined = (inByte.ReadByte() != 0);
+    file.HasStream = (inByte.ReadByte() != 0);
+    file.IsDir = (inByte.ReadByte() != 0);
+    inByte.ReadString(name);
+    db.SetPath(fileIndex, name);
+    file.Size = inByte.ReadUInt64();
+    file.RecoveryRecordPos = 0;
   }
 
-  _recoveryIndex.lastRecoveryFilesIndexToUpdate = _newDB.Files.Size();
-}
-
-void CHandler::WriteRecoveryFoldersData()
-{
-  int foldersSize = _newDB.Folders.Size() - _recoveryIndex.lastRecoveryFoldersIndexToUpdate;
-  _recoveryStreamOut.write(reinterpret_cast <const char*> (&foldersSize), sizeof(foldersSize));
-  for (int currFolder = _recoveryIndex.lastRecoveryFoldersIndexToUpdate; currFolder < _newDB.Folders.Size(); ++currFolder)
+  num = inByte.ReadUInt32();
+  for (i = 0; i < num; i++)
   {
-    //     BindPairs
-    int bindPairSize = _newDB.Folders[currFolder].BindPairs.Size();
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&bindPairSize), sizeof(bindPairSize));
-    for(int currBindPair = 0; currBindPair < bindPairSize; ++currBindPair)
-    {
-      //      InIndex
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].BindPairs[currBindPair].InIndex), sizeof(_newDB.Folders[currFolder].BindPairs[currBindPair].InIndex));
-	  //      OutIdex
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].BindPairs[currBindPair].OutIndex), sizeof(_newDB.Folders[currFolder].BindPairs[currBindPair].OutIndex));
-    }
-
-    //    Coders
-    int coderSize = _newDB.Folders[currFolder].Coders.Size();
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&coderSize), sizeof(coderSize));
-    for(int currCoder = 0; currCoder < coderSize; ++currCoder)
-    {
-      //      MethodID
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].Coders[currCoder].MethodID), sizeof(_newDB.Folders[currFolder].Coders[currCoder].MethodID));
-      //      NumInStreams
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].Coders[currCoder].NumInStreams), sizeof(_newDB.Folders[currFolder].Coders[currCoder].NumInStreams));
-      //      NumOutStreams
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].Coders[currCoder].NumOutStreams), sizeof(_newDB.Folders[currFolder].Coders[currCoder].NumOutStreams));
-      //      Props
-      int bufferCapacity = _newDB.Folders[currFolder].Coders[currCoder].Props.GetCapacity();
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&bufferCapacity), sizeof(bufferCapacity));
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].Coders[currCoder].Props[0]), bufferCapacity);
-    }
-
-    //    PackStreams
-    int packStreamsSize = _newDB.Folders[currFolder].PackStreams.Size();
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&packStreamsSize), sizeof(packStreamsSize));
-    for(int currPackStream = 0; currPackStream < packStreamsSize; ++currPackStream)
+    CFolder &folder = db.Folders[db.Folders.Add(CFolder())];
+    UInt32 numItems, j;
+    numItems = inByte.ReadUInt32();
+    for (j = 0; j < numItems; j++)
     {
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].PackStreams[currPackStream]), sizeof(_newDB.Folders[currFolder].PackStreams[currPackStream]));
+      CBindPair bindPair;
+      bindPair.InIndex = inByte.ReadUInt32();
+      bindPair.OutIndex = inByte.ReadUInt32();
+      folder.BindPairs.Add(bindPair);
     }
-
-    //    UnpackCRC
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].UnpackCRC), sizeof(_newDB.Folders[currFolder].UnpackCRC));
-
-    //    UnpackCRCDefined
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].UnpackCRCDefined), sizeof(_newDB.Folders[currFolder].UnpackCRCDefined));
-
-	//    UnpackSizes
-    int unpackSizesSize = _newDB.Folders[currFolder].UnpackSizes.Size();
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (&unpackSizesSize), sizeof(unpackSizesSize));
-    for(int currUnpackSize = 0; currUnpackSize < unpackSizesSize; ++currUnpackSize)
+    numItems = inByte.ReadUInt32();
+    for (j = 0; j < numItems; j++)
     {
-      _recoveryStreamOut.write(reinterpret_cast <const char*> (&_newDB.Folders[currFolder].UnpackSizes[currUnpackSize]), sizeof(_newDB.Folders[currFolder].UnpackSizes[currUnpackSize]));
+      CCoderInfo &coder = folder.Coders[folder.Coders.Add(CCoderInfo())];
+      coder.MethodID = inByte.ReadUInt64();
+      coder.NumInStreams = inByte.ReadUInt32();
+      coder.NumOutStreams = inByte.ReadUInt32();
+      UInt32 propsSize = inByte.ReadUInt32();
+      coder.Props.SetCapacity(propsSize);
+      inByte.ReadBytes(coder.Props, propsSize);
     }
+    numItems = inByte.ReadUInt32();
+    for (j = 0; j < numItems; j++)
+      folder.PackStreams.Add(inByte.ReadUInt32());
+    folder.UnpackCRC = inByte.ReadUInt32();
+    folder.UnpackCRCDefined = (inByte.ReadByte() != 0);
+    numItems = inByte.ReadUInt32();
+    for (j = 0; j < numItems; j++)
+      folder.UnpackSizes.Add(inByte.ReadUInt64());
   }
+}
 
-  _recoveryIndex.lastRecoveryFoldersIndexToUpdate = _newDB.Folders.Size();
+void CHandler::CommitRecoveryData()
+{
+  if (_recoveryRecord.GetSize() == 0)
+    return;
+  if (_recoveryStreamOut.is_open())
+  {
+    _recoveryStreamOut.write(reinterpret_cast <const char*> (_recoveryRecord.GetData()), _recoveryRecord.GetSize());
+    _recoveryStreamOut.flush();
+  }
+  _recoveryRecord.Clear();
 }
 
 HRESULT CHandler::UpdateRecoveryData()
@@ -748,22 +578,32 @@ HRESULT CHandler::UpdateRecoveryData()
   // Update start of recovery position for the item in the recovery file
   if (_recoveryIndex.lastRecoveryFilesIndexToUpdate < _newDB.Files.Size())
   {
-    _newDB.Files[_recoveryIndex.lastRecoveryFilesIndexToUpdate].RecoveryRecordPos = _recoveryStreamOut.tellp();
+    _newDB.Files[_recoveryIndex.lastRecoveryFilesIndexToUpdate].RecoveryRecordPos =
+        (Int64)_recoveryStreamOut.tellp() + (Int64)_recoveryRecord.GetSize();
   }
 
-  WriteRecoveryStartPosData();
-  WriteRecoveryCTimeData();
-  WriteRecoveryMTimeData();
-  WriteRecoveryATimeData();
-  WriteRecoveryPackCRCsDefinedData();
-  WriteRecoveryPackCRCsData();
-  WriteRecoveryPackSizesData();
-  WriteRecoveryNumUnpackStreamsVectorData();
-  WriteRecoveryIsAntiData();
-  WriteRecoveryFilesData();
-  WriteRecoveryFoldersData();
+  int numFilesPrev = _recoveryIndex.lastRecoveryFilesIndexToUpdate;
+  if (_recoveryRecord.GetSize() == 0)
+    _recoveryGroupStartTime = ::GetTickCount();
 
-  _recoveryStreamOut.flush();
+  WriteRecoveryRecord();
+
+  if (IsRecoveryGroupMode())
+  {
+    bool isCoc = false;
+    if (!_recoveryCocPrefix.IsEmpty() && _newDB.Files.Size() > numFilesPrev)
+    {
+      UString name;
+      _newDB.GetPath(_newDB.Files.Size() - 1, name);
+      isCoc = NameHasPrefix(name, _recoveryCocPrefix);
+    }
+    if (!isCoc &&
+        (_recoveryGroupSize == 0 || _recoveryRecord.GetSize() < _recoveryGroupSize) &&
+        (_recoveryGroupTime == 0 || ::GetTickCount() - _recoveryGroupStartTime < _recoveryGroupTime))
+      return S_OK;
+  }
+
+  CommitRecoveryData();
 
   return S_OK;
   COM_TRY_END
@@ -783,214 +623,178 @@ HRESULT CHandler::OpenWithRecoveryData(UString& recoveryFileName,
   if (NULL != _archive.SeqStream)
 	  return S_FALSE;
 
-  std::ifstream recoveryStream(recoveryFileName, std::ios::binary);
-  if (!recoveryStream.is_open())
-    return E_FAIL;
-
-  // Last coc index is used to exclude all items
-  // that were written without a valid Coc entry
-  int lastCocStartPosSize = 0;
-  int lastCocCTimeSize = 0;
-  int lastCocMTimeSize = 0;
-  int lastCocATimeSize = 0;
-  int lastCocPackCRCsDefinedSize = 0;
-  int lastCocPackCRCsSize = 0;
-  int lastCocFilesSize = 0;
-  int lastCocFoldersSize = 0;
-  int lastCocPackSizesSize = 0;
-  int lastCocNumUnpackStreamsVectorSize = 0;
-  int lastCocIsAntiSize = 0;
-
-  // 7-ZIP RECOVERY SIGNATURE ( 4 Bytes )
-  // =============================================
-  int signatureLength = wcslen(kRecoverySignature) + 1;
-  UString signature;
-  recoveryStream.read(reinterpret_cast <char*> (signature.GetBuffer(signatureLength)), signatureLength * sizeof(wchar_t));
+  // The journal is read with one call and replayed from memory
+  CByteBuffer journal;
+  size_t journalSize;
+  {
+    std::ifstream recoveryStream(recoveryFileName, std::ios::binary | std::ios::ate);
+    if (!recoveryStream.is_open())
+      return E_FAIL;
+    std::streamoff fileSize = recoveryStream.tellg();
+    if (fileSize < (std::streamoff)kRecoverySignatureSize || (UInt64)fileSize != (size_t)fileSize)
+      return E_FAIL;
+    journalSize = (size_t)fileSize;
+    journal.SetCapacity(journalSize);
+    recoveryStream.seekg(0);
+    recoveryStream.read(reinterpret_cast <char*> ((Byte *)journal), journalSize);
+    if ((size_t)recoveryStream.gcount() != journalSize)
+      return E_FAIL;
+  }
+  const Byte *buf = journal;
 
   // If signature does not match, we can't recover
-  if (signature != kRecoverySignature)
+  if (memcmp(buf, kRecoverySignature, kRecoverySignatureSize) != 0)
+    return E_FAIL;
+
+  // First pass: find the records with correct CRC
+  size_t validEnd = kRecoverySignatureSize;
+  int numRecords = 0;
+  for (;;)
   {
-    recoveryStream.close();
-	return E_FAIL;
+    if (journalSize - validEnd < kRecoveryRecordHeaderSize)
+      break;
+    const Byte *p = buf + validEnd;
+    UInt32 dataSize = GetUi32(p + 4);
+    if (dataSize == 0 || dataSize > journalSize - validEnd - kRecoveryRecordHeaderSize)
+      break;
+    if (GetUi32(p) != CrcCalc(p + 4, dataSize + 4))
+      break;
+    validEnd += kRecoveryRecordHeaderSize + dataSize;
+    numRecords++;
   }
 
-  fpos_t validRecoveryStreamEndPos = recoveryStream.tellg().seekpos();
-
   // We will clear all of the existing DB state and try to recover it
   _newDB.Clear();
 
-  while(true)
+  // Usually each record contains one file, one folder and one pack stream
+  _newDB.Files.Reserve(numRecords);
+  _newDB.Folders.Reserve(numRecords);
+  _newDB.PackSizes.Reserve(numRecords);
+  _newDB.PackCRCsDefined.Reserve(numRecords);
+  _newDB.NumUnpackStreamsVector.Reserve(numRecords);
+  _newDB.IsAnti.Reserve(numRecords);
+  _newDB.StartPos.Defined.Reserve(numRecords);
+  _newDB.CTime.Defined.Reserve(numRecords);
+  _newDB.CTime.Values.Reserve(numRecords);
+  _newDB.MTime.Defined.Reserve(numRecords);
+  _newDB.MTime.Values.Reserve(numRecords);
+  _newDB.ATime.Defined.Reserve(numRecords);
+  _newDB.ATime.Values.Reserve(numRecords);
+
+  // Last coc index is used to exclude all items
+  // that were written without a valid Coc entry
+  CRecoveryIndex lastCoc;
+  lastCoc.Init();
+  size_t validRecoveryStreamEndPos = kRecoverySignatureSize;
+
+  CPrefixFilter filter;
+  filter.Init(filterDirs);
+
+  UString name;
+  size_t pos = kRecoverySignatureSize;
+  while (pos < validEnd)
   {
-    // StartPos
-    // =============================================
-    CUInt64DefVector startPos;
-    ReadRecoveryStartPosData(recoveryStream, startPos);
-
-    // CTime
-    // =============================================
-    CUInt64DefVector cTime;
-    ReadRecoveryCTimeData(recoveryStream, cTime);
-
-    // MTime
-    // =============================================
-    CUInt64DefVector mTime;
-    ReadRecoveryMTimeData(recoveryStream, mTime);
-  
-    // ATime
-    // =============================================
-    CUInt64DefVector aTime;
-    ReadRecoveryATimeData(recoveryStream, aTime);
-
-    // PackCRCsDefined
-    // =============================================
-    CRecordVector<bool> packCRCsDefined;
-    ReadRecoveryPackCRCsDefinedData(recoveryStream, packCRCsDefined);
-
-    // PackCRCs
-    // =============================================
-    CRecordVector<UInt32> packCRCs;
-    ReadRecoveryPackCRCsData(recoveryStream, packCRCs);
-
-    // PackSizes
-    // =============================================
-    CRecordVector<UInt64> packSizes;
-    ReadRecoveryPackSizesData(recoveryStream, packSizes);
-
-   // NumUnpackStreamVector
-   // =============================================
-    CRecordVector<CNum> numUnpackStreamsVector;
-    ReadRecoveryNumUnpackStreamsVectorData(recoveryStream, numUnpackStreamsVector);
-
-    // IsAnti
-    // =============================================
-    CRecordVector<bool> isAnti;
-    ReadRecoveryIsAntiData(recoveryStream, isAnti);
-
-    // Files
-    // =============================================
-    CObjectVector<CFileItem> files;
-    ReadRecoveryFilesData(recoveryStream, files);
+    UInt32 dataSize = GetUi32(buf + pos + 4);
+    pos += kRecoveryRecordHeaderSize;
+
+    int filesStart = _newDB.Files.Size();
+    int foldersStart = _newDB.Folders.Size();
+    try
+    {
+      CInByte2 inByte;
+      inByte.Init(buf + pos, dataSize);
+      ReadRecoveryRecord(inByte, _newDB);
+    }
+    catch(...)
+    {
+      break;
+    }
+    pos += dataSize;
 
     // !!!!!Will remove all items from a found item since all streams are sequential!!!!!
+    // (the items of this record are removed below with other items after last COC entry)
     bool itemFiltered = false;
-    for (int currentFileItem = 0; currentFileItem < files.Size(); ++currentFileItem)
+    int i;
+    for (i = filesStart; i < _newDB.Files.Size(); i++)
     {
-      if (IsItemFiltered(files[currentFileItem].Name, filterDirs))
+      _newDB.GetPath(i, name);
+      if (filter.Test(name))
       {
         itemFiltered = true;
         break;
       }
     }
-    if(itemFiltered)
-      break;
-
-    // Folders
-    // =============================================
-    CObjectVector<CFolder> folders;
-    ReadRecoveryFoldersData(recoveryStream, folders);
-
-    // We only add full records
-    if (recoveryStream.eof())
+    if (itemFiltered)
       break;
 
 	// Count recovered stats info
-    for (int currentFileItem = 0; currentFileItem < files.Size(); ++currentFileItem)
+    for (i = filesStart; i < _newDB.Files.Size(); i++)
     {
-      if (files[currentFileItem].Name.Left(itemStatFilter.Length()) == itemStatFilter)
+      _newDB.GetPath(i, name);
+      if (NameHasPrefix(name, itemStatFilter))
       {
         ++_recoveredFileCount;
 
-        for (int currFolder = 0; currFolder < folders.Size(); ++currFolder)
+        for (int currFolder = foldersStart; currFolder < _newDB.Folders.Size(); ++currFolder)
         {
-          _recoveredUncompressedFileSize += folders[currFolder].GetUnpackSize();
+          _recoveredUncompressedFileSize += _newDB.Folders[currFolder].GetUnpackSize();
         }
       }
     }
 
-    // Add new record
-    for (int currStartPos = 0; currStartPos < startPos.Defined.Size(); ++currStartPos)
-    {
-      _newDB.StartPos.Defined.Add(startPos.Defined[currStartPos]);
-      if (currStartPos < startPos.Values.Size())
-        _newDB.StartPos.Values.Add(startPos.Values[currStartPos]);
-    }
-    for (int currCTime = 0; currCTime < cTime.Defined.Size(); ++currCTime)
-    {
-      _newDB.CTime.Defined.Add(cTime.Defined[currCTime]);
-      if (currCTime < cTime.Values.Size())
-        _newDB.CTime.Values.Add(cTime.Values[currCTime]);
-    }
-    for (int currMTime = 0; currMTime < mTime.Defined.Size(); ++currMTime)
-    {
-      _newDB.MTime.Defined.Add(mTime.Defined[currMTime]);
-      if (currMTime < mTime.Values.Size())
-        _newDB.MTime.Values.Add(mTime.Values[currMTime]);
-    }
-    for (int currATime = 0; currATime < aTime.Defined.Size(); ++currATime)
-    {
-      _newDB.ATime.Defined.Add(aTime.Defined[currATime]);
-      if (currATime < aTime.Values.Size())
-        _newDB.ATime.Values.Add(aTime.Values[currATime]);
-    }
-    for (int currPackCRCsDefined = 0; currPackCRCsDefined < packCRCsDefined.Size(); ++currPackCRCsDefined)
-      _newDB.PackCRCsDefined.Add(packCRCsDefined[currPackCRCsDefined]);
-    for (int currPackCRCs = 0; currPackCRCs < packCRCs.Size(); ++currPackCRCs)
-      _newDB.PackCRCs.Add(packCRCs[currPackCRCs]);
-    for (int currPackSizes = 0; currPackSizes < packSizes.Size(); ++currPackSizes)
-      _newDB.PackSizes.Add(packSizes[currPackSizes]);
-    for (int currNumUnpackStreamsVector = 0; currNumUnpackStreamsVector < numUnpackStreamsVector.Size(); ++currNumUnpackStreamsVector)
-      _newDB.NumUnpackStreamsVector.Add(numUnpackStreamsVector[currNumUnpackStreamsVector]);
-    for (int currIsAnti = 0; currIsAnti < isAnti.Size(); ++currIsAnti)
-      _newDB.IsAnti.Add(isAnti[currIsAnti]);
-    for (int currFiles = 0; currFiles < files.Size(); ++currFiles)
-      _newDB.Files.Add(files[currFiles]);
-    for (int currFolders = 0; currFolders < folders.Size(); ++currFolders)
-      _newDB.Folders.Add(folders[currFolders]);
-
     // See if we have a coc entry in which case, we have a good non-corrupted entry
     // and only in that case update the indexes and recovery stream end positions
-    if (files.Size() && 
-        files[files.Size() - 1].Name.Left(cocEntryFilter.Length()) == cocEntryFilter)
+    bool isCoc = false;
+    if (_newDB.Files.Size() > filesStart)
     {
-      lastCocStartPosSize = _newDB.StartPos.Defined.Size();
-      lastCocCTimeSize = _newDB.CTime.Defined.Size();
-      lastCocMTimeSize = _newDB.MTime.Defined.Size();
-      lastCocATimeSize = _newDB.ATime.Defined.Size();
-      lastCocPackCRCsDefinedSize = _newDB.PackCRCsDefined.Size();
-      lastCocPackCRCsSize = _newDB.PackCRCs.Size();
-      lastCocFilesSize = _newDB.Files.Size();
-      lastCocFoldersSize = _newDB.Folders.Size();
-      lastCocPackSizesSize = _newDB.PackSizes.Size();
-      lastCocNumUnpackStreamsVectorSize = _newDB.NumUnpackStreamsVector.Size();
-      lastCocIsAntiSize = _newDB.IsAnti.Size();
-
-      validRecoveryStreamEndPos = recoveryStream.tellg().seekpos();
+      _newDB.GetPath(_newDB.Files.Size() - 1, name);
+      isCoc = NameHasPrefix(name, cocEntryFilter);
+    }
+    if (isCoc)
+    {
+      lastCoc.lastRecoveryStartPosIndexToUpdate = _newDB.StartPos.Defined.Size();
+      lastCoc.lastRecoveryCTimeIndexToUpdate = _newDB.CTime.Defined.Size();
+      lastCoc.lastRecoveryMTimeIndexToUpdate = _newDB.MTime.Defined.Size();
+      lastCoc.lastRecoveryATimeIndexToUpdate = _newDB.ATime.Defined.Size();
+      lastCoc.lastRecoveryPackCRCsDefinedIndexToUpdate = _newDB.PackCRCsDefined.Size();
+      lastCoc.lastRecoveryPackCRCsIndexToUpdate = _newDB.PackCRCs.Size();
+      lastCoc.lastRecoveryFilesIndexToUpdate = _newDB.Files.Size();
+      lastCoc.lastRecoveryFoldersIndexToUpdate = _newDB.Folders.Size();
+      lastCoc.lastRecoveryPackSizesIndexToUpdate = _newDB.PackSizes.Size();
+      lastCoc.lastRecoveryNumUnpackStreamsVectorIndexToUpdate = _newDB.NumUnpackStreamsVector.Size();
+      lastCoc.lastRecoveryIsAntiIndexToUpdate = _newDB.IsAnti.Size();
+
+      validRecoveryStreamEndPos = pos;
     }
   }
 
+  journal.Free();
+
   // Now remove everything from _newDB that wasn't followed by a COC entry which means
   // that an operation has been interrupted and therefore can not be considered complete
-  _newDB.StartPos.Defined.DeleteFrom(lastCocStartPosSize);
-  _newDB.CTime.Defined.DeleteFrom(lastCocCTimeSize);
-  _newDB.MTime.Defined.DeleteFrom(lastCocMTimeSize);
-  _newDB.ATime.Defined.DeleteFrom(lastCocATimeSize);
-  _newDB.PackCRCsDefined.DeleteFrom(lastCocPackCRCsDefinedSize);
-  _newDB.PackCRCs.DeleteFrom(lastCocPackCRCsSize);
-  _newDB.Files.DeleteFrom(lastCocFilesSize);
-  _newDB.Folders.DeleteFrom(lastCocFoldersSize);
-  _newDB.PackSizes.DeleteFrom(lastCocPackSizesSize);
-  _newDB.NumUnpackStreamsVector.DeleteFrom(lastCocNumUnpackStreamsVectorSize);
-  _newDB.IsAnti.DeleteFrom(lastCocIsAntiSize);
-
-  recoveryStream.close();
+  _newDB.StartPos.Defined.DeleteFrom(lastCoc.lastRecoveryStartPosIndexToUpdate);
+  _newDB.CTime.Defined.DeleteFrom(lastCoc.lastRecoveryCTimeIndexToUpdate);
+  _newDB.MTime.Defined.DeleteFrom(lastCoc.lastRecoveryMTimeIndexToUpdate);
+  _newDB.ATime.Defined.DeleteFrom(lastCoc.lastRecoveryATimeIndexToUpdate);
+  _newDB.PackCRCsDefined.DeleteFrom(lastCoc.lastRecoveryPackCRCsDefinedIndexToUpdate);
+  _newDB.PackCRCs.DeleteFrom(lastCoc.lastRecoveryPackCRCsIndexToUpdate);
+  _newDB.Files.DeleteFrom(lastCoc.lastRecoveryFilesIndexToUpdate);
+  _newDB.Folders.DeleteFrom(lastCoc.lastRecoveryFoldersIndexToUpdate);
+  _newDB.PackSizes.DeleteFrom(lastCoc.lastRecoveryPackSizesIndexToUpdate);
+  _newDB.NumUnpackStreamsVector.DeleteFrom(lastCoc.lastRecoveryNumUnpackStreamsVectorIndexToUpdate);
+  _newDB.IsAnti.DeleteFrom(lastCoc.lastRecoveryIsAntiIndexToUpdate);
+
+  _nameIndex.Clear();
+  _nameIndex.Update(_newDB);
+
   _recoveryFileName = recoveryFileName;
+  _recoveryRecord.Clear();
   _recoveryStreamOut.open(recoveryFileName, std::ios_base::binary | std::ios_base::out | std::ios_base::in | std::ios_base::ate);
 
   if (!_recoveryStreamOut.is_open())
     return S_FALSE;
 
   // Set file point to eof for new records to be written
-  // NOTE (cast): position from get of istream for some reason different in type
   _recoveryStreamOut.seekp((std::streamoff)validRecoveryStreamEndPos);
   if (NULL == _archive.SeqStream)
     RINOK(_archive.Create(outStream, false));
@@ -1029,15 +833,12 @@ HRESULT CHandler::SetRecoveryOption(UString &recoveryFileName)
     return S_OK;
 
   _recoveryFileName = recoveryFileName;
+  _recoveryRecord.Clear();
   _recoveryStreamOut.open(recoveryFileName, std::ios_base::binary | std::ios_base::out | std::ios_base::ate);
 
   if (_recoveryStreamOut.is_open())
   {
-    // 7-ZIP RECOVERY SIGNATURE ( 4 Bytes )
-    // =============================================
-    int signatureLength = wcslen(kRecoverySignature) + 1;
-
-    _recoveryStreamOut.write(reinterpret_cast <const char*> (kRecoverySignature), signatureLength * sizeof(wchar_t));
+    _recoveryStreamOut.write(reinterpret_cast <const char*> (kRecoverySignature), kRecoverySignatureSize);
     _recoveryStreamOut.flush();
     _recoveryIndex.Init();
 
@@ -1067,6 +868,67 @@ unsigned long long CHandler::GetRecoveredUncompressedFileSize()
   return _recoveredUncompressedFileSize;
 }
 
+HRESULT CHandler::SetUpdateOptions(IArchiveUpdateCallback *updateCallback, UInt32 numItems,
+    CCompressionMethodMode &methodMode,
+    CCompressionMethodMode &headerMethod,
+    CUpdateOptions &options)
+{
+  RINOK(SetCompressionMethod(methodMode, headerMethod));
+  #ifdef COMPRESS_MT
+  methodMode.NumThreads = _numThreads;
+  headerMethod.NumThreads = 1;
+  #endif
+
+  RINOK(SetPassword(methodMode, updateCallback));
+
+  bool compressMainHeader = _compressHeaders;  // check it
+
+  bool encryptHeaders = false;
+
+  if (methodMode.PasswordIsDefined)
+  {
+    if (_encryptHeadersSpecified)
+      encryptHeaders = _encryptHeaders;
+    #ifndef _NO_CRYPTO
+    else
+      encryptHeaders = _passwordIsDefined;
+    #endif
+    compressMainHeader = true;
+    if(encryptHeaders)
+      RINOK(SetPassword(headerMethod, updateCallback));
+  }
+
+  if (numItems < 2)
+    compressMainHeader = false;
+
+  options.Method = &methodMode;
+  options.HeaderMethod = (_compressHeaders || encryptHeaders) ? &headerMethod : 0;
+  options.UseFilters = _level != 0 && _autoFilter;
+  options.MaxFilter = _level >= 8;
+
+  options.HeaderOptions.CompressMainHeader = compressMainHeader;
+  options.HeaderOptions.WriteCTime = WriteCTime;
+  options.HeaderOptions.WriteATime = WriteATime;
+  options.HeaderOptions.WriteMTime = WriteMTime;
+  
+  options.NumSolidFiles = _numSolidFiles;
+  options.NumSolidBytes = _numSolidBytes;
+  options.SolidExtension = _solidExtension;
+  options.RemoveSfxBlock = _removeSfxBlock;
+  options.VolumeMode = _volumeMode;
+  options.CommitCallback = _recoveryStreamOut.is_open() ? this : NULL;
+  return S_OK;
+}
+
+// Update() calls it for each folder, so recovery record is written
+// as soon as data of folder is in archive stream.
+
+HRESULT CHandler::FolderCommitted()
+{
+  HRESULT res = UpdateRecoveryData();
+  return res == S_FALSE ? S_OK : res;
+}
+
 STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numItems,
     IArchiveUpdateCallback *updateCallback)
 {
@@ -1087,7 +949,9 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
     db = &_db;
   #endif
 
-  CObjectVector<CUpdateItem> updateItems;
+  // it keeps capacity of items vector between calls
+  CObjectVector<CUpdateItem> &updateItems = _updateSession.UpdateItems;
+  updateItems.Clear();
   
   for (UInt32 i = 0; i < numItems; i++)
   {
@@ -1108,7 +972,7 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
     if (ui.IndexInArchive != -1)
     {
       const CFileItem &fi = db->Files[ui.IndexInArchive];
-      ui.Name = fi.Name;
+      db->GetPath(ui.IndexInArchive, ui.Name);
       ui.IsDir = fi.IsDir;
       ui.Size = fi.Size;
       ui.IsAnti = db->IsItemAnti(ui.IndexInArchive);
@@ -1208,50 +1072,8 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   }
 
   CCompressionMethodMode methodMode, headerMethod;
-  RINOK(SetCompressionMethod(methodMode, headerMethod));
-  #ifdef COMPRESS_MT
-  methodMode.NumThreads = _numThreads;
-  headerMethod.NumThreads = 1;
-  #endif
-
-  RINOK(SetPassword(methodMode, updateCallback));
-
-  bool compressMainHeader = _compressHeaders;  // check it
-
-  bool encryptHeaders = false;
-
-  if (methodMode.PasswordIsDefined)
-  {
-    if (_encryptHeadersSpecified)
-      encryptHeaders = _encryptHeaders;
-    #ifndef _NO_CRYPTO
-    else
-      encryptHeaders = _passwordIsDefined;
-    #endif
-    compressMainHeader = true;
-    if(encryptHeaders)
-      RINOK(SetPassword(headerMethod, updateCallback));
-  }
-
-  if (numItems < 2)
-    compressMainHeader = false;
-
   CUpdateOptions options;
-  options.Method = &methodMode;
-  options.HeaderMethod = (_compressHeaders || encryptHeaders) ? &headerMethod : 0;
-  options.UseFilters = _level != 0 && _autoFilter;
-  options.MaxFilter = _level >= 8;
-
-  options.HeaderOptions.CompressMainHeader = compressMainHeader;
-  options.HeaderOptions.WriteCTime = WriteCTime;
-  options.HeaderOptions.WriteATime = WriteATime;
-  options.HeaderOptions.WriteMTime = WriteMTime;
-  
-  options.NumSolidFiles = _numSolidFiles;
-  options.NumSolidBytes = _numSolidBytes;
-  options.SolidExtension = _solidExtension;
-  options.RemoveSfxBlock = _removeSfxBlock;
-  options.VolumeMode = _volumeMode;
+  RINOK(SetUpdateOptions(updateCallback, numItems, methodMode, headerMethod, options));
 
   HRESULT res = Update(
       EXTERNAL_CODECS_VARS
@@ -1263,19 +1085,31 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
       db,
       #endif
       updateItems,
-      _archive, _newDB, outStream, updateCallback, options);
+      _archive, _newDB, outStream, updateCallback, options, &_updateSession);
 
   RINOK(res);
 
-  updateItems.ClearAndFree();
+  updateItems.Clear();
+  _nameIndex.Update(_newDB);
 
   if (0 == numItems) // Close archive
   {
-    res = _archive.WriteDatabase(EXTERNAL_CODECS_VARS
-      _newDB, options.HeaderMethod, options.HeaderOptions);
+    _updateSession.Clear();
+    _newDB.ReserveDown();
+    // full header (compaction) also removes header blocks of previous checkpoints from db
+    if (_newDB.IsEmpty())
+      res = _archive.WriteDatabase(EXTERNAL_CODECS_VARS
+        _newDB, options.HeaderMethod, options.HeaderOptions);
+    else
+      res = _archive.WriteCheckpoint(EXTERNAL_CODECS_VARS
+        _newDB, options.HeaderMethod, options.HeaderOptions, !_keepHeaderChain,
+        GetNumJournaledFolders());
 
     if (_recoveryStreamOut.is_open())
+    {
+      CommitRecoveryData();
       _recoveryStreamOut.close();
+    }
 
     return res;
   }
@@ -1288,8 +1122,10 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 	  NWindows::NCOM::CPropVariant prop;
 	  updateCallback->GetProperty(0, kpidSize, &prop);
 
+	  // files of folders were recorded already in FolderCommitted()
 	  int index = _newDB.Files.Size() - 1;
-	  if (index >= 0 && index < _newDB.Files.Size() )
+	  if (index >= 0 && index < _newDB.Files.Size() &&
+	      _recoveryIndex.lastRecoveryFilesIndexToUpdate < _newDB.Files.Size())
 	  {
         _newDB.Files[index].RecoveryRecordPos = 0;
         if (prop.uhVal.QuadPart == _newDB.Files[index].Size)
@@ -1302,6 +1138,33 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   COM_TRY_END
 }
 
+/*
+WriteCheckpoint() makes archive consistent without closing it:
+  compact = false: it writes header block only for items that were added
+    after previous checkpoint, and that block is linked to previous block.
+  compact = true: it writes full standard header (compaction of header chain).
+Next UpdateItems() calls continue to add items after that header block.
+Archive with delta header block can be opened only by this 7z handler.
+Other 7z readers reject it until full header is written.
+*/
+
+HRESULT CHandler::WriteCheckpoint(IArchiveUpdateCallback *updateCallback, bool compact)
+{
+  COM_TRY_BEGIN
+  if (NULL == _archive.SeqStream || !updateCallback)
+    return E_FAIL;
+
+  CCompressionMethodMode methodMode, headerMethod;
+  CUpdateOptions options;
+  RINOK(SetUpdateOptions(updateCallback, _newDB.Files.Size(), methodMode, headerMethod, options));
+
+  CommitRecoveryData();
+  return _archive.WriteCheckpoint(EXTERNAL_CODECS_VARS
+      _newDB, options.HeaderMethod, options.HeaderOptions, compact,
+      GetNumJournaledFolders());
+  COM_TRY_END
+}
+
 static HRESULT GetBindInfoPart(UString &srcString, UInt32 &coder, UInt32 &stream)
 {
   stream = 0;
@@ -1332,11 +1195,57 @@ static HRESULT GetBindInfo(UString &srcString, CBind &bind)
   return S_OK;
 }
 
+// size in bytes: number of bytes or number with B/K/M suffix
+
+static HRESULT ParseSizeValue(const PROPVARIANT &value, UInt32 &size)
+{
+  if (value.vt == VT_UI4)
+  {
+    size = value.ulVal;
+    return S_OK;
+  }
+  if (value.vt != VT_BSTR)
+    return E_INVALIDARG;
+  UString s = value.bstrVal;
+  const wchar_t *start = s;
+  const wchar_t *end;
+  UInt64 number = ConvertStringToUInt64(start, &end);
+  if (end - start != s.Length() || s.IsEmpty())
+    return ParsePropDictionaryValue(s, size);
+  if (number > (UInt32)0xFFFFFFFF)
+    return E_INVALIDARG;
+  size = (UInt32)number;
+  return S_OK;
+}
+
+static void AddPropToKey(UString &key, const UString &name, const PROPVARIANT &value)
+{
+  wchar_t temp[32];
+  key += name;
+  key += L'=';
+  switch (value.vt)
+  {
+    case VT_EMPTY: break;
+    case VT_BSTR: key += value.bstrVal; break;
+    case VT_UI4: ConvertUInt64ToString(value.ulVal, temp); key += temp; break;
+    case VT_BOOL: key += ((value.boolVal != VARIANT_FALSE) ? L'+' : L'-'); break;
+    default: key += L'?'; ConvertUInt64ToString(value.vt, temp); key += temp; break;
+  }
+  key += L'\n';
+}
+
 STDMETHODIMP CHandler::SetProperties(const wchar_t **names, const PROPVARIANT *values, Int32 numProperties)
 {
   COM_TRY_BEGIN
   _binds.Clear();
   BeforeSetProperty();
+  UString sessionPropsKey;
+
+  CommitRecoveryData();
+  _recoveryGroupSize = 0;
+  _recoveryGroupTime = 0;
+  _recoveryCocPrefix.Empty();
+  _keepHeaderChain = false;
 
   for (int i = 0; i < numProperties; i++)
   {
@@ -1349,6 +1258,7 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t **names, const PROPVARIANT *v
 
     if (name[0] == 'B')
     {
+      AddPropToKey(sessionPropsKey, name, value);
       name.Delete(0);
       CBind bind;
       RINOK(GetBindInfo(name, bind));
@@ -1356,9 +1266,51 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t **names, const PROPVARIANT *v
       continue;
     }
 
+    // Recovery journal group commit
+    if (name == L"RGB")
+    {
+      RINOK(ParseSizeValue(value, _recoveryGroupSize));
+      continue;
+    }
+    if (name == L"RGT")
+    {
+      // milliseconds
+      RINOK(ParsePropValue(L"", value, _recoveryGroupTime));
+      continue;
+    }
+    if (name == L"RCOC")
+    {
+      if (value.vt != VT_BSTR)
+        return E_INVALIDARG;
+      _recoveryCocPrefix = value.bstrVal;
+      continue;
+    }
+
+    // Segmented header mode: keep header chain at close (no compaction)
+    if (name == L"HSEG")
+    {
+      RINOK(SetBoolProperty(_keepHeaderChain, value));
+      continue;
+    }
+
+    AddPropToKey(sessionPropsKey, name, value);
     RINOK(SetProperty(name, value));
   }
 
+  // Session encoders depend on methods, binds and password.
+  // The client can call SetProperties() before each UpdateItems() call, so
+  // we free encoders only if some property other than journal ones was changed.
+  if (sessionPropsKey != _sessionPropsKey)
+  {
+    _updateSession.Clear();
+    _sessionPropsKey = sessionPropsKey;
+  }
+
+  // COC entries are recognized by RCOC prefix only. Without it
+  // checkpoint records could stay in group buffer without flush.
+  if ((_recoveryGroupSize != 0 || _recoveryGroupTime != 0) && _recoveryCocPrefix.IsEmpty())
+    return E_INVALIDARG;
+
   return S_OK;
   COM_TRY_END
 }
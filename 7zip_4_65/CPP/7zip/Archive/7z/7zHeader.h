@@ -90,6 +90,18 @@ namespace NID
     kStartPos,
     kDummy
   };
+
+  /*
+  Delta header block (segmented header mode) starts with kChainedHeader instead of kHeader
+  (also in packed data of kEncodedHeader). Other field IDs are same as in kHeader.
+  Readers that don't support header chain reject such archive, instead of
+  showing only items of last block.
+  kPrevHeader is record of kArchiveProperties in delta header block.
+  Data: start header of previous header block:
+    UInt64 NextHeaderOffset, UInt64 NextHeaderSize, UInt32 NextHeaderCRC.
+  */
+  const UInt32 kChainedHeader = 0x71;
+  const UInt32 kPrevHeader = 0x70;
 }
 
 }}
@@ -357,12 +357,23 @@ void CInArchive::Close()
   _stream.Release();
 }
 
-void CInArchive::ReadArchiveProperties(CInArchiveInfo & /* archiveInfo */)
+void CInArchive::ReadArchiveProperties(CInArchiveInfo &archiveInfo)
 {
   for (;;)
   {
-    if (ReadID() == NID::kEnd)
+    UInt64 type = ReadID();
+    if (type == NID::kEnd)
       break;
+    if (type == NID::kPrevHeader)
+    {
+      if (ReadNumber() != kStartHeaderSize)
+        ThrowIncorrect();
+      archiveInfo.PrevHeader.NextHeaderOffset = ReadUInt64();
+      archiveInfo.PrevHeader.NextHeaderSize = ReadUInt64();
+      archiveInfo.PrevHeader.NextHeaderCRC = ReadUInt32();
+      archiveInfo.PrevHeaderDefined = true;
+      continue;
+    }
     SkeepData();
   }
 }
@@ -952,8 +963,14 @@ HRESULT CInArchive::ReadHeader(
       {
         CStreamSwitch streamSwitch;
         streamSwitch.Set(this, &dataVector);
+        if (db.Names.IsEmpty())
+          db.Names.ReserveChars((unsigned)(_inByteBack->GetRem() / 2));
+        UString name;
         for (int i = 0; i < db.Files.Size(); i++)
-          _inByteBack->ReadString(db.Files[i].Name);
+        {
+          _inByteBack->ReadString(name);
+          db.SetPath(i, name);
+        }
         break;
       }
       case NID::kWinAttributes:
@@ -1116,6 +1133,9 @@ void CArchiveDatabaseEx::FillFolderStartFileIndex()
       indexInFolder = 0;
     }
   }
+  // empty folders at the end ("gap" folders of header blocks)
+  while (FolderStartFileIndex.Size() < Folders.Size())
+    FolderStartFileIndex.Add(Files.Size());
 }
 
 HRESULT CInArchive::ReadDatabase2(
@@ -1184,25 +1204,77 @@ HRESULT CInArchive::ReadDatabase2(
   if (nextHeaderSize > (UInt64)0xFFFFFFFF)
     return S_FALSE;
 
-  RINOK(_stream->Seek(nextHeaderOffset, STREAM_SEEK_CUR, NULL));
+  HeadersSize += kHeaderSize;
+  db.PhySize = kHeaderSize + nextHeaderOffset + nextHeaderSize;
 
-  CByteBuffer buffer2;
-  buffer2.SetCapacity((size_t)nextHeaderSize);
+  CStartHeader h;
+  h.NextHeaderOffset = nextHeaderOffset;
+  h.NextHeaderSize = nextHeaderSize;
+  h.NextHeaderCRC = nextHeaderCRC;
+  RINOK(ReadHeaderBlock(
+      EXTERNAL_CODECS_LOC_VARS
+      db, h
+      #ifndef _NO_CRYPTO
+      , getTextPassword, passwordIsDefined
+      #endif
+      ));
+  if (!db.ArchiveInfo.PrevHeaderDefined)
+    return S_OK;
+  return ReadHeaderChain(
+      EXTERNAL_CODECS_LOC_VARS
+      db, nextHeaderOffset
+      #ifndef _NO_CRYPTO
+      , getTextPassword, passwordIsDefined
+      #endif
+      );
+}
 
-  RINOK(ReadStream_FALSE(_stream, buffer2, (size_t)nextHeaderSize));
-  HeadersSize += kHeaderSize + nextHeaderSize;
-  db.PhySize = kHeaderSize + nextHeaderOffset + nextHeaderSize;
+HRESULT CInArchive::ReadHeaderBlock(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    CArchiveDatabaseEx &db,
+    const CStartHeader &h
+    #ifndef _NO_CRYPTO
+    , ICryptoGetTextPassword *getTextPassword, bool &passwordIsDefined
+    #endif
+    )
+{
+  UInt64 nextHeaderSize = h.NextHeaderSize;
+  if (nextHeaderSize > (UInt64)0xFFFFFFFF)
+    return S_FALSE;
+
+  UInt64 headerPos = db.ArchiveInfo.StartPositionAfterHeader + h.NextHeaderOffset;
+
+  // if stream is mapped to memory, we parse header in place
+  const Byte *header = NULL;
+  CMyComPtr<IInStreamGetBuf> getBuf;
+  _stream.QueryInterface(IID_IInStreamGetBuf, &getBuf);
+  if (getBuf)
+  {
+    HRESULT res = getBuf->GetBuf(headerPos, (UInt32)nextHeaderSize, &header);
+    if (res != S_OK && res != S_FALSE)
+      return res;
+  }
 
-  if (CrcCalc(buffer2, (UInt32)nextHeaderSize) != nextHeaderCRC)
+  CByteBuffer buffer2;
+  if (header == NULL)
+  {
+    RINOK(_stream->Seek(headerPos, STREAM_SEEK_SET, NULL));
+    buffer2.SetCapacity((size_t)nextHeaderSize);
+    RINOK(ReadStream_FALSE(_stream, buffer2, (size_t)nextHeaderSize));
+    header = buffer2;
+  }
+  HeadersSize += nextHeaderSize;
+
+  if (CrcCalc(header, (UInt32)nextHeaderSize) != h.NextHeaderCRC)
     ThrowIncorrect();
   
   CStreamSwitch streamSwitch;
-  streamSwitch.Set(this, buffer2);
+  streamSwitch.Set(this, header, (size_t)nextHeaderSize);
   
   CObjectVector<CByteBuffer> dataVector;
   
   UInt64 type = ReadID();
-  if (type != NID::kHeader)
+  if (type != NID::kHeader && type != NID::kChainedHeader)
   {
     if (type != NID::kEncodedHeader)
       ThrowIncorrect();
@@ -1222,19 +1294,143 @@ HRESULT CInArchive::ReadDatabase2(
       ThrowIncorrect();
     streamSwitch.Remove();
     streamSwitch.Set(this, dataVector.Front());
-    if (ReadID() != NID::kHeader)
+    type = ReadID();
+    if (type != NID::kHeader && type != NID::kChainedHeader)
       ThrowIncorrect();
   }
 
   db.HeadersSize = HeadersSize;
 
-  return ReadHeader(
+  RINOK(ReadHeader(
     EXTERNAL_CODECS_LOC_VARS
     db
     #ifndef _NO_CRYPTO
     , getTextPassword, passwordIsDefined
     #endif
-    );
+    ));
+  // only delta header block links to previous block
+  if ((type == NID::kChainedHeader) != db.ArchiveInfo.PrevHeaderDefined)
+    ThrowIncorrect();
+  return S_OK;
+}
+
+static void AddPopIDs(CRecordVector<UInt64> &dest, const CRecordVector<UInt64> &src)
+{
+  for (int i = 0; i < src.Size(); i++)
+  {
+    int j;
+    for (j = 0; j < dest.Size(); j++)
+      if (dest[j] == src[i])
+        break;
+    if (j == dest.Size())
+      dest.Add(src[i]);
+  }
+}
+
+static void AppendDefVector(CUInt64DefVector &dest, const CUInt64DefVector &src, int destIndex, int numItems)
+{
+  for (int i = 0; i < numItems; i++)
+  {
+    UInt64 value;
+    bool defined = src.GetItem(i, value);
+    if (defined || !dest.Defined.IsEmpty())
+      dest.SetItem(destIndex + i, defined, value);
+  }
+}
+
+/*
+db contains last header block of header chain. ReadHeaderChain() reads
+previous header blocks (each block links to previous one), and it merges
+all blocks to db from first to last. Data of each block must follow
+data of previous block.
+*/
+
+HRESULT CInArchive::ReadHeaderChain(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    CArchiveDatabaseEx &db,
+    UInt64 lastHeaderOffset
+    #ifndef _NO_CRYPTO
+    , ICryptoGetTextPassword *getTextPassword, bool &passwordIsDefined
+    #endif
+    )
+{
+  CObjectVector<CArchiveDatabaseEx> blocks; // from last to first
+  blocks.Add(db);
+  UInt64 headerOffset = lastHeaderOffset;
+  for (;;)
+  {
+    const CInArchiveInfo &info = blocks.Back().ArchiveInfo;
+    if (!info.PrevHeaderDefined)
+      break;
+    CStartHeader h = info.PrevHeader;
+    // it also protects from loops
+    if (h.NextHeaderOffset >= headerOffset || h.NextHeaderSize > headerOffset - h.NextHeaderOffset)
+      ThrowIncorrect();
+    headerOffset = h.NextHeaderOffset;
+    CArchiveDatabaseEx &block = blocks[blocks.Add(CArchiveDatabaseEx())];
+    block.Clear();
+    block.ArchiveInfo.StartPosition = db.ArchiveInfo.StartPosition;
+    block.ArchiveInfo.StartPositionAfterHeader = db.ArchiveInfo.StartPositionAfterHeader;
+    block.ArchiveInfo.Version = db.ArchiveInfo.Version;
+    RINOK(ReadHeaderBlock(
+        EXTERNAL_CODECS_LOC_VARS
+        block, h
+        #ifndef _NO_CRYPTO
+        , getTextPassword, passwordIsDefined
+        #endif
+        ));
+  }
+
+  UInt64 phySize = db.PhySize;
+  db.Clear();
+  db.ArchiveInfo = blocks.Back().ArchiveInfo;
+  db.ArchiveInfo.PrevHeaderDefined = false;
+  UInt64 dataEnd = 0;
+  
+  for (int b = blocks.Size() - 1; b >= 0; b--)
+  {
+    const CArchiveDatabaseEx &block = blocks[b];
+    int i;
+    if (!block.PackSizes.IsEmpty())
+    {
+      if (db.PackSizes.IsEmpty())
+        dataEnd = db.ArchiveInfo.DataStartPosition = block.ArchiveInfo.DataStartPosition;
+      else if (block.ArchiveInfo.DataStartPosition != dataEnd)
+        ThrowIncorrect();
+      for (i = 0; i < block.PackSizes.Size(); i++)
+      {
+        db.PackSizes.Add(block.PackSizes[i]);
+        db.PackCRCsDefined.Add(block.PackCRCsDefined[i]);
+        db.PackCRCs.Add(block.PackCRCs[i]);
+        dataEnd += block.PackSizes[i];
+      }
+    }
+    for (i = 0; i < block.Folders.Size(); i++)
+    {
+      db.Folders.Add(block.Folders[i]);
+      db.NumUnpackStreamsVector.Add(block.NumUnpackStreamsVector[i]);
+    }
+    int numFiles = block.Files.Size();
+    int startIndex = db.Files.Size();
+    AppendDefVector(db.CTime, block.CTime, startIndex, numFiles);
+    AppendDefVector(db.ATime, block.ATime, startIndex, numFiles);
+    AppendDefVector(db.MTime, block.MTime, startIndex, numFiles);
+    AppendDefVector(db.StartPos, block.StartPos, startIndex, numFiles);
+    UString name;
+    for (i = 0; i < numFiles; i++)
+    {
+      if (block.IsItemAnti(i) || !db.IsAnti.IsEmpty())
+        db.SetItemAnti(startIndex + i, block.IsItemAnti(i));
+      db.Files.Add(block.Files[i]);
+      block.GetPath(i, name);
+      db.SetPath(startIndex + i, name);
+    }
+    AddPopIDs(db.ArchiveInfo.FileInfoPopIDs, block.ArchiveInfo.FileInfoPopIDs);
+  }
+
+  db.HeadersSize = HeadersSize;
+  db.PhySize = phySize;
+  return S_OK;
 }
 
 HRESULT CInArchive::ReadDatabase(
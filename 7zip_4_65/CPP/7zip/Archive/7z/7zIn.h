@@ -24,9 +24,12 @@ struct CInArchiveInfo
   UInt64 DataStartPosition;
   UInt64 DataStartPosition2;
   CRecordVector<UInt64> FileInfoPopIDs;
+  bool PrevHeaderDefined;   // it's delta header block (segmented header mode)
+  CStartHeader PrevHeader;
   void Clear()
   {
     FileInfoPopIDs.Clear();
+    PrevHeaderDefined = false;
   }
 };
 
@@ -108,6 +111,7 @@ public:
     _size = size;
     _pos = 0;
   }
+  size_t GetRem() const { return _size - _pos; }
   Byte ReadByte();
   void ReadBytes(Byte *data, size_t size);
   void SkeepData(UInt64 size);
@@ -220,6 +224,22 @@ private:
       ,ICryptoGetTextPassword *getTextPassword, bool &passwordIsDefined
       #endif
       );
+  HRESULT ReadHeaderBlock(
+      DECL_EXTERNAL_CODECS_LOC_VARS
+      CArchiveDatabaseEx &db,
+      const CStartHeader &h
+      #ifndef _NO_CRYPTO
+      ,ICryptoGetTextPassword *getTextPassword, bool &passwordIsDefined
+      #endif
+      );
+  HRESULT ReadHeaderChain(
+      DECL_EXTERNAL_CODECS_LOC_VARS
+      CArchiveDatabaseEx &db,
+      UInt64 lastHeaderOffset
+      #ifndef _NO_CRYPTO
+      ,ICryptoGetTextPassword *getTextPassword, bool &passwordIsDefined
+      #endif
+      );
   HRESULT ReadDatabase2(
       DECL_EXTERNAL_CODECS_LOC_VARS
       CArchiveDatabaseEx &db
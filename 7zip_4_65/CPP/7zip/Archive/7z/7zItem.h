@@ -9,6 +9,7 @@
 #include "../../Common/MethodId.h"
 
 #include "7zHeader.h"
+#include "7zNameTable.h"
 
 namespace NArchive {
 namespace N7z {
@@ -100,7 +101,7 @@ struct CUInt64DefVector
   void ReserveDown()
   {
     Values.ReserveDown();
-    Values.ReserveDown();
+    Defined.ReserveDown();
   }
 
   bool GetItem(int index, UInt64 &value) const
@@ -134,7 +135,7 @@ struct CFileItem
   UInt64 Size;
   UInt32 Attrib;
   UInt32 Crc;
-  UString Name;
+  CNameRef NameRef; // name in CArchiveDatabase::Names
 
   Int64 RecoveryRecordPos;
 
@@ -145,11 +146,12 @@ struct CFileItem
   bool AttribDefined;
 
   CFileItem():
+    RecoveryRecordPos(0),
     HasStream(true),
     IsDir(false),
     CrcDefined(false),
     AttribDefined(false)
-      {}
+      { NameRef.Init(); }
   void SetAttrib(UInt32 attrib)
   {
     AttribDefined = true;
@@ -157,8 +159,11 @@ struct CFileItem
   }
 };
 
+// CFileItem2 contains properties of item that are not stored in CFileItem
+
 struct CFileItem2
 {
+  UString Name;
   UInt64 CTime;
   UInt64 ATime;
   UInt64 MTime;
@@ -177,7 +182,8 @@ struct CArchiveDatabase
   CRecordVector<UInt32> PackCRCs;
   CObjectVector<CFolder> Folders;
   CRecordVector<CNum> NumUnpackStreamsVector;
-  CObjectVector<CFileItem> Files;
+  CRecordVector<CFileItem> Files;
+  CNameTable Names;
 
   CUInt64DefVector CTime;
   CUInt64DefVector ATime;
@@ -193,6 +199,7 @@ struct CArchiveDatabase
     Folders.Clear();
     NumUnpackStreamsVector.Clear();
     Files.Clear();
+    Names.Clear();
     CTime.Clear();
     ATime.Clear();
     MTime.Clear();
@@ -208,6 +215,7 @@ struct CArchiveDatabase
     Folders.ReserveDown();
     NumUnpackStreamsVector.ReserveDown();
     Files.ReserveDown();
+    Names.ReserveDown();
     CTime.ReserveDown();
     ATime.ReserveDown();
     MTime.ReserveDown();
@@ -251,8 +259,16 @@ struct CArchiveDatabase
     IsAnti[index] = isAnti;
   }
 
+  void GetPath(int index, UString &path) const { Names.Get(Files[index].NameRef, path); }
+  void SetPath(int index, const UString &path) { Files[index].NameRef = Names.Add(path); }
+
   void GetFile(int index, CFileItem &file, CFileItem2 &file2) const;
   void AddFile(const CFileItem &file, const CFileItem2 &file2);
+
+  // it removes "gap" folders (header blocks of segmented header mode) at the end.
+  // First numFixedFolders folders are never removed (they were written to recovery journal).
+  // It returns total size of removed folders.
+  UInt64 RemoveTailGapFolders(int numFixedFolders);
 };
 
 }}
@@ -0,0 +1,285 @@
+// 7zNameIndex.cpp
+
+#include "StdAfx.h"
+
+#include "7zNameIndex.h"
+
+namespace NArchive {
+namespace N7z {
+
+static const wchar_t kDirDelimiter = L'/';
+static const int kHashTableSizeMin = 1 << 10;
+
+static UInt32 GetNameHash(int parent, const wchar_t *name, unsigned len)
+{
+  UInt32 hash = 2166136261U ^ (UInt32)parent;
+  hash *= 16777619;
+  for (unsigned i = 0; i < len; i++)
+  {
+    hash ^= (UInt32)name[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+void CNameIndex::Clear()
+{
+  _nodes.Clear();
+  _chars.Clear();
+  _nextSameName.Clear();
+  _numItems = 0;
+
+  CNode root;
+  root.Parent = -1;
+  root.FirstChild = -1;
+  root.NextSibling = -1;
+  root.ItemIndex = -1;
+  root.Hash = 0;
+  root.NameOffset = 0;
+  root.NameLen = 0;
+  _nodes.Add(root);
+
+  _hashTable.Clear();
+  _hashTable.Reserve(kHashTableSizeMin);
+  for (int i = 0; i < kHashTableSizeMin; i++)
+    _hashTable.Add(-1);
+}
+
+void CNameIndex::InsertToHashTable(int nodeIndex)
+{
+  unsigned mask = (unsigned)_hashTable.Size() - 1;
+  unsigned i = _nodes[nodeIndex].Hash & mask;
+  while (_hashTable[i] >= 0)
+    i = (i + 1) & mask;
+  _hashTable[i] = nodeIndex;
+}
+
+void CNameIndex::GrowHashTable()
+{
+  int newSize = _hashTable.Size() * 2;
+  _hashTable.Clear();
+  _hashTable.Reserve(newSize);
+  int i;
+  for (i = 0; i < newSize; i++)
+    _hashTable.Add(-1);
+  // root node is not in hash table
+  for (i = 1; i < _nodes.Size(); i++)
+    InsertToHashTable(i);
+}
+
+int CNameIndex::FindChild(int parent, const wchar_t *name, unsigned len, UInt32 hash) const
+{
+  unsigned mask = (unsigned)_hashTable.Size() - 1;
+  for (unsigned i = hash & mask;; i = (i + 1) & mask)
+  {
+    int nodeIndex = _hashTable[i];
+    if (nodeIndex < 0)
+      return -1;
+    const CNode &node = _nodes[nodeIndex];
+    if (node.Hash == hash && node.Parent == parent && node.NameLen == len &&
+        (len == 0 || memcmp(&_chars[node.NameOffset], name, len * sizeof(wchar_t)) == 0))
+      return nodeIndex;
+  }
+}
+
+int CNameIndex::GetChild(int parent, const wchar_t *name, unsigned len)
+{
+  UInt32 hash = GetNameHash(parent, name, len);
+  int nodeIndex = FindChild(parent, name, len, hash);
+  if (nodeIndex >= 0)
+    return nodeIndex;
+
+  CNode node;
+  node.Parent = parent;
+  node.FirstChild = -1;
+  node.NextSibling = _nodes[parent].FirstChild;
+  node.ItemIndex = -1;
+  node.Hash = hash;
+  node.NameOffset = _chars.Size();
+  node.NameLen = len;
+  for (unsigned i = 0; i < len; i++)
+    _chars.Add(name[i]);
+  nodeIndex = _nodes.Add(node);
+  _nodes[parent].FirstChild = nodeIndex;
+
+  if (_nodes.Size() * 2 > _hashTable.Size())
+    GrowHashTable();
+  else
+    InsertToHashTable(nodeIndex);
+  return nodeIndex;
+}
+
+int CNameIndex::FindNode(const UString &name) const
+{
+  const wchar_t *s = name;
+  int len = name.Length();
+  int nodeIndex = 0;
+  for (int start = 0, i = 0;; i++)
+  {
+    if (i == len || s[i] == kDirDelimiter)
+    {
+      unsigned partLen = (unsigned)(i - start);
+      nodeIndex = FindChild(nodeIndex, s + start, partLen, GetNameHash(nodeIndex, s + start, partLen));
+      if (nodeIndex < 0 || i == len)
+        return nodeIndex;
+      start = i + 1;
+    }
+  }
+}
+
+int CNameIndex::GetNode(const UString &name)
+{
+  const wchar_t *s = name;
+  int len = name.Length();
+  int nodeIndex = 0;
+  for (int start = 0, i = 0;; i++)
+  {
+    if (i == len || s[i] == kDirDelimiter)
+    {
+      nodeIndex = GetChild(nodeIndex, s + start, (unsigned)(i - start));
+      if (i == len)
+        return nodeIndex;
+      start = i + 1;
+    }
+  }
+}
+
+void CNameIndex::Add(const UString &name, int itemIndex)
+{
+  while (_nextSameName.Size() <= itemIndex)
+    _nextSameName.Add(-1);
+  int nodeIndex = GetNode(name);
+  int first = _nodes[nodeIndex].ItemIndex;
+  if (first < 0 || itemIndex < first)
+  {
+    _nextSameName[itemIndex] = first;
+    _nodes[nodeIndex].ItemIndex = itemIndex;
+    return;
+  }
+  int prev = first;
+  while (_nextSameName[prev] >= 0 && _nextSameName[prev] < itemIndex)
+    prev = _nextSameName[prev];
+  _nextSameName[itemIndex] = _nextSameName[prev];
+  _nextSameName[prev] = itemIndex;
+}
+
+void CNameIndex::Remove(const UString &name, int itemIndex)
+{
+  int nodeIndex = FindNode(name);
+  if (nodeIndex < 0 || itemIndex >= _nextSameName.Size())
+    return;
+  int next = _nextSameName[itemIndex];
+  _nextSameName[itemIndex] = -1;
+  int prev = _nodes[nodeIndex].ItemIndex;
+  if (prev == itemIndex)
+  {
+    _nodes[nodeIndex].ItemIndex = next;
+    return;
+  }
+  for (; prev >= 0; prev = _nextSameName[prev])
+    if (_nextSameName[prev] == itemIndex)
+    {
+      _nextSameName[prev] = next;
+      return;
+    }
+}
+
+int CNameIndex::Find(const UString &name) const
+{
+  int nodeIndex = FindNode(name);
+  if (nodeIndex < 0)
+    return -1;
+  return _nodes[nodeIndex].ItemIndex;
+}
+
+void CNameIndex::GetSubtree(const UString &name, CIntVector &itemIndexes) const
+{
+  int nodeIndex = FindNode(name);
+  if (nodeIndex < 0)
+    return;
+  CIntVector stack;
+  stack.Add(nodeIndex);
+  while (!stack.IsEmpty())
+  {
+    nodeIndex = stack.Back();
+    stack.DeleteBack();
+    const CNode &node = _nodes[nodeIndex];
+    for (int itemIndex = node.ItemIndex; itemIndex >= 0; itemIndex = _nextSameName[itemIndex])
+      itemIndexes.Add(itemIndex);
+    for (int child = node.FirstChild; child >= 0; child = _nodes[child].NextSibling)
+      stack.Add(child);
+  }
+}
+
+void CNameIndex::Update(const CArchiveDatabase &db)
+{
+  if (db.Files.Size() < _numItems)
+    Clear();
+  UString name;
+  for (; _numItems < db.Files.Size(); _numItems++)
+  {
+    db.GetPath(_numItems, name);
+    Add(name, _numItems);
+  }
+}
+
+void CPrefixFilter::Init(const CObjectVector<UString> &prefixes)
+{
+  _nodes.Clear();
+  CNode root;
+  root.FirstChild = -1;
+  root.NextSibling = -1;
+  root.Char = 0;
+  root.IsEnd = false;
+  _nodes.Add(root);
+  for (int i = 0; i < prefixes.Size(); i++)
+  {
+    const UString &prefix = prefixes[i];
+    int nodeIndex = 0;
+    for (int j = 0; j < prefix.Length(); j++)
+    {
+      wchar_t c = prefix[j];
+      int child;
+      for (child = _nodes[nodeIndex].FirstChild; child >= 0; child = _nodes[child].NextSibling)
+        if (_nodes[child].Char == c)
+          break;
+      if (child < 0)
+      {
+        CNode node;
+        node.FirstChild = -1;
+        node.NextSibling = _nodes[nodeIndex].FirstChild;
+        node.Char = c;
+        node.IsEnd = false;
+        child = _nodes.Add(node);
+        _nodes[nodeIndex].FirstChild = child;
+      }
+      nodeIndex = child;
+    }
+    _nodes[nodeIndex].IsEnd = true;
+  }
+}
+
+bool CPrefixFilter::Test(const UString &name) const
+{
+  if (_nodes.IsEmpty())
+    return false;
+  int nodeIndex = 0;
+  if (_nodes[0].IsEnd)
+    return true;
+  for (int i = 0; i < name.Length(); i++)
+  {
+    wchar_t c = name[i];
+    int child;
+    for (child = _nodes[nodeIndex].FirstChild; child >= 0; child = _nodes[child].NextSibling)
+      if (_nodes[child].Char == c)
+        break;
+    if (child < 0)
+      return false;
+    if (_nodes[child].IsEnd)
+      return true;
+    nodeIndex = child;
+  }
+  return false;
+}
+
+}}
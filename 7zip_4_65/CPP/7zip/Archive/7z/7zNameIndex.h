@@ -0,0 +1,94 @@
+// 7zNameIndex.h
+
+#ifndef __7Z_NAME_INDEX_H
+#define __7Z_NAME_INDEX_H
+
+#include "7zItem.h"
+
+namespace NArchive {
+namespace N7z {
+
+inline bool NameHasPrefix(const UString &name, const UString &prefix)
+{
+  int len = prefix.Length();
+  if (name.Length() < len)
+    return false;
+  const wchar_t *s = name;
+  const wchar_t *p = prefix;
+  for (int i = 0; i < len; i++)
+    if (s[i] != p[i])
+      return false;
+  return true;
+}
+
+/*
+CNameIndex is index for item names of CArchiveDatabase (names use '/' as separator).
+It's tree of path parts. Child nodes are found via hash table (parent node, part).
+  Find()       - O(path length)
+  GetSubtree() - O(number of nodes in subtree)
+Several items can have same name. Find() returns item with smallest index.
+*/
+
+class CNameIndex
+{
+  struct CNode
+  {
+    int Parent;
+    int FirstChild;
+    int NextSibling;
+    int ItemIndex;    // first item with that name, or -1
+    UInt32 Hash;
+    unsigned NameOffset;
+    unsigned NameLen;
+  };
+
+  CRecordVector<CNode> _nodes;
+  CRecordVector<wchar_t> _chars;   // parts of names
+  CIntVector _hashTable;           // node indexes, -1 - empty slot
+  CIntVector _nextSameName;        // for each item: next item with same name, or -1
+  int _numItems;
+
+  int FindChild(int parent, const wchar_t *name, unsigned len, UInt32 hash) const;
+  int GetChild(int parent, const wchar_t *name, unsigned len);
+  int FindNode(const UString &name) const;
+  int GetNode(const UString &name);
+  void InsertToHashTable(int nodeIndex);
+  void GrowHashTable();
+public:
+  CNameIndex() { Clear(); }
+  void Clear();
+
+  // It indexes new items of (files) and rebuilds index, if items were deleted
+  void Update(const CArchiveDatabase &db);
+
+  void Add(const UString &name, int itemIndex);
+  void Remove(const UString &name, int itemIndex);
+  int Find(const UString &name) const;
+
+  // it adds item of (name) and all items in (name/) subtree
+  void GetSubtree(const UString &name, CIntVector &itemIndexes) const;
+};
+
+/*
+CPrefixFilter checks whether name starts with one of prefixes.
+It's tree of characters, so Test() is O(name length) for any number of prefixes.
+*/
+
+class CPrefixFilter
+{
+  struct CNode
+  {
+    int FirstChild;
+    int NextSibling;
+    wchar_t Char;
+    bool IsEnd;
+  };
+  CRecordVector<CNode> _nodes;
+public:
+  void Init(const CObjectVector<UString> &prefixes);
+  bool Test(const UString &name) const;
+};
+
+}}
+
+#endif
@@ -0,0 +1,260 @@
+// 7zNameTable.cpp
+
+#include "StdAfx.h"
+
+#include "7zNameTable.h"
+
+namespace NArchive {
+namespace N7z {
+
+static const wchar_t kDirDelimiter = L'/';
+static const int kHashTableSizeMin = 1 << 8;
+
+static UInt32 GetNameHash(int parent, const wchar_t *name, unsigned len)
+{
+  UInt32 hash = 2166136261U ^ (UInt32)parent;
+  hash *= 16777619;
+  for (unsigned i = 0; i < len; i++)
+  {
+    hash ^= (UInt32)name[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+void CNameTable::Clear()
+{
+  _chars.Free();
+  _numChars = 0;
+  _dirs.Clear();
+  _lastDir = 0;
+  _lastDirPathLen = 0;
+
+  CDir root;
+  root.Parent = -1;
+  root.Hash = 0;
+  root.Offset = 0;
+  root.Len = 0;
+  root.PathLen = 0;
+  _dirs.Add(root);
+
+  _hashTable.Clear();
+  _hashTable.Reserve(kHashTableSizeMin);
+  for (int i = 0; i < kHashTableSizeMin; i++)
+    _hashTable.Add(-1);
+}
+
+void CNameTable::ReserveDown()
+{
+  _chars.SetCapacity(_numChars);
+  _dirs.ReserveDown();
+  _lastDirPath.Free();
+  _lastDir = 0;
+  _lastDirPathLen = 0;
+}
+
+void CNameTable::ReserveChars(UInt32 numChars)
+{
+  if (numChars > _chars.GetCapacity())
+    _chars.SetCapacity(numChars);
+}
+
+void CNameTable::InsertToHashTable(int dirIndex)
+{
+  unsigned mask = (unsigned)_hashTable.Size() - 1;
+  unsigned i = _dirs[dirIndex].Hash & mask;
+  while (_hashTable[i] >= 0)
+    i = (i + 1) & mask;
+  _hashTable[i] = dirIndex;
+}
+
+void CNameTable::GrowHashTable()
+{
+  int newSize = _hashTable.Size() * 2;
+  _hashTable.Clear();
+  _hashTable.Reserve(newSize);
+  int i;
+  for (i = 0; i < newSize; i++)
+    _hashTable.Add(-1);
+  // root dir is not in hash table
+  for (i = 1; i < _dirs.Size(); i++)
+    InsertToHashTable(i);
+}
+
+UInt32 CNameTable::AddChars(const wchar_t *s, unsigned len)
+{
+  UInt32 offset = _numChars;
+  if (len > _chars.GetCapacity() - offset)
+  {
+    size_t newCapacity = _chars.GetCapacity();
+    newCapacity += newCapacity / 2 + len + (1 << 10);
+    _chars.SetCapacity(newCapacity);
+  }
+  if (len != 0)
+    memcpy((wchar_t *)_chars + offset, s, len * sizeof(wchar_t));
+  _numChars += len;
+  return offset;
+}
+
+int CNameTable::GetDir(int parent, const wchar_t *name, unsigned len)
+{
+  UInt32 hash = GetNameHash(parent, name, len);
+  unsigned mask = (unsigned)_hashTable.Size() - 1;
+  for (unsigned i = hash & mask;; i = (i + 1) & mask)
+  {
+    int dirIndex = _hashTable[i];
+    if (dirIndex < 0)
+      break;
+    const CDir &dir = _dirs[dirIndex];
+    if (dir.Hash == hash && dir.Parent == parent && dir.Len == len &&
+        (len == 0 || memcmp((const wchar_t *)_chars + dir.Offset, name, len * sizeof(wchar_t)) == 0))
+      return dirIndex;
+  }
+
+  CDir dir;
+  dir.Parent = parent;
+  dir.Hash = hash;
+  dir.Offset = AddChars(name, len);
+  dir.Len = len;
+  dir.PathLen = (parent == 0 ? 0 : _dirs[parent].PathLen + 1) + len;
+  int dirIndex = _dirs.Add(dir);
+
+  if (_dirs.Size() * 2 > _hashTable.Size())
+    GrowHashTable();
+  else
+    InsertToHashTable(dirIndex);
+  return dirIndex;
+}
+
+CNameRef CNameTable::Add(const wchar_t *name, unsigned len)
+{
+  CNameRef ref;
+  unsigned start = len;
+  while (start != 0 && name[start - 1] != kDirDelimiter)
+    start--;
+  
+  // (start) is length of directory path with tail delimiter
+  if (start == _lastDirPathLen &&
+      (start == 0 || memcmp((const wchar_t *)_lastDirPath, name, start * sizeof(wchar_t)) == 0))
+    ref.Dir = _lastDir;
+  else
+  {
+    ref.Dir = 0;
+    unsigned partStart = 0;
+    for (unsigned i = 0; i < start; i++)
+      if (name[i] == kDirDelimiter)
+      {
+        ref.Dir = GetDir(ref.Dir, name + partStart, i - partStart);
+        partStart = i + 1;
+      }
+    if (start > _lastDirPath.GetCapacity())
+      _lastDirPath.SetCapacity(start + start / 2);
+    if (start != 0)
+      memcpy((wchar_t *)_lastDirPath, name, start * sizeof(wchar_t));
+    _lastDirPathLen = start;
+    _lastDir = ref.Dir;
+  }
+
+  ref.Len = len - start;
+  ref.Offset = AddChars(name + start, ref.Len);
+  return ref;
+}
+
+void CNameTable::GetChars(const CNameRef &ref, wchar_t *dest, wchar_t separator) const
+{
+  dest += GetLen(ref);
+  unsigned len = ref.Len;
+  if (len != 0)
+  {
+    dest -= len;
+    memcpy(dest, (const wchar_t *)_chars + ref.Offset, len * sizeof(wchar_t));
+  }
+  for (int dirIndex = ref.Dir; dirIndex != 0;)
+  {
+    const CDir &dir = _dirs[dirIndex];
+    *--dest = separator;
+    len = dir.Len;
+    if (len != 0)
+    {
+      dest -= len;
+      memcpy(dest, (const wchar_t *)_chars + dir.Offset, len * sizeof(wchar_t));
+    }
+    dirIndex = dir.Parent;
+  }
+}
+
+void CNameTable::Get(const CNameRef &ref, UString &name) const
+{
+  int len = (int)GetLen(ref);
+  GetChars(ref, name.GetBuffer(len));
+  name.ReleaseBuffer(len);
+}
+
+// it compares (s1 + end1) and (s2 + end2). end is kDirDelimiter for directory part or 0 for last part.
+// It returns 0, if both parts are equal, including (end) chars.
+
+static int ComparePartsNoCase(
+    const wchar_t *s1, unsigned len1, wchar_t end1,
+    const wchar_t *s2, unsigned len2, wchar_t end2)
+{
+  for (unsigned i = 0;; i++)
+  {
+    wchar_t c1 = (i < len1) ? s1[i] : end1;
+    wchar_t c2 = (i < len2) ? s2[i] : end2;
+    if (c1 != c2)
+    {
+      wchar_t u1 = MyCharUpper(c1);
+      wchar_t u2 = MyCharUpper(c2);
+      if (u1 < u2) return -1;
+      if (u1 > u2) return 1;
+    }
+    if (i >= len1 || i >= len2)
+      return 0;
+  }
+}
+
+int CNameTable::CompareNoCase(const CNameRef &ref1, const CNameRef &ref2) const
+{
+  const wchar_t *chars = _chars;
+  const wchar_t *s1 = chars + ref1.Offset;
+  const wchar_t *s2 = chars + ref2.Offset;
+  unsigned len1 = ref1.Len;
+  unsigned len2 = ref2.Len;
+  wchar_t end1 = 0;
+  wchar_t end2 = 0;
+
+  // we go up to common directory. Parent's PathLen is smaller than PathLen of child,
+  // except of empty part in root directory (PathLen = 0).
+  int dir1 = ref1.Dir;
+  int dir2 = ref2.Dir;
+  while (dir1 != dir2)
+  {
+    const CDir &d1 = _dirs[dir1];
+    const CDir &d2 = _dirs[dir2];
+    if (dir2 == 0 || (dir1 != 0 && d1.PathLen >= d2.PathLen))
+    {
+      s1 = chars + d1.Offset;
+      len1 = d1.Len;
+      end1 = kDirDelimiter;
+      dir1 = d1.Parent;
+    }
+    else
+    {
+      s2 = chars + d2.Offset;
+      len2 = d2.Len;
+      end2 = kDirDelimiter;
+      dir2 = d2.Parent;
+    }
+  }
+
+  int res = ComparePartsNoCase(s1, len1, end1, s2, len2, end2);
+  if (res != 0 || end1 == 0)
+    return res;
+  // different directories that differ only in case of chars
+  UString name1, name2;
+  Get(ref1, name1);
+  Get(ref2, name2);
+  return MyStringCompareNoCase(name1, name2);
+}
+
+}}
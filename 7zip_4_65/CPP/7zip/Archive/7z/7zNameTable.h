@@ -0,0 +1,87 @@
+// 7zNameTable.h
+
+#ifndef __7Z_NAME_TABLE_H
+#define __7Z_NAME_TABLE_H
+
+#include "../../../Common/Buffer.h"
+#include "../../../Common/MyString.h"
+#include "../../../Common/MyVector.h"
+#include "../../../Common/Types.h"
+
+namespace NArchive {
+namespace N7z {
+
+/*
+CNameTable stores names of items (names use '/' as separator) in one array of chars.
+Name is stored as (directory, last part). Each directory is stored only once
+as (parent directory, part), so items in same directory share the prefix.
+Directory is found via hash table (parent directory, part).
+Node 0 is root directory (empty prefix).
+Names are not removed from table. New name for item is added as new name.
+Items are usually sorted by directories, so Add() checks the directory
+of previous name before hash table search.
+*/
+
+struct CNameRef
+{
+  int Dir;
+  UInt32 Offset;
+  UInt32 Len;
+
+  void Init() { Dir = 0; Offset = 0; Len = 0; }
+};
+
+class CNameTable
+{
+  struct CDir
+  {
+    int Parent;
+    UInt32 Hash;
+    UInt32 Offset;
+    UInt32 Len;
+    UInt32 PathLen; // length of (parent path + '/' + part)
+  };
+
+  CWCharBuffer _chars;
+  UInt32 _numChars;
+  CRecordVector<CDir> _dirs;
+  CIntVector _hashTable; // dir indexes, -1 - empty slot
+
+  // directory of previous Add() call
+  int _lastDir;
+  CWCharBuffer _lastDirPath;
+  unsigned _lastDirPathLen;
+
+  void InsertToHashTable(int dirIndex);
+  void GrowHashTable();
+  int GetDir(int parent, const wchar_t *name, unsigned len);
+  UInt32 AddChars(const wchar_t *s, unsigned len);
+public:
+  CNameTable() { Clear(); }
+  void Clear();
+  void ReserveDown();
+  void ReserveChars(UInt32 numChars);
+  bool IsEmpty() const { return _numChars == 0 && _dirs.Size() == 1; }
+
+  CNameRef Add(const wchar_t *name, unsigned len);
+  CNameRef Add(const UString &name) { return Add(name, name.Length()); }
+
+  unsigned GetLen(const CNameRef &ref) const
+  {
+    if (ref.Dir == 0)
+      return ref.Len;
+    return _dirs[ref.Dir].PathLen + 1 + ref.Len;
+  }
+
+  // it writes GetLen(ref) chars to dest. Parts are separated with (separator)
+  void GetChars(const CNameRef &ref, wchar_t *dest, wchar_t separator = L'/') const;
+  void Get(const CNameRef &ref, UString &name) const;
+
+  // it's same as MyStringCompareNoCase() for full paths, but it doesn't build paths,
+  // if names differ in first part after common directory.
+  int CompareNoCase(const CNameRef &ref1, const CNameRef &ref2) const;
+};
+
+}}
+
+#endif
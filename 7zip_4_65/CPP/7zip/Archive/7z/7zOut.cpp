@@ -99,6 +99,7 @@ HRESULT COutArchive::WriteFinishHeader(const CFinishHeader &h)
 HRESULT COutArchive::Create(ISequentialOutStream *stream, bool endMarker)
 {
   Close();
+  _prevHeaderDefined = false;
   #ifdef _7Z_VOL
   // endMarker = false;
   _endMarker = endMarker;
@@ -573,6 +574,8 @@ HRESULT COutArchive::EncodeStream(
 void COutArchive::WriteHeader(
     const CArchiveDatabase &db,
     const CHeaderOptions &headerOptions,
+    UInt64 dataOffset,
+    const CStartHeader *prevHeader,
     UInt64 &headerOffset)
 {
   int i;
@@ -581,16 +584,27 @@ void COutArchive::WriteHeader(
   for (i = 0; i < db.PackSizes.Size(); i++)
     packedSize += db.PackSizes[i];
 
-  headerOffset = packedSize;
+  headerOffset = dataOffset + packedSize;
 
-  WriteByte(NID::kHeader);
+  WriteID(prevHeader ? NID::kChainedHeader : NID::kHeader);
 
   // Archive Properties
 
+  if (prevHeader)
+  {
+    WriteByte(NID::kArchiveProperties);
+    WriteID(NID::kPrevHeader);
+    WriteNumber(kStartHeaderSize);
+    WriteUInt64(prevHeader->NextHeaderOffset);
+    WriteUInt64(prevHeader->NextHeaderSize);
+    WriteUInt32(prevHeader->NextHeaderCRC);
+    WriteByte(NID::kEnd);
+  }
+
   if (db.Folders.Size() > 0)
   {
     WriteByte(NID::kMainStreamsInfo);
-    WritePackInfo(0, db.PackSizes,
+    WritePackInfo(dataOffset, db.PackSizes,
         db.PackCRCsDefined,
         db.PackCRCs);
 
@@ -689,10 +703,10 @@ void COutArchive::WriteHeader(
     size_t namesDataSize = 0;
     for (int i = 0; i < db.Files.Size(); i++)
     {
-      const UString &name = db.Files[i].Name;
-      if (!name.IsEmpty())
+      unsigned len = db.Names.GetLen(db.Files[i].NameRef);
+      if (len != 0)
         numDefined++;
-      namesDataSize += (name.Length() + 1) * 2;
+      namesDataSize += (len + 1) * 2;
     }
     
     if (numDefined > 0)
@@ -703,9 +717,10 @@ void COutArchive::WriteHeader(
       WriteByte(NID::kName);
       WriteNumber(namesDataSize);
       WriteByte(0);
+      UString name;
       for (int i = 0; i < db.Files.Size(); i++)
       {
-        const UString &name = db.Files[i].Name;
+        db.GetPath(i, name);
         for (int t = 0; t <= name.Length(); t++)
         {
           wchar_t c = name[t];
@@ -749,15 +764,16 @@ void COutArchive::WriteHeader(
   WriteByte(NID::kEnd); // for headers
 }
 
-HRESULT COutArchive::WriteDatabase(
+HRESULT COutArchive::WriteHeaderBlock(
     DECL_EXTERNAL_CODECS_LOC_VARS
     const CArchiveDatabase &db,
     const CCompressionMethodMode *options,
-    const CHeaderOptions &headerOptions)
+    const CHeaderOptions &headerOptions,
+    UInt64 dataOffset,
+    UInt64 tailGapSize,
+    const CStartHeader *prevHeader,
+    CStartHeader &h)
 {
-  if (!db.CheckNumFiles())
-    return E_FAIL;
-
   UInt64 headerOffset;
   UInt32 headerCRC;
   UInt64 headerSize;
@@ -783,7 +799,7 @@ HRESULT COutArchive::WriteDatabase(
     _countMode = encodeHeaders;
     _writeToStream = true;
     _countSize = 0;
-    WriteHeader(db, headerOptions, headerOffset);
+    WriteHeader(db, headerOptions, dataOffset, prevHeader, headerOffset);
 
     if (encodeHeaders)
     {
@@ -793,10 +809,11 @@ HRESULT COutArchive::WriteDatabase(
       
       _countMode = false;
       _writeToStream = false;
-      WriteHeader(db, headerOptions, headerOffset);
+      WriteHeader(db, headerOptions, dataOffset, prevHeader, headerOffset);
       
       if (_countSize != _outByte2.GetPos())
         return E_FAIL;
+      headerOffset += tailGapSize;
 
       CCompressionMethodMode encryptOptions;
       encryptOptions.PasswordIsDefined = options->PasswordIsDefined;
@@ -822,39 +839,186 @@ HRESULT COutArchive::WriteDatabase(
       for (int i = 0; i < packSizes.Size(); i++)
         headerOffset += packSizes[i];
     }
+    else
+      headerOffset += tailGapSize;
     RINOK(_outByte.Flush());
     headerCRC = CRC_GET_DIGEST(_crc);
     headerSize = _outByte.GetProcessedSize();
   }
+  h.NextHeaderSize = headerSize;
+  h.NextHeaderCRC = headerCRC;
+  h.NextHeaderOffset = headerOffset;
+  return S_OK;
+}
+
+HRESULT COutArchive::WriteDatabase(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    const CArchiveDatabase &db,
+    const CCompressionMethodMode *options,
+    const CHeaderOptions &headerOptions)
+{
+  if (!db.CheckNumFiles())
+    return E_FAIL;
+
+  CStartHeader h;
+  RINOK(WriteHeaderBlock(
+      EXTERNAL_CODECS_LOC_VARS
+      db, options, headerOptions, 0, 0, NULL, h));
   #ifdef _7Z_VOL
   if (_endMarker)
   {
-    CFinishHeader h;
-    h.NextHeaderSize = headerSize;
-    h.NextHeaderCRC = headerCRC;
-    h.NextHeaderOffset =
-        UInt64(0) - (headerSize +
+    CFinishHeader fh;
+    fh.NextHeaderSize = h.NextHeaderSize;
+    fh.NextHeaderCRC = h.NextHeaderCRC;
+    fh.NextHeaderOffset =
+        UInt64(0) - (h.NextHeaderSize +
         4 + kFinishHeaderSize);
-    h.ArchiveStartOffset = h.NextHeaderOffset - headerOffset;
-    h.AdditionalStartBlockSize = 0;
-    RINOK(WriteFinishHeader(h));
+    fh.ArchiveStartOffset = fh.NextHeaderOffset - h.NextHeaderOffset;
+    fh.AdditionalStartBlockSize = 0;
+    RINOK(WriteFinishHeader(fh));
     return WriteFinishSignature();
   }
   else
   #endif
   {
-    CStartHeader h;
-    h.NextHeaderSize = headerSize;
-    h.NextHeaderCRC = headerCRC;
-    h.NextHeaderOffset = headerOffset;
     RINOK(Stream->Seek(_prefixHeaderPos, STREAM_SEEK_SET, NULL));
     return WriteStartHeader(h);
   }
 }
 
+HRESULT COutArchive::WriteCheckpoint(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    CArchiveDatabase &db,
+    const CCompressionMethodMode *options,
+    const CHeaderOptions &headerOptions,
+    bool fullHeader,
+    int numFixedFolders)
+{
+  if (!db.CheckNumFiles())
+    return E_FAIL;
+  if (db.IsEmpty())
+    return S_OK;
+
+  bool delta = (_prevHeaderDefined && !fullHeader);
+
+  // only "gap" folder of previous header block was added
+  if (delta && db.Files.Size() == _numChainedFiles && db.Folders.Size() == _numChainedFolders + 1)
+    return S_OK;
+
+  int i;
+  UInt64 tailGapSize = 0;
+  if (!delta)
+    tailGapSize = db.RemoveTailGapFolders(numFixedFolders);
+
+  UInt64 dataOffset = 0;
+  UInt64 dataEnd = 0;
+  for (i = 0; i < db.PackSizes.Size(); i++)
+  {
+    if (delta && i == _numChainedPackStreams)
+      dataOffset = dataEnd;
+    dataEnd += db.PackSizes[i];
+  }
+
+  CStartHeader h;
+  if (delta)
+  {
+    CArchiveDatabase deltaDB;
+    for (i = _numChainedPackStreams; i < db.PackSizes.Size(); i++)
+    {
+      deltaDB.PackSizes.Add(db.PackSizes[i]);
+      if (i < db.PackCRCsDefined.Size())
+      {
+        deltaDB.PackCRCsDefined.Add(db.PackCRCsDefined[i]);
+        deltaDB.PackCRCs.Add(db.PackCRCs[i]);
+      }
+    }
+    for (i = _numChainedFolders; i < db.Folders.Size(); i++)
+    {
+      deltaDB.Folders.Add(db.Folders[i]);
+      deltaDB.NumUnpackStreamsVector.Add(db.NumUnpackStreamsVector[i]);
+    }
+    for (i = _numChainedFiles; i < db.Files.Size(); i++)
+    {
+      CFileItem file;
+      CFileItem2 file2;
+      db.GetFile(i, file, file2);
+      deltaDB.AddFile(file, file2);
+    }
+    RINOK(WriteHeaderBlock(
+        EXTERNAL_CODECS_LOC_VARS
+        deltaDB, options, headerOptions, dataOffset, 0, &_prevHeader, h));
+  }
+  else
+  {
+    RINOK(WriteHeaderBlock(
+        EXTERNAL_CODECS_LOC_VARS
+        db, options, headerOptions, 0, tailGapSize, NULL, h));
+  }
+
+  UInt64 endPos;
+  RINOK(Stream->Seek(0, STREAM_SEEK_CUR, &endPos));
+  RINOK(Stream->Seek(_prefixHeaderPos, STREAM_SEEK_SET, NULL));
+  RINOK(WriteStartHeader(h));
+  RINOK(Stream->Seek(endPos, STREAM_SEEK_SET, NULL));
+
+  _prevHeaderDefined = true;
+  _prevHeader = h;
+  _numChainedFiles = db.Files.Size();
+  _numChainedFolders = db.Folders.Size();
+  _numChainedPackStreams = db.PackSizes.Size();
+
+  // header block (and packed streams of encoded header) is "gap" folder for next items
+  UInt64 gapSize = h.NextHeaderOffset + h.NextHeaderSize - dataEnd;
+  CFolder folder;
+  CCoderInfo coder;
+  coder.MethodID = 0; // Copy
+  coder.NumInStreams = 1;
+  coder.NumOutStreams = 1;
+  folder.Coders.Add(coder);
+  folder.PackStreams.Add(0);
+  folder.UnpackSizes.Add(gapSize);
+  db.Folders.Add(folder);
+  db.NumUnpackStreamsVector.Add(0);
+  db.PackSizes.Add(gapSize);
+  if (!db.PackCRCsDefined.IsEmpty())
+  {
+    db.PackCRCsDefined.Add(false);
+    db.PackCRCs.Add(0);
+  }
+  return S_OK;
+}
+
+static bool IsGapFolder(const CFolder &folder)
+{
+  return folder.Coders.Size() == 1
+      && folder.Coders[0].MethodID == 0
+      && folder.PackStreams.Size() == 1
+      && folder.BindPairs.Size() == 0;
+}
+
+UInt64 CArchiveDatabase::RemoveTailGapFolders(int numFixedFolders)
+{
+  UInt64 size = 0;
+  while (Folders.Size() > numFixedFolders && !PackSizes.IsEmpty()
+      && NumUnpackStreamsVector.Back() == 0 && IsGapFolder(Folders.Back()))
+  {
+    size += PackSizes.Back();
+    Folders.DeleteBack();
+    NumUnpackStreamsVector.DeleteBack();
+    PackSizes.DeleteBack();
+    if (PackCRCsDefined.Size() > PackSizes.Size())
+    {
+      PackCRCsDefined.DeleteBack();
+      PackCRCs.DeleteBack();
+    }
+  }
+  return size;
+}
+
 void CArchiveDatabase::GetFile(int index, CFileItem &file, CFileItem2 &file2) const
 {
   file = Files[index];
+  GetPath(index, file2.Name);
   file2.CTimeDefined = CTime.GetItem(index, file2.CTime);
   file2.ATimeDefined = ATime.GetItem(index, file2.ATime);
   file2.MTimeDefined = MTime.GetItem(index, file2.MTime);
@@ -871,6 +1035,7 @@ void CArchiveDatabase::AddFile(const CFileItem &file, const CFileItem2 &file2)
   StartPos.SetItem(index, file2.StartPosDefined, file2.StartPos);
   SetItemAnti(index, file2.IsAnti);
   Files.Add(file);
+  SetPath(index, file2.Name);
 }
 
 }}
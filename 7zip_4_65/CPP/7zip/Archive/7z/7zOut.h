@@ -57,10 +57,30 @@ struct CHeaderOptions
       {}
 };
 
+/*
+Segmented header mode (WriteCheckpoint):
+  Each checkpoint writes header block only for items that were added after
+  previous checkpoint (delta header block) and links it to previous block
+  via NID::kPrevHeader. Then start header is updated to point to new block.
+  Data of next items follows that header block. The bytes of header block are
+  added to db as "gap" folder (Copy coder, no files), so db always describes
+  all bytes of archive, and full header for db is standard 7z header.
+  Delta header block starts with NID::kChainedHeader, so old readers reject
+  archive until full header is written (compaction).
+  Compaction removes "gap" folders at the end of db: new full header just
+  follows old header blocks, and these bytes are not referenced anymore.
+*/
+
 class COutArchive
 {
   UInt64 _prefixHeaderPos;
 
+  bool _prevHeaderDefined;
+  CStartHeader _prevHeader;
+  int _numChainedFiles;        // items that are described by previous header blocks
+  int _numChainedFolders;
+  int _numChainedPackStreams;
+
   HRESULT WriteDirect(const void *data, UInt32 size);
   
   UInt64 GetPos() const;
@@ -109,7 +129,18 @@ class COutArchive
   void WriteHeader(
       const CArchiveDatabase &db,
       const CHeaderOptions &headerOptions,
+      UInt64 dataOffset,
+      const CStartHeader *prevHeader,
       UInt64 &headerOffset);
+  HRESULT WriteHeaderBlock(
+      DECL_EXTERNAL_CODECS_LOC_VARS
+      const CArchiveDatabase &db,
+      const CCompressionMethodMode *options,
+      const CHeaderOptions &headerOptions,
+      UInt64 dataOffset,
+      UInt64 tailGapSize,
+      const CStartHeader *prevHeader,
+      CStartHeader &h);
   
   bool _countMode;
   bool _writeToStream;
@@ -133,7 +164,7 @@ class COutArchive
   CMyComPtr<IOutStream> Stream;
 public:
 
-  COutArchive() { _outByte.Create(1 << 16); }
+  COutArchive(): _prevHeaderDefined(false) { _outByte.Create(1 << 16); }
   CMyComPtr<ISequentialOutStream> SeqStream;
   HRESULT Create(ISequentialOutStream *stream, bool endMarker);
   void Close();
@@ -144,6 +175,24 @@ public:
       const CCompressionMethodMode *options,
       const CHeaderOptions &headerOptions);
 
+  // fullHeader = true: it writes header for all items (compaction of header chain).
+  // Compaction removes tail "gap" folders, except first numFixedFolders folders.
+  // It adds "gap" folder for new header block to db.
+  HRESULT WriteCheckpoint(
+      DECL_EXTERNAL_CODECS_LOC_VARS
+      CArchiveDatabase &db,
+      const CCompressionMethodMode *options,
+      const CHeaderOptions &headerOptions,
+      bool fullHeader,
+      int numFixedFolders);
+
+  // Call it, if item (index) of db was changed after it was written to header block.
+  void NotifyFileChanged(int index)
+  {
+    if (_prevHeaderDefined && index < _numChainedFiles)
+      _prevHeaderDefined = false;
+  }
+
   #ifdef _7Z_VOL
   static UInt32 GetVolHeadersSize(UInt64 dataSize, int nameLength = 0, bool props = false);
   static UInt64 GetVolPureSize(UInt64 volSize, int nameLength = 0, bool props = false);
@@ -2,12 +2,22 @@
 
 #include "StdAfx.h"
 
+#include "Windows/System.h"
+#include "Windows/Thread.h"
+
 #include "../../Common/LimitedStreams.h"
+#include "../../Common/OutMemStream.h"
 #include "../../Common/ProgressUtils.h"
+#ifdef COMPRESS_MT
+#include "../../Common/ProgressMt.h"
+#endif
 
 #include "../../Compress/CopyCoder.h"
 
 #include "../Common/ItemNameUtils.h"
+#ifdef COMPRESS_MT
+#include "../Common/MtUpdateThreads.h"
+#endif
 
 #include "7zEncode.h"
 #include "7zFolderInStream.h"
@@ -104,9 +114,9 @@ static int CompareFolders(const CFolder &f1, const CFolder &f2)
   return 0;
 }
 
-static int CompareFiles(const CFileItem &f1, const CFileItem &f2)
+static int CompareFiles(const CArchiveDatabase &db, int i1, int i2)
 {
-  return MyStringCompareNoCase(f1.Name, f2.Name);
+  return db.Names.CompareNoCase(db.Files[i1].NameRef, db.Files[i2].NameRef);
 }
 
 static int CompareFolderRefs(const int *p1, const int *p2, void *param)
@@ -122,9 +132,9 @@ static int CompareFolderRefs(const int *p1, const int *p2, void *param)
       db.NumUnpackStreamsVector[i2]));
   if (db.NumUnpackStreamsVector[i1] == 0)
     return 0;
-  return CompareFiles(
-      db.Files[db.FolderStartFileIndex[i1]],
-      db.Files[db.FolderStartFileIndex[i2]]);
+  return CompareFiles(db,
+      db.FolderStartFileIndex[i1],
+      db.FolderStartFileIndex[i2]);
 }
 
 ////////////////////////////////////////////////////////////
@@ -292,6 +302,7 @@ struct CSolidGroup
 {
   CCompressionMethodMode Method;
   CRecordVector<UInt32> Indices;
+  bool IsExeGroup;
 };
 
 static wchar_t *g_ExeExts[] =
@@ -410,6 +421,8 @@ static void SplitFilesToGroups(
   CSolidGroup &generalGroup = groups[0];
   CSolidGroup &exeGroup = groups[1];
   generalGroup.Method = method;
+  generalGroup.IsExeGroup = false;
+  exeGroup.IsExeGroup = true;
   int i;
   for (i = 0; i < updateItems.Size(); i++)
   {
@@ -447,7 +460,7 @@ static void SplitFilesToGroups(
 static void FromUpdateItemToFileItem(const CUpdateItem &ui,
     CFileItem &file, CFileItem2 &file2)
 {
-  file.Name = NItemName::MakeLegalName(ui.Name);
+  file2.Name = NItemName::MakeLegalName(ui.Name);
   if (ui.AttribDefined)
     file.SetAttrib(ui.Attrib);
   
@@ -462,6 +475,437 @@ static void FromUpdateItemToFileItem(const CUpdateItem &ui,
   file.HasStream = ui.HasStream();
 }
 
+static const int kNumSessionEncodersMax = 4;
+
+void CUpdateSession::FreeEncoders()
+{
+  for (int i = 0; i < _encoders.Size(); i++)
+    delete _encoders[i].Encoder;
+  _encoders.Clear();
+}
+
+void CUpdateSession::Clear()
+{
+  FreeEncoders();
+  _encoders.ClearAndFree();
+  UpdateItems.ClearAndFree();
+  _passwordIsDefined = false;
+  _password.Empty();
+}
+
+CEncoder *CUpdateSession::GetEncoder(const CCompressionMethodMode &method, bool isExeGroup, const UInt64 *inSizeForReduce)
+{
+  if (method.PasswordIsDefined != _passwordIsDefined || method.Password != _password)
+  {
+    FreeEncoders();
+    _passwordIsDefined = method.PasswordIsDefined;
+    _password = method.Password;
+  }
+
+  // CEncoder sets reduced dictionary size only at first Encode() call
+  UInt32 dictionarySize = 0;
+  for (int m = 0; m < method.Methods.Size(); m++)
+  {
+    dictionarySize = GetMethodDictionarySize(method.Methods[m], inSizeForReduce);
+    if (dictionarySize != 0)
+      break;
+  }
+
+  int i;
+  for (i = 0; i < _encoders.Size(); i++)
+  {
+    CEncoderItem item = _encoders[i];
+    if (item.IsExeGroup == isExeGroup && item.DictionarySize == dictionarySize)
+    {
+      _encoders.Delete(i);
+      _encoders.Add(item);
+      return item.Encoder;
+    }
+  }
+  if (_encoders.Size() >= kNumSessionEncodersMax)
+  {
+    delete _encoders[0].Encoder;
+    _encoders.Delete(0);
+  }
+  CEncoderItem item;
+  item.Encoder = new CEncoder(method);
+  item.IsExeGroup = isExeGroup;
+  item.DictionarySize = dictionarySize;
+  _encoders.Add(item);
+  return item.Encoder;
+}
+
+// it adds (folder) (if it's not NULL) and processed files of that folder to newDatabase
+
+static HRESULT AddFolder(
+    const CArchiveDatabaseEx *db,
+    const CObjectVector<CUpdateItem> &updateItems,
+    const UInt32 *indices, int numFiles,
+    const CRecordVector<bool> &processed,
+    const CRecordVector<UInt32> &crcs,
+    const CRecordVector<UInt64> &sizes,
+    const CFolder *folder,
+    CArchiveDatabase &newDatabase,
+    const CUpdateOptions &options)
+{
+  if (folder)
+    newDatabase.Folders.Add(*folder);
+  
+  bool isComplete = true;
+  CNum numUnpackStreams = 0;
+  for (int subIndex = 0; subIndex < numFiles; subIndex++)
+  {
+    const CUpdateItem &ui = updateItems[indices[subIndex]];
+    CFileItem file;
+    CFileItem2 file2;
+    if (ui.NewProperties)
+      FromUpdateItemToFileItem(ui, file, file2);
+    else
+      db->GetFile(ui.IndexInArchive, file, file2);
+    if (file2.IsAnti || file.IsDir)
+      return E_FAIL;
+    
+    if (!processed[subIndex])
+    {
+      isComplete = false;
+      continue;
+      // file.Name += L".locked";
+    }
+
+    file.Crc = crcs[subIndex];
+    file.Size = sizes[subIndex];
+    if (file.Size != ui.Size)
+      isComplete = false;
+    if (file.Size != 0)
+    {
+      file.CrcDefined = true;
+      file.HasStream = true;
+      numUnpackStreams++;
+    }
+    else
+    {
+      file.CrcDefined = false;
+      file.HasStream = false;
+    }
+    newDatabase.AddFile(file, file2);
+  }
+  // numUnpackStreams = 0 is very bad case for locked files
+  // v3.13 doesn't understand it.
+  if (folder)
+    newDatabase.NumUnpackStreamsVector.Add(numUnpackStreams);
+  if (isComplete && options.CommitCallback)
+    return options.CommitCallback->FolderCommitted();
+  return S_OK;
+}
+
+// it returns number of files for next folder (solid block) that starts from (indices[0])
+
+static int GetNumFolderFiles(
+    const CObjectVector<CUpdateItem> &updateItems,
+    const UInt32 *indices, int numFiles,
+    UInt64 numSolidFiles,
+    const CUpdateOptions &options)
+{
+  UInt64 totalSize = 0;
+  int numSubFiles;
+  const wchar_t *prevExtension = NULL;
+  for (numSubFiles = 0; numSubFiles < numFiles &&
+      numSubFiles < numSolidFiles; numSubFiles++)
+  {
+    const CUpdateItem &ui = updateItems[indices[numSubFiles]];
+    totalSize += ui.Size;
+    if (totalSize > options.NumSolidBytes)
+      break;
+    if (options.SolidExtension)
+    {
+      const wchar_t *ext = (const wchar_t *)ui.Name + ui.GetExtensionPos();
+      if (numSubFiles == 0)
+        prevExtension = ext;
+      else
+        if (MyStringCompareNoCase(ext, prevExtension) != 0)
+          break;
+    }
+  }
+  if (numSubFiles < 1)
+    numSubFiles = 1;
+  return numSubFiles;
+}
+
+#ifdef COMPRESS_MT
+
+/*
+Multithreaded compression of folders (solid blocks) of one group.
+Each thread has its own encoder and compresses one folder to memory blocks
+(COutMemStream). The folder input stream of thread opens files of folder via
+(updateCallback) under lock. The main thread writes folders to archive in
+original order: the thread that compresses first uncommitted folder is switched
+to real stream mode, so it writes directly to archive stream.
+If the call has only one folder (for example, UpdateItems() call for one item),
+that folder is compressed in main thread, and the coder itself can use
+method.NumThreads threads (LZMA2 block threads, LZMA match finder thread).
+*/
+
+static const UInt32 kMtNumThreadsMax = (1 << 10);
+static const size_t kMtMemPerThread = (1 << 25);
+static const size_t kMtBlockSize = (1 << 16);
+
+struct CThreadInfo: public CMtUpdateThread
+{
+  #ifdef EXTERNAL_CODECS
+  CMyComPtr<ICompressCodecsInfo> _codecsInfo;
+  const CObjectVector<CCodecInfoEx> *_externalCodecs;
+  #endif
+
+  CFolderInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+
+  CEncoder *Encoder; // it's created after CThreadInfo was added to vector
+  const UInt64 *InSizeForReduce;
+  CFolder Folder;
+  CRecordVector<UInt64> PackSizes;
+
+  int FolderIndex;
+
+  CThreadInfo(): InStreamSpec(0), Encoder(0) {}
+  ~CThreadInfo() { delete Encoder; }
+  HRESULT Code();
+};
+
+HRESULT CThreadInfo::Code()
+{
+  Folder = CFolder();
+  PackSizes.Clear();
+  return Encoder->Encode(
+      #ifdef EXTERNAL_CODECS
+      _codecsInfo, _externalCodecs,
+      #endif
+      InStream, NULL, InSizeForReduce, Folder,
+      OutStream, PackSizes, Progress);
+}
+
+struct CMtFolder: public CMemLockBlocks
+{
+  CFolder Folder;
+  CRecordVector<UInt64> PackSizes;
+  CRecordVector<bool> Processed;
+  CRecordVector<UInt32> CRCs;
+  CRecordVector<UInt64> Sizes;
+  bool Defined;    // compressed data is in memory blocks
+  CMtFolder(): Defined(false) {}
+};
+
+class CMtFolders
+{
+public:
+  CMemBlockManagerMt *Manager;
+  CObjectVector<CMtFolder> Refs;
+  CMtFolders(CMemBlockManagerMt *manager): Manager(manager) {} ;
+  ~CMtFolders()
+  {
+    for (int i = 0; i < Refs.Size(); i++)
+      Refs[i].FreeOpt(Manager);
+  }
+};
+
+/*
+It returns number of threads for EncodeFoldersMt() (0 or 1 : multithreading is not used).
+Each thread needs encoder and kMtMemPerThread of memory blocks,
+so number of threads is reduced to use not more than half of RAM.
+*/
+
+static UInt32 GetNumMtThreads(const CCompressionMethodMode &method,
+    const UInt64 *inSizeForReduce, int numFolders)
+{
+  UInt32 numThreads = method.NumThreads;
+  if (numThreads > kMtNumThreadsMax)
+    numThreads = kMtNumThreadsMax;
+  if (numThreads > (UInt32)numFolders)
+    numThreads = (UInt32)numFolders;
+  if (numThreads <= 1)
+    return 0;
+
+  UInt32 dictionarySize = 0;
+  for (int m = 0; m < method.Methods.Size(); m++)
+  {
+    dictionarySize = GetMethodDictionarySize(method.Methods[m], inSizeForReduce);
+    if (dictionarySize != 0)
+      break;
+  }
+  // LZMA with BT4 match finder needs about (dictionarySize * 11.5)
+  UInt64 memPerThread = (UInt64)dictionarySize * 12 + (6 << 20) + kMtMemPerThread;
+  UInt64 ramSize = NWindows::NSystem::GetRamSize();
+  if (ramSize != 0)
+  {
+    UInt64 numThreadsMax = (ramSize / 2) / memPerThread;
+    if (numThreads > numThreadsMax)
+      numThreads = (UInt32)numThreadsMax;
+  }
+  return (numThreads > 1) ? numThreads : 0;
+}
+
+static HRESULT EncodeFoldersMt(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    const CArchiveDatabaseEx *db,
+    const CObjectVector<CUpdateItem> &updateItems,
+    const CRecordVector<UInt32> &indices,
+    const CRecordVector<int> &folderNumFiles,
+    UInt32 numThreads,
+    const CCompressionMethodMode &method,
+    const UInt64 *inSizeForReduce,
+    COutArchive &archive,
+    CArchiveDatabase &newDatabase,
+    IArchiveUpdateCallback *updateCallback,
+    CLocalProgress *lps,
+    const CUpdateOptions &options)
+{
+  int numFolders = folderNumFiles.Size();
+
+  // each folder is compressed with one thread
+  CCompressionMethodMode method2 = method;
+  method2.NumThreads = 1;
+  for (int m = 0; m < method2.Methods.Size(); m++)
+  {
+    CObjectVector<CProp> &props = method2.Methods[m].Props;
+    for (int j = 0; j < props.Size(); j++)
+      if (props[j].Id == NCoderPropID::kNumThreads)
+        props[j].Value = (UInt32)1;
+  }
+
+  CMtCompressProgressMixer mtCompressProgressMixer;
+  mtCompressProgressMixer.Init(numThreads, lps);
+
+  NWindows::NSynchronization::CSynchro synchro;
+  RINOK(synchro.Create());
+
+  CMemBlockManagerMt memManager(kMtBlockSize);
+  CMtFolders refs(&memManager);
+
+  CMtUpdateThreads<CThreadInfo> threads;
+  CRecordVector<NWindows::NSynchronization::CHandle_WFMO> compressingCompletedEvents;
+  CRecordVector<int> threadIndices;  // list threads in order of folders
+  CRecordVector<int> folderStartIndex;
+
+  {
+    RINOK(memManager.AllocateSpaceAlways(&synchro, (size_t)numThreads * (kMtMemPerThread / kMtBlockSize)));
+    int i;
+    int startIndex = 0;
+    for (i = 0; i < numFolders; i++)
+    {
+      refs.Refs.Add(CMtFolder());
+      folderStartIndex.Add(startIndex);
+      startIndex += folderNumFiles[i];
+    }
+
+    UInt32 t;
+    for (t = 0; t < numThreads; t++)
+      threads.Threads.Add(CThreadInfo());
+
+    for (t = 0; t < numThreads; t++)
+    {
+      CThreadInfo &threadInfo = threads.Threads[t];
+      #ifdef EXTERNAL_CODECS
+      threadInfo._codecsInfo = codecsInfo;
+      threadInfo._externalCodecs = externalCodecs;
+      #endif
+      threadInfo.Encoder = new CEncoder(method2);
+      threadInfo.InSizeForReduce = inSizeForReduce;
+      threadInfo.InStreamSpec = new CFolderInStream;
+      threadInfo.InStream = threadInfo.InStreamSpec;
+      RINOK(threadInfo.Create(&synchro, &memManager, &mtCompressProgressMixer, (int)t));
+    }
+  }
+
+  UInt64 inSize = 0;
+  UInt64 outSize = 0;
+  int mtIndex = 0;
+  int index = 0;
+
+  while (index < numFolders)
+  {
+    if (threadIndices.Size() < (int)numThreads && mtIndex < numFolders)
+    {
+      for (UInt32 t = 0; t < numThreads; t++)
+      {
+        CThreadInfo &threadInfo = threads.Threads[t];
+        if (threadInfo.IsFree)
+        {
+          // coder threads call (updateCallback) for progress under that lock
+          threadInfo.InStreamSpec->Init(updateCallback,
+              &indices[folderStartIndex[mtIndex]], folderNumFiles[mtIndex],
+              &mtCompressProgressMixer.CriticalSection);
+          threadInfo.FolderIndex = mtIndex++;
+          threadInfo.StartCoding();
+          compressingCompletedEvents.Add(threadInfo.CompressionCompletedEvent);
+          threadIndices.Add(t);
+          break;
+        }
+      }
+      continue;
+    }
+
+    CMtFolder &ref = refs.Refs[index];
+    if (ref.Defined)
+    {
+      RINOK(ref.WriteToStream(memManager.GetBlockSize(), archive.SeqStream));
+      ref.FreeOpt(&memManager);
+    }
+    else
+    {
+      {
+        CThreadInfo &thread = threads.Threads[threadIndices.Front()];
+        if (!thread.OutStreamSpec->WasUnlockEventSent())
+        {
+          thread.OutStreamSpec->SetSeqOutStream(archive.SeqStream);
+          thread.OutStreamSpec->SetRealStreamMode();
+        }
+      }
+
+      DWORD result = NWindows::NSynchronization::WaitForMultiObj_Any_Infinite(
+          compressingCompletedEvents.Size(), &compressingCompletedEvents.Front());
+      int t = (int)(result - WAIT_OBJECT_0);
+      CThreadInfo &threadInfo = threads.Threads[threadIndices[t]];
+      threadInfo.IsFree = true;
+      RINOK(threadInfo.Result);
+      threadIndices.Delete(t);
+      compressingCompletedEvents.Delete(t);
+
+      CMtFolder &ref2 = refs.Refs[threadInfo.FolderIndex];
+      ref2.Folder = threadInfo.Folder;
+      ref2.PackSizes = threadInfo.PackSizes;
+      ref2.Processed = threadInfo.InStreamSpec->Processed;
+      ref2.CRCs = threadInfo.InStreamSpec->CRCs;
+      ref2.Sizes = threadInfo.InStreamSpec->Sizes;
+      
+      if (t != 0)
+      {
+        threadInfo.OutStreamSpec->DetachData(ref2);
+        ref2.Defined = true;
+        continue;
+      }
+      RINOK(threadInfo.OutStreamSpec->WriteToRealStream());
+      threadInfo.OutStreamSpec->ReleaseOutStream();
+    }
+
+    for (int i = 0; i < ref.PackSizes.Size(); i++)
+    {
+      newDatabase.PackSizes.Add(ref.PackSizes[i]);
+      outSize += ref.PackSizes[i];
+    }
+    inSize += ref.Folder.GetUnpackSize();
+
+    RINOK(AddFolder(db, updateItems, &indices[folderStartIndex[index]], folderNumFiles[index],
+        ref.Processed, ref.CRCs, ref.Sizes, &ref.Folder, newDatabase, options));
+    index++;
+  }
+
+  // all coder threads are free here, so they don't call (lps) anymore
+  lps->InSize += inSize;
+  lps->OutSize += outSize;
+  return S_OK;
+}
+
+#endif
+
 static HRESULT Update2(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IInStream *inStream,
@@ -471,7 +915,8 @@ static HRESULT Update2(
     CArchiveDatabase &newDatabase,
     ISequentialOutStream *seqOutStream,
     IArchiveUpdateCallback *updateCallback,
-    const CUpdateOptions &options)
+    const CUpdateOptions &options,
+    CUpdateSession &session)
 {
   UInt64 numSolidFiles = options.NumSolidFiles;
   if (numSolidFiles == 0)
@@ -670,32 +1115,32 @@ static HRESULT Update2(
       */
     }
     
-    CEncoder encoder(group.Method);
+    CRecordVector<int> folderNumFiles;
+    for (i = 0; i < numFiles;)
+    {
+      int numSubFiles = GetNumFolderFiles(updateItems, &indices[i], numFiles - i, numSolidFiles, options);
+      folderNumFiles.Add(numSubFiles);
+      i += numSubFiles;
+    }
 
+    #ifdef COMPRESS_MT
+    UInt32 numMtThreads = GetNumMtThreads(group.Method, &inSizeForReduce, folderNumFiles.Size());
+    if (numMtThreads > 1)
+    {
+      RINOK(EncodeFoldersMt(
+          EXTERNAL_CODECS_LOC_VARS
+          db, updateItems, indices, folderNumFiles, numMtThreads, group.Method, &inSizeForReduce,
+          archive, newDatabase, updateCallback, lps, options));
+      continue;
+    }
+    #endif
+
+    CEncoder &encoder = *session.GetEncoder(group.Method, group.IsExeGroup, &inSizeForReduce);
+
+    int folderIndex = 0;
     for (i = 0; i < numFiles;)
     {
-      UInt64 totalSize = 0;
-      int numSubFiles;
-      UString prevExtension;
-      for (numSubFiles = 0; i + numSubFiles < numFiles &&
-          numSubFiles < numSolidFiles; numSubFiles++)
-      {
-        const CUpdateItem &ui = updateItems[indices[i + numSubFiles]];
-        totalSize += ui.Size;
-        if (totalSize > options.NumSolidBytes)
-          break;
-        if (options.SolidExtension)
-        {
-          UString ext = ui.GetExtension();
-          if (numSubFiles == 0)
-            prevExtension = ext;
-          else
-            if (ext.CompareNoCase(prevExtension) != 0)
-              break;
-        }
-      }
-      if (numSubFiles < 1)
-        numSubFiles = 1;
+      int numSubFiles = folderNumFiles[folderIndex++];
 
       CFolderInStream *inStreamSpec = new CFolderInStream;
       CMyComPtr<ISequentialInStream> solidInStream(inStreamSpec);
@@ -717,49 +1162,9 @@ static HRESULT Update2(
       // newDatabase.PackCRCsDefined.Add(false);
       // newDatabase.PackCRCs.Add(0);
       
-      newDatabase.Folders.Add(folderItem);
-      
-      CNum numUnpackStreams = 0;
-      for (int subIndex = 0; subIndex < numSubFiles; subIndex++)
-      {
-        const CUpdateItem &ui = updateItems[indices[i + subIndex]];
-        CFileItem file;
-        CFileItem2 file2;
-        if (ui.NewProperties)
-          FromUpdateItemToFileItem(ui, file, file2);
-        else
-          db->GetFile(ui.IndexInArchive, file, file2);
-        if (file2.IsAnti || file.IsDir)
-          return E_FAIL;
-        
-        /*
-        CFileItem &file = newDatabase.Files[
-              startFileIndexInDatabase + i + subIndex];
-        */
-        if (!inStreamSpec->Processed[subIndex])
-        {
-          continue;
-          // file.Name += L".locked";
-        }
-
-        file.Crc = inStreamSpec->CRCs[subIndex];
-        file.Size = inStreamSpec->Sizes[subIndex];
-        if (file.Size != 0)
-        {
-          file.CrcDefined = true;
-          file.HasStream = true;
-          numUnpackStreams++;
-        }
-        else
-        {
-          file.CrcDefined = false;
-          file.HasStream = false;
-        }
-        newDatabase.AddFile(file, file2);
-      }
-      // numUnpackStreams = 0 is very bad case for locked files
-      // v3.13 doesn't understand it.
-      newDatabase.NumUnpackStreamsVector.Add(numUnpackStreams);
+      RINOK(AddFolder(db, updateItems, &indices[i], numSubFiles,
+          inStreamSpec->Processed, inStreamSpec->CRCs, inStreamSpec->Sizes,
+          &folderItem, newDatabase, options));
       i += numSubFiles;
     }
   }
@@ -799,7 +1204,6 @@ static HRESULT Update2(
     }
   }
     
-  newDatabase.ReserveDown();
   return S_OK;
 }
 
@@ -812,12 +1216,21 @@ HRESULT Update(
     CArchiveDatabase &newDatabase,
     ISequentialOutStream *seqOutStream,
     IArchiveUpdateCallback *updateCallback,
-    const CUpdateOptions &options)
+    const CUpdateOptions &options,
+    CUpdateSession *session)
 {
-  return Update2(
+  if (session)
+    return Update2(
+        EXTERNAL_CODECS_LOC_VARS
+        inStream, db, updateItems,
+        archive, newDatabase, seqOutStream, updateCallback, options, *session);
+  CUpdateSession localSession;
+  RINOK(Update2(
         EXTERNAL_CODECS_LOC_VARS
         inStream, db, updateItems,
-        archive, newDatabase, seqOutStream, updateCallback, options);
+        archive, newDatabase, seqOutStream, updateCallback, options, localSession));
+  newDatabase.ReserveDown();
+  return S_OK;
 }
 
 }}
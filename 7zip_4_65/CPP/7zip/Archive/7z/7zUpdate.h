@@ -53,6 +53,18 @@ struct CUpdateItem
   UString GetExtension() const;
 };
 
+/*
+Update() calls FolderCommitted() after each new folder was written to
+archive stream and its files were added to newDatabase,
+if all files of that folder were read completely.
+*/
+
+class IUpdateCommitCallback
+{
+public:
+  virtual HRESULT FolderCommitted() = 0;
+};
+
 struct CUpdateOptions
 {
   const CCompressionMethodMode *Method;
@@ -67,8 +79,44 @@ struct CUpdateOptions
   bool SolidExtension;
   bool RemoveSfxBlock;
   bool VolumeMode;
+
+  IUpdateCommitCallback *CommitCallback; // can be NULL
 };
 
+class CEncoder;
+
+/*
+CUpdateSession keeps state between Update() calls, if the archive is
+written with many Update() calls (for example, one call per item)
+and the database is written only after last call:
+  - Update() doesn't shrink (newDatabase) vectors, so they grow geometrically.
+  - encoders are reused, if group method and reduced dictionary size are same.
+Call Clear() after last call.
+*/
+
+class CUpdateSession
+{
+  struct CEncoderItem
+  {
+    CEncoder *Encoder;
+    bool IsExeGroup;
+    UInt32 DictionarySize;
+  };
+  CRecordVector<CEncoderItem> _encoders; // the most recently used encoder is last
+  bool _passwordIsDefined;
+  UString _password;
+  void FreeEncoders();
+public:
+  CObjectVector<CUpdateItem> UpdateItems;
+
+  CUpdateSession(): _passwordIsDefined(false) {}
+  ~CUpdateSession() { FreeEncoders(); }
+  void Clear();
+  CEncoder *GetEncoder(const CCompressionMethodMode &method, bool isExeGroup, const UInt64 *inSizeForReduce);
+};
+
+// session can be NULL. Then Update() shrinks (newDatabase) at the end.
+
 HRESULT Update(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IInStream *inStream,
@@ -78,7 +126,8 @@ HRESULT Update(
     CArchiveDatabase &newDatabase,
     ISequentialOutStream *seqOutStream,
     IArchiveUpdateCallback *updateCallback,
-    const CUpdateOptions &options);
+    const CUpdateOptions &options,
+    CUpdateSession *session);
 }}
 
 #endif
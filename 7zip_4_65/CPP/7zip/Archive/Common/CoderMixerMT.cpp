@@ -56,8 +56,7 @@ STDMETHODIMP CCoderMixerMT::Code(ISequentialInStream *inStream,
   _streamBinders.Clear();
   for (i = 0; i + 1 < _coders.Size(); i++)
   {
-    _streamBinders.Add(CStreamBinder());
-    CStreamBinder &sb = _streamBinders[i];
+    CStreamBinder &sb = _streamBinders.AddNew();
     RINOK(sb.CreateEvents());
     sb.CreateStreams(&_coders[i + 1].InStream, &_coders[i].OutStream);
   }
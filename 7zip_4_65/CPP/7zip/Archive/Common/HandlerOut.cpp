@@ -61,6 +61,7 @@ static const UInt32 kDeflateFastBytesX7 = 64;
 static const UInt32 kDeflateFastBytesX9 = 128;
 
 static const UInt32 kDeflatePassesX1 = 1;
+static const UInt32 kDeflatePassesX3 = 2; // lazy parsing in fast mode (algo = 0)
 static const UInt32 kDeflatePassesX7 = 3;
 static const UInt32 kDeflatePassesX9 = 10;
 
@@ -223,7 +224,9 @@ void COutHandler::SetCompressionMethod2(COneMethodInfo &oneMethodInfo
     UInt32 numPasses =
       (level >= 9 ? kDeflatePassesX9 :
       (level >= 7 ? kDeflatePassesX7 :
-                    kDeflatePassesX1));
+      (level >= 5 ? kDeflatePassesX1 :
+      (level >= 3 ? kDeflatePassesX3 :
+                    kDeflatePassesX1))));
     
     UInt32 algo =
       (level >= 5 ? kDeflateAlgoX5 :
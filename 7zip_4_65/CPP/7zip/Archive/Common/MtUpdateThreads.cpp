@@ -0,0 +1,57 @@
+// MtUpdateThreads.cpp
+
+#include "StdAfx.h"
+
+#include "MtUpdateThreads.h"
+
+static THREAD_FUNC_DECL CoderThread(void *threadCoderInfo)
+{
+  ((CMtUpdateThread *)threadCoderInfo)->WaitAndCode();
+  return 0;
+}
+
+HRESULT CMtUpdateThread::Create(NWindows::NSynchronization::CSynchro *synchro,
+    CMemBlockManagerMt *memManager, CMtCompressProgressMixer *progressMixer, int index)
+{
+  RINOK(CompressEvent.CreateIfNotCreated());
+  RINOK(CompressionCompletedEvent.CreateIfNotCreated(synchro));
+  OutStreamSpec = new COutMemStream(memManager);
+  OutStream = OutStreamSpec;
+  RINOK(OutStreamSpec->CreateEvents(synchro));
+  ProgressSpec = new CMtCompressProgress();
+  Progress = ProgressSpec;
+  ProgressSpec->Init(progressMixer, index);
+  IsFree = true;
+  return Thread.Create(CoderThread, this);
+}
+
+void CMtUpdateThread::StartCoding()
+{
+  IsFree = false;
+  OutStreamSpec->Init();
+  ProgressSpec->Reinit();
+  CompressEvent.Set();
+}
+
+void CMtUpdateThread::WaitAndCode()
+{
+  for (;;)
+  {
+    CompressEvent.Lock();
+    if (ExitThread)
+      return;
+    Result = Code();
+    CompressionCompletedEvent.Set();
+  }
+}
+
+void CMtUpdateThread::StopWaitClose()
+{
+  ExitThread = true;
+  if (OutStreamSpec != 0)
+    OutStreamSpec->StopWriting(E_ABORT);
+  if (CompressEvent.IsCreated())
+    CompressEvent.Set();
+  Thread.Wait();
+  Thread.Close();
+}
@@ -0,0 +1,71 @@
+// MtUpdateThreads.h
+
+#ifndef __ARCHIVE_MT_UPDATE_THREADS_H
+#define __ARCHIVE_MT_UPDATE_THREADS_H
+
+#include "../../../Common/MyCom.h"
+#include "../../../Common/MyVector.h"
+
+#include "../../../Windows/Synchronization.h"
+#include "../../../Windows/Thread.h"
+
+#include "../../Common/OutMemStream.h"
+#include "../../Common/ProgressMt.h"
+
+/*
+Coder thread for multithreaded update (Zip items, 7z folders).
+Main thread sets input of thread and calls StartCoding(). Thread calls Code(),
+that writes compressed data to OutStream (memory blocks or real stream),
+and then it sets CompressionCompletedEvent.
+*/
+
+class CMtUpdateThread
+{
+public:
+  NWindows::CThread Thread;
+  NWindows::NSynchronization::CAutoResetEvent CompressEvent;
+  NWindows::NSynchronization::CAutoResetEvent_WFMO CompressionCompletedEvent;
+  bool ExitThread;
+
+  CMtCompressProgress *ProgressSpec;
+  CMyComPtr<ICompressProgressInfo> Progress;
+
+  COutMemStream *OutStreamSpec;
+  CMyComPtr<IOutStream> OutStream;
+
+  HRESULT Result;
+  bool IsFree;
+
+  CMtUpdateThread():
+      ExitThread(false),
+      ProgressSpec(0),
+      OutStreamSpec(0),
+      Result(S_OK),
+      IsFree(true)
+  {}
+  virtual ~CMtUpdateThread() {}
+
+  virtual HRESULT Code() = 0;
+
+  HRESULT Create(NWindows::NSynchronization::CSynchro *synchro,
+      CMemBlockManagerMt *memManager, CMtCompressProgressMixer *progressMixer, int index);
+  void StartCoding();
+  void WaitAndCode();
+  void StopWaitClose();
+};
+
+// T is derived from CMtUpdateThread. Threads are stopped before T objects are deleted.
+
+template <class T>
+class CMtUpdateThreads
+{
+public:
+  CObjectVector<T> Threads;
+  ~CMtUpdateThreads()
+  {
+    for (int i = 0; i < Threads.Size(); i++)
+      Threads[i].StopWaitClose();
+  }
+};
+
+#endif
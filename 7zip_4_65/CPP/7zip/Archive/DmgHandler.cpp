@@ -21,6 +21,13 @@
 #include "../Compress/CopyCoder.h"
 #include "../Compress/ZlibDecoder.h"
 
+#ifdef COMPRESS_MT
+#include "../../Windows/System.h"
+
+#include "../Common/MtThreadPool.h"
+#include "../Common/StreamObjects.h"
+#endif
+
 // #define DMG_SHOW_RAW
 
 // #include <stdio.h>
@@ -266,6 +273,130 @@ STDMETHODIMP CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value)
 
 IMP_IInArchive_ArcProps
 
+#ifdef COMPRESS_MT
+
+/*
+  Multi-threaded extraction: zlib and bzip2 blocks are compressed independently,
+  so worker threads can decode them in any order. Main thread reads packed blocks
+  and writes unpacked blocks in original order. The number of blocks in work is
+  limited by the number of jobs, and big blocks are decoded in main thread,
+  so memory usage is limited too.
+*/
+
+static const UInt64 kMtBlockSizeMax = (UInt64)1 << 24;
+
+static bool IsMtBlock(const CBlock &block)
+{
+  return (block.Type == METHOD_ZLIB || block.Type == METHOD_BZIP2) &&
+      block.PackSize <= kMtBlockSizeMax && block.UnpSize <= kMtBlockSizeMax;
+}
+
+static int GetNumMtBlocks(const CFile &file)
+{
+  int num = 0;
+  for (int i = 0; i < file.Blocks.Size(); i++)
+    if (IsMtBlock(file.Blocks[i]))
+      num++;
+  return num;
+}
+
+// 2 jobs per thread, and each job has input and output buffers
+static const UInt64 kMtJobMemSize = kMtBlockSizeMax * 2 * 2;
+
+static UInt32 GetNumMtThreads(UInt32 numThreads)
+{
+  UInt64 ramSize = NWindows::NSystem::GetRamSize();
+  UInt32 numThreadsMax = (UInt32)MyMin(ramSize / 2 / kMtJobMemSize, (UInt64)(1 << 10));
+  if (numThreads > numThreadsMax)
+    numThreads = numThreadsMax;
+  return numThreads;
+}
+
+struct CMtBlockJob
+{
+  CByteBuffer InBuffer;
+  CByteBuffer OutBuffer;
+  UInt32 Type;
+  size_t InSize;
+  size_t OutSize;
+  UInt64 InProcessed;
+  size_t OutProcessed;
+  HRESULT Result;
+};
+
+class CMtBlockDecoder: public CMtJobQueue
+{
+public:
+  CObjectVector<CMtBlockJob> Jobs;
+
+  ~CMtBlockDecoder() { StopAndWait(); }
+  HRESULT Create(UInt32 numThreads);
+  HRESULT StartBlock(IInStream *stream, const CBlock &block);
+  void ThreadFunc();
+};
+
+HRESULT CMtBlockDecoder::Create(UInt32 numThreads)
+{
+  for (UInt32 i = 0; i < numThreads * 2; i++)
+    Jobs.Add(CMtBlockJob());
+  return CMtJobQueue::Create(numThreads, Jobs.Size());
+}
+
+HRESULT CMtBlockDecoder::StartBlock(IInStream *stream, const CBlock &block)
+{
+  CMtBlockJob &job = Jobs[GetNextJobIndex()];
+  job.Type = block.Type;
+  job.InSize = (size_t)block.PackSize;
+  job.OutSize = (size_t)block.UnpSize;
+  if (job.InBuffer.GetCapacity() < job.InSize)
+  {
+    job.InBuffer.Free();
+    job.InBuffer.SetCapacity(job.InSize);
+  }
+  if (job.OutBuffer.GetCapacity() < job.OutSize)
+  {
+    job.OutBuffer.Free();
+    job.OutBuffer.SetCapacity(job.OutSize);
+  }
+  RINOK(stream->Seek(block.PackPos, STREAM_SEEK_SET, NULL));
+  RINOK(ReadStream(stream, job.InBuffer, &job.InSize));
+  StartJob();
+  return S_OK;
+}
+
+void CMtBlockDecoder::ThreadFunc()
+{
+  NCompress::NBZip2::CDecoder *bzip2CoderSpec = new NCompress::NBZip2::CDecoder();
+  CMyComPtr<ICompressCoder> bzip2Coder = bzip2CoderSpec;
+
+  NCompress::NZlib::CDecoder *zlibCoderSpec = new NCompress::NZlib::CDecoder();
+  CMyComPtr<ICompressCoder> zlibCoder = zlibCoderSpec;
+
+  CSequentialInStreamImp *bufInStreamSpec = new CSequentialInStreamImp;
+  CMyComPtr<ISequentialInStream> bufInStream = bufInStreamSpec;
+  CSequentialInStreamSizeCount *inStreamSpec = new CSequentialInStreamSizeCount;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  CSequentialOutStreamImp2 *outStreamSpec = new CSequentialOutStreamImp2;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+
+  int jobIndex;
+  while (GetJob(jobIndex))
+  {
+    CMtBlockJob &job = Jobs[jobIndex];
+    bufInStreamSpec->Init(job.InBuffer, job.InSize);
+    inStreamSpec->Init(bufInStream);
+    outStreamSpec->Init(job.OutBuffer, job.OutSize);
+    ICompressCoder *coder = (job.Type == METHOD_ZLIB) ? (ICompressCoder *)zlibCoder : (ICompressCoder *)bzip2Coder;
+    try { job.Result = coder->Code(inStream, outStream, NULL, NULL, NULL); }
+    catch(...) { job.Result = E_OUTOFMEMORY; }
+    job.InProcessed = inStreamSpec->GetSize();
+    job.OutProcessed = outStreamSpec->GetPos();
+    JobFinished(jobIndex);
+  }
+}
+
+#endif
+
 static int FindKeyPair(const CXmlItem &item, const AString &key, const AString &nextTag)
 {
   for (int i = 0; i + 1 < item.SubItems.Size(); i++)
@@ -626,6 +757,12 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
   CMyComPtr<ISequentialInStream> inStream(streamSpec);
   streamSpec->SetStream(_inStream);
 
+  #ifdef COMPRESS_MT
+  CMtBlockDecoder mtDecoder;
+  bool mtMode = false;
+  UInt32 numThreads = GetNumMtThreads(NWindows::NSystem::GetNumberOfProcessors());
+  #endif
+
   for (i = 0; i < numItems; i++, currentPackTotal += currentPackSize, currentUnpTotal += currentUnpSize)
   {
     lps->InSize = currentPackTotal;
@@ -676,6 +813,22 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
 
       UInt64 unpPos = 0;
       UInt64 packPos = 0;
+
+      #ifdef COMPRESS_MT
+      if (!mtMode && numThreads > 1 && GetNumMtBlocks(item) > 1)
+      {
+        // if threads can't be created, we use single-threaded decoding
+        mtMode = (mtDecoder.Create(numThreads) == S_OK);
+        if (!mtMode)
+        {
+          mtDecoder.StopAndWait();
+          numThreads = 1;
+        }
+      }
+      // blocks before mtBlockIndex were sent to worker threads
+      int mtBlockIndex = 0;
+      #endif
+
       {
         for (int j = 0; j < item.Blocks.Size(); j++)
         {
@@ -692,6 +845,19 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
             break;
           }
 
+          #ifdef COMPRESS_MT
+          if (mtMode)
+          {
+            if (mtBlockIndex < j)
+              mtBlockIndex = j;
+            for (; mtBlockIndex < item.Blocks.Size() && mtDecoder.CanStartJob() &&
+                IsMtBlock(item.Blocks[mtBlockIndex]); mtBlockIndex++)
+            {
+              RINOK(mtDecoder.StartBlock(_inStream, item.Blocks[mtBlockIndex]));
+            }
+          }
+          #endif
+
           RINOK(_inStream->Seek(block.PackPos, STREAM_SEEK_SET, NULL));
           streamSpec->Init(block.PackSize);
           // UInt64 startSize = outStreamSpec->GetSize();
@@ -699,6 +865,19 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
           outStreamSpec->Init(block.UnpSize);
           HRESULT res = S_OK;
 
+          #ifdef COMPRESS_MT
+          if (mtMode && j < mtBlockIndex)
+          {
+            int jobIndex;
+            RINOK(mtDecoder.WaitJob(jobIndex));
+            const CMtBlockJob &job = mtDecoder.Jobs[jobIndex];
+            RINOK(WriteStream(outStream, job.OutBuffer, job.OutProcessed));
+            res = job.Result;
+            if (res == S_OK && block.Type == METHOD_BZIP2 && job.InProcessed != block.PackSize)
+              opRes = NArchive::NExtract::NOperationResult::kDataError;
+          }
+          else
+          #endif
           switch(block.Type)
           {
             case METHOD_ZERO_0:
@@ -759,6 +938,12 @@ STDMETHODIMP CHandler::Extract(const UInt32* indices, UInt32 numItems,
             }
           }
         }
+        #ifdef COMPRESS_MT
+        if (mtMode)
+        {
+          RINOK(mtDecoder.WaitAllJobs());
+        }
+        #endif
       }
     }
     outStream.Release();
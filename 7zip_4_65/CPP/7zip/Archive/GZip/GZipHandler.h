@@ -12,6 +12,10 @@
 #include "GZipIn.h"
 #include "GZipUpdate.h"
 
+#ifdef COMPRESS_MT
+#include "../../../Windows/System.h"
+#endif
+
 namespace NArchive {
 namespace NGZip {
 
@@ -55,6 +59,9 @@ private:
     m_Method.NumMatchFinderCyclesDefined = false;
     m_Level = m_Method.NumPasses = m_Method.NumFastBytes =
         m_Method.NumMatchFinderCycles = m_Method.Algo = 0xFFFFFFFF;
+    #ifdef COMPRESS_MT
+    m_Method.NumThreads = NWindows::NSystem::GetNumberOfProcessors();
+    #endif
   }
 };
 
@@ -25,6 +25,7 @@ static const UInt32 kAlgoX1 = 0;
 static const UInt32 kAlgoX5 = 1;
 
 static const UInt32 kNumPassesX1  = 1;
+static const UInt32 kNumPassesX3  = 2; // lazy parsing in fast mode (algo = 0)
 static const UInt32 kNumPassesX7  = 3;
 static const UInt32 kNumPassesX9  = 10;
 
@@ -122,7 +123,9 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
     if (m_Method.NumPasses == 0xFFFFFFFF)
       m_Method.NumPasses = (level >= 9 ? kNumPassesX9 :
                            (level >= 7 ? kNumPassesX7 :
-                                         kNumPassesX1));
+                           (level >= 5 ? kNumPassesX1 :
+                           (level >= 3 ? kNumPassesX3 :
+                                         kNumPassesX1))));
     if (m_Method.NumFastBytes == 0xFFFFFFFF)
       m_Method.NumFastBytes = (level >= 9 ? kNumFastBytesX9 :
                               (level >= 7 ? kNumFastBytesX7 :
@@ -157,6 +160,9 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 STDMETHODIMP CHandler::SetProperties(const wchar_t **names, const PROPVARIANT *values, Int32 numProperties)
 {
   InitMethodProperties();
+  #ifdef COMPRESS_MT
+  const UInt32 numProcessors = NSystem::GetNumberOfProcessors();
+  #endif
   for (int i = 0; i < numProperties; i++)
   {
     UString name = names[i];
@@ -193,6 +199,12 @@ STDMETHODIMP CHandler::SetProperties(const wchar_t **names, const PROPVARIANT *v
       RINOK(ParsePropValue(name.Mid(1), prop, num));
       m_Method.Algo = num;
     }
+    else if (name.Left(2) == L"MT")
+    {
+      #ifdef COMPRESS_MT
+      RINOK(ParseMtProp(name.Mid(2), prop, numProcessors, m_Method.NumThreads));
+      #endif
+    }
     else
       return E_INVALIDARG;
   }
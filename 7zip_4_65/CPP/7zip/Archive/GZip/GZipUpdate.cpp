@@ -19,6 +19,19 @@
 
 #include "GZipUpdate.h"
 
+#ifdef COMPRESS_MT
+extern "C"
+{
+  #include "../../../../C/7zCrc.h"
+}
+
+#include "../../Common/MtThreadPool.h"
+#include "../../Common/StreamObjects.h"
+#include "../../Common/StreamUtils.h"
+
+#include "../../Compress/DeflateEncoder.h"
+#endif
+
 namespace NArchive {
 namespace NGZip {
 
@@ -31,6 +44,217 @@ static const Byte kHostOS =
   NFileHeader::NHostOS::kUnix;
   #endif
 
+static HRESULT SetEncoderProperties(ICompressCoder *encoder, const CCompressionMethodMode &method)
+{
+  NWindows::NCOM::CPropVariant properties[] =
+  {
+    method.Algo,
+    method.NumPasses,
+    method.NumFastBytes,
+    method.NumMatchFinderCycles
+  };
+  PROPID propIDs[] =
+  {
+    NCoderPropID::kAlgorithm,
+    NCoderPropID::kNumPasses,
+    NCoderPropID::kNumFastBytes,
+    NCoderPropID::kMatchFinderCycles
+  };
+  int numProps = sizeof(propIDs) / sizeof(propIDs[0]);
+  if (!method.NumMatchFinderCyclesDefined)
+    numProps--;
+  CMyComPtr<ICompressSetCoderProperties> setCoderProperties;
+  RINOK(encoder->QueryInterface(IID_ICompressSetCoderProperties, (void **)&setCoderProperties));
+  return setCoderProperties->SetCoderProperties(propIDs, properties, numProps);
+}
+
+#ifdef COMPRESS_MT
+
+/*
+  Multi-threaded compression (as in pigz): input is split to blocks of kMtBlockSize bytes,
+  and worker threads deflate these blocks. Each block uses last 32 KB of previous block
+  as preset dictionary, and each non-final block ends with empty stored block, so
+  compressed blocks are byte aligned. Main thread writes compressed blocks in original
+  order, so the result is one usual deflate stream. CRC of each block is calculated
+  in worker thread, and main thread combines these CRCs.
+*/
+
+static const UInt32 kMtBlockSize = (UInt32)1 << 20;
+static const UInt32 kMtDictSize = (UInt32)1 << 15;
+
+// CRC of (data1 + data2) from CRC of data1 and CRC of data2 (zlib's crc32_combine)
+
+static UInt32 Gf2MatrixTimes(const UInt32 *mat, UInt32 vec)
+{
+  UInt32 sum = 0;
+  for (; vec != 0; vec >>= 1, mat++)
+    if (vec & 1)
+      sum ^= *mat;
+  return sum;
+}
+
+static void Gf2MatrixSquare(UInt32 *square, const UInt32 *mat)
+{
+  for (int i = 0; i < 32; i++)
+    square[i] = Gf2MatrixTimes(mat, mat[i]);
+}
+
+static UInt32 CrcCombine(UInt32 crc1, UInt32 crc2, UInt64 size2)
+{
+  if (size2 == 0)
+    return crc1;
+  UInt32 even[32];
+  UInt32 odd[32];
+  odd[0] = 0xEDB88320;
+  UInt32 row = 1;
+  for (int i = 1; i < 32; i++, row <<= 1)
+    odd[i] = row;
+  Gf2MatrixSquare(even, odd);
+  Gf2MatrixSquare(odd, even);
+  for (;;)
+  {
+    Gf2MatrixSquare(even, odd);
+    if (size2 & 1)
+      crc1 = Gf2MatrixTimes(even, crc1);
+    size2 >>= 1;
+    if (size2 == 0)
+      break;
+    Gf2MatrixSquare(odd, even);
+    if (size2 & 1)
+      crc1 = Gf2MatrixTimes(odd, crc1);
+    size2 >>= 1;
+    if (size2 == 0)
+      break;
+  }
+  return crc1 ^ crc2;
+}
+
+struct CMtDeflateJob
+{
+  CByteBuffer InBuffer; // kMtDictSize bytes of dictionary + kMtBlockSize bytes of block
+  UInt32 DictSize;
+  UInt32 Size;
+  bool FinalBlock;
+  CSequentialOutStreamImp *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  UInt32 Crc;
+  HRESULT Result;
+
+  const Byte *GetData() const { return (const Byte *)InBuffer + kMtDictSize; }
+};
+
+class CMtDeflateEncoder: public CMtJobQueue
+{
+public:
+  const CCompressionMethodMode *Method;
+  CObjectVector<CMtDeflateJob> Jobs;
+
+  ~CMtDeflateEncoder() { StopAndWait(); }
+  HRESULT Create(UInt32 numThreads);
+  void ThreadFunc();
+};
+
+HRESULT CMtDeflateEncoder::Create(UInt32 numThreads)
+{
+  for (UInt32 i = 0; i < numThreads * 2; i++)
+  {
+    CMtDeflateJob &job = Jobs[Jobs.Add(CMtDeflateJob())];
+    job.InBuffer.SetCapacity(kMtDictSize + kMtBlockSize);
+    job.OutStreamSpec = new CSequentialOutStreamImp;
+    job.OutStream = job.OutStreamSpec;
+  }
+  return CMtJobQueue::Create(numThreads, Jobs.Size());
+}
+
+void CMtDeflateEncoder::ThreadFunc()
+{
+  NCompress::NDeflate::NEncoder::CCOMCoder *encoderSpec = new NCompress::NDeflate::NEncoder::CCOMCoder;
+  CMyComPtr<ICompressCoder> encoder = encoderSpec;
+  HRESULT propsResult = SetEncoderProperties(encoder, *Method);
+
+  int jobIndex;
+  while (GetJob(jobIndex))
+  {
+    CMtDeflateJob &job = Jobs[jobIndex];
+    job.Crc = CrcCalc(job.GetData(), job.Size);
+    job.OutStreamSpec->Init();
+    job.Result = propsResult;
+    if (job.Result == S_OK)
+      job.Result = encoderSpec->BaseCodeBuf(job.GetData(), job.Size, job.DictSize,
+          job.FinalBlock, job.OutStream);
+    JobFinished(jobIndex);
+  }
+}
+
+static HRESULT UpdateArchiveMt(
+    CMtDeflateEncoder &mtEncoder,
+    ISequentialInStream *inStream,
+    ISequentialOutStream *outStream,
+    CLocalProgress *lps,
+    UInt32 &crc, UInt64 &unpackSize)
+{
+  const int numJobs = mtEncoder.Jobs.Size();
+
+  crc = 0;
+  unpackSize = 0;
+  UInt64 packSize = 0;
+  bool inputFinished = false;
+  bool finalWasWritten = false;
+  
+  for (;;)
+  {
+    if (!inputFinished && mtEncoder.CanStartJob())
+    {
+      UInt64 numStarted = mtEncoder.GetNumStarted();
+      CMtDeflateJob &job = mtEncoder.Jobs[mtEncoder.GetNextJobIndex()];
+      size_t size = kMtBlockSize;
+      RINOK(ReadStream(inStream, (Byte *)job.InBuffer + kMtDictSize, &size));
+      if (size == 0)
+      {
+        inputFinished = true;
+        continue;
+      }
+      job.DictSize = 0;
+      if (numStarted != 0)
+      {
+        // previous block is full (kMtBlockSize bytes), and its buffer is not reused yet
+        const CMtDeflateJob &prev = mtEncoder.Jobs[(int)((numStarted - 1) % numJobs)];
+        job.DictSize = kMtDictSize;
+        memcpy((Byte *)job.InBuffer, prev.GetData() + prev.Size - kMtDictSize, kMtDictSize);
+      }
+      job.Size = (UInt32)size;
+      job.FinalBlock = (size != kMtBlockSize);
+      inputFinished = job.FinalBlock;
+      mtEncoder.StartJob();
+      continue;
+    }
+    if (!mtEncoder.HasStartedJobs())
+      break;
+    int jobIndex;
+    RINOK(mtEncoder.WaitJob(jobIndex));
+    const CMtDeflateJob &job = mtEncoder.Jobs[jobIndex];
+    RINOK(job.Result);
+    size_t outSize = job.OutStreamSpec->GetSize();
+    RINOK(WriteStream(outStream, job.OutStreamSpec->GetBuffer(), outSize));
+    crc = CrcCombine(crc, job.Crc, job.Size);
+    unpackSize += job.Size;
+    packSize += outSize;
+    finalWasWritten = job.FinalBlock;
+    lps->InSize = unpackSize;
+    lps->OutSize = packSize;
+    RINOK(lps->SetCur());
+  }
+  if (!finalWasWritten)
+  {
+    // empty final block with fixed Huffman codes
+    static const Byte kFinalBlock[2] = { 3, 0 };
+    RINOK(WriteStream(outStream, kFinalBlock, sizeof(kFinalBlock)));
+  }
+  return S_OK;
+}
+
+#endif
+
 HRESULT UpdateArchive(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IInStream * /* inStream */,
@@ -73,38 +297,37 @@ HRESULT UpdateArchive(
 
   RINOK(outArchive.WriteHeader(item));
 
+  #ifdef COMPRESS_MT
+  CMtDeflateEncoder mtEncoder;
+  bool mtMode = false;
+  if (compressionMethod.NumThreads > 1 && unpackSize > kMtBlockSize)
+  {
+    mtEncoder.Method = &compressionMethod;
+    // if threads can't be created, we use single-threaded encoder
+    mtMode = (mtEncoder.Create(compressionMethod.NumThreads) == S_OK);
+    if (!mtMode)
+      mtEncoder.StopAndWait();
+  }
+  if (mtMode)
+  {
+    UInt64 size;
+    RINOK(UpdateArchiveMt(mtEncoder, fileInStream, outStream, lps, item.FileCRC, size));
+    item.UnPackSize32 = (UInt32)size;
+  }
+  else
+  #endif
   {
     RINOK(CreateCoder(
         EXTERNAL_CODECS_LOC_VARS
         kMethodId_Deflate, deflateEncoder, true));
     if (!deflateEncoder)
       return E_NOTIMPL;
+    RINOK(SetEncoderProperties(deflateEncoder, compressionMethod));
+    RINOK(deflateEncoder->Code(crcStream, outStream, NULL, NULL, progress));
 
-    NWindows::NCOM::CPropVariant properties[] =
-    {
-      compressionMethod.Algo,
-      compressionMethod.NumPasses,
-      compressionMethod.NumFastBytes,
-      compressionMethod.NumMatchFinderCycles
-    };
-    PROPID propIDs[] =
-    {
-      NCoderPropID::kAlgorithm,
-      NCoderPropID::kNumPasses,
-      NCoderPropID::kNumFastBytes,
-      NCoderPropID::kMatchFinderCycles
-    };
-    int numProps = sizeof(propIDs) / sizeof(propIDs[0]);
-    if (!compressionMethod.NumMatchFinderCyclesDefined)
-      numProps--;
-    CMyComPtr<ICompressSetCoderProperties> setCoderProperties;
-    RINOK(deflateEncoder.QueryInterface(IID_ICompressSetCoderProperties, &setCoderProperties));
-    RINOK(setCoderProperties->SetCoderProperties(propIDs, properties, numProps));
+    item.FileCRC = inStreamSpec->GetCRC();
+    item.UnPackSize32 = (UInt32)inStreamSpec->GetSize();
   }
-  RINOK(deflateEncoder->Code(crcStream, outStream, NULL, NULL, progress));
-
-  item.FileCRC = inStreamSpec->GetCRC();
-  item.UnPackSize32 = (UInt32)inStreamSpec->GetSize();
   RINOK(outArchive.WritePostHeader(item));
   return updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK);
 }
@@ -13,6 +13,12 @@
 
 #include "../../../../C/CpuArch.h"
 
+#ifdef COMPRESS_MT
+#include "../../../Windows/System.h"
+
+#include "../../Common/MtThreadPool.h"
+#endif
+
 #include "WimIn.h"
 
 #define Get16(p) GetUi16(p)
@@ -135,6 +141,240 @@ static void GetFileTimeFromMem(const Byte *p, FILETIME *ft)
   ft->dwHighDateTime = Get32(p + 4);
 }
 
+CUnpacker::CUnpacker()
+{
+  #ifdef COMPRESS_MT
+  _mtUnpacker = NULL;
+  NumThreads = NWindows::NSystem::GetNumberOfProcessors();
+  #endif
+}
+
+#ifdef COMPRESS_MT
+
+/*
+  Multi-threaded unpacking: chunks of resource are independent, so they are
+  decoded in batches of kMtBatchNumChunks chunks. Main thread reads packed batches
+  and writes unpacked batches in original order, worker threads decode batches
+  with their own LZX / XPress decoders. So SHA-1 of output stream (it's calculated
+  in main thread) is overlapped with decoding of next batches.
+*/
+
+static const int kMtBatchNumChunksBits = 5;
+static const UInt32 kMtBatchNumChunks = (UInt32)1 << kMtBatchNumChunksBits;
+
+static UInt64 GetChunkOffset(const Byte *sizes, unsigned entrySize, UInt32 index)
+{
+  if (index == 0)
+    return 0;
+  const Byte *p = sizes + (size_t)entrySize * (index - 1);
+  return (entrySize == 4) ? Get32(p): Get64(p);
+}
+
+class CChunkDecoder
+{
+  NCompress::NLzx::CDecoder *lzxDecoderSpec;
+  CMyComPtr<ICompressCoder> lzxDecoder;
+  NXpress::CDecoder xpressDecoder;
+  CSequentialInStreamImp *inStreamSpec;
+  CMyComPtr<ISequentialInStream> inStream;
+  CSequentialOutStreamImp2 *outStreamSpec;
+  CMyComPtr<ISequentialOutStream> outStream;
+public:
+  CChunkDecoder(): lzxDecoderSpec(NULL)
+  {
+    inStreamSpec = new CSequentialInStreamImp;
+    inStream = inStreamSpec;
+    outStreamSpec = new CSequentialOutStreamImp2;
+    outStream = outStreamSpec;
+  }
+  HRESULT Decode(const Byte *data, UInt32 inSize, Byte *dest, UInt32 outSize, bool lzxMode);
+};
+
+HRESULT CChunkDecoder::Decode(const Byte *data, UInt32 inSize, Byte *dest, UInt32 outSize, bool lzxMode)
+{
+  if (inSize == outSize)
+  {
+    memcpy(dest, data, outSize);
+    return S_OK;
+  }
+  inStreamSpec->Init(data, inSize);
+  outStreamSpec->Init(dest, outSize);
+  if (lzxMode)
+  {
+    if (!lzxDecoder)
+    {
+      lzxDecoderSpec = new NCompress::NLzx::CDecoder(true);
+      lzxDecoder = lzxDecoderSpec;
+      RINOK(lzxDecoderSpec->SetParams(kChunkSizeBits));
+    }
+    lzxDecoderSpec->SetKeepHistory(false);
+    UInt64 outSize64 = outSize;
+    RINOK(lzxDecoder->Code(inStream, outStream, NULL, &outSize64, NULL));
+  }
+  else
+  {
+    RINOK(xpressDecoder.Code(inStream, outStream, outSize));
+  }
+  return (outStreamSpec->GetPos() == outSize) ? S_OK : S_FALSE;
+}
+
+struct CMtUnpackJob
+{
+  CByteBuffer InBuffer;
+  CByteBuffer OutBuffer;
+  CRecordVector<UInt32> InOffsets; // (numChunks + 1) offsets of chunks in InBuffer
+  UInt32 OutSize;
+  bool LzxMode;
+  HRESULT Result;
+};
+
+class CMtUnpacker: public CMtJobQueue
+{
+public:
+  CObjectVector<CMtUnpackJob> Jobs;
+
+  ~CMtUnpacker() { StopAndWait(); }
+  HRESULT Create(UInt32 numThreads);
+  CMtUnpackJob &GetNextJob() { return Jobs[GetNextJobIndex()]; }
+  void ThreadFunc();
+};
+
+HRESULT CMtUnpacker::Create(UInt32 numThreads)
+{
+  for (UInt32 i = 0; i < numThreads * 2; i++)
+  {
+    CMtUnpackJob &job = Jobs[Jobs.Add(CMtUnpackJob())];
+    job.InBuffer.SetCapacity(kChunkSize * kMtBatchNumChunks);
+    job.OutBuffer.SetCapacity(kChunkSize * kMtBatchNumChunks);
+  }
+  return CMtJobQueue::Create(numThreads, Jobs.Size());
+}
+
+void CMtUnpacker::ThreadFunc()
+{
+  CChunkDecoder decoder;
+  int jobIndex;
+  while (GetJob(jobIndex))
+  {
+    CMtUnpackJob &job = Jobs[jobIndex];
+    job.Result = S_OK;
+    Byte *dest = (Byte *)job.OutBuffer;
+    UInt32 outPos = 0;
+    for (int i = 0; i + 1 < job.InOffsets.Size(); i++)
+    {
+      UInt32 offset = job.InOffsets[i];
+      UInt32 outSize = MyMin(kChunkSize, job.OutSize - outPos);
+      try
+      {
+        job.Result = decoder.Decode((const Byte *)job.InBuffer + offset,
+            job.InOffsets[i + 1] - offset, dest + outPos, outSize, job.LzxMode);
+      }
+      catch(...) { job.Result = E_OUTOFMEMORY; }
+      if (job.Result != S_OK)
+        break;
+      outPos += outSize;
+    }
+    JobFinished(jobIndex);
+  }
+}
+
+static HRESULT UnpackMtReal(CMtUnpacker &mt, IInStream *inStream, const CResource &resource, bool lzxMode,
+    const Byte *sizes, UInt32 numChunks, unsigned entrySize, UInt64 baseOffset, UInt64 chunksPackSize,
+    ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  UInt32 nextChunk = 0;
+  UInt64 outProcessed = 0;
+  UInt64 inProcessed = 0;
+  for (;;)
+  {
+    if (nextChunk < numChunks && mt.CanStartJob())
+    {
+      CMtUnpackJob &job = mt.GetNextJob();
+      UInt32 numBatchChunks = MyMin(kMtBatchNumChunks, numChunks - nextChunk);
+      UInt64 startOffset = GetChunkOffset(sizes, entrySize, nextChunk);
+      UInt64 offset = startOffset;
+      UInt64 outPos = (UInt64)nextChunk << kChunkSizeBits;
+      job.InOffsets.Clear();
+      job.InOffsets.Add(0);
+      for (UInt32 i = 1; i <= numBatchChunks; i++)
+      {
+        UInt32 index = nextChunk + i;
+        UInt64 nextOffset = (index == numChunks) ? chunksPackSize : GetChunkOffset(sizes, entrySize, index);
+        UInt64 outSize = MyMin((UInt64)kChunkSize, resource.UnpackSize - outPos);
+        // WIM writer stores chunk without compression, if compression doesn't help
+        if (nextOffset < offset || nextOffset - offset > outSize)
+          return S_FALSE;
+        job.InOffsets.Add((UInt32)(nextOffset - startOffset));
+        offset = nextOffset;
+        outPos += outSize;
+      }
+      job.OutSize = (UInt32)(outPos - ((UInt64)nextChunk << kChunkSizeBits));
+      job.LzxMode = lzxMode;
+      RINOK(inStream->Seek(baseOffset + startOffset, STREAM_SEEK_SET, NULL));
+      RINOK(ReadStream_FALSE(inStream, (Byte *)job.InBuffer, (size_t)(offset - startOffset)));
+      mt.StartJob();
+      nextChunk += numBatchChunks;
+      continue;
+    }
+    if (!mt.HasStartedJobs())
+      return S_OK;
+    int jobIndex;
+    RINOK(mt.WaitJob(jobIndex));
+    const CMtUnpackJob &job = mt.Jobs[jobIndex];
+    RINOK(job.Result);
+    RINOK(WriteStream(outStream, (const Byte *)job.OutBuffer, job.OutSize));
+    outProcessed += job.OutSize;
+    inProcessed += job.InOffsets.Back();
+    if (progress)
+    {
+      RINOK(progress->SetRatioInfo(&inProcessed, &outProcessed));
+    }
+  }
+}
+
+// If threads or buffers can't be created, it returns false and
+// disables multithreading, so Unpack() uses single-threaded code.
+
+bool CUnpacker::CreateMtUnpacker()
+{
+  if (_mtUnpacker)
+    return true;
+  _mtUnpacker = new CMtUnpacker;
+  HRESULT res;
+  try { res = _mtUnpacker->Create(NumThreads); }
+  catch(...) { res = E_OUTOFMEMORY; }
+  if (res == S_OK)
+    return true;
+  delete _mtUnpacker;
+  _mtUnpacker = NULL;
+  NumThreads = 1;
+  return false;
+}
+
+HRESULT CUnpacker::UnpackMt(IInStream *inStream, const CResource &resource, bool lzxMode,
+    UInt32 numChunks, unsigned entrySize, UInt64 baseOffset, UInt64 chunksPackSize,
+    ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  HRESULT res = UnpackMtReal(*_mtUnpacker, inStream, resource, lzxMode, (const Byte *)sizesBuf,
+      numChunks, entrySize, baseOffset, chunksPackSize, outStream, progress);
+  if (res != S_OK)
+    if (_mtUnpacker->WaitAllJobs() != S_OK)
+    {
+      delete _mtUnpacker;
+      _mtUnpacker = NULL;
+    }
+  return res;
+}
+
+#endif
+
+CUnpacker::~CUnpacker()
+{
+  #ifdef COMPRESS_MT
+  delete _mtUnpacker;
+  #endif
+}
+
 HRESULT CUnpacker::Unpack(IInStream *inStream, const CResource &resource, bool lzxMode,
     ISequentialOutStream *outStream, ICompressProgressInfo *progress)
 {
@@ -172,6 +412,13 @@ HRESULT CUnpacker::Unpack(IInStream *inStream, const CResource &resource, bool l
   RINOK(ReadStream_FALSE(inStream, (Byte *)sizesBuf, sizesBufSize));
   const Byte *p = (const Byte *)sizesBuf;
   
+  #ifdef COMPRESS_MT
+  if (NumThreads > 1 && numChunks > kMtBatchNumChunks && resource.PackSize >= sizesBufSize64 &&
+      CreateMtUnpacker())
+    return UnpackMt(inStream, resource, lzxMode, (UInt32)numChunks, entrySize,
+        resource.Offset + sizesBufSize64, resource.PackSize - sizesBufSize64, outStream, progress);
+  #endif
+
   if (lzxMode && !lzxDecoder)
   {
     lzxDecoderSpec = new NCompress::NLzx::CDecoder(true);
@@ -242,7 +489,11 @@ HRESULT CUnpacker::Unpack(IInStream *inStream, const CResource &resource, bool l
   return result;
 }
 
-static HRESULT UnpackData(IInStream *inStream, const CResource &resource, bool lzxMode, CByteBuffer &buf, Byte *digest)
+// OpenArchive() uses one CUnpacker for all resources, so worker threads
+// are created only once, and only if some resource is big enough for them.
+
+static HRESULT UnpackData(CUnpacker &unpacker, IInStream *inStream, const CResource &resource,
+    bool lzxMode, CByteBuffer &buf, Byte *digest)
 {
   size_t size = (size_t)resource.UnpackSize;
   if (size != resource.UnpackSize)
@@ -254,7 +505,6 @@ static HRESULT UnpackData(IInStream *inStream, const CResource &resource, bool l
   CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
   outStreamSpec->Init((Byte *)buf, size);
 
-  CUnpacker unpacker;
   return unpacker.Unpack(inStream, resource, lzxMode, outStream, NULL, digest);
 }
 
@@ -464,10 +714,10 @@ HRESULT ReadHeader(IInStream *inStream, CHeader &h)
   return h.Parse(p);
 }
 
-HRESULT ReadStreams(IInStream *inStream, const CHeader &h, CDatabase &db)
+static HRESULT ReadStreams(CUnpacker &unpacker, IInStream *inStream, const CHeader &h, CDatabase &db)
 {
   CByteBuffer offsetBuf;
-  RINOK(UnpackData(inStream, h.OffsetResource, h.IsLzxMode(), offsetBuf, NULL));
+  RINOK(UnpackData(unpacker, inStream, h.OffsetResource, h.IsLzxMode(), offsetBuf, NULL));
   for (size_t i = 0; i + kStreamInfoSize <= offsetBuf.GetCapacity(); i += kStreamInfoSize)
   {
     CStreamInfo s;
@@ -480,9 +730,10 @@ HRESULT ReadStreams(IInStream *inStream, const CHeader &h, CDatabase &db)
 
 HRESULT OpenArchive(IInStream *inStream, const CHeader &h, CByteBuffer &xml, CDatabase &db)
 {
-  RINOK(UnpackData(inStream, h.XmlResource, h.IsLzxMode(), xml, NULL));
+  CUnpacker unpacker;
+  RINOK(UnpackData(unpacker, inStream, h.XmlResource, h.IsLzxMode(), xml, NULL));
 
-  RINOK(ReadStreams(inStream, h, db));
+  RINOK(ReadStreams(unpacker, inStream, h, db));
   bool needBootMetadata = !h.MetadataResource.IsEmpty();
   if (h.PartNumber == 1)
   {
@@ -495,7 +746,7 @@ HRESULT OpenArchive(IInStream *inStream, const CHeader &h, CByteBuffer &xml, CDa
         continue;
       Byte hash[kHashSize];
       CByteBuffer metadata;
-      RINOK(UnpackData(inStream, si.Resource, h.IsLzxMode(), metadata, hash));
+      RINOK(UnpackData(unpacker, inStream, si.Resource, h.IsLzxMode(), metadata, hash));
       if (memcmp(hash, si.Hash, kHashSize) != 0)
         return S_FALSE;
       wchar_t sz[32];
@@ -512,7 +763,7 @@ HRESULT OpenArchive(IInStream *inStream, const CHeader &h, CByteBuffer &xml, CDa
   if (needBootMetadata)
   {
     CByteBuffer metadata;
-    RINOK(UnpackData(inStream, h.MetadataResource, h.IsLzxMode(), metadata, NULL));
+    RINOK(UnpackData(unpacker, inStream, h.MetadataResource, h.IsLzxMode(), metadata, NULL));
     RINOK(ParseDir(metadata, metadata.GetCapacity(), L"0" WSTRING_PATH_SEPARATOR, db.Items));
   }
   return S_OK;
@@ -212,6 +212,10 @@ HRESULT ReadHeader(IInStream *inStream, CHeader &header);
 HRESULT OpenArchive(IInStream *inStream, const CHeader &header, CByteBuffer &xml, CDatabase &database);
 HRESULT SortDatabase(CDatabase &database);
 
+#ifdef COMPRESS_MT
+class CMtUnpacker;
+#endif
+
 class CUnpacker
 {
   NCompress::CCopyCoder *copyCoderSpec;
@@ -223,9 +227,24 @@ class CUnpacker
   NXpress::CDecoder xpressDecoder;
 
   CByteBuffer sizesBuf;
+
+  #ifdef COMPRESS_MT
+  CMtUnpacker *_mtUnpacker;
+  bool CreateMtUnpacker();
+  HRESULT UnpackMt(IInStream *inStream, const CResource &res, bool lzxMode,
+      UInt32 numChunks, unsigned entrySize, UInt64 baseOffset, UInt64 chunksPackSize,
+      ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+  #endif
+
   HRESULT Unpack(IInStream *inStream, const CResource &res, bool lzxMode,
       ISequentialOutStream *outStream, ICompressProgressInfo *progress);
 public:
+  #ifdef COMPRESS_MT
+  UInt32 NumThreads;
+  #endif
+
+  CUnpacker();
+  ~CUnpacker();
   HRESULT Unpack(IInStream *inStream, const CResource &res, bool lzxMode,
       ISequentialOutStream *outStream, ICompressProgressInfo *progress, Byte *digest);
 };
@@ -32,6 +32,7 @@ static const UInt32 kLzAlgoX1 = 0;
 static const UInt32 kLzAlgoX5 = 1;
 
 static const UInt32 kDeflateNumPassesX1  = 1;
+static const UInt32 kDeflateNumPassesX3  = 2; // lazy parsing in fast mode (algo = 0)
 static const UInt32 kDeflateNumPassesX7  = 3;
 static const UInt32 kDeflateNumPassesX9  = 10;
 
@@ -307,7 +308,9 @@ STDMETHODIMP CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
       if (options.NumPasses == 0xFFFFFFFF)
         options.NumPasses = (level >= 9 ? kDeflateNumPassesX9 :
                             (level >= 7 ? kDeflateNumPassesX7 :
-                                          kDeflateNumPassesX1));
+                            (level >= 5 ? kDeflateNumPassesX1 :
+                            (level >= 3 ? kDeflateNumPassesX3 :
+                                          kDeflateNumPassesX1))));
       if (options.NumFastBytes == 0xFFFFFFFF)
         options.NumFastBytes = (level >= 9 ? kDeflateNumFastBytesX9 :
                                (level >= 7 ? kDeflateNumFastBytesX7 :
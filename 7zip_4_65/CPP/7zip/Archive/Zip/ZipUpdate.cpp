@@ -19,6 +19,10 @@
 
 #include "../../Compress/CopyCoder.h"
 
+#ifdef COMPRESS_MT
+#include "../Common/MtUpdateThreads.h"
+#endif
+
 #include "ZipAddCommon.h"
 #include "ZipOut.h"
 #include "ZipUpdate.h"
@@ -137,97 +141,36 @@ static void SetItemInfoFromCompressingResult(const CCompressingResult &compressi
 
 #ifdef COMPRESS_MT
 
-static THREAD_FUNC_DECL CoderThread(void *threadCoderInfo);
-
-struct CThreadInfo
+struct CThreadInfo: public CMtUpdateThread
 {
   #ifdef EXTERNAL_CODECS
   CMyComPtr<ICompressCodecsInfo> _codecsInfo;
   const CObjectVector<CCodecInfoEx> *_externalCodecs;
   #endif
 
-  NWindows::CThread Thread;
-  NWindows::NSynchronization::CAutoResetEvent CompressEvent;
-  NWindows::NSynchronization::CAutoResetEvent CompressionCompletedEvent;
-  bool ExitThread;
-
-  CMtCompressProgress *ProgressSpec;
-  CMyComPtr<ICompressProgressInfo> Progress;
-
-  COutMemStream *OutStreamSpec;
-  CMyComPtr<IOutStream> OutStream;
   CMyComPtr<ISequentialInStream> InStream;
 
   CAddCommon Coder;
-  HRESULT Result;
   CCompressingResult CompressingResult;
 
-  bool IsFree;
   UInt32 UpdateIndex;
 
-  CThreadInfo(const CCompressionMethodMode &options):
-      ExitThread(false),
-      ProgressSpec(0),
-      OutStreamSpec(0),
-      Coder(options)
-  {}
-  
-  HRESULT CreateEvents()
-  {
-    RINOK(CompressEvent.CreateIfNotCreated());
-    return CompressionCompletedEvent.CreateIfNotCreated();
-  }
-  HRes CreateThread() { return Thread.Create(CoderThread, this); }
-
-  void WaitAndCode();
-  void StopWaitClose()
-  {
-    ExitThread = true;
-    if (OutStreamSpec != 0)
-      OutStreamSpec->StopWriting(E_ABORT);
-    if (CompressEvent.IsCreated())
-      CompressEvent.Set();
-    Thread.Wait();
-    Thread.Close();
-  }
-
+  CThreadInfo(const CCompressionMethodMode &options): Coder(options) {}
+  HRESULT Code();
 };
 
-void CThreadInfo::WaitAndCode()
+HRESULT CThreadInfo::Code()
 {
-  for (;;)
-  {
-    CompressEvent.Lock();
-    if (ExitThread)
-      return;
-    Result = Coder.Compress(
-        #ifdef EXTERNAL_CODECS
-        _codecsInfo, _externalCodecs,
-        #endif
-        InStream, OutStream, Progress, CompressingResult);
-    if (Result == S_OK && Progress)
-      Result = Progress->SetRatioInfo(&CompressingResult.UnpackSize, &CompressingResult.PackSize);
-    CompressionCompletedEvent.Set();
-  }
-}
-
-static THREAD_FUNC_DECL CoderThread(void *threadCoderInfo)
-{
-  ((CThreadInfo *)threadCoderInfo)->WaitAndCode();
-  return 0;
+  HRESULT res = Coder.Compress(
+      #ifdef EXTERNAL_CODECS
+      _codecsInfo, _externalCodecs,
+      #endif
+      InStream, OutStream, Progress, CompressingResult);
+  if (res == S_OK && Progress)
+    res = Progress->SetRatioInfo(&CompressingResult.UnpackSize, &CompressingResult.PackSize);
+  return res;
 }
 
-class CThreads
-{
-public:
-  CObjectVector<CThreadInfo> Threads;
-  ~CThreads()
-  {
-    for (int i = 0; i < Threads.Size(); i++)
-      Threads[i].StopWaitClose();
-  }
-};
-
 struct CMemBlocks2: public CMemLockBlocks
 {
   CCompressingResult CompressingResult;
@@ -596,15 +539,18 @@ static HRESULT Update2(
   CMtCompressProgressMixer mtCompressProgressMixer;
   mtCompressProgressMixer.Init(numThreads, mtProgressMixerSpec->RatioProgress);
 
+  NWindows::NSynchronization::CSynchro synchro;
+  RINOK(synchro.Create());
+
   CMemBlockManagerMt memManager(kBlockSize);
   CMemRefs refs(&memManager);
 
-  CThreads threads;
-  CRecordVector<HANDLE> compressingCompletedEvents;
+  CMtUpdateThreads<CThreadInfo> threads;
+  CRecordVector<NWindows::NSynchronization::CHandle_WFMO> compressingCompletedEvents;
   CRecordVector<int> threadIndices;  // list threads in order of updateItems
 
   {
-    RINOK(memManager.AllocateSpaceAlways((size_t)numThreads * (kMemPerThread / kBlockSize)));
+    RINOK(memManager.AllocateSpaceAlways(&synchro, (size_t)numThreads * (kMemPerThread / kBlockSize)));
     for(i = 0; i < updateItems.Size(); i++)
       refs.Refs.Add(CMemBlocks2());
 
@@ -619,15 +565,7 @@ static HRESULT Update2(
       threadInfo._codecsInfo = codecsInfo;
       threadInfo._externalCodecs = externalCodecs;
       #endif
-      RINOK(threadInfo.CreateEvents());
-      threadInfo.OutStreamSpec = new COutMemStream(&memManager);
-      RINOK(threadInfo.OutStreamSpec->CreateEvents());
-      threadInfo.OutStream = threadInfo.OutStreamSpec;
-      threadInfo.IsFree = true;
-      threadInfo.ProgressSpec = new CMtCompressProgress();
-      threadInfo.Progress = threadInfo.ProgressSpec;
-      threadInfo.ProgressSpec->Init(&mtCompressProgressMixer, (int)i);
-      RINOK(threadInfo.CreateThread());
+      RINOK(threadInfo.Create(&synchro, &memManager, &mtCompressProgressMixer, (int)i));
     }
   }
   int mtItemIndex = 0;
@@ -678,17 +616,14 @@ static HRESULT Update2(
         CThreadInfo &threadInfo = threads.Threads[i];
         if (threadInfo.IsFree)
         {
-          threadInfo.IsFree = false;
           threadInfo.InStream = fileInStream;
 
           // !!!!! we must release ref before sending event
           // BUG was here in v4.43 and v4.44. It could change ref counter in two threads in same time
           fileInStream.Release();
 
-          threadInfo.OutStreamSpec->Init();
-          threadInfo.ProgressSpec->Reinit();
-          threadInfo.CompressEvent.Set();
           threadInfo.UpdateIndex = mtItemIndex - 1;
+          threadInfo.StartCoding();
 
           compressingCompletedEvents.Add(threadInfo.CompressionCompletedEvent);
           threadIndices.Add(i);
@@ -757,8 +692,8 @@ static HRESULT Update2(
             }
           }
 
-          DWORD result = ::WaitForMultipleObjects(compressingCompletedEvents.Size(),
-              &compressingCompletedEvents.Front(), FALSE, INFINITE);
+          DWORD result = NWindows::NSynchronization::WaitForMultiObj_Any_Infinite(
+              compressingCompletedEvents.Size(), &compressingCompletedEvents.Front());
           int t = (int)(result - WAIT_OBJECT_0);
           CThreadInfo &threadInfo = threads.Threads[threadIndices[t]];
           threadInfo.InStream.Release();
@@ -609,6 +609,14 @@ SOURCE=..\..\Common\MethodProps.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Common\MtThreadPool.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\MtThreadPool.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\OffsetStream.cpp
 # End Source File
 # Begin Source File
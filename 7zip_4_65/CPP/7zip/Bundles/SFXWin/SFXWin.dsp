@@ -397,6 +397,14 @@ SOURCE=..\..\Common\LockedStream.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Common\MtThreadPool.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\MtThreadPool.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\OutBuffer.cpp
 # End Source File
 # Begin Source File
@@ -6,10 +6,20 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
 #endif
 
 #include "FileStreams.h"
 
+#ifdef USE_WIN_FILE
+#include "../../Windows/FileMapping.h"
+#include "../../Windows/FileSystem.h"
+#endif
+
 static inline HRESULT ConvertBoolToHRESULT(bool result)
 {
   #ifdef _WIN32
@@ -142,6 +152,181 @@ STDMETHODIMP CInFileStream::GetSize(UInt64 *size)
 }
 
 
+//////////////////////////
+// CInMappedFileStream
+
+// we don't map big files in 32-bit address space
+static const UInt64 kMappedFileSizeMax = (sizeof(size_t) > 4) ? ((UInt64)1 << 40) : ((UInt64)1 << 28);
+
+/*
+We map only files on local fixed drives. If network connection is lost or
+removable media is ejected, access to view raises exception instead of
+returning read error. UNC paths ("\\server\share\", "\\?\") are not mapped.
+*/
+
+#ifdef USE_WIN_FILE
+template <class T>
+static bool IsOnFixedDrive(const T *path)
+{
+  if (path[0] == '\\' && path[1] == '\\')
+    return false;
+  if (path[0] != 0 && path[1] == ':')
+  {
+    T root[4] = { path[0], ':', '\\', 0 };
+    return NWindows::NFile::NSystem::MyGetDriveType(root) == DRIVE_FIXED;
+  }
+  return ::GetDriveType(NULL) == DRIVE_FIXED;
+}
+#else
+static bool IsLocalRegularFile(int handle)
+{
+  struct stat st;
+  if (::fstat(handle, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  #ifdef __linux__
+  struct statfs fs;
+  if (::fstatfs(handle, &fs) != 0)
+    return false;
+  switch ((UInt32)fs.f_type)
+  {
+    case 0x6969:     // NFS
+    case 0x517B:     // SMB
+    case 0xFF534D42: // CIFS
+    case 0xFE534D42: // SMB2
+    case 0x65735546: // FUSE
+      return false;
+  }
+  #endif
+  return true;
+}
+#endif
+
+#ifdef USE_WIN_FILE
+bool CInMappedFileStream::Map(NWindows::NFile::NIO::CInFile &file)
+#else
+bool CInMappedFileStream::Map(NC::NFile::NIO::CInFile &file)
+#endif
+{
+  Unmap();
+  UInt64 size;
+  if (!file.GetLength(size) || size == 0 || size > kMappedFileSizeMax)
+    return false;
+
+  #ifdef USE_WIN_FILE
+
+  if (::GetFileType(file.GetHandle()) != FILE_TYPE_DISK)
+    return false;
+  // view keeps reference to file, so we can close handles after mapping
+  NWindows::CFileMapping mapping;
+  if (!mapping.Create(file.GetHandle(), NULL, PAGE_READONLY, 0, NULL))
+    return false;
+  void *data = mapping.MapViewOfFile(FILE_MAP_READ, 0, (SIZE_T)size);
+  if (data == NULL)
+    return false;
+  
+  #else
+  
+  if (!IsLocalRegularFile(file.GetHandle()))
+    return false;
+  void *data = ::mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, file.GetHandle(), 0);
+  if (data == MAP_FAILED)
+    return false;
+  
+  #endif
+
+  _data = (const Byte *)data;
+  _size = size;
+  _pos = 0;
+  return true;
+}
+
+void CInMappedFileStream::Unmap()
+{
+  if (_data == 0)
+    return;
+  #ifdef USE_WIN_FILE
+  ::UnmapViewOfFile((LPCVOID)_data);
+  #else
+  ::munmap((void *)_data, (size_t)_size);
+  #endif
+  _data = 0;
+  _size = 0;
+  _pos = 0;
+}
+
+bool CInMappedFileStream::Open(LPCTSTR fileName)
+{
+  #ifdef USE_WIN_FILE
+  if (!IsOnFixedDrive(fileName))
+    return false;
+  NWindows::NFile::NIO::CInFile file;
+  #else
+  NC::NFile::NIO::CInFile file;
+  #endif
+  return file.Open(fileName) && Map(file);
+}
+
+#ifdef USE_WIN_FILE
+#ifndef _UNICODE
+bool CInMappedFileStream::Open(LPCWSTR fileName)
+{
+  if (!IsOnFixedDrive(fileName))
+    return false;
+  NWindows::NFile::NIO::CInFile file;
+  return file.Open(fileName) && Map(file);
+}
+#endif
+#endif
+
+STDMETHODIMP CInMappedFileStream::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize != NULL)
+    *processedSize = 0;
+  if (_pos >= _size)
+    return S_OK;
+  UInt64 rem = _size - _pos;
+  if (size > rem)
+    size = (UInt32)rem;
+  memcpy(data, _data + (size_t)_pos, size);
+  _pos += size;
+  if (processedSize != NULL)
+    *processedSize = size;
+  return S_OK;
+}
+
+STDMETHODIMP CInMappedFileStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  switch(seekOrigin)
+  {
+    case STREAM_SEEK_SET: break;
+    case STREAM_SEEK_CUR: offset += (Int64)_pos; break;
+    case STREAM_SEEK_END: offset += (Int64)_size; break;
+    default: return STG_E_INVALIDFUNCTION;
+  }
+  if (offset < 0)
+    return STG_E_INVALIDFUNCTION;
+  _pos = (UInt64)offset;
+  if (newPosition != NULL)
+    *newPosition = _pos;
+  return S_OK;
+}
+
+STDMETHODIMP CInMappedFileStream::GetSize(UInt64 *size)
+{
+  *size = _size;
+  return S_OK;
+}
+
+STDMETHODIMP CInMappedFileStream::GetBuf(UInt64 offset, UInt32 size, const Byte **data)
+{
+  *data = NULL;
+  if (offset > _size || size > _size - offset)
+    return S_FALSE;
+  *data = _data + (size_t)offset;
+  return S_OK;
+}
+
+
 //////////////////////////
 // COutFileStream
 
@@ -52,6 +52,52 @@ public:
   STDMETHOD(GetSize)(UInt64 *size);
 };
 
+/*
+CInMappedFileStream maps whole file to memory (MapViewOfFile / mmap).
+Read() copies data from view, and GetBuf() returns pointer to view.
+Open() returns false, if file can't be mapped (empty file, file is too big
+for address space, file is not regular file on local fixed drive,
+or file system doesn't support mapping).
+Then caller can use CInFileStream.
+Note: if other process truncates mapped file, access to view fails
+(SIGBUS in POSIX). So it's used only for archives opened for reading.
+*/
+
+class CInMappedFileStream:
+  public IInStream,
+  public IStreamGetSize,
+  public IInStreamGetBuf,
+  public CMyUnknownImp
+{
+  const Byte *_data;
+  UInt64 _size;
+  UInt64 _pos;
+  #ifdef USE_WIN_FILE
+  bool Map(NWindows::NFile::NIO::CInFile &file);
+  #else
+  bool Map(NC::NFile::NIO::CInFile &file);
+  #endif
+  void Unmap();
+public:
+  CInMappedFileStream(): _data(0), _size(0), _pos(0) {}
+  virtual ~CInMappedFileStream() { Unmap(); }
+
+  bool Open(LPCTSTR fileName);
+  #ifdef USE_WIN_FILE
+  #ifndef _UNICODE
+  bool Open(LPCWSTR fileName);
+  #endif
+  #endif
+
+  MY_UNKNOWN_IMP3(IInStream, IStreamGetSize, IInStreamGetBuf)
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+
+  STDMETHOD(GetSize)(UInt64 *size);
+  STDMETHOD(GetBuf)(UInt64 offset, UInt32 size, const Byte **data);
+};
+
 #ifndef _WIN32_WCE
 class CStdInFileStream:
   public ISequentialInStream,
@@ -74,6 +74,10 @@ public:
     }
     return size;
   }
+  // direct access to buffered bytes: caller must not Skip() more than GetRem() bytes
+  UInt32 GetRem() const { return (UInt32)(_bufferLimit - _buffer); }
+  const Byte *GetPtr() const { return _buffer; }
+  void Skip(UInt32 size) { _buffer += size; }
   UInt64 GetProcessedSize() const { return _processedSize + (_buffer - _bufferBase); }
   bool WasFinished() const { return _wasFinished; }
 };
@@ -12,6 +12,12 @@ HRESULT CLockedInStream::Read(UInt64 startPos, void *data, UInt32 size,
   return _stream->Read(data, size, processedSize);
 }
 
+HRESULT CLockedInStream::GetSize(UInt64 *size)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+  return _stream->Seek(0, STREAM_SEEK_END, size);
+}
+
 STDMETHODIMP CLockedSequentialInStreamImp::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
   UInt32 realProcessedSize = 0;
@@ -21,3 +27,40 @@ STDMETHODIMP CLockedSequentialInStreamImp::Read(void *data, UInt32 size, UInt32
     *processedSize = realProcessedSize;
   return result;
 }
+
+STDMETHODIMP CLockedInStreamImp::Read(void *data, UInt32 size, UInt32 *processedSize)
+{
+  UInt32 realProcessedSize = 0;
+  HRESULT result = _lockedInStream->Read(_pos, data, size, &realProcessedSize);
+  _pos += realProcessedSize;
+  if (processedSize != NULL)
+    *processedSize = realProcessedSize;
+  return result;
+}
+
+STDMETHODIMP CLockedInStreamImp::Seek(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
+{
+  UInt64 newPos;
+  switch(seekOrigin)
+  {
+    case STREAM_SEEK_SET:
+      newPos = offset;
+      break;
+    case STREAM_SEEK_CUR:
+      newPos = _pos + offset;
+      break;
+    case STREAM_SEEK_END:
+    {
+      UInt64 size;
+      RINOK(_lockedInStream->GetSize(&size));
+      newPos = size + offset;
+      break;
+    }
+    default:
+      return STG_E_INVALIDFUNCTION;
+  }
+  _pos = newPos;
+  if (newPosition != NULL)
+    *newPosition = newPos;
+  return S_OK;
+}
@@ -15,6 +15,7 @@ public:
   void Init(IInStream *stream)
     { _stream = stream; }
   HRESULT Read(UInt64 startPos, void *data, UInt32 size, UInt32 *processedSize);
+  HRESULT GetSize(UInt64 *size);
 };
 
 class CLockedSequentialInStreamImp:
@@ -35,4 +36,26 @@ public:
   STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
 };
 
+// Seekable view of a shared CLockedInStream. Each user (thread) gets its own
+// object with its own position, so several users can read one stream.
+
+class CLockedInStreamImp:
+  public IInStream,
+  public CMyUnknownImp
+{
+  CLockedInStream *_lockedInStream;
+  UInt64 _pos;
+public:
+  void Init(CLockedInStream *lockedInStream)
+  {
+    _lockedInStream = lockedInStream;
+    _pos = 0;
+  }
+
+  MY_UNKNOWN_IMP1(IInStream)
+
+  STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition);
+};
+
 #endif
@@ -51,7 +51,7 @@ void CMemBlockManager::FreeBlock(void *p)
 }
 
 
-HRes CMemBlockManagerMt::AllocateSpace(size_t numBlocks, size_t numNoLockBlocks)
+HRes CMemBlockManagerMt::AllocateSpace(NWindows::NSynchronization::CSynchro *synchro, size_t numBlocks, size_t numNoLockBlocks)
 {
   if (numNoLockBlocks > numBlocks)
     return E_INVALIDARG;
@@ -59,16 +59,16 @@ HRes CMemBlockManagerMt::AllocateSpace(size_t numBlocks, size_t numNoLockBlocks)
     return E_OUTOFMEMORY;
   size_t numLockBlocks = numBlocks - numNoLockBlocks;
   Semaphore.Close();
-  return Semaphore.Create((LONG)numLockBlocks, (LONG)numLockBlocks);
+  return Semaphore.Create(synchro, (LONG)numLockBlocks, (LONG)numLockBlocks);
 }
 
-HRes CMemBlockManagerMt::AllocateSpaceAlways(size_t desiredNumberOfBlocks, size_t numNoLockBlocks)
+HRes CMemBlockManagerMt::AllocateSpaceAlways(NWindows::NSynchronization::CSynchro *synchro, size_t desiredNumberOfBlocks, size_t numNoLockBlocks)
 {
   if (numNoLockBlocks > desiredNumberOfBlocks)
     return E_INVALIDARG;
   for (;;)
   {
-    if (AllocateSpace(desiredNumberOfBlocks, numNoLockBlocks) == 0)
+    if (AllocateSpace(synchro, desiredNumberOfBlocks, numNoLockBlocks) == 0)
       return 0;
     if (desiredNumberOfBlocks == numNoLockBlocks)
       return E_OUTOFMEMORY;
@@ -36,13 +36,14 @@ class CMemBlockManagerMt: public CMemBlockManager
 {
   NWindows::NSynchronization::CCriticalSection _criticalSection;
 public:
-  NWindows::NSynchronization::CSemaphore Semaphore;
+  NWindows::NSynchronization::CSemaphore_WFMO Semaphore;
 
   CMemBlockManagerMt(size_t blockSize = (1 << 20)): CMemBlockManager(blockSize) {}
   ~CMemBlockManagerMt() { FreeSpace(); }
 
-  HRes AllocateSpace(size_t numBlocks, size_t numNoLockBlocks = 0);
-  HRes AllocateSpaceAlways(size_t desiredNumberOfBlocks, size_t numNoLockBlocks = 0);
+  // (synchro) is used for Semaphore, that is waited together with COutMemStream events
+  HRes AllocateSpace(NWindows::NSynchronization::CSynchro *synchro, size_t numBlocks, size_t numNoLockBlocks = 0);
+  HRes AllocateSpaceAlways(NWindows::NSynchronization::CSynchro *synchro, size_t desiredNumberOfBlocks, size_t numNoLockBlocks = 0);
   void FreeSpace();
   void *AllocateBlock();
   void FreeBlock(void *p, bool lockMode = true);
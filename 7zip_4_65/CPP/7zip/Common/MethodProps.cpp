@@ -11,31 +11,48 @@
 static UInt64 k_LZMA = 0x030101;
 // static UInt64 k_LZMA2 = 0x030102;
 
-HRESULT SetMethodProperties(const CMethod &method, const UInt64 *inSizeForReduce, IUnknown *coder)
+static bool GetReducedDictionarySize(const CMethod &method, const UInt64 *inSizeForReduce, UInt32 &reducedDictionarySize)
 {
-  bool tryReduce = false;
-  UInt32 reducedDictionarySize = 1 << 10;
+  reducedDictionarySize = 1 << 10;
   if (inSizeForReduce != 0 && (method.Id == k_LZMA /* || methodFull.MethodID == k_LZMA2 */))
   {
     for (;;)
     {
       const UInt32 step = (reducedDictionarySize >> 1);
       if (reducedDictionarySize >= *inSizeForReduce)
-      {
-        tryReduce = true;
-        break;
-      }
+        return true;
       reducedDictionarySize += step;
       if (reducedDictionarySize >= *inSizeForReduce)
-      {
-        tryReduce = true;
-        break;
-      }
+        return true;
       if (reducedDictionarySize >= ((UInt32)3 << 30))
         break;
       reducedDictionarySize += step;
     }
   }
+  return false;
+}
+
+UInt32 GetMethodDictionarySize(const CMethod &method, const UInt64 *inSizeForReduce)
+{
+  for (int i = 0; i < method.Props.Size(); i++)
+  {
+    const CProp &prop = method.Props[i];
+    if (prop.Id == NCoderPropID::kDictionarySize && prop.Value.vt == VT_UI4)
+    {
+      UInt32 reducedDictionarySize;
+      if (GetReducedDictionarySize(method, inSizeForReduce, reducedDictionarySize))
+        if (reducedDictionarySize < prop.Value.ulVal)
+          return reducedDictionarySize;
+      return prop.Value.ulVal;
+    }
+  }
+  return 0;
+}
+
+HRESULT SetMethodProperties(const CMethod &method, const UInt64 *inSizeForReduce, IUnknown *coder)
+{
+  UInt32 reducedDictionarySize;
+  bool tryReduce = GetReducedDictionarySize(method, inSizeForReduce, reducedDictionarySize);
 
   {
     int numProps = method.Props.Size();
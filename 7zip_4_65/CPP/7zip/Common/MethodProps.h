@@ -38,4 +38,8 @@ struct CMethodsMode
 
 HRESULT SetMethodProperties(const CMethod &method, const UInt64 *inSizeForReduce, IUnknown *coder);
 
+// It returns dictionary size that SetMethodProperties() sets for coder,
+// or 0, if (method) has no dictionary size property.
+UInt32 GetMethodDictionarySize(const CMethod &method, const UInt64 *inSizeForReduce);
+
 #endif
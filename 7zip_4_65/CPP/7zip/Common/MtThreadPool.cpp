@@ -0,0 +1,104 @@
+// MtThreadPool.cpp
+
+#include "StdAfx.h"
+
+#include "MtThreadPool.h"
+
+static THREAD_FUNC_DECL MtPoolThread(void *p)
+{
+  ((CMtThreadPool *)p)->ThreadFunc();
+  return 0;
+}
+
+CMtThreadPool::~CMtThreadPool()
+{
+  StopAndWait();
+  delete []_threads;
+}
+
+HRESULT CMtThreadPool::Create(UInt32 numThreads, UInt32 maxCount)
+{
+  RINOK_THREAD(_canStartSemaphore.Create(0, maxCount + numThreads));
+  _threads = new NWindows::CThread[numThreads];
+  for (; _numThreads < numThreads; _numThreads++)
+  {
+    RINOK_THREAD(_threads[_numThreads].Create(MtPoolThread, this));
+  }
+  return S_OK;
+}
+
+void CMtThreadPool::StopAndWait()
+{
+  if (_numThreads == 0)
+    return;
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+    _stop = true;
+  }
+  _canStartSemaphore.Release(_numThreads);
+  for (UInt32 i = 0; i < _numThreads; i++)
+    _threads[i].Wait();
+  _numThreads = 0;
+}
+
+HRESULT CMtJobQueue::Create(UInt32 numThreads, int numJobs)
+{
+  _finished.Reserve(numJobs);
+  for (int i = 0; i < numJobs; i++)
+    _finished.Add(false);
+  RINOK_THREAD(_jobFinishedEvent.CreateIfNotCreated());
+  return CMtThreadPool::Create(numThreads, (UInt32)numJobs);
+}
+
+bool CMtJobQueue::GetJob(int &jobIndex)
+{
+  _canStartSemaphore.Lock();
+  NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+  if (_stop)
+    return false;
+  jobIndex = (int)(_nextJob++ % _finished.Size());
+  return true;
+}
+
+void CMtJobQueue::JobFinished(int jobIndex)
+{
+  {
+    NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+    _finished[jobIndex] = true;
+  }
+  _jobFinishedEvent.Set();
+}
+
+void CMtJobQueue::StartJob()
+{
+  _numStarted++;
+  _canStartSemaphore.Release();
+}
+
+HRESULT CMtJobQueue::WaitJob(int &jobIndex)
+{
+  jobIndex = (int)(_numWaited % _finished.Size());
+  for (;;)
+  {
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+      if (_finished[jobIndex])
+      {
+        _finished[jobIndex] = false;
+        _numWaited++;
+        return S_OK;
+      }
+    }
+    RINOK_THREAD(_jobFinishedEvent.Lock());
+  }
+}
+
+HRESULT CMtJobQueue::WaitAllJobs()
+{
+  while (HasStartedJobs())
+  {
+    int jobIndex;
+    RINOK(WaitJob(jobIndex));
+  }
+  return S_OK;
+}
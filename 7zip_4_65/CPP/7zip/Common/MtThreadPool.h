@@ -0,0 +1,76 @@
+// MtThreadPool.h
+
+#ifndef __MT_THREAD_POOL_H
+#define __MT_THREAD_POOL_H
+
+#include "../../Common/MyVector.h"
+#include "../../Common/Types.h"
+
+#include "../../Windows/Synchronization.h"
+#include "../../Windows/Thread.h"
+
+#define RINOK_THREAD(x) { WRes __result_ = (x); if(__result_ != 0) return __result_; }
+
+/*
+CMtThreadPool runs (numThreads) worker threads that call ThreadFunc().
+Worker thread waits for work on _canStartSemaphore and exits, if _stop is set.
+StopAndWait() sets _stop and releases _canStartSemaphore for all threads.
+Derived class must call StopAndWait() in its destructor, since worker threads
+use members of derived class.
+If Create() fails, some threads can be created already. StopAndWait() stops them,
+and caller can use single-threaded code instead.
+*/
+
+class CMtThreadPool
+{
+  NWindows::CThread *_threads;
+  UInt32 _numThreads;
+protected:
+  NWindows::NSynchronization::CCriticalSection _criticalSection;
+  NWindows::NSynchronization::CSemaphore _canStartSemaphore;
+  bool _stop;
+public:
+  CMtThreadPool(): _threads(0), _numThreads(0), _stop(false) {}
+  virtual ~CMtThreadPool();
+  // (maxCount) is maximum count of _canStartSemaphore, not including StopAndWait() releases
+  HRESULT Create(UInt32 numThreads, UInt32 maxCount);
+  void StopAndWait();
+  UInt32 GetNumThreads() const { return _numThreads; }
+  virtual void ThreadFunc() = 0;
+};
+
+/*
+CMtJobQueue is ring of (numJobs) job slots, that are processed in order.
+Main thread fills the slot GetNextJobIndex() and calls StartJob().
+Then it gets finished jobs in same order with WaitJob().
+Worker thread gets job index with GetJob() and calls JobFinished() after job.
+Derived class stores jobs data in array of (numJobs) items.
+*/
+
+class CMtJobQueue: public CMtThreadPool
+{
+  NWindows::NSynchronization::CAutoResetEvent _jobFinishedEvent;
+  CRecordVector<bool> _finished;
+  UInt64 _nextJob;
+  UInt64 _numStarted;
+  UInt64 _numWaited;
+protected:
+  // it's called by worker thread. It returns false, if thread must exit
+  bool GetJob(int &jobIndex);
+  void JobFinished(int jobIndex);
+public:
+  CMtJobQueue(): _nextJob(0), _numStarted(0), _numWaited(0) {}
+  HRESULT Create(UInt32 numThreads, int numJobs);
+
+  int GetNumJobs() const { return _finished.Size(); }
+  UInt64 GetNumStarted() const { return _numStarted; }
+  bool CanStartJob() const { return _numStarted - _numWaited < (UInt64)_finished.Size(); }
+  bool HasStartedJobs() const { return _numStarted != _numWaited; }
+  int GetNextJobIndex() const { return (int)(_numStarted % _finished.Size()); }
+  void StartJob();
+  // it waits for the oldest started job, that was not waited yet
+  HRESULT WaitJob(int &jobIndex);
+  HRESULT WaitAllJobs();
+};
+
+#endif
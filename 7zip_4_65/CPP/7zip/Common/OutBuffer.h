@@ -52,6 +52,22 @@ public:
     if(_pos == _limitPos)
       FlushWithCheck();
   }
+  // it writes 4 bytes of (v): low byte first
+  void WriteUInt32(UInt32 v)
+  {
+    if (_limitPos - _pos > 4)
+    {
+      Byte *p = _buffer + _pos;
+      p[0] = (Byte)v;
+      p[1] = (Byte)(v >> 8);
+      p[2] = (Byte)(v >> 16);
+      p[3] = (Byte)(v >> 24);
+      _pos += 4;
+      return;
+    }
+    for (int i = 0; i < 4; i++, v >>= 8)
+      WriteByte((Byte)v);
+  }
   void WriteBytes(const void *data, size_t size)
   {
     for (size_t i = 0; i < size; i++)
@@ -65,8 +65,9 @@ STDMETHODIMP COutMemStream::Write(const void *data, UInt32 size, UInt32 *process
       }
       continue;
     }
-    HANDLE events[3] = { StopWritingEvent, WriteToRealStreamEvent, /* NoLockEvent, */ _memManager->Semaphore };
-    DWORD waitResult = ::WaitForMultipleObjects((Blocks.LockMode ? 3 : 2), events, FALSE, INFINITE);
+    NWindows::NSynchronization::CHandle_WFMO events[3] =
+        { StopWritingEvent, WriteToRealStreamEvent, /* NoLockEvent, */ _memManager->Semaphore };
+    DWORD waitResult = NWindows::NSynchronization::WaitForMultiObj_Any_Infinite((Blocks.LockMode ? 3 : 2), events);
     switch (waitResult)
     {
       case (WAIT_OBJECT_0 + 0):
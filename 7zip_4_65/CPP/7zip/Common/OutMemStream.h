@@ -16,8 +16,8 @@ class COutMemStream:
   bool _realStreamMode;
 
   bool _unlockEventWasSent;
-  NWindows::NSynchronization::CAutoResetEvent StopWritingEvent;
-  NWindows::NSynchronization::CAutoResetEvent WriteToRealStreamEvent;
+  NWindows::NSynchronization::CAutoResetEvent_WFMO StopWritingEvent;
+  NWindows::NSynchronization::CAutoResetEvent_WFMO WriteToRealStreamEvent;
   // NWindows::NSynchronization::CAutoResetEvent NoLockEvent;
 
   HRESULT StopWriteResult;
@@ -30,10 +30,11 @@ class COutMemStream:
 
 public:
 
-  HRes CreateEvents()
+  // (synchro) must be same as for CMemBlockManagerMt::AllocateSpace()
+  HRes CreateEvents(NWindows::NSynchronization::CSynchro *synchro)
   {
-    RINOK(StopWritingEvent.CreateIfNotCreated());
-    return WriteToRealStreamEvent.CreateIfNotCreated();
+    RINOK(StopWritingEvent.CreateIfNotCreated(synchro));
+    return WriteToRealStreamEvent.CreateIfNotCreated(synchro);
   }
 
   void SetOutStream(IOutStream *outStream)
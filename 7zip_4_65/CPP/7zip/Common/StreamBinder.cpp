@@ -2,6 +2,11 @@
 
 #include "StdAfx.h"
 
+extern "C"
+{
+#include "../../../C/Alloc.h"
+}
+
 #include "StreamBinder.h"
 #include "../../Common/Defs.h"
 #include "../../Common/MyCom.h"
@@ -49,24 +54,62 @@ STDMETHODIMP CSequentialOutStreamForBinder::Write(const void *data, UInt32 size,
 
 //////////////////////////
 // CStreamBinder
-// (_thereAreBytesToReadEvent && _bufferSize == 0) means that stream is finished.
 
-HRes CStreamBinder::CreateEvents()
+#ifdef _WIN32
+
+static inline UInt32 AtomicLoad(volatile UInt32 *p)
+  { return (UInt32)InterlockedCompareExchange((LONG *)p, 0, 0); }
+static inline void AtomicStore(volatile UInt32 *p, UInt32 value)
+  { InterlockedExchange((LONG *)p, (LONG)value); }
+
+#else
+
+static inline UInt32 AtomicLoad(volatile UInt32 *p)
+  { __sync_synchronize(); UInt32 value = *p; __sync_synchronize(); return value; }
+static inline void AtomicStore(volatile UInt32 *p, UInt32 value)
+  { __sync_synchronize(); *p = value; __sync_synchronize(); }
+
+#endif
+
+void CStreamBinder::Free()
 {
-  RINOK(_allBytesAreWritenEvent.Create(true));
-  RINOK(_thereAreBytesToReadEvent.Create());
-  return _readStreamIsClosedEvent.Create();
+  ::MidFree(_buf);
+  _buf = 0;
+  _bufSize = 0;
+}
+
+HRes CStreamBinder::CreateEvents(UInt32 bufferSize)
+{
+  RINOK(_canReadEvent.CreateIfNotCreated());
+  RINOK(_canWriteEvent.CreateIfNotCreated());
+  UInt32 size = (1 << 12);
+  while (size < bufferSize && size < ((UInt32)1 << 30))
+    size <<= 1;
+  if (_buf == 0 || _bufSize != size)
+  {
+    Free();
+    _buf = (Byte *)::MidAlloc(size);
+    if (_buf == 0)
+      return E_OUTOFMEMORY;
+    _bufSize = size;
+  }
+  ReInit();
+  return S_OK;
 }
 
 void CStreamBinder::ReInit()
 {
-  _thereAreBytesToReadEvent.Reset();
-  _readStreamIsClosedEvent.Reset();
+  _writePos = 0;
+  _readPos = 0;
+  _readerWaits = 0;
+  _writerWaits = 0;
+  _writeIsClosed = 0;
+  _readIsClosed = 0;
+  _canReadEvent.Reset();
+  _canWriteEvent.Reset();
   ProcessedSize = 0;
 }
 
-
-  
 void CStreamBinder::CreateStreams(ISequentialInStream **inStream,
       ISequentialOutStream **outStream)
 {
@@ -82,28 +125,42 @@ void CStreamBinder::CreateStreams(ISequentialInStream **inStream,
   outStreamSpec->SetBinder(this);
   *outStream = outStreamLoc.Detach();
 
-  _buffer = NULL;
-  _bufferSize= 0;
-  ProcessedSize = 0;
+  ReInit();
 }
 
 HRESULT CStreamBinder::Read(void *data, UInt32 size, UInt32 *processedSize)
 {
-  UInt32 sizeToRead = size;
+  UInt32 sizeToRead = 0;
   if (size > 0)
   {
-    RINOK(_thereAreBytesToReadEvent.Lock());
-    sizeToRead = MyMin(_bufferSize, size);
-    if (_bufferSize > 0)
+    for (;;)
     {
-      memcpy(data, _buffer, sizeToRead);
-      _buffer = ((const Byte *)_buffer) + sizeToRead;
-      _bufferSize -= sizeToRead;
-      if (_bufferSize == 0)
+      UInt32 writePos = AtomicLoad(&_writePos);
+      UInt32 rem = writePos - _readPos;
+      if (rem != 0)
       {
-        _thereAreBytesToReadEvent.Reset();
-        _allBytesAreWritenEvent.Set();
+        sizeToRead = MyMin(rem, size);
+        UInt32 pos = _readPos & (_bufSize - 1);
+        UInt32 cur = MyMin(sizeToRead, _bufSize - pos);
+        memcpy(data, _buf + pos, cur);
+        memcpy((Byte *)data + cur, _buf, sizeToRead - cur);
+        AtomicStore(&_readPos, _readPos + sizeToRead);
+        if (AtomicLoad(&_writerWaits) != 0)
+          _canWriteEvent.Set();
+        break;
       }
+      if (AtomicLoad(&_writeIsClosed) != 0)
+      {
+        // Write() could add data before CloseWrite()
+        if (AtomicLoad(&_writePos) == writePos)
+          break;
+        continue;
+      }
+      AtomicStore(&_readerWaits, 1);
+      if (AtomicLoad(&_writePos) == writePos && AtomicLoad(&_writeIsClosed) == 0)
+        if (_canReadEvent.Lock() != 0)
+          return E_FAIL;
+      AtomicStore(&_readerWaits, 0);
     }
   }
   if (processedSize != NULL)
@@ -114,29 +171,38 @@ HRESULT CStreamBinder::Read(void *data, UInt32 size, UInt32 *processedSize)
 
 void CStreamBinder::CloseRead()
 {
-  _readStreamIsClosedEvent.Set();
+  AtomicStore(&_readIsClosed, 1);
+  _canWriteEvent.Set();
 }
 
 HRESULT CStreamBinder::Write(const void *data, UInt32 size, UInt32 *processedSize)
 {
-  if (size > 0)
+  UInt32 rem = size;
+  while (rem != 0)
   {
-    _buffer = data;
-    _bufferSize = size;
-    _allBytesAreWritenEvent.Reset();
-    _thereAreBytesToReadEvent.Set();
-
-    HANDLE events[2];
-    events[0] = _allBytesAreWritenEvent;
-    events[1] = _readStreamIsClosedEvent;
-    DWORD waitResult = ::WaitForMultipleObjects(2, events, FALSE, INFINITE);
-    if (waitResult != WAIT_OBJECT_0 + 0)
-    {
-      // ReadingWasClosed = true;
+    if (AtomicLoad(&_readIsClosed) != 0)
       return S_FALSE;
+    UInt32 readPos = AtomicLoad(&_readPos);
+    UInt32 avail = _bufSize - (_writePos - readPos);
+    if (avail == 0)
+    {
+      AtomicStore(&_writerWaits, 1);
+      if (AtomicLoad(&_readPos) == readPos && AtomicLoad(&_readIsClosed) == 0)
+        if (_canWriteEvent.Lock() != 0)
+          return E_FAIL;
+      AtomicStore(&_writerWaits, 0);
+      continue;
     }
-    // if(!_allBytesAreWritenEvent.Lock())
-    //   return E_FAIL;
+    UInt32 cur = MyMin(avail, rem);
+    UInt32 pos = _writePos & (_bufSize - 1);
+    UInt32 cur1 = MyMin(cur, _bufSize - pos);
+    memcpy(_buf + pos, data, cur1);
+    memcpy(_buf, (const Byte *)data + cur1, cur - cur1);
+    data = (const Byte *)data + cur;
+    rem -= cur;
+    AtomicStore(&_writePos, _writePos + cur);
+    if (AtomicLoad(&_readerWaits) != 0)
+      _canReadEvent.Set();
   }
   if (processedSize != NULL)
     *processedSize = size;
@@ -145,6 +211,6 @@ HRESULT CStreamBinder::Write(const void *data, UInt32 size, UInt32 *processedSiz
 
 void CStreamBinder::CloseWrite()
 {
-  // _bufferSize must be = 0
-  _thereAreBytesToReadEvent.Set();
+  AtomicStore(&_writeIsClosed, 1);
+  _canReadEvent.Set();
 }
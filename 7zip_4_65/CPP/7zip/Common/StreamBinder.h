@@ -6,18 +6,43 @@
 #include "../IStream.h"
 #include "../../Windows/Synchronization.h"
 
+/*
+CStreamBinder connects output stream of one coder thread with input stream
+of another coder thread. It's bounded ring buffer for one writer and one reader:
+  Write() copies data to ring and waits only if ring is full.
+  Read() copies data from ring and waits only if ring is empty.
+_writePos and _readPos are numbers of written and read bytes (modulo 2^32).
+Each of them is changed only by one thread. A thread sets its "waits" flag
+before waiting, and other thread sets event, if it sees that flag after
+it has changed its position.
+*/
+
+const UInt32 kStreamBinderBufferSizeDefault = (UInt32)4 << 20; // 4 blocks of 1 MB
+
 class CStreamBinder
 {
-  NWindows::NSynchronization::CManualResetEvent _allBytesAreWritenEvent;
-  NWindows::NSynchronization::CManualResetEvent _thereAreBytesToReadEvent;
-  NWindows::NSynchronization::CManualResetEvent _readStreamIsClosedEvent;
-  UInt32 _bufferSize;
-  const void *_buffer;
+  NWindows::NSynchronization::CAutoResetEvent _canReadEvent;
+  NWindows::NSynchronization::CAutoResetEvent _canWriteEvent;
+  Byte *_buf;
+  UInt32 _bufSize; // power of 2
+  volatile UInt32 _writePos;
+  volatile UInt32 _readPos;
+  volatile UInt32 _readerWaits;
+  volatile UInt32 _writerWaits;
+  volatile UInt32 _writeIsClosed;
+  volatile UInt32 _readIsClosed;
+  void Free();
+
+  // it owns _buf, so it can not be copied
+  CStreamBinder(const CStreamBinder &);
+  CStreamBinder &operator=(const CStreamBinder &);
 public:
-  // bool ReadingWasClosed;
   UInt64 ProcessedSize;
-  CStreamBinder() {}
-  HRes CreateEvents();
+  CStreamBinder(): _buf(0), _bufSize(0) {}
+  ~CStreamBinder() { Free(); }
+
+  // bufferSize is rounded up to power of 2
+  HRes CreateEvents(UInt32 bufferSize = kStreamBinderBufferSizeDefault);
 
   void CreateStreams(ISequentialInStream **inStream,
       ISequentialOutStream **outStream);
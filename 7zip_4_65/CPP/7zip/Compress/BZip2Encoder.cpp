@@ -53,7 +53,8 @@ void CThreadInfo::Free()
 
 static THREAD_FUNC_DECL MFThread(void *threadCoderInfo)
 {
-  return ((CThreadInfo *)threadCoderInfo)->ThreadFunc();
+  ((CThreadInfo *)threadCoderInfo)->ThreadFunc();
+  return 0;
 }
 
 #define RINOK_THREAD(x) { WRes __result_ = (x); if(__result_ != 0) return __result_; }
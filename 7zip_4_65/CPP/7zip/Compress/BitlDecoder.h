@@ -5,9 +5,11 @@
 
 #include "../IStream.h"
 
+#include "../../../C/CpuArch.h"
+
 namespace NBitl {
 
-const int kNumBigValueBits = 8 * 4;
+const int kNumBigValueBits = 8 * 8;
 
 const int kNumValueBytes = 3;
 const int kNumValueBits = 8  * kNumValueBytes;
@@ -16,12 +18,20 @@ const UInt32 kMask = (1 << kNumValueBits) - 1;
 
 extern Byte kInvertTable[256];
 
+/*
+m_Value is 64-bit bit accumulator: next bit of stream is bit 0 of m_Value.
+Normalize() keeps more than kNumValueBits bits in m_Value.
+If input buffer contains 8 bytes or more, it loads them with one word read.
+The bits above m_NumBits are not cleared after such read: they are bits of
+next bytes of stream, so next Normalize() writes same bits there again.
+*/
+
 template<class TInByte>
 class CBaseDecoder
 {
 protected:
-  int m_BitPos;
-  UInt32 m_Value;
+  unsigned m_NumBits;
+  UInt64 m_Value;
   TInByte m_Stream;
 public:
   UInt32 NumExtraBytes;
@@ -31,19 +41,28 @@ public:
   void Init()
   {
     m_Stream.Init();
-    m_BitPos = kNumBigValueBits;
+    m_NumBits = 0;
     m_Value = 0;
     NumExtraBytes = 0;
   }
   UInt64 GetProcessedSize() const
-    { return m_Stream.GetProcessedSize() - (kNumBigValueBits - m_BitPos) / 8; }
+    { return m_Stream.GetProcessedSize() - m_NumBits / 8; }
   UInt64 GetProcessedBitsSize() const
-    { return (m_Stream.GetProcessedSize() << 3) - (kNumBigValueBits - m_BitPos); }
-  int GetBitPosition() const { return (m_BitPos & 7); }
+    { return (m_Stream.GetProcessedSize() << 3) - m_NumBits; }
+  int GetBitPosition() const { return (int)((0 - m_NumBits) & 7); }
 
   void Normalize()
   {
-    for (;m_BitPos >= 8; m_BitPos -= 8)
+    if (m_NumBits > kNumValueBits)
+      return;
+    if (m_Stream.GetRem() >= 8)
+    {
+      m_Value |= (UInt64)GetUi64(m_Stream.GetPtr()) << m_NumBits;
+      m_Stream.Skip((kNumBigValueBits - 1 - m_NumBits) >> 3);
+      m_NumBits |= (kNumBigValueBits - 8);
+      return;
+    }
+    for (; m_NumBits <= kNumValueBits; m_NumBits += 8)
     {
       Byte b = 0;
       if (!m_Stream.ReadByte(b))
@@ -51,16 +70,21 @@ public:
         b = 0xFF; // check it
         NumExtraBytes++;
       }
-      m_Value = (b << (kNumBigValueBits - m_BitPos)) | m_Value;
+      m_Value = ((UInt64)b << m_NumBits) | (m_Value & (((UInt64)1 << m_NumBits) - 1));
     }
   }
   
+  void MovePos(int numBits)
+  {
+    m_NumBits -= numBits;
+    m_Value >>= numBits;
+  }
+
   UInt32 ReadBits(int numBits)
   {
     Normalize();
-    UInt32 res = m_Value & ((1 << numBits) - 1);
-    m_BitPos += numBits;
-    m_Value >>= numBits;
+    UInt32 res = (UInt32)m_Value & ((1 << numBits) - 1);
+    MovePos(numBits);
     return res;
   }
 
@@ -68,55 +92,22 @@ public:
   {
     if (NumExtraBytes == 0)
       return false;
-    return ((UInt32)(kNumBigValueBits - m_BitPos) < (NumExtraBytes << 3));
+    return (m_NumBits < (NumExtraBytes << 3));
   }
 };
 
 template<class TInByte>
 class CDecoder: public CBaseDecoder<TInByte>
 {
-  UInt32 m_NormalValue;
-
 public:
-  void Init()
-  {
-    CBaseDecoder<TInByte>::Init();
-    m_NormalValue = 0;
-  }
-
-  void Normalize()
-  {
-    for (; this->m_BitPos >= 8; this->m_BitPos -= 8)
-    {
-      Byte b = 0;
-      if (!this->m_Stream.ReadByte(b))
-      {
-        b = 0xFF; // check it
-        this->NumExtraBytes++;
-      }
-      m_NormalValue = (b << (kNumBigValueBits - this->m_BitPos)) | m_NormalValue;
-      this->m_Value = (this->m_Value << 8) | kInvertTable[b];
-    }
-  }
-  
+  // it returns next numBits bits in reversed (MSB first) order
   UInt32 GetValue(int numBits)
   {
-    Normalize();
-    return ((this->m_Value >> (8 - this->m_BitPos)) & kMask) >> (kNumValueBits - numBits);
-  }
-
-  void MovePos(int numBits)
-  {
-    this->m_BitPos += numBits;
-    m_NormalValue >>= numBits;
-  }
-  
-  UInt32 ReadBits(int numBits)
-  {
-    Normalize();
-    UInt32 res = m_NormalValue & ( (1 << numBits) - 1);
-    MovePos(numBits);
-    return res;
+    this->Normalize();
+    UInt32 v = (UInt32)this->m_Value;
+    return (((UInt32)kInvertTable[v & 0xFF] << 16) |
+        ((UInt32)kInvertTable[(v >> 8) & 0xFF] << 8) |
+        kInvertTable[(v >> 16) & 0xFF]) >> (kNumValueBits - numBits);
   }
 };
 
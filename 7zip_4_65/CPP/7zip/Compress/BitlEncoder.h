@@ -5,11 +5,26 @@
 
 #include "../Common/OutBuffer.h"
 
+/*
+m_Value is bit accumulator: next bit of stream goes to bit (m_NumBits) of m_Value.
+WriteBits() writes 4 bytes to m_Stream when m_Value contains 32 bits or more.
+So m_NumBits < 32 between calls. WriteBits() supports up to 16 bits per call.
+*/
+
 class CBitlEncoder
 {
   COutBuffer m_Stream;
-  int m_BitPos;
-  Byte m_CurByte;
+  unsigned m_NumBits;
+  UInt64 m_Value;
+
+  void WriteFullBytes()
+  {
+    for (; m_NumBits >= 8; m_NumBits -= 8)
+    {
+      m_Stream.WriteByte((Byte)m_Value);
+      m_Value >>= 8;
+    }
+  }
 public:
   bool Create(UInt32 bufferSize) { return m_Stream.Create(bufferSize); }
   void SetStream(ISequentialOutStream *outStream) { m_Stream.SetStream(outStream); }
@@ -17,8 +32,8 @@ public:
   void Init()
   {
     m_Stream.Init();
-    m_BitPos = 8;
-    m_CurByte = 0;
+    m_NumBits = 0;
+    m_Value = 0;
   }
   HRESULT Flush()
   {
@@ -28,33 +43,33 @@ public:
   
   void FlushByte()
   {
-    if(m_BitPos < 8)
-      m_Stream.WriteByte(m_CurByte);
-    m_BitPos = 8;
-    m_CurByte = 0;
+    WriteFullBytes();
+    if (m_NumBits != 0)
+      m_Stream.WriteByte((Byte)m_Value);
+    m_NumBits = 0;
+    m_Value = 0;
   }
 
   void WriteBits(UInt32 value, int numBits)
   {
-    while(numBits > 0)
+    m_Value |= (UInt64)(value & (((UInt32)1 << numBits) - 1)) << m_NumBits;
+    m_NumBits += numBits;
+    if (m_NumBits >= 32)
     {
-      if (numBits < m_BitPos)
-      {
-        m_CurByte |= (value & ((1 << numBits) - 1)) << (8 - m_BitPos);
-        m_BitPos -= numBits;
-        return;
-      }
-      numBits -= m_BitPos;
-      m_Stream.WriteByte((Byte)(m_CurByte | (value << (8 - m_BitPos))));
-      value >>= m_BitPos;
-      m_BitPos = 8;
-      m_CurByte = 0;
+      m_Stream.WriteUInt32((UInt32)m_Value);
+      m_Value >>= 32;
+      m_NumBits -= 32;
     }
   }
-  UInt32 GetBitPosition() const {  return (8 - m_BitPos); }
+  UInt32 GetBitPosition() const { return m_NumBits & 7; }
   UInt64 GetProcessedSize() const {
-      return m_Stream.GetProcessedSize() + (8 - m_BitPos + 7) /8; }
-  void WriteByte(Byte b) { m_Stream.WriteByte(b);}
+      return m_Stream.GetProcessedSize() + (m_NumBits + 7) / 8; }
+  // it must be called only for byte aligned stream
+  void WriteByte(Byte b)
+  {
+    WriteFullBytes();
+    m_Stream.WriteByte(b);
+  }
 };
 
 #endif
@@ -2,6 +2,8 @@
 
 #include "StdAfx.h"
 
+#include "../Common/StreamUtils.h"
+
 #include "DeflateDecoder.h"
 
 namespace NCompress {
@@ -15,8 +17,98 @@ CCoder::CCoder(bool deflate64Mode, bool deflateNSIS):
     _deflate64Mode(deflate64Mode),
     _deflateNSIS(deflateNSIS),
     _keepHistory(false),
+    _index(0),
+    _resumePoint(0),
     ZlibMode(false) {}
 
+static const Byte kIndexSignature[4] = { 'D', 'I', 'D', 'X' };
+static const UInt32 kIndexHeaderSize = 4 + 4 + 8;
+static const UInt32 kPointHeaderSize = 8 + 8 + 4;
+
+static void SetUi64(Byte *p, UInt64 v)
+{
+  SetUi32(p, (UInt32)v);
+  SetUi32(p + 4, (UInt32)(v >> 32));
+}
+
+int CIndex::FindPoint(UInt64 outPos) const
+{
+  int left = 0, right = Points.Size();
+  while (left != right)
+  {
+    int mid = (left + right) / 2;
+    if (Points[mid].OutPos <= outPos)
+      left = mid + 1;
+    else
+      right = mid;
+  }
+  return left - 1;
+}
+
+HRESULT CIndex::Save(ISequentialOutStream *stream) const
+{
+  Byte buf[kIndexHeaderSize];
+  memcpy(buf, kIndexSignature, 4);
+  SetUi32(buf + 4, (UInt32)Points.Size());
+  SetUi64(buf + 8, Spacing);
+  RINOK(WriteStream(stream, buf, kIndexHeaderSize));
+  for (int i = 0; i < Points.Size(); i++)
+  {
+    const CAccessPoint &p = Points[i];
+    UInt32 windowSize = (UInt32)p.Window.GetCapacity();
+    SetUi64(buf, p.InBitPos);
+    SetUi64(buf + 8, p.OutPos);
+    SetUi32(buf + 16, windowSize);
+    RINOK(WriteStream(stream, buf, kPointHeaderSize));
+    RINOK(WriteStream(stream, p.Window, windowSize));
+  }
+  return S_OK;
+}
+
+HRESULT CIndex::Load(ISequentialInStream *stream)
+{
+  Clear();
+  Byte buf[kIndexHeaderSize];
+  RINOK(ReadStream_FALSE(stream, buf, kIndexHeaderSize));
+  if (memcmp(buf, kIndexSignature, 4) != 0)
+    return S_FALSE;
+  UInt32 numPoints = GetUi32(buf + 4);
+  Spacing = GetUi64(buf + 8);
+  for (UInt32 i = 0; i < numPoints; i++)
+  {
+    RINOK(ReadStream_FALSE(stream, buf, kPointHeaderSize));
+    CAccessPoint &p = Points[Points.Add(CAccessPoint())];
+    p.InBitPos = GetUi64(buf);
+    p.OutPos = GetUi64(buf + 8);
+    UInt32 windowSize = GetUi32(buf + 16);
+    if (windowSize > kHistorySize64 || (UInt64)windowSize > p.OutPos ||
+        (i != 0 && p.OutPos <= Points[i - 1].OutPos))
+    {
+      Clear();
+      return S_FALSE;
+    }
+    p.Window.SetCapacity(windowSize);
+    RINOK(ReadStream_FALSE(stream, p.Window, windowSize));
+  }
+  return S_OK;
+}
+
+void CCoder::AddAccessPoint()
+{
+  UInt64 outPos = _outPosBase + m_OutWindowStream.GetProcessedSize();
+  UInt64 lastPos = _index->Points.IsEmpty() ? 0 : _index->Points.Back().OutPos;
+  if (outPos < lastPos + _index->Spacing)
+    return;
+  CAccessPoint &p = _index->Points[_index->Points.Add(CAccessPoint())];
+  p.InBitPos = _inBitPosBase + m_InBitStream.GetProcessedBitsSize();
+  p.OutPos = outPos;
+  UInt32 windowSize = m_OutWindowStream.GetHistorySize();
+  if (windowSize > outPos)
+    windowSize = (UInt32)outPos;
+  p.Window.SetCapacity(windowSize);
+  m_OutWindowStream.GetHistory(p.Window, windowSize);
+}
+
 UInt32 CCoder::ReadBits(int numBits)
 {
   return m_InBitStream.ReadBits(numBits);
@@ -137,6 +229,20 @@ HRESULT CCoder::CodeSpec(UInt32 curSize)
     m_FinalBlock = false;
     _remainLen = 0;
     _needReadTable = true;
+    _inBitPosBase = 0;
+    _outPosBase = 0;
+    if (_resumePoint)
+    {
+      const CAccessPoint &p = *_resumePoint;
+      _resumePoint = 0;
+      UInt32 windowSize = (UInt32)p.Window.GetCapacity();
+      if (windowSize > (_deflate64Mode ? kHistorySize64: kHistorySize32))
+        return E_INVALIDARG;
+      m_OutWindowStream.SetHistory(p.Window, windowSize);
+      _inBitPosBase = p.InBitPos & ~(UInt64)7;
+      _outPosBase = p.OutPos;
+      ReadBits((int)(p.InBitPos & 7));
+    }
   }
 
   if (curSize == 0)
@@ -159,6 +265,8 @@ HRESULT CCoder::CodeSpec(UInt32 curSize)
         _remainLen = kLenIdFinished;
         break;
       }
+      if (_index)
+        AddAccessPoint();
       if (!ReadTables())
         return S_FALSE;
       _needReadTable = false;
@@ -3,7 +3,9 @@
 #ifndef __DEFLATE_DECODER_H
 #define __DEFLATE_DECODER_H
 
+#include "../../Common/Buffer.h"
 #include "../../Common/MyCom.h"
+#include "../../Common/MyVector.h"
 
 #include "../ICoder.h"
 
@@ -18,6 +20,38 @@ namespace NCompress {
 namespace NDeflate {
 namespace NDecoder {
 
+/*
+  Access point allows to start decoding from the middle of deflate stream.
+  Points are placed at the starts of deflate blocks, so the decoder state
+  there is only the bit position in input stream and the window.
+  It's decoder level API: caller sets CIndex with SetIndex() for normal decoding,
+  stores it with CIndex::Save(), and later uses CIndex::Load(), FindPoint()
+  and SetResumePoint(). Archive handlers don't use it now.
+  DeflateIndexTest() in LzmaBench ("lzma b") checks it.
+*/
+
+struct CAccessPoint
+{
+  UInt64 InBitPos; // bit offset of block start from the start of deflate stream
+  UInt64 OutPos;   // offset in unpacked data
+  CByteBuffer Window; // last unpacked bytes before OutPos (up to dictionary size)
+};
+
+class CIndex
+{
+public:
+  UInt64 Spacing; // minimal distance (in unpacked bytes) between points
+  CObjectVector<CAccessPoint> Points;
+
+  CIndex(): Spacing((UInt64)1 << 22) {}
+  void Clear() { Points.Clear(); }
+  // it returns index of last point with (OutPos <= outPos), or -1
+  int FindPoint(UInt64 outPos) const;
+  HRESULT Save(ISequentialOutStream *stream) const;
+  // it returns S_FALSE for unsupported data
+  HRESULT Load(ISequentialInStream *stream);
+};
+
 class CCoder:
   public ICompressCoder,
   public ICompressGetInStreamProcessedSize,
@@ -48,6 +82,12 @@ class CCoder:
   UInt32 _rep0;
   bool _needReadTable;
 
+  CIndex *_index;
+  const CAccessPoint *_resumePoint;
+  UInt64 _inBitPosBase;
+  UInt64 _outPosBase;
+  void AddAccessPoint();
+
   UInt32 ReadBits(int numBits);
 
   bool DeCodeLevelTable(Byte *values, int numSymbols);
@@ -83,6 +123,16 @@ public:
   CCoder(bool deflate64Mode, bool deflateNSIS = false);
   void SetKeepHistory(bool keepHistory) { _keepHistory = keepHistory; }
 
+  // if (index) is set, next decoding calls add access points to (index)
+  void SetIndex(CIndex *index) { _index = index; }
+  /*
+    Next decoding call starts from (point) instead of start of stream.
+    Caller must set input stream to byte (point->InBitPos >> 3) of deflate stream.
+    Unpacked data is written from (point->OutPos). (point) must be available
+    until the start of decoding.
+  */
+  void SetResumePoint(const CAccessPoint *point) { _resumePoint = point; }
+
   HRESULT CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
 
@@ -35,6 +35,12 @@ static const UInt32 kMatchArrayLimit = kMatchArraySize - kMatchMaxLen * 4 * size
 static const UInt32 kBlockUncompressedSizeThreshold = kMaxUncompressedBlockSize -
     kMatchMaxLen - kNumOpts;
 
+// fast mode: match finder cycles, if kMatchFinderCycles is not set
+static const UInt32 kFastCutValueGreedy = 4;
+static const UInt32 kFastCutValueLazy = 16;
+// greedy mode: positions inside longer matches are not inserted to hash table
+static const UInt32 kFastInsertLenMax = 32;
+
 static const int kMaxCodeBitLength = 11;
 static const int kMaxLevelBitLength = 7;
 
@@ -91,6 +97,9 @@ CCoder::CCoder(bool deflate64Mode):
   m_NumFastBytes(32),
   _fastMode(false),
   _btMode(true),
+  _numPassesProp(1),
+  _lazyMode(false),
+  _lazyPending(false),
   m_OnePosMatchesMemory(0),
   m_DistanceMemory(0),
   m_Created(false),
@@ -156,6 +165,8 @@ HRESULT CCoder::Create()
   }
   if (m_MatchFinderCycles != 0)
     _lzInWindow.cutValue = m_MatchFinderCycles;
+  else if (_fastMode)
+    _lzInWindow.cutValue = _lazyMode ? kFastCutValueLazy : kFastCutValueGreedy;
   m_Created = true;
   return S_OK;
   COM_TRY_END
@@ -171,18 +182,7 @@ HRESULT CCoder::BaseSetEncoderProperties2(const PROPID *propIDs, const PROPVARIA
       case NCoderPropID::kNumPasses:
         if (prop.vt != VT_UI4)
           return E_INVALIDARG;
-        m_NumDivPasses = prop.ulVal;
-        if (m_NumDivPasses == 0)
-          m_NumDivPasses = 1;
-        if (m_NumDivPasses == 1)
-          m_NumPasses = 1;
-        else if (m_NumDivPasses <= kNumDivPassesMax)
-          m_NumPasses = 2;
-        else
-        {
-          m_NumPasses = 2 + (m_NumDivPasses - kNumDivPassesMax);
-          m_NumDivPasses = kNumDivPassesMax;
-        }
+        _numPassesProp = prop.ulVal;
         break;
       case NCoderPropID::kNumFastBytes:
         if (prop.vt != VT_UI4)
@@ -228,6 +228,24 @@ CCoder::~CCoder()
   MatchFinder_Free(&_lzInWindow, &g_Alloc);
 }
 
+void CCoder::SetNumPasses()
+{
+  // passes are not used in fast mode: there are no prices for parsing
+  m_NumDivPasses = _fastMode ? 1 : _numPassesProp;
+  if (m_NumDivPasses == 0)
+    m_NumDivPasses = 1;
+  if (m_NumDivPasses == 1)
+    m_NumPasses = 1;
+  else if (m_NumDivPasses <= kNumDivPassesMax)
+    m_NumPasses = 2;
+  else
+  {
+    m_NumPasses = 2 + (m_NumDivPasses - kNumDivPassesMax);
+    m_NumDivPasses = kNumDivPassesMax;
+  }
+  _lazyMode = (_fastMode && _numPassesProp > 1);
+}
+
 NO_INLINE void CCoder::GetMatches()
 {
   if (m_IsMultiPass)
@@ -416,16 +434,71 @@ NO_INLINE UInt32 CCoder::GetOptimal(UInt32 &backRes)
   }
 }
 
+// fast mode uses only longest match from hash chain match finder
+
+NO_INLINE UInt32 CCoder::GetLongestMatch(UInt32 &distRes)
+{
+  UInt32 distanceTmp[kMatchMaxLen * 2 + 3];
+  UInt32 numPairs = Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, distanceTmp);
+  m_AdditionalOffset++;
+  if (numPairs == 0)
+    return 0;
+  UInt32 len = distanceTmp[numPairs - 2];
+  distRes = distanceTmp[numPairs - 1];
+  if (len == m_NumFastBytes && m_NumFastBytes != m_MatchMaxLen)
+  {
+    UInt32 numAvail = Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) + 1;
+    const Byte *pby = Inline_MatchFinder_GetPointerToCurrentPos(&_lzInWindow) - 1;
+    const Byte *pby2 = pby - (distRes + 1);
+    if (numAvail > m_MatchMaxLen)
+      numAvail = m_MatchMaxLen;
+    for (; len < numAvail && pby[len] == pby2[len]; len++);
+  }
+  return len;
+}
+
 UInt32 CCoder::GetOptimalFast(UInt32 &backRes)
 {
-  GetMatches();
-  UInt32 numDistancePairs = m_MatchDistances[0];
-  if (numDistancePairs == 0)
+  UInt32 len;
+  UInt32 dist;
+  if (_lazyPending)
+  {
+    // the match for current position was found at previous call
+    _lazyPending = false;
+    len = _lazyLen;
+    dist = _lazyDist;
+  }
+  else
+    len = GetLongestMatch(dist);
+  if (len < kMatchMinLen)
     return 1;
-  UInt32 lenMain = m_MatchDistances[numDistancePairs - 1];
-  backRes = m_MatchDistances[numDistancePairs];
-  MovePos(lenMain - 1);
-  return lenMain;
+  backRes = dist;
+  if (_lazyMode)
+  {
+    if (len < m_NumFastBytes)
+    {
+      // if next position has longer match, we write literal for current position
+      UInt32 dist2;
+      UInt32 len2 = GetLongestMatch(dist2);
+      if (len2 > len)
+      {
+        _lazyPending = true;
+        _lazyLen = len2;
+        _lazyDist = dist2;
+        return 1;
+      }
+      MovePos(len - 2);
+      return len;
+    }
+  }
+  else if (len > kFastInsertLenMax)
+  {
+    MatchFinder_MoveNoInsert(&_lzInWindow, len - 1);
+    m_AdditionalOffset += len - 1;
+    return len;
+  }
+  MovePos(len - 1);
+  return len;
 }
 
 void CTables::InitStructures()
@@ -608,7 +681,7 @@ NO_INLINE void CCoder::TryBlock()
   BlockSizeRes = 0;
   for (;;)
   {
-    if (m_OptimumCurrentIndex == m_OptimumEndIndex)
+    if (m_OptimumCurrentIndex == m_OptimumEndIndex && !_lazyPending)
     {
       if (m_Pos >= kMatchArrayLimit || BlockSizeRes >= blockSize || !m_SecondPass &&
           ((Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) == 0) || m_ValueIndex >= m_ValueBlockSize))
@@ -914,9 +987,21 @@ SRes Read(void *object, void *data, size_t *size)
   return (SRes)res;
 }
 
-HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
-    const UInt64 * /* inSize */ , const UInt64 * /* outSize */ , ICompressProgressInfo *progress)
+static SRes BufRead(void *object, void *data, size_t *size)
 {
+  CBufSeqInStream *p = (CBufSeqInStream *)object;
+  size_t curSize = (*size < p->Rem) ? *size : p->Rem;
+  memcpy(data, p->Data, curSize);
+  p->Data += curSize;
+  p->Rem -= curSize;
+  *size = curSize;
+  return SZ_OK;
+}
+
+HRESULT CCoder::CodeStream(ISeqInStream *inStream, ISequentialOutStream *outStream,
+    UInt32 dictSize, bool finalStream, ICompressProgressInfo *progress)
+{
+  SetNumPasses();
   m_CheckStatic = (m_NumPasses != 1 || m_NumDivPasses != 1);
   m_IsMultiPass = (m_CheckStatic || (m_NumPasses != 1 || m_NumDivPasses != 1));
 
@@ -926,11 +1011,17 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
 
   UInt64 nowPos = 0;
 
-  _seqInStream.RealStream = inStream;
-  _seqInStream.SeqInStream.Read = Read;
-  _lzInWindow.stream = &_seqInStream.SeqInStream;
+  _lzInWindow.stream = inStream;
 
   MatchFinder_Init(&_lzInWindow);
+  if (dictSize != 0)
+  {
+    // dictionary bytes are inserted to match finder, but they are not coded
+    if (_btMode)
+      Bt3Zip_MatchFinder_Skip(&_lzInWindow, dictSize);
+    else
+      Hc3Zip_MatchFinder_Skip(&_lzInWindow, dictSize);
+  }
   m_OutStream.SetStream(outStream);
   m_OutStream.Init();
 
@@ -943,12 +1034,13 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
   t.InitStructures();
 
   m_AdditionalOffset = 0;
+  _lazyPending = false;
   do
   {
     t.BlockSizeRes = kBlockUncompressedSizeThreshold;
     m_SecondPass = false;
     GetBlockPrice(1, m_NumDivPasses);
-    CodeBlock(1, Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) == 0);
+    CodeBlock(1, finalStream && Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) == 0);
     nowPos += m_Tables[1].BlockSizeRes;
     if (progress != NULL)
     {
@@ -959,9 +1051,33 @@ HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *ou
   while (Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) != 0);
   if (_lzInWindow.result != SZ_OK)
     return _lzInWindow.result;
+  if (!finalStream)
+    WriteStoreBlock(0, 0, false);
   return m_OutStream.Flush();
 }
 
+HRESULT CCoder::CodeReal(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */ , const UInt64 * /* outSize */ , ICompressProgressInfo *progress)
+{
+  _seqInStream.RealStream = inStream;
+  _seqInStream.SeqInStream.Read = Read;
+  return CodeStream(&_seqInStream.SeqInStream, outStream, 0, true, progress);
+}
+
+HRESULT CCoder::BaseCodeBuf(const Byte *data, size_t size, UInt32 dictSize, bool finalStream,
+    ISequentialOutStream *outStream)
+{
+  const UInt32 dictSizeMax = m_Deflate64Mode ? kHistorySize64 : kHistorySize32;
+  if (dictSize > dictSizeMax)
+    dictSize = dictSizeMax;
+  _bufInStream.SeqInStream.Read = BufRead;
+  _bufInStream.Data = data - dictSize;
+  _bufInStream.Rem = size + dictSize;
+  try { return CodeStream(&_bufInStream.SeqInStream, outStream, dictSize, finalStream, NULL); }
+  catch(const COutBufferException &e) { return e.ErrorCode; }
+  catch(...) { return E_FAIL; }
+}
+
 HRESULT CCoder::BaseCode(ISequentialInStream *inStream, ISequentialOutStream *outStream,
     const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress)
 {
@@ -55,12 +55,20 @@ typedef struct _CSeqInStream
   CMyComPtr<ISequentialInStream> RealStream;
 } CSeqInStream;
 
+typedef struct _CBufSeqInStream
+{
+  ISeqInStream SeqInStream;
+  const Byte *Data;
+  size_t Rem;
+} CBufSeqInStream;
+
 class CCoder
 {
   CMatchFinder _lzInWindow;
   CBitlEncoder m_OutStream;
 
   CSeqInStream _seqInStream;
+  CBufSeqInStream _bufInStream;
 
 public:
   CCodeValue *m_Values;
@@ -70,6 +78,13 @@ public:
   bool _fastMode;
   bool _btMode;
 
+  // fast mode: greedy parsing for (kNumPasses == 1), lazy parsing for (kNumPasses > 1)
+  UInt32 _numPassesProp;
+  bool _lazyMode;
+  bool _lazyPending;
+  UInt32 _lazyLen;
+  UInt32 _lazyDist;
+
   UInt16 *m_OnePosMatchesMemory;
   UInt16 *m_DistanceMemory;
 
@@ -121,7 +136,9 @@ public:
   UInt32 m_MatchFinderCycles;
   // IMatchFinderSetNumPasses *m_SetMfPasses;
 
+  void SetNumPasses();
   void GetMatches();
+  UInt32 GetLongestMatch(UInt32 &distRes);
   void MovePos(UInt32 num);
   UInt32 Backward(UInt32 &backRes, UInt32 cur);
   UInt32 GetOptimal(UInt32 &backRes);
@@ -166,6 +183,8 @@ public:
 
   UInt32 GetBlockPrice(int tableIndex, int numDivPasses);
   void CodeBlock(int tableIndex, bool finalBlock);
+  HRESULT CodeStream(ISeqInStream *inStream, ISequentialOutStream *outStream,
+      UInt32 dictSize, bool finalStream, ICompressProgressInfo *progress);
 
 public:
   CCoder(bool deflate64Mode = false);
@@ -177,6 +196,15 @@ public:
   HRESULT BaseCode(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
 
+  /*
+    It codes (size) bytes from (data) as one part of deflate stream.
+    (dictSize) bytes before (data) are used as preset dictionary.
+    If (finalStream) is false, the part ends with empty stored block (sync flush),
+    so the output is byte aligned and the next part can be appended to it.
+  */
+  HRESULT BaseCodeBuf(const Byte *data, size_t size, UInt32 dictSize, bool finalStream,
+      ISequentialOutStream *outStream);
+
   HRESULT BaseSetEncoderProperties2(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
 };
 
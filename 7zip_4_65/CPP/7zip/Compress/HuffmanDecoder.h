@@ -9,6 +9,12 @@ namespace NCompress {
 namespace NHuffman {
 
 const int kNumTableBits = 9;
+const int kNumLenBits = 4;
+
+/*
+Codes with length <= kNumTableBits are decoded with one lookup in m_Table,
+that returns both symbol and length. Longer codes are decoded via m_Limits.
+*/
 
 template <int kNumBitsMax, UInt32 m_NumSymbols>
 class CDecoder
@@ -16,7 +22,7 @@ class CDecoder
   UInt32 m_Limits[kNumBitsMax + 1];     // m_Limits[i] = value limit for symbols with length = i
   UInt32 m_Positions[kNumBitsMax + 1];  // m_Positions[i] = index in m_Symbols[] of first symbol with length = i
   UInt32 m_Symbols[m_NumSymbols];
-  Byte m_Lengths[1 << kNumTableBits];   // Table oh length for short codes.
+  UInt16 m_Table[1 << kNumTableBits];   // (symbol << kNumLenBits) | length for short codes
 
 public:
   
@@ -39,7 +45,6 @@ public:
     lenCounts[0] = 0;
     m_Positions[0] = m_Limits[0] = 0;
     UInt32 startPos = 0;
-    UInt32 index = 0;
     const UInt32 kMaxValue = (1 << kNumBitsMax);
     for (i = 1; i <= kNumBitsMax; i++)
     {
@@ -49,12 +54,6 @@ public:
       m_Limits[i] = (i == kNumBitsMax) ? kMaxValue : startPos;
       m_Positions[i] = m_Positions[i - 1] + lenCounts[i - 1];
       tmpPositions[i] = m_Positions[i];
-      if(i <= kNumTableBits)
-      {
-        UInt32 limit = (m_Limits[i] >> (kNumBitsMax - kNumTableBits));
-        for (; index < limit; index++)
-          m_Lengths[index] = (Byte)i;
-      }
     }
     for (symbol = 0; symbol < m_NumSymbols; symbol++)
     {
@@ -62,6 +61,17 @@ public:
       if (len != 0)
         m_Symbols[tmpPositions[len]++] = symbol;
     }
+    for (i = 1; i <= kNumTableBits; i++)
+    {
+      UInt32 num = (UInt32)1 << (kNumTableBits - i);
+      UInt32 pos = m_Limits[i - 1] >> (kNumBitsMax - kNumTableBits);
+      for (UInt32 k = 0; k < (UInt32)lenCounts[i]; k++)
+      {
+        UInt16 val = (UInt16)((m_Symbols[m_Positions[i] + k] << kNumLenBits) | i);
+        for (UInt32 j = 0; j < num; j++)
+          m_Table[pos++] = val;
+      }
+    }
     return true;
   }
 
@@ -71,9 +81,12 @@ public:
     int numBits;
     UInt32 value = bitStream->GetValue(kNumBitsMax);
     if (value < m_Limits[kNumTableBits])
-      numBits = m_Lengths[value >> (kNumBitsMax - kNumTableBits)];
-    else
-      for (numBits = kNumTableBits + 1; value >= m_Limits[numBits]; numBits++);
+    {
+      UInt32 pair = m_Table[value >> (kNumBitsMax - kNumTableBits)];
+      bitStream->MovePos((int)(pair & ((1 << kNumLenBits) - 1)));
+      return pair >> kNumLenBits;
+    }
+    for (numBits = kNumTableBits + 1; value >= m_Limits[numBits]; numBits++);
     bitStream->MovePos(numBits);
     UInt32 index = m_Positions[numBits] +
       ((value - m_Limits[numBits - 1]) >> (kNumBitsMax - numBits));
@@ -32,6 +32,9 @@ extern "C"
 {
 #include "../../../../C/7zCrc.h"
 #include "../../../../C/Alloc.h"
+#ifdef BENCH_AES
+#include "../../../../C/Aes.h"
+#endif
 }
 
 #include "../../../Common/MyCom.h"
@@ -49,6 +52,18 @@ extern "C"
 #include "../LzmaEncoder.h"
 #endif
 
+#ifdef BENCH_BCJ2
+#include "../../Common/StreamBinder.h"
+#include "../Bcj2Coder.h"
+#endif
+
+#ifdef BENCH_DEFLATE
+#include "../../../Common/Defs.h"
+#include "../../../Common/MyVector.h"
+#include "../DeflateDecoder.h"
+#include "../DeflateEncoder.h"
+#endif
+
 static const UInt32 kUncompressMinBlockSize = 1 << 26;
 static const UInt32 kAdditionalSize = (1 << 16);
 static const UInt32 kCompressedAdditionalSize = (1 << 10);
@@ -899,7 +914,7 @@ struct CCrcThreads
 {
   UInt32 NumThreads;
   CCrcInfo *Items;
-  CCrcThreads(): Items(0), NumThreads(0) {}
+  CCrcThreads(): NumThreads(0), Items(0) {}
   void WaitAll()
   {
     for (UInt32 i = 0; i < NumThreads; i++)
@@ -1019,3 +1034,447 @@ HRESULT CrcBench(UInt32 numThreads, UInt32 bufferSize, UInt64 &speed)
   return S_OK;
 }
 
+#ifdef BENCH_AES
+
+HRESULT AesBench(bool decode, UInt32 bufferSize, UInt64 &speed)
+{
+  bufferSize &= ~(UInt32)(AES_BLOCK_SIZE - 1);
+  if (bufferSize == 0)
+    return E_INVALIDARG;
+  AesGenTables();
+
+  CBenchBuffer buffer;
+  if (!buffer.Alloc((size_t)bufferSize * 2))
+    return E_OUTOFMEMORY;
+  Byte *buf = buffer.Buffer;
+  Byte *temp = buf + bufferSize;
+  CBaseRandomGenerator RG;
+  Byte key[32];
+  Byte iv[AES_BLOCK_SIZE];
+  RandGen(key, sizeof(key), RG);
+  RandGen(iv, sizeof(iv), RG);
+  RandGen(buf, bufferSize, RG);
+
+  CAesCbc aes;
+  Aes_SetKeyEncode(&aes.aes, key, sizeof(key));
+  AesCbc_Init(&aes, iv);
+  memcpy(temp, buf, bufferSize);
+  if (AesCbc_Encode(&aes, temp, bufferSize) != bufferSize)
+    return S_FALSE;
+  Aes_SetKeyDecode(&aes.aes, key, sizeof(key));
+  AesCbc_Init(&aes, iv);
+  if (AesCbc_Decode(&aes, temp, bufferSize) != bufferSize)
+    return S_FALSE;
+  if (memcmp(temp, buf, bufferSize) != 0)
+    return S_FALSE;
+
+  if (decode)
+    Aes_SetKeyDecode(&aes.aes, key, sizeof(key));
+  else
+    Aes_SetKeyEncode(&aes.aes, key, sizeof(key));
+  AesCbc_Init(&aes, iv);
+
+  UInt32 numCycles = ((UInt32)1 << 28) / bufferSize + 1;
+  UInt64 timeVal = GetTimeCount();
+  for (UInt32 i = 0; i < numCycles; i++)
+  {
+    if (decode)
+      AesCbc_Decode(&aes, buf, bufferSize);
+    else
+      AesCbc_Encode(&aes, buf, bufferSize);
+  }
+  timeVal = GetTimeCount() - timeVal;
+  if (timeVal == 0)
+    timeVal = 1;
+
+  UInt64 size = (UInt64)numCycles * bufferSize;
+  speed = MyMultDiv64(size, timeVal, GetFreq());
+  return S_OK;
+}
+
+#endif
+
+#ifdef BENCH_BCJ2
+
+/*
+Bcj2Bench runs BCJ2 and LZMA coders as 7z "BCJ2" method does:
+BCJ2 main stream goes to LZMA encoder (and from LZMA decoder).
+  pipeline = false: main stream is stored in memory buffer, and coders run one after another.
+  pipeline = true: coders run in two threads connected with CStreamBinder.
+Call, jump and range coder streams of BCJ2 are stored in memory in both modes.
+*/
+
+struct CBcj2BenchInfo
+{
+  CBenchRandomGenerator Data;
+  UInt32 Crc;
+  UInt32 DictionarySize;
+  UInt64 MainSize;
+  CBenchmarkOutStream *MainSpec;
+  CMyComPtr<ISequentialOutStream> Main;
+  CBenchmarkOutStream *SideSpecs[3];
+  CMyComPtr<ISequentialOutStream> Sides[3];
+  CBenchmarkOutStream *PackSpec;
+  CMyComPtr<ISequentialOutStream> Pack;
+  CBenchmarkOutStream *PropsSpec;
+  CMyComPtr<ISequentialOutStream> Props;
+
+  CStreamBinder Binder;
+  CMyComPtr<ISequentialOutStream> BinderOut;
+  NWindows::CThread Thread;
+  HRESULT ThreadResult;
+  bool DecodeMode;
+
+  HRESULT Init(UInt32 dictionarySize, CBaseRandomGenerator *rg);
+  HRESULT Bcj2Encode(ISequentialOutStream *mainStream);
+  HRESULT LzmaEncode(ISequentialInStream *mainStream);
+  HRESULT LzmaDecode(ISequentialOutStream *mainStream);
+  HRESULT Bcj2Decode(ISequentialInStream *mainStream);
+  HRESULT Encode(bool pipeline);
+  HRESULT Decode(bool pipeline);
+  HRESULT RunPipeline(bool decode);
+
+  static THREAD_FUNC_DECL ThreadFunction(void *param)
+  {
+    CBcj2BenchInfo *p = (CBcj2BenchInfo *)param;
+    if (p->DecodeMode)
+      p->ThreadResult = p->LzmaDecode(p->BinderOut);
+    else
+      p->ThreadResult = p->Bcj2Encode(p->BinderOut);
+    // it calls CloseWrite(), so second coder gets end of stream
+    p->BinderOut.Release();
+    return 0;
+  }
+};
+
+static CBenchmarkOutStream *CreateBenchOutStream(CMyComPtr<ISequentialOutStream> &stream, size_t size)
+{
+  CBenchmarkOutStream *spec = new CBenchmarkOutStream;
+  stream = spec;
+  if (!spec->Alloc(size))
+    return 0;
+  spec->Init();
+  return spec;
+}
+
+HRESULT CBcj2BenchInfo::Init(UInt32 dictionarySize, CBaseRandomGenerator *rg)
+{
+  DictionarySize = dictionarySize;
+  UInt32 bufferSize = dictionarySize + kAdditionalSize;
+  Data.Set(rg);
+  if (!Data.Alloc(bufferSize))
+    return E_OUTOFMEMORY;
+  Data.Generate();
+  Crc = CrcCalc(Data.Buffer, Data.BufferSize);
+
+  if ((MainSpec = CreateBenchOutStream(Main, bufferSize + kAdditionalSize)) == 0)
+    return E_OUTOFMEMORY;
+  for (int i = 0; i < 3; i++)
+    if ((SideSpecs[i] = CreateBenchOutStream(Sides[i], bufferSize / 4 + kCompressedAdditionalSize)) == 0)
+      return E_OUTOFMEMORY;
+  if ((PackSpec = CreateBenchOutStream(Pack, bufferSize / 2 + kCompressedAdditionalSize)) == 0)
+    return E_OUTOFMEMORY;
+  if ((PropsSpec = CreateBenchOutStream(Props, kMaxLzmaPropSize)) == 0)
+    return E_OUTOFMEMORY;
+  return S_OK;
+}
+
+HRESULT CBcj2BenchInfo::Bcj2Encode(ISequentialOutStream *mainStream)
+{
+  CBenchmarkInStream *inStreamSpec = new CBenchmarkInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(Data.Buffer, Data.BufferSize);
+  for (int i = 0; i < 3; i++)
+    SideSpecs[i]->Init();
+  CMyComPtr<ICompressCoder2> encoder = new NCompress::NBcj2::CEncoder;
+  ISequentialInStream *inStreams[1] = { inStream };
+  ISequentialOutStream *outStreams[4] = { mainStream, Sides[0], Sides[1], Sides[2] };
+  return encoder->Code(inStreams, NULL, 1, outStreams, NULL, 4, NULL);
+}
+
+HRESULT CBcj2BenchInfo::LzmaEncode(ISequentialInStream *mainStream)
+{
+  NCompress::NLzma::CEncoder *encoderSpec = new NCompress::NLzma::CEncoder;
+  CMyComPtr<ICompressCoder> encoder = encoderSpec;
+  PROPID propID = NCoderPropID::kDictionarySize;
+  PROPVARIANT prop;
+  prop.vt = VT_UI4;
+  prop.ulVal = DictionarySize;
+  RINOK(encoderSpec->SetCoderProperties(&propID, &prop, 1));
+  PropsSpec->Init();
+  RINOK(encoderSpec->WriteCoderProperties(Props));
+  PackSpec->Init();
+  return encoder->Code(mainStream, Pack, 0, 0, 0);
+}
+
+HRESULT CBcj2BenchInfo::LzmaDecode(ISequentialOutStream *mainStream)
+{
+  NCompress::NLzma::CDecoder *decoderSpec = new NCompress::NLzma::CDecoder;
+  CMyComPtr<ICompressCoder> decoder = decoderSpec;
+  RINOK(decoderSpec->SetDecoderProperties2(PropsSpec->Buffer, PropsSpec->Pos));
+  CBenchmarkInStream *inStreamSpec = new CBenchmarkInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(PackSpec->Buffer, PackSpec->Pos);
+  return decoder->Code(inStream, mainStream, 0, &MainSize, 0);
+}
+
+HRESULT CBcj2BenchInfo::Bcj2Decode(ISequentialInStream *mainStream)
+{
+  CBenchmarkInStream *sideSpecs[3];
+  CMyComPtr<ISequentialInStream> sides[3];
+  for (int i = 0; i < 3; i++)
+  {
+    sideSpecs[i] = new CBenchmarkInStream;
+    sides[i] = sideSpecs[i];
+    sideSpecs[i]->Init(SideSpecs[i]->Buffer, SideSpecs[i]->Pos);
+  }
+  CCrcOutStream *crcOutStreamSpec = new CCrcOutStream;
+  CMyComPtr<ISequentialOutStream> crcOutStream = crcOutStreamSpec;
+  crcOutStreamSpec->Init();
+  CMyComPtr<ICompressCoder2> decoder = new NCompress::NBcj2::CDecoder;
+  ISequentialInStream *inStreams[4] = { mainStream, sides[0], sides[1], sides[2] };
+  ISequentialOutStream *outStreams[1] = { crcOutStream };
+  RINOK(decoder->Code(inStreams, NULL, 4, outStreams, NULL, 1, NULL));
+  if (CRC_GET_DIGEST(crcOutStreamSpec->Crc) != Crc)
+    return S_FALSE;
+  return S_OK;
+}
+
+HRESULT CBcj2BenchInfo::RunPipeline(bool decode)
+{
+  RINOK(Binder.CreateEvents());
+  CMyComPtr<ISequentialInStream> binderIn;
+  Binder.CreateStreams(&binderIn, &BinderOut);
+  DecodeMode = decode;
+  ThreadResult = E_FAIL;
+  RINOK(Thread.Create(ThreadFunction, this));
+  HRESULT res;
+  if (decode)
+    res = Bcj2Decode(binderIn);
+  else
+    res = LzmaEncode(binderIn);
+  // it calls CloseRead(), so first coder doesn't wait, if second coder has failed
+  binderIn.Release();
+  Thread.Wait();
+  Thread.Close();
+  RINOK(res);
+  return ThreadResult;
+}
+
+HRESULT CBcj2BenchInfo::Encode(bool pipeline)
+{
+  if (pipeline)
+  {
+    RINOK(RunPipeline(false));
+    MainSize = Binder.ProcessedSize;
+    return S_OK;
+  }
+  MainSpec->Init();
+  RINOK(Bcj2Encode(Main));
+  MainSize = MainSpec->Pos;
+  CBenchmarkInStream *inStreamSpec = new CBenchmarkInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(MainSpec->Buffer, MainSpec->Pos);
+  return LzmaEncode(inStream);
+}
+
+HRESULT CBcj2BenchInfo::Decode(bool pipeline)
+{
+  if (pipeline)
+    return RunPipeline(true);
+  MainSpec->Init();
+  RINOK(LzmaDecode(Main));
+  if (MainSpec->Pos != MainSize)
+    return S_FALSE;
+  CBenchmarkInStream *inStreamSpec = new CBenchmarkInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  inStreamSpec->Init(MainSpec->Buffer, MainSpec->Pos);
+  return Bcj2Decode(inStream);
+}
+
+HRESULT Bcj2Bench(UInt32 dictionarySize, bool pipeline, UInt64 &encodeSpeed, UInt64 &decodeSpeed)
+{
+  CBaseRandomGenerator rg;
+  CBcj2BenchInfo info;
+  RINOK(info.Init(dictionarySize, &rg));
+
+  UInt64 timeVal = GetTimeCount();
+  RINOK(info.Encode(pipeline));
+  timeVal = GetTimeCount() - timeVal;
+  encodeSpeed = MyMultDiv64(info.Data.BufferSize, timeVal, GetFreq());
+
+  timeVal = GetTimeCount();
+  RINOK(info.Decode(pipeline));
+  timeVal = GetTimeCount() - timeVal;
+  decodeSpeed = MyMultDiv64(info.Data.BufferSize, timeVal, GetFreq());
+  return S_OK;
+}
+
+#endif
+
+#ifdef BENCH_DEFLATE
+
+// MSZIP (cab) compresses data in blocks of 32 KB. Decoder keeps history between blocks.
+static const UInt32 kMsZipBlockSize = (1 << 15);
+
+HRESULT DeflateBench(NDeflateBenchMode::EEnum mode, UInt32 bufferSize, UInt64 &speed)
+{
+  if (bufferSize == 0)
+    return E_INVALIDARG;
+  bool deflate64 = (mode == NDeflateBenchMode::kDeflate64);
+  UInt32 blockSize = (mode == NDeflateBenchMode::kMsZip) ? kMsZipBlockSize : bufferSize;
+  UInt32 numBlocks = (bufferSize + blockSize - 1) / blockSize;
+
+  CBaseRandomGenerator rgLoc;
+  CBenchRandomGenerator rg;
+  rg.Set(&rgLoc);
+  if (!rg.Alloc(bufferSize))
+    return E_OUTOFMEMORY;
+  rg.Generate();
+  UInt32 crc = CrcCalc(rg.Buffer, rg.BufferSize);
+
+  CBenchmarkOutStream *outStreamSpec = new CBenchmarkOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  if (!outStreamSpec->Alloc((size_t)bufferSize + (bufferSize >> 3) + (size_t)numBlocks * kCompressedAdditionalSize))
+    return E_OUTOFMEMORY;
+  outStreamSpec->Init();
+
+  CBenchmarkInStream *inStreamSpec = new CBenchmarkInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+
+  CRecordVector<UInt32> packSizes;
+  {
+    CMyComPtr<ICompressCoder> encoder;
+    if (deflate64)
+      encoder = new NCompress::NDeflate::NEncoder::CCOMCoder64;
+    else
+      encoder = new NCompress::NDeflate::NEncoder::CCOMCoder;
+    for (UInt32 pos = 0; pos < bufferSize; pos += blockSize)
+    {
+      inStreamSpec->Init(rg.Buffer + pos, MyMin(blockSize, bufferSize - pos));
+      UInt32 startPos = outStreamSpec->Pos;
+      RINOK(encoder->Code(inStream, outStream, NULL, NULL, NULL));
+      packSizes.Add(outStreamSpec->Pos - startPos);
+    }
+  }
+
+  NCompress::NDeflate::NDecoder::CCoder *decoderSpec;
+  if (deflate64)
+    decoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder64;
+  else
+    decoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
+  CMyComPtr<ICompressCoder> decoder = decoderSpec;
+  CCrcOutStream *crcOutStreamSpec = new CCrcOutStream;
+  CMyComPtr<ISequentialOutStream> crcOutStream = crcOutStreamSpec;
+
+  UInt32 numCycles = ((UInt32)1 << 27) / bufferSize + 1;
+  UInt64 timeVal = GetTimeCount();
+  for (UInt32 i = 0; i < numCycles; i++)
+  {
+    crcOutStreamSpec->Init();
+    const Byte *packData = outStreamSpec->Buffer;
+    UInt32 pos = 0;
+    for (int b = 0; b < packSizes.Size(); b++)
+    {
+      inStreamSpec->Init(packData, packSizes[b]);
+      packData += packSizes[b];
+      UInt64 outSize = MyMin(blockSize, bufferSize - pos);
+      pos += blockSize;
+      decoderSpec->SetKeepHistory(b != 0);
+      RINOK(decoder->Code(inStream, crcOutStream, NULL, &outSize, NULL));
+    }
+    if (CRC_GET_DIGEST(crcOutStreamSpec->Crc) != crc)
+      return S_FALSE;
+  }
+  timeVal = GetTimeCount() - timeVal;
+  if (timeVal == 0)
+    timeVal = 1;
+
+  UInt64 size = (UInt64)numCycles * bufferSize;
+  speed = MyMultDiv64(size, timeVal, GetFreq());
+  return S_OK;
+}
+
+HRESULT DeflateIndexTest()
+{
+  const UInt32 kBufferSize = (1 << 22);
+  CBaseRandomGenerator rgLoc;
+  CBenchRandomGenerator rg;
+  rg.Set(&rgLoc);
+  if (!rg.Alloc(kBufferSize))
+    return E_OUTOFMEMORY;
+  rg.Generate();
+
+  CBenchmarkOutStream *packStreamSpec = new CBenchmarkOutStream;
+  CMyComPtr<ISequentialOutStream> packStream = packStreamSpec;
+  if (!packStreamSpec->Alloc(kBufferSize + (kBufferSize >> 3) + kCompressedAdditionalSize))
+    return E_OUTOFMEMORY;
+  packStreamSpec->Init();
+  CBenchmarkInStream *inStreamSpec = new CBenchmarkInStream;
+  CMyComPtr<ISequentialInStream> inStream = inStreamSpec;
+  {
+    CMyComPtr<ICompressCoder> encoder = new NCompress::NDeflate::NEncoder::CCOMCoder;
+    inStreamSpec->Init(rg.Buffer, rg.BufferSize);
+    RINOK(encoder->Code(inStream, packStream, NULL, NULL, NULL));
+  }
+
+  CBenchmarkOutStream *outStreamSpec = new CBenchmarkOutStream;
+  CMyComPtr<ISequentialOutStream> outStream = outStreamSpec;
+  if (!outStreamSpec->Alloc(kBufferSize))
+    return E_OUTOFMEMORY;
+
+  NCompress::NDeflate::NDecoder::CCOMCoder *decoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
+  CMyComPtr<ICompressCoder> decoder = decoderSpec;
+
+  // normal decoding builds index
+  NCompress::NDeflate::NDecoder::CIndex index;
+  index.Spacing = (1 << 18);
+  decoderSpec->SetIndex(&index);
+  inStreamSpec->Init(packStreamSpec->Buffer, packStreamSpec->Pos);
+  outStreamSpec->Init();
+  HRESULT res = decoder->Code(inStream, outStream, NULL, NULL, NULL);
+  decoderSpec->SetIndex(NULL);
+  RINOK(res);
+  if (outStreamSpec->Pos != kBufferSize || memcmp(outStreamSpec->Buffer, rg.Buffer, kBufferSize) != 0)
+    return S_FALSE;
+  if (index.Points.Size() < 2)
+    return S_FALSE;
+
+  // index is stored and loaded as in sidecar file
+  size_t indexSize = 64;
+  int i;
+  for (i = 0; i < index.Points.Size(); i++)
+    indexSize += 32 + index.Points[i].Window.GetCapacity();
+  CBenchmarkOutStream *indexStreamSpec = new CBenchmarkOutStream;
+  CMyComPtr<ISequentialOutStream> indexStream = indexStreamSpec;
+  if (!indexStreamSpec->Alloc(indexSize))
+    return E_OUTOFMEMORY;
+  indexStreamSpec->Init();
+  RINOK(index.Save(indexStream));
+  NCompress::NDeflate::NDecoder::CIndex index2;
+  inStreamSpec->Init(indexStreamSpec->Buffer, indexStreamSpec->Pos);
+  RINOK(index2.Load(inStream));
+  if (index2.Points.Size() != index.Points.Size())
+    return S_FALSE;
+
+  // decoding from each access point must give tail of data
+  for (i = 0; i < index2.Points.Size(); i++)
+  {
+    const NCompress::NDeflate::NDecoder::CAccessPoint &p = index2.Points[i];
+    if (index2.FindPoint(p.OutPos) != i || p.OutPos > kBufferSize)
+      return S_FALSE;
+    UInt64 inPos = p.InBitPos >> 3;
+    if (inPos > packStreamSpec->Pos)
+      return S_FALSE;
+    inStreamSpec->Init(packStreamSpec->Buffer + (size_t)inPos, packStreamSpec->Pos - (size_t)inPos);
+    outStreamSpec->Init();
+    decoderSpec->SetResumePoint(&p);
+    RINOK(decoder->Code(inStream, outStream, NULL, NULL, NULL));
+    size_t tailSize = kBufferSize - (size_t)p.OutPos;
+    if (outStreamSpec->Pos != tailSize || memcmp(outStreamSpec->Buffer, rg.Buffer + (size_t)p.OutPos, tailSize) != 0)
+      return S_FALSE;
+  }
+  return S_OK;
+}
+
+#endif
@@ -45,4 +45,34 @@ UInt64 GetBenchMemoryUsage(UInt32 numThreads, UInt32 dictionary);
 bool CrcInternalTest();
 HRESULT CrcBench(UInt32 numThreads, UInt32 bufferSize, UInt64 &speed);
 
+#ifdef BENCH_AES
+// AES-256-CBC speed (bytes per second). It returns S_FALSE, if decoded data doesn't match.
+HRESULT AesBench(bool decode, UInt32 bufferSize, UInt64 &speed);
+#endif
+
+#ifdef BENCH_BCJ2
+// BCJ2 + LZMA chain speed (bytes of source data per second).
+// pipeline = true: coders run in two threads connected with CStreamBinder.
+// It returns S_FALSE, if decoded data doesn't match.
+HRESULT Bcj2Bench(UInt32 dictionarySize, bool pipeline, UInt64 &encodeSpeed, UInt64 &decodeSpeed);
+#endif
+
+#ifdef BENCH_DEFLATE
+namespace NDeflateBenchMode
+{
+  enum EEnum
+  {
+    kDeflate,   // gzip, zip
+    kDeflate64, // zip
+    kMsZip      // cab: 32 KB blocks, history is kept between blocks
+  };
+}
+// Deflate decompression speed (bytes of unpacked data per second).
+// It returns S_FALSE, if decoded data doesn't match.
+HRESULT DeflateBench(NDeflateBenchMode::EEnum mode, UInt32 bufferSize, UInt64 &speed);
+// It checks access point index and resume of Deflate decoder (NDecoder::CIndex).
+// It returns S_FALSE, if decoded data doesn't match.
+HRESULT DeflateIndexTest();
+#endif
+
 #endif
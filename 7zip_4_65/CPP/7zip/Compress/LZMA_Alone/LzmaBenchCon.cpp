@@ -240,6 +240,62 @@ HRESULT LzmaBenchCon(
   midRes.SetMid(callback.EncodeRes, callback.DecodeRes);
   PrintTotals(f, midRes);
   fprintf(f, "\n");
+
+  #ifdef BENCH_AES
+  {
+    // AES speed is shown in same units as compression speed, so it's easy to see
+    // whether encryption or compression limits the speed of encrypted archive creation.
+    const UInt32 kAesBufferSize = (1 << 20);
+    UInt64 encodeSpeed, decodeSpeed;
+    RINOK(AesBench(false, kAesBufferSize, encodeSpeed));
+    RINOK(AesBench(true, kAesBufferSize, decodeSpeed));
+    fprintf(f, "\nAES-256-CBC:  Encrypt");
+    PrintNumber(f, encodeSpeed >> 10, 8);
+    fprintf(f, " KB/s   Decrypt");
+    PrintNumber(f, decodeSpeed >> 10, 8);
+    fprintf(f, " KB/s\n");
+  }
+  #endif
+
+  #ifdef BENCH_BCJ2
+  {
+    // If BCJ2 and LZMA coders really overlap, pipeline speed is higher than serial speed
+    // (up to speed of slowest coder, if there are 2 or more CPU threads).
+    const UInt32 kBcj2DictionarySize = (1 << 22);
+    UInt64 encodeSpeed[2], decodeSpeed[2];
+    for (int k = 0; k < 2; k++)
+      RINOK(Bcj2Bench(kBcj2DictionarySize, k != 0, encodeSpeed[k], decodeSpeed[k]));
+    fprintf(f, "\nBCJ2+LZMA:       Serial     Pipeline\n");
+    fprintf(f, "Compress:   ");
+    PrintNumber(f, encodeSpeed[0] >> 10, 8);
+    fprintf(f, " KB/s");
+    PrintNumber(f, encodeSpeed[1] >> 10, 8);
+    fprintf(f, " KB/s\nDecompress: ");
+    PrintNumber(f, decodeSpeed[0] >> 10, 8);
+    fprintf(f, " KB/s");
+    PrintNumber(f, decodeSpeed[1] >> 10, 8);
+    fprintf(f, " KB/s\n");
+  }
+  #endif
+
+  #ifdef BENCH_DEFLATE
+  {
+    const UInt32 kDeflateBufferSize = (1 << 22);
+    static const char *kDeflateNames[] = { "Deflate:   ", "Deflate64: ", "MSZIP:     " };
+    HRESULT res = DeflateIndexTest();
+    fprintf(f, "\nDeflate index and resume test: %s\n", (res == S_OK) ? "OK" : "Error");
+    RINOK(res);
+    fprintf(f, "\nDecompress (gzip, zip, cab):\n");
+    for (int k = 0; k < 3; k++)
+    {
+      UInt64 speed;
+      RINOK(DeflateBench((NDeflateBenchMode::EEnum)k, kDeflateBufferSize, speed));
+      fprintf(f, "%s", kDeflateNames[k]);
+      PrintNumber(f, speed >> 10, 8);
+      fprintf(f, " KB/s\n");
+    }
+  }
+  #endif
   return S_OK;
 }
 
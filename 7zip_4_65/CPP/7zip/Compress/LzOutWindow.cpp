@@ -12,3 +12,27 @@ void CLzOutWindow::Init(bool solid)
   ErrorCode = S_OK;
   #endif
 }
+
+void CLzOutWindow::SetHistory(const Byte *data, UInt32 size)
+{
+  Init(false);
+  memcpy(_buffer, data, size);
+  _pos = _streamPos = size;
+  if (_pos == _bufferSize)
+  {
+    _pos = _streamPos = 0;
+    _overDict = true;
+  }
+}
+
+void CLzOutWindow::GetHistory(Byte *dest, UInt32 size) const
+{
+  if (size > _pos)
+  {
+    UInt32 part = size - _pos;
+    memcpy(dest, _buffer + _bufferSize - part, part);
+    dest += part;
+    size = _pos;
+  }
+  memcpy(dest, _buffer + _pos - size, size);
+}
@@ -15,6 +15,12 @@ class CLzOutWindow: public COutBuffer
 {
 public:
   void Init(bool solid = false);
+
+  // it inits the window and sets (size) bytes of history. size <= _bufferSize
+  void SetHistory(const Byte *data, UInt32 size);
+  UInt32 GetHistorySize() const { return _overDict ? _bufferSize : _pos; }
+  // it copies last (size) bytes of history to (dest). size <= GetHistorySize()
+  void GetHistory(Byte *dest, UInt32 size) const;
   
   // distance >= 0, len > 0,
   bool CopyBlock(UInt32 distance, UInt32 len)
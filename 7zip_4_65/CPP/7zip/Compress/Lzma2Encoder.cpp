@@ -0,0 +1,125 @@
+// Lzma2Encoder.cpp
+
+#include "StdAfx.h"
+
+extern "C"
+{
+#include "../../../C/Alloc.h"
+}
+
+#include "../Common/StreamUtils.h"
+
+#include "Lzma2Encoder.h"
+
+static HRESULT SResToHRESULT(SRes res)
+{
+  switch(res)
+  {
+    case SZ_OK: return S_OK;
+    case SZ_ERROR_MEM: return E_OUTOFMEMORY;
+    case SZ_ERROR_PARAM: return E_INVALIDARG;
+    // case SZ_ERROR_THREAD: return E_FAIL;
+  }
+  return E_FAIL;
+}
+
+namespace NCompress {
+namespace NLzma2 {
+
+static const UInt32 kStreamStepSize = (UInt32)1 << 31;
+
+static SRes MyRead(void *object, void *data, size_t *size)
+{
+  UInt32 curSize = ((*size < kStreamStepSize) ? (UInt32)*size : kStreamStepSize);
+  HRESULT res = ((NLzma::CSeqInStream *)object)->RealStream->Read(data, curSize, &curSize);
+  *size = curSize;
+  return (SRes)res;
+}
+
+static size_t MyWrite(void *object, const void *data, size_t size)
+{
+  NLzma::CSeqOutStream *p = (NLzma::CSeqOutStream *)object;
+  p->Res = WriteStream(p->RealStream, data, size);
+  if (p->Res != 0)
+    return 0;
+  return size;
+}
+
+static void *SzBigAlloc(void *, size_t size) { return BigAlloc(size); }
+static void SzBigFree(void *, void *address) { BigFree(address); }
+static ISzAlloc g_BigAlloc = { SzBigAlloc, SzBigFree };
+
+static void *SzAlloc(void *, size_t size) { return MyAlloc(size); }
+static void SzFree(void *, void *address) { MyFree(address); }
+static ISzAlloc g_Alloc = { SzAlloc, SzFree };
+
+CEncoder::CEncoder()
+{
+  _seqInStream.SeqInStream.Read = MyRead;
+  _seqOutStream.SeqOutStream.Write = MyWrite;
+  _encoder = 0;
+  _encoder = Lzma2Enc_Create(&g_Alloc, &g_BigAlloc);
+  if (_encoder == 0)
+    throw 1;
+}
+
+CEncoder::~CEncoder()
+{
+  if (_encoder != 0)
+    Lzma2Enc_Destroy(_encoder);
+}
+
+static HRESULT SetLzma2Prop(PROPID propID, const PROPVARIANT &prop, CLzma2EncProps &lzma2Props)
+{
+  switch (propID)
+  {
+    case NCoderPropID::kBlockSize:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; lzma2Props.blockSize = prop.ulVal; break;
+    case NCoderPropID::kNumThreads:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; lzma2Props.numTotalThreads = (int)(prop.ulVal); break;
+    default:
+      RINOK(NLzma::SetLzmaProp(propID, prop, lzma2Props.lzmaProps));
+  }
+  return S_OK;
+}
+
+STDMETHODIMP CEncoder::SetCoderProperties(const PROPID *propIDs,
+    const PROPVARIANT *coderProps, UInt32 numProps)
+{
+  CLzma2EncProps lzma2Props;
+  Lzma2EncProps_Init(&lzma2Props);
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    RINOK(SetLzma2Prop(propIDs[i], coderProps[i], lzma2Props));
+  }
+  return SResToHRESULT(Lzma2Enc_SetProps(_encoder, &lzma2Props));
+}
+
+STDMETHODIMP CEncoder::WriteCoderProperties(ISequentialOutStream *outStream)
+{
+  Byte prop = Lzma2Enc_WriteProperties(_encoder);
+  return WriteStream(outStream, &prop, 1);
+}
+
+STDMETHODIMP CEncoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    const UInt64 * /* inSize */, const UInt64 * /* outSize */, ICompressProgressInfo *progress)
+{
+  NLzma::CCompressProgressImp progressImp;
+  progressImp.p.Progress = NLzma::CompressProgress;
+  progressImp.Progress = progress;
+  progressImp.Res = SZ_OK;
+
+  _seqInStream.RealStream = inStream;
+  _seqOutStream.RealStream = outStream;
+  _seqOutStream.Res = S_OK;
+  SRes res = Lzma2Enc_Encode(_encoder, &_seqOutStream.SeqOutStream, &_seqInStream.SeqInStream, progress ? &progressImp.p : NULL);
+  _seqOutStream.RealStream.Release();
+  if (res == SZ_ERROR_WRITE && _seqOutStream.Res != S_OK)
+    return _seqOutStream.Res;
+  if (res == SZ_ERROR_PROGRESS && progressImp.Res != S_OK)
+    return progressImp.Res;
+  return SResToHRESULT(res);
+}
+
+}}
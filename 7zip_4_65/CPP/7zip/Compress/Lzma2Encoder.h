@@ -0,0 +1,49 @@
+// Lzma2Encoder.h
+
+#ifndef __LZMA2_ENCODER_H
+#define __LZMA2_ENCODER_H
+
+extern "C"
+{
+#include "../../../C/Lzma2Enc.h"
+}
+
+#include "../../Common/MyCom.h"
+
+#include "../ICoder.h"
+
+#include "LzmaEncoder.h"
+
+namespace NCompress {
+namespace NLzma2 {
+
+class CEncoder :
+  public ICompressCoder,
+  public ICompressSetCoderProperties,
+  public ICompressWriteCoderProperties,
+  public CMyUnknownImp
+{
+  CLzma2EncHandle _encoder;
+
+  NLzma::CSeqInStream _seqInStream;
+  NLzma::CSeqOutStream _seqOutStream;
+
+public:
+  CEncoder();
+
+  MY_UNKNOWN_IMP2(
+      ICompressSetCoderProperties,
+      ICompressWriteCoderProperties
+      )
+
+  STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
+  STDMETHOD(SetCoderProperties)(const PROPID *propIDs, const PROPVARIANT *props, UInt32 numProps);
+  STDMETHOD(WriteCoderProperties)(ISequentialOutStream *outStream);
+
+  virtual ~CEncoder();
+};
+
+}}
+
+#endif
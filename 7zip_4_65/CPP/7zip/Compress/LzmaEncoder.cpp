@@ -108,6 +108,40 @@ static int ParseMatchFinder(const wchar_t *s, int *btMode, int *numHashBytes)
   return 1;
 }
 
+HRESULT SetLzmaProp(PROPID propID, const PROPVARIANT &prop, CLzmaEncProps &ep)
+{
+  switch (propID)
+  {
+    case NCoderPropID::kNumFastBytes:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.fb = prop.ulVal; break;
+    case NCoderPropID::kMatchFinderCycles:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.mc = prop.ulVal; break;
+    case NCoderPropID::kAlgorithm:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.algo = prop.ulVal; break;
+    case NCoderPropID::kDictionarySize:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.dictSize = prop.ulVal; break;
+    case NCoderPropID::kPosStateBits:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.pb = prop.ulVal; break;
+    case NCoderPropID::kLitPosBits:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.lp = prop.ulVal; break;
+    case NCoderPropID::kLitContextBits:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.lc = prop.ulVal; break;
+    case NCoderPropID::kNumThreads:
+      if (prop.vt != VT_UI4) return E_INVALIDARG; ep.numThreads = prop.ulVal; break;
+    case NCoderPropID::kMultiThread:
+      if (prop.vt != VT_BOOL) return E_INVALIDARG; ep.numThreads = ((prop.boolVal == VARIANT_TRUE) ? 2 : 1); break;
+    case NCoderPropID::kEndMarker:
+      if (prop.vt != VT_BOOL) return E_INVALIDARG; ep.writeEndMark = (prop.boolVal == VARIANT_TRUE); break;
+    case NCoderPropID::kMatchFinder:
+      if (prop.vt != VT_BSTR) return E_INVALIDARG;
+      if (!ParseMatchFinder(prop.bstrVal, &ep.btMode, &ep.numHashBytes /* , &_matchFinderBase.skipModeBits */))
+        return E_INVALIDARG; break;
+    default:
+      return E_INVALIDARG;
+  }
+  return S_OK;
+}
+
 STDMETHODIMP CEncoder::SetCoderProperties(const PROPID *propIDs,
     const PROPVARIANT *coderProps, UInt32 numProps)
 {
@@ -116,36 +150,7 @@ STDMETHODIMP CEncoder::SetCoderProperties(const PROPID *propIDs,
 
   for (UInt32 i = 0; i < numProps; i++)
   {
-    const PROPVARIANT &prop = coderProps[i];
-    switch (propIDs[i])
-    {
-      case NCoderPropID::kNumFastBytes:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.fb = prop.ulVal; break;
-      case NCoderPropID::kMatchFinderCycles:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.mc = prop.ulVal; break;
-      case NCoderPropID::kAlgorithm:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.algo = prop.ulVal; break;
-      case NCoderPropID::kDictionarySize:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.dictSize = prop.ulVal; break;
-      case NCoderPropID::kPosStateBits:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.pb = prop.ulVal; break;
-      case NCoderPropID::kLitPosBits:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.lp = prop.ulVal; break;
-      case NCoderPropID::kLitContextBits:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.lc = prop.ulVal; break;
-      case NCoderPropID::kNumThreads:
-        if (prop.vt != VT_UI4) return E_INVALIDARG; props.numThreads = prop.ulVal; break;
-      case NCoderPropID::kMultiThread:
-        if (prop.vt != VT_BOOL) return E_INVALIDARG; props.numThreads = ((prop.boolVal == VARIANT_TRUE) ? 2 : 1); break;
-      case NCoderPropID::kEndMarker:
-        if (prop.vt != VT_BOOL) return E_INVALIDARG; props.writeEndMark = (prop.boolVal == VARIANT_TRUE); break;
-      case NCoderPropID::kMatchFinder:
-        if (prop.vt != VT_BSTR) return E_INVALIDARG;
-        if (!ParseMatchFinder(prop.bstrVal, &props.btMode, &props.numHashBytes /* , &_matchFinderBase.skipModeBits */))
-          return E_INVALIDARG; break;
-      default:
-        return E_INVALIDARG;
-    }
+    RINOK(SetLzmaProp(propIDs[i], coderProps[i], props));
   }
   return SResToHRESULT(LzmaEnc_SetProps(_encoder, &props));
 }
@@ -171,13 +176,6 @@ STDMETHODIMP CEncoder::ReleaseOutStream()
   return S_OK;
 }
 
-typedef struct _CCompressProgressImp
-{
-  ICompressProgress p;
-  ICompressProgressInfo *Progress;
-  HRESULT Res;
-} CCompressProgressImp;
-
 #define PROGRESS_UNKNOWN_VALUE ((UInt64)(Int64)-1)
 
 #define CONVERT_PR_VAL(x) (x == PROGRESS_UNKNOWN_VALUE ? NULL : &x)
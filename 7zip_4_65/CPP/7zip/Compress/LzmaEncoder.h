@@ -59,6 +59,17 @@ public:
   virtual ~CEncoder();
 };
 
+typedef struct _CCompressProgressImp
+{
+  ICompressProgress p;
+  ICompressProgressInfo *Progress;
+  HRESULT Res;
+} CCompressProgressImp;
+
+SRes CompressProgress(void *pp, UInt64 inSize, UInt64 outSize);
+
+HRESULT SetLzmaProp(PROPID propID, const PROPVARIANT &prop, CLzmaEncProps &ep);
+
 }}
 
 #endif
@@ -47,6 +47,17 @@ STDMETHODIMP COutStreamWithAdler::Write(const void *data, UInt32 size, UInt32 *p
   return result;
 }
 
+NCompress::NDeflate::NDecoder::CCOMCoder *CDecoder::GetDeflateCoder()
+{
+  if (!DeflateDecoder)
+  {
+    DeflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
+    DeflateDecoderSpec->ZlibMode = true;
+    DeflateDecoder = DeflateDecoderSpec;
+  }
+  return DeflateDecoderSpec;
+}
+
 STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream *outStream,
     const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress)
 {
@@ -56,31 +67,35 @@ STDMETHODIMP CDecoder::Code(ISequentialInStream *inStream, ISequentialOutStream
     AdlerSpec = new COutStreamWithAdler;
     AdlerStream = AdlerSpec;
   }
-  if (!DeflateDecoder)
+  GetDeflateCoder();
+
+  bool resume = (_resumePoint != 0);
+  if (resume)
   {
-    DeflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
-    DeflateDecoderSpec->ZlibMode = true;
-    DeflateDecoder = DeflateDecoderSpec;
+    DeflateDecoderSpec->SetResumePoint(_resumePoint);
+    _resumePoint = 0;
+  }
+  else
+  {
+    Byte buf[2];
+    RINOK(ReadStream_FALSE(inStream, buf, 2));
+    int method = buf[0] & 0xF;
+    if (method != 8)
+      return S_FALSE;
+    // int dicSize = buf[0] >> 4;
+    if ((((UInt32)buf[0] << 8) + buf[1]) % 31 != 0)
+      return S_FALSE;
+    if ((buf[1] & 0x20) != 0) // dictPresent
+      return S_FALSE;
+    // int level = (buf[1] >> 6);
   }
-
-  Byte buf[2];
-  RINOK(ReadStream_FALSE(inStream, buf, 2));
-  int method = buf[0] & 0xF;
-  if (method != 8)
-    return S_FALSE;
-  // int dicSize = buf[0] >> 4;
-  if ((((UInt32)buf[0] << 8) + buf[1]) % 31 != 0)
-    return S_FALSE;
-  if ((buf[1] & 0x20) != 0) // dictPresent
-    return S_FALSE;
-  // int level = (buf[1] >> 6);
 
   AdlerSpec->SetStream(outStream);
   AdlerSpec->Init();
   HRESULT res = DeflateDecoder->Code(inStream, AdlerStream, inSize, outSize, progress);
   AdlerSpec->ReleaseStream();
 
-  if (res == S_OK)
+  if (res == S_OK && !resume)
   {
     const Byte *p = DeflateDecoderSpec->ZlibFooter;
     UInt32 adler = ((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 8) | p[3];
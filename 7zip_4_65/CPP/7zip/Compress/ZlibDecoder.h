@@ -34,7 +34,21 @@ class CDecoder:
   
   NCompress::NDeflate::NDecoder::CCOMCoder *DeflateDecoderSpec;
   CMyComPtr<ICompressCoder> DeflateDecoder;
+  const NCompress::NDeflate::NDecoder::CAccessPoint *_resumePoint;
 public:
+  CDecoder(): DeflateDecoderSpec(0), _resumePoint(0) {}
+
+  // Deflate coder for SetIndex(). Access points are relative to the start
+  // of deflate stream, that follows 2-bytes zlib header.
+  NCompress::NDeflate::NDecoder::CCOMCoder *GetDeflateCoder();
+
+  /*
+    Next Code() call starts from (point). Caller must set input stream to
+    byte (2 + (point->InBitPos >> 3)) of zlib stream. Adler-32 is not checked
+    in that call, since the checksum of data before (point) is unknown.
+  */
+  void SetResumePoint(const NCompress::NDeflate::NDecoder::CAccessPoint *point) { _resumePoint = point; }
+
   STDMETHOD(Code)(ISequentialInStream *inStream, ISequentialOutStream *outStream,
       const UInt64 *inSize, const UInt64 *outSize, ICompressProgressInfo *progress);
 
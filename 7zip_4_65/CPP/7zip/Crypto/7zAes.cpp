@@ -5,6 +5,7 @@
 extern "C"
 {
 #include "../../../C/Sha256.h"
+#include "../../../C/CpuArch.h"
 }
 
 #include "Windows/Synchronization.h"
@@ -22,6 +23,8 @@ using namespace NWindows;
 namespace NCrypto {
 namespace NSevenZ {
 
+struct CSha256Prepare { CSha256Prepare() { Sha256Prepare(); } } g_Sha256Prepare;
+
 bool CKeyInfo::IsEqualTo(const CKeyInfo &a) const
 {
   if (SaltSize != a.SaltSize || NumCyclesPower != a.NumCyclesPower)
@@ -29,9 +32,32 @@ bool CKeyInfo::IsEqualTo(const CKeyInfo &a) const
   for (UInt32 i = 0; i < SaltSize; i++)
     if (Salt[i] != a.Salt[i])
       return false;
-  return (Password == a.Password);
+  return memcmp(PasswordHash, a.PasswordHash, kPasswordHashSize) == 0;
+}
+
+void CKeyInfo::SetPassword(const Byte *data, size_t size)
+{
+  Password.SetCapacity(size);
+  if (size != 0)
+    memcpy(Password, data, size);
+  CSha256 sha;
+  Sha256_Init(&sha);
+  Sha256_Update(&sha, data, size);
+  Sha256_Final(&sha, PasswordHash);
+}
+
+UInt32 CKeyInfo::GetHash() const
+{
+  UInt32 hash = (UInt32)NumCyclesPower;
+  for (UInt32 i = 0; i < SaltSize; i++)
+    hash = hash * 31 + Salt[i];
+  return hash ^ GetUi32(PasswordHash);
 }
 
+// (Salt, Password, counter) units are hashed in batches of up to kDigestNumUnitsMax units
+static const size_t kDigestBufferSizeMax = (1 << 12);
+static const size_t kDigestNumUnitsMax = 64;
+
 void CKeyInfo::CalculateDigest()
 {
   if (NumCyclesPower == 0x3F)
@@ -46,18 +72,47 @@ void CKeyInfo::CalculateDigest()
   }
   else
   {
+    /*
+      Key = SHA-256(Salt, Password, 0, Salt, Password, 1, ... , Salt, Password, numRounds - 1)
+      where counter is 64-bit little-endian.
+      We prepare several consecutive units in buffer to reduce the number of Sha256_Update() calls.
+    */
+    const size_t passwordSize = Password.GetCapacity();
+    const size_t unitSize = SaltSize + passwordSize + 8;
+    size_t numUnits = kDigestBufferSizeMax / unitSize;
+    if (numUnits > kDigestNumUnitsMax)
+      numUnits = kDigestNumUnitsMax;
+    if (numUnits == 0)
+      numUnits = 1;
+    CByteBuffer buffer;
+    buffer.SetCapacity(unitSize * numUnits);
+    Byte *buf = buffer;
+    size_t i;
+    for (i = 0; i < numUnits; i++)
+    {
+      Byte *unit = buf + unitSize * i;
+      memcpy(unit, Salt, SaltSize);
+      if (passwordSize != 0)
+        memcpy(unit + SaltSize, Password, passwordSize);
+    }
+
     CSha256 sha;
     Sha256_Init(&sha);
     const UInt64 numRounds = UInt64(1) << (NumCyclesPower);
-    Byte temp[8] = { 0,0,0,0,0,0,0,0 };
-    for (UInt64 round = 0; round < numRounds; round++)
+    for (UInt64 round = 0; round < numRounds;)
     {
-      Sha256_Update(&sha, Salt, (size_t)SaltSize);
-      Sha256_Update(&sha, Password, Password.GetCapacity());
-      Sha256_Update(&sha, temp, 8);
-      for (int i = 0; i < 8; i++)
-        if (++(temp[i]) != 0)
-          break;
+      size_t num = numUnits;
+      if (num > numRounds - round)
+        num = (size_t)(numRounds - round);
+      for (i = 0; i < num; i++)
+      {
+        UInt64 counter = round + i;
+        Byte *p = buf + unitSize * i + unitSize - 8;
+        for (int k = 0; k < 8; k++, counter >>= 8)
+          p[k] = (Byte)counter;
+      }
+      Sha256_Update(&sha, buf, unitSize * num);
+      round += num;
     }
     Sha256_Final(&sha, Key);
   }
@@ -83,20 +138,40 @@ bool CKeyInfoCache::Find(CKeyInfo &key)
   return false;
 }
 
-void CKeyInfoCache::Add(CKeyInfo &key)
+void CKeyInfoCache::Add(const CKeyInfo &key)
 {
-  if (Find(key))
-    return;
+  for (int i = 0; i < Keys.Size(); i++)
+    if (key.IsEqualTo(Keys[i]))
+      return;
   if (Keys.Size() >= Size)
     Keys.DeleteBack();
   Keys.Insert(0, key);
+  // we don't keep password in cache
+  Keys[0].Password.Free();
 }
 
-static CKeyInfoCache g_GlobalKeyCache(32);
+/*
+g_GlobalKeyCacheCriticalSection protects only g_GlobalKeyCache, so
+lookups are not blocked by slow key calculation in another thread.
+Key calculation is serialized via one of g_KeyCalcCriticalSections
+selected by hash of key: if several threads need same key, only
+first thread calculates it, and other threads find it in the cache.
+*/
+
+static const int kKeyCacheSize = 64;
+static const unsigned kNumKeyCalcCriticalSections = 8;
+
+static CKeyInfoCache g_GlobalKeyCache(kKeyCacheSize);
 static NSynchronization::CCriticalSection g_GlobalKeyCacheCriticalSection;
+static NSynchronization::CCriticalSection g_KeyCalcCriticalSections[kNumKeyCalcCriticalSections];
+
+static bool FindKeyInGlobalCache(CKeyInfo &key)
+{
+  NSynchronization::CCriticalSectionLock lock(g_GlobalKeyCacheCriticalSection);
+  return g_GlobalKeyCache.Find(key);
+}
 
 CBase::CBase():
-  _cachedKeys(16),
   _ivSize(0)
 {
   for (int i = 0; i < sizeof(_iv); i++)
@@ -105,18 +180,15 @@ CBase::CBase():
 
 void CBase::CalculateDigest()
 {
+  if (FindKeyInGlobalCache(_key))
+    return;
+  NSynchronization::CCriticalSectionLock calcLock(
+      g_KeyCalcCriticalSections[_key.GetHash() % kNumKeyCalcCriticalSections]);
+  if (FindKeyInGlobalCache(_key))
+    return;
+  _key.CalculateDigest();
   NSynchronization::CCriticalSectionLock lock(g_GlobalKeyCacheCriticalSection);
-  if (_cachedKeys.Find(_key))
-    g_GlobalKeyCache.Add(_key);
-  else
-  {
-    if (!g_GlobalKeyCache.Find(_key))
-    {
-      _key.CalculateDigest();
-      g_GlobalKeyCache.Add(_key);
-    }
-    _cachedKeys.Add(_key);
-  }
+  g_GlobalKeyCache.Add(_key);
 }
 
 #ifndef EXTRACT_ONLY
@@ -212,8 +284,7 @@ STDMETHODIMP CDecoder::SetDecoderProperties2(const Byte *data, UInt32 size)
 
 STDMETHODIMP CBaseCoder::CryptoSetPassword(const Byte *data, UInt32 size)
 {
-  _key.Password.SetCapacity((size_t)size);
-  memcpy(_key.Password, data, (size_t)size);
+  _key.SetPassword(data, (size_t)size);
   return S_OK;
 }
 
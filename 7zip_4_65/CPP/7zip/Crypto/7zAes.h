@@ -15,6 +15,8 @@ namespace NSevenZ {
 
 const int kKeySize = 32;
 
+const int kPasswordHashSize = 32;
+
 class CKeyInfo
 {
 public:
@@ -22,12 +24,15 @@ public:
   UInt32 SaltSize;
   Byte Salt[16];
   CByteBuffer Password;
+  Byte PasswordHash[kPasswordHashSize]; // SHA-256 of Password, it's used as cache key
   Byte Key[kKeySize];
 
   bool IsEqualTo(const CKeyInfo &a) const;
+  void SetPassword(const Byte *data, size_t size);
   void CalculateDigest();
+  UInt32 GetHash() const;
 
-  CKeyInfo() { Init(); }
+  CKeyInfo() { Init(); SetPassword(0, 0); }
   void Init()
   {
     NumCyclesPower = 0;
@@ -37,6 +42,13 @@ public:
   }
 };
 
+/*
+CKeyInfoCache keeps most recently used keys. It doesn't store passwords:
+keys are compared by (NumCyclesPower, Salt, PasswordHash).
+CKeyInfoCache is not thread-safe. CBase uses one process-wide cache
+that is shared by all coders and protected with critical section.
+*/
+
 class CKeyInfoCache
 {
   int Size;
@@ -44,13 +56,11 @@ class CKeyInfoCache
 public:
   CKeyInfoCache(int size): Size(size) {}
   bool Find(CKeyInfo &key);
-  // HRESULT Calculate(CKeyInfo &key);
-  void Add(CKeyInfo &key);
+  void Add(const CKeyInfo &key);
 };
 
 class CBase
 {
-  CKeyInfoCache _cachedKeys;
 protected:
   CKeyInfo _key;
   Byte _iv[16];
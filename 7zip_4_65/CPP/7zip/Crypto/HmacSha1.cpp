@@ -89,20 +89,26 @@ void CHmac32::Final(UInt32 *mac, size_t macSize)
     mac[i] = digest[i];
 }
 
-void CHmac32::GetLoopXorDigest(UInt32 *mac, UInt32 numIteration)
+void CHmac32::GetLoopXorDigests(UInt32 *macs, unsigned numMacs, UInt32 numIteration)
 {
-  UInt32 block[kBlockSizeInWords];
-  UInt32 block2[kBlockSizeInWords];
-  _sha.PrepareBlock(block, kDigestSizeInWords);
-  _sha2.PrepareBlock(block2, kDigestSizeInWords);
-  for(unsigned int s = 0; s < kDigestSizeInWords; s++)
-    block[s] = mac[s];
+  UInt32 blocks[kNumLanesMax * kBlockSizeInWords];
+  UInt32 blocks2[kNumLanesMax * kBlockSizeInWords];
+  unsigned int k, s;
+  for (k = 0; k < numMacs; k++)
+  {
+    UInt32 *block = blocks + k * kBlockSizeInWords;
+    _sha.PrepareBlock(block, kDigestSizeInWords);
+    _sha2.PrepareBlock(blocks2 + k * kBlockSizeInWords, kDigestSizeInWords);
+    for (s = 0; s < kDigestSizeInWords; s++)
+      block[s] = macs[k * kDigestSizeInWords + s];
+  }
   for(UInt32 i = 0; i < numIteration; i++)
   {
-    _sha.GetBlockDigest(block, block2);
-    _sha2.GetBlockDigest(block2, block);
-    for (unsigned int s = 0; s < kDigestSizeInWords; s++)
-      mac[s] ^= block[s];
+    _sha.GetBlockDigests(blocks, blocks2, numMacs);
+    _sha2.GetBlockDigests(blocks2, blocks, numMacs);
+    for (k = 0; k < numMacs; k++)
+      for (s = 0; s < kDigestSizeInWords; s++)
+        macs[k * kDigestSizeInWords + s] ^= blocks[k * kBlockSizeInWords + s];
   }
 }
 
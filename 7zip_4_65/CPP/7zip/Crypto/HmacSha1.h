@@ -31,7 +31,10 @@ public:
   void Final(UInt32 *mac, size_t macSize = kDigestSizeInWords);
   
   // It'sa for hmac function. in,out: mac[kDigestSizeInWords].
-  void GetLoopXorDigest(UInt32 *mac, UInt32 numIteration);
+  void GetLoopXorDigest(UInt32 *mac, UInt32 numIteration) { GetLoopXorDigests(mac, 1, numIteration); }
+  // It does GetLoopXorDigest() for (numMacs <= kNumLanesMax) independent macs in parallel.
+  // in,out: macs[numMacs * kDigestSizeInWords].
+  void GetLoopXorDigests(UInt32 *macs, unsigned numMacs, UInt32 numIteration);
 };
 
 }}
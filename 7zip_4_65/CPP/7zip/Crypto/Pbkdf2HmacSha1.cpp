@@ -44,22 +44,29 @@ void Pbkdf2Hmac32(const Byte *pwd, size_t pwdSize, const UInt32 *salt, size_t sa
 {
   CHmac32 baseCtx;
   baseCtx.SetKey(pwd, pwdSize);
-  for (UInt32 i = 1; keySize > 0; i++)
+  for (UInt32 i = 1; keySize > 0;)
   {
-    CHmac32 ctx = baseCtx;
-    ctx.Update(salt, saltSize);
-    UInt32 u[kDigestSizeInWords] = { i };
-    const unsigned int curSize = (keySize < kDigestSizeInWords) ? (unsigned int)keySize : kDigestSizeInWords;
-    ctx.Update(u, 1);
-    ctx.Final(u, kDigestSizeInWords);
+    // blocks of key are independent, so we calculate up to kNumLanesMax blocks in parallel
+    UInt32 u[kNumLanesMax * kDigestSizeInWords];
+    unsigned int numBlocks;
+    for (numBlocks = 0; numBlocks < kNumLanesMax && numBlocks * kDigestSizeInWords < keySize; numBlocks++, i++)
+    {
+      CHmac32 ctx = baseCtx;
+      ctx.Update(salt, saltSize);
+      UInt32 *uCur = u + numBlocks * kDigestSizeInWords;
+      uCur[0] = i;
+      ctx.Update(uCur, 1);
+      ctx.Final(uCur, kDigestSizeInWords);
+    }
 
     // Speed-optimized code start
-    ctx = baseCtx;
-    ctx.GetLoopXorDigest(u, numIterations - 1);
+    baseCtx.GetLoopXorDigests(u, numBlocks, numIterations - 1);
     // Speed-optimized code end
     
-    unsigned int s;
-    for (s = 0; s < curSize; s++)
+    size_t curSize = numBlocks * kDigestSizeInWords;
+    if (curSize > keySize)
+      curSize = keySize;
+    for (size_t s = 0; s < curSize; s++)
       key[s] = u[s];
     
     /*
@@ -7,9 +7,32 @@
 #include "Sha1.h"
 extern "C"
 {
+#include "../../../C/CpuArch.h"
 #include "../../../C/RotateDefs.h"
 }
 
+#ifdef MY_CPU_X86_OR_AMD64
+#if defined(_MSC_VER) && (_MSC_VER >= 1900)
+#define USE_SHA_NI
+#define USE_SSE2_LANES
+#elif defined(_MSC_VER) && (_MSC_VER >= 1300)
+#define USE_SSE2_LANES
+#elif defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define USE_SHA_NI
+#define SHA_NI_ATTRIB __attribute__((target("sse4.1,sha")))
+#define USE_SSE2_LANES
+#define SSE2_ATTRIB __attribute__((target("sse2")))
+#endif
+#endif
+
+#ifdef USE_SHA_NI
+#include <immintrin.h>
+#endif
+
+#ifdef USE_SSE2_LANES
+#include <emmintrin.h>
+#endif
+
 namespace NCrypto {
 namespace NSha1 {
 
@@ -58,16 +81,16 @@ void CContextBase::Init()
   _count = 0;
 }
 
-void CContextBase::GetBlockDigest(UInt32 *data, UInt32 *destDigest, bool returnRes)
+static void GetBlockDigestPortable(const UInt32 *state, UInt32 *data, UInt32 *destDigest, bool returnRes)
 {
   UInt32 a, b, c, d, e;
   UInt32 W[kNumW];
 
-  a = _state[0];
-  b = _state[1];
-  c = _state[2];
-  d = _state[3];
-  e = _state[4];
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
   #ifdef _SHA1_UNROLL
   RX_5(R0, 0); RX_5(R0, 5); RX_5(R0, 10);
   #else
@@ -89,11 +112,11 @@ void CContextBase::GetBlockDigest(UInt32 *data, UInt32 *destDigest, bool returnR
   for (; i < 80; i += 5) { RX_5(R4, i); }
   #endif
 
-  destDigest[0] = _state[0] + a;
-  destDigest[1] = _state[1] + b;
-  destDigest[2] = _state[2] + c;
-  destDigest[3] = _state[3] + d;
-  destDigest[4] = _state[4] + e;
+  destDigest[0] = state[0] + a;
+  destDigest[1] = state[1] + b;
+  destDigest[2] = state[2] + c;
+  destDigest[3] = state[3] + d;
+  destDigest[4] = state[4] + e;
 
   if (returnRes)
     for (int i = 0 ; i < 16; i++)
@@ -103,6 +126,257 @@ void CContextBase::GetBlockDigest(UInt32 *data, UInt32 *destDigest, bool returnR
   // a = b = c = d = e = 0;
 }
 
+typedef void (*SHA1_BLOCKS_FUNC)(UInt32 *state, const UInt32 *data, size_t numBlocks);
+typedef void (*SHA1_BLOCKS_BE_FUNC)(UInt32 *state, const Byte *data, size_t numBlocks);
+typedef void (*SHA1_LANES_FUNC)(const UInt32 *state, const UInt32 *blocks, UInt32 *destBlocks, unsigned numBlocks);
+
+// GetBlockDigestPortable() doesn't change data, if (returnRes == false)
+
+static void Sha1_UpdateBlocks(UInt32 *state, const UInt32 *data, size_t numBlocks)
+{
+  for (; numBlocks != 0; numBlocks--, data += kBlockSizeInWords)
+    GetBlockDigestPortable(state, (UInt32 *)data, state, false);
+}
+
+static void Sha1_UpdateBlocksBe(UInt32 *state, const Byte *data, size_t numBlocks)
+{
+  UInt32 data32[kBlockSizeInWords];
+  for (; numBlocks != 0; numBlocks--, data += kBlockSize)
+  {
+    for (unsigned i = 0; i < kBlockSizeInWords; i++)
+      data32[i] = GetBe32(data + i * 4);
+    GetBlockDigestPortable(state, data32, state, false);
+  }
+}
+
+static void Sha1_GetBlockDigests(const UInt32 *state, const UInt32 *blocks, UInt32 *destBlocks, unsigned numBlocks)
+{
+  for (unsigned k = 0; k < numBlocks; k++)
+    GetBlockDigestPortable(state, (UInt32 *)blocks + k * kBlockSizeInWords,
+        destBlocks + k * kBlockSizeInWords, false);
+}
+
+/*
+  SHA-NI version (x86 SHA extensions) is based on public domain code
+  from Intel's "Intel SHA Extensions" paper and Jeffrey Walton's SHA-Intrinsics.
+  Each SHA1RNDS4 instruction does 4 rounds. SHA1NEXTE calculates E for next
+  4 rounds, and SHA1MSG1 / SHA1MSG2 / PXOR calculate message schedule.
+*/
+
+#ifdef USE_SHA_NI
+
+#ifndef SHA_NI_ATTRIB
+#define SHA_NI_ATTRIB
+#endif
+
+#define SHA1_LOAD(i, m) m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + (i) * 16)), mask);
+
+#define SHA1_RNDS4(e, eNext, m, f) \
+    e = _mm_sha1nexte_epu32(e, m); \
+    eNext = abcd; \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, f);
+
+// (m) is message for current rounds, (mNext) for next rounds, and so on
+#define SHA1_RNDS4_MSG(e, eNext, m, mNext, mNext2, mPrev, f) \
+    SHA1_RNDS4(e, eNext, m, f) \
+    mNext = _mm_sha1msg2_epu32(mNext, m); \
+    mPrev = _mm_sha1msg1_epu32(mPrev, m); \
+    mNext2 = _mm_xor_si128(mNext2, m);
+
+// data is big-endian stream, if (wordsMode == 0)
+// data is array of UInt32 words, if (wordsMode != 0)
+SHA_NI_ATTRIB
+static void Sha1_UpdateBlocks_Intel(UInt32 *state, const Byte *data, size_t numBlocks, int wordsMode)
+{
+  const __m128i mask = wordsMode ?
+      _mm_set_epi32(0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c):
+      _mm_set_epi32(0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f);
+  __m128i abcd, e0, e1;
+  __m128i m0, m1, m2, m3;
+
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+  e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+  for (; numBlocks != 0; numBlocks--, data += kBlockSize)
+  {
+    __m128i abcdSave = abcd;
+    __m128i e0Save = e0;
+
+    SHA1_LOAD(0, m0)
+    e0 = _mm_add_epi32(e0, m0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    SHA1_LOAD(1, m1)  SHA1_RNDS4(e1, e0, m1, 0)  m0 = _mm_sha1msg1_epu32(m0, m1);
+    SHA1_LOAD(2, m2)  SHA1_RNDS4(e0, e1, m2, 0)  m1 = _mm_sha1msg1_epu32(m1, m2);  m0 = _mm_xor_si128(m0, m2);
+    SHA1_LOAD(3, m3)  SHA1_RNDS4_MSG(e1, e0, m3, m0, m1, m2, 0)
+
+    SHA1_RNDS4_MSG(e0, e1, m0, m1, m2, m3, 0)
+    SHA1_RNDS4_MSG(e1, e0, m1, m2, m3, m0, 1)
+    SHA1_RNDS4_MSG(e0, e1, m2, m3, m0, m1, 1)
+    SHA1_RNDS4_MSG(e1, e0, m3, m0, m1, m2, 1)
+    SHA1_RNDS4_MSG(e0, e1, m0, m1, m2, m3, 1)
+    SHA1_RNDS4_MSG(e1, e0, m1, m2, m3, m0, 1)
+    SHA1_RNDS4_MSG(e0, e1, m2, m3, m0, m1, 2)
+    SHA1_RNDS4_MSG(e1, e0, m3, m0, m1, m2, 2)
+    SHA1_RNDS4_MSG(e0, e1, m0, m1, m2, m3, 2)
+    SHA1_RNDS4_MSG(e1, e0, m1, m2, m3, m0, 2)
+    SHA1_RNDS4_MSG(e0, e1, m2, m3, m0, m1, 2)
+    SHA1_RNDS4_MSG(e1, e0, m3, m0, m1, m2, 3)
+    SHA1_RNDS4_MSG(e0, e1, m0, m1, m2, m3, 3)
+
+    SHA1_RNDS4(e1, e0, m1, 3)  m2 = _mm_sha1msg2_epu32(m2, m1);  m3 = _mm_xor_si128(m3, m1);
+    SHA1_RNDS4(e0, e1, m2, 3)  m3 = _mm_sha1msg2_epu32(m3, m2);
+    SHA1_RNDS4(e1, e0, m3, 3)
+
+    e0 = _mm_sha1nexte_epu32(e0, e0Save);
+    abcd = _mm_add_epi32(abcd, abcdSave);
+  }
+
+  _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = (UInt32)_mm_cvtsi128_si32(_mm_shuffle_epi32(e0, 0xFF));
+}
+
+static void Sha1_UpdateBlocks_Intel(UInt32 *state, const UInt32 *data, size_t numBlocks)
+{
+  Sha1_UpdateBlocks_Intel(state, (const Byte *)data, numBlocks, 1);
+}
+
+static void Sha1_UpdateBlocksBe_Intel(UInt32 *state, const Byte *data, size_t numBlocks)
+{
+  Sha1_UpdateBlocks_Intel(state, data, numBlocks, 0);
+}
+
+static void Sha1_GetBlockDigests_Intel(const UInt32 *state, const UInt32 *blocks, UInt32 *destBlocks, unsigned numBlocks)
+{
+  for (unsigned k = 0; k < numBlocks; k++)
+  {
+    UInt32 *dest = destBlocks + k * kBlockSizeInWords;
+    for (unsigned i = 0; i < kDigestSizeInWords; i++)
+      dest[i] = state[i];
+    Sha1_UpdateBlocks_Intel(dest, (const Byte *)(blocks + k * kBlockSizeInWords), 1, 1);
+  }
+}
+
+#endif
+
+/*
+  SSE2 multi-buffer version calculates 4 independent blocks in parallel:
+  each 32-bit lane of SSE2 register contains one word of one block.
+*/
+
+#ifdef USE_SSE2_LANES
+
+#ifndef SSE2_ATTRIB
+#define SSE2_ATTRIB
+#endif
+
+#define SSE2_ROTL(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+
+#define SSE2_W(i) (W[(i) & 15] = SSE2_ROTL(_mm_xor_si128( \
+    _mm_xor_si128(W[((i) - 3) & 15], W[((i) - 8) & 15]), \
+    _mm_xor_si128(W[((i) - 14) & 15], W[((i) - 16) & 15])), 1))
+
+#define SSE2_F1(x, y, z) _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z)))
+#define SSE2_F2(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define SSE2_F3(x, y, z) _mm_or_si128(_mm_and_si128(x, y), _mm_and_si128(z, _mm_or_si128(x, y)))
+
+#define SSE2_RNDS(from, to, f, k, w) \
+    for (i = from; i < to; i++) { \
+      __m128i t = _mm_add_epi32(_mm_add_epi32(SSE2_ROTL(a, 5), f(b, c, d)), \
+          _mm_add_epi32(_mm_add_epi32(e, k), w)); \
+      e = d; d = c; c = SSE2_ROTL(b, 30); b = a; a = t; }
+
+SSE2_ATTRIB
+static void Sha1_GetBlockDigests_Sse2(const UInt32 *state, const UInt32 *blocks, UInt32 *destBlocks, unsigned numBlocks)
+{
+  __m128i W[16];
+  __m128i a, b, c, d, e;
+  UInt32 res[kDigestSizeInWords][4];
+  unsigned i, k;
+
+  for (i = 0; i < 16; i++)
+  {
+    // unused lanes repeat first block
+    const UInt32 *p = blocks + i;
+    W[i] = _mm_set_epi32(
+        (int)p[(numBlocks > 3 ? 3 : 0) * kBlockSizeInWords],
+        (int)p[(numBlocks > 2 ? 2 : 0) * kBlockSizeInWords],
+        (int)p[(numBlocks > 1 ? 1 : 0) * kBlockSizeInWords],
+        (int)p[0]);
+  }
+
+  a = _mm_set1_epi32((int)state[0]);
+  b = _mm_set1_epi32((int)state[1]);
+  c = _mm_set1_epi32((int)state[2]);
+  d = _mm_set1_epi32((int)state[3]);
+  e = _mm_set1_epi32((int)state[4]);
+
+  {
+    const __m128i k1 = _mm_set1_epi32(0x5A827999);
+    const __m128i k2 = _mm_set1_epi32(0x6ED9EBA1);
+    const __m128i k3 = _mm_set1_epi32((int)0x8F1BBCDC);
+    const __m128i k4 = _mm_set1_epi32((int)0xCA62C1D6);
+    SSE2_RNDS( 0, 16, SSE2_F1, k1, W[i])
+    SSE2_RNDS(16, 20, SSE2_F1, k1, SSE2_W(i))
+    SSE2_RNDS(20, 40, SSE2_F2, k2, SSE2_W(i))
+    SSE2_RNDS(40, 60, SSE2_F3, k3, SSE2_W(i))
+    SSE2_RNDS(60, 80, SSE2_F2, k4, SSE2_W(i))
+  }
+
+  _mm_storeu_si128((__m128i *)res[0], a);
+  _mm_storeu_si128((__m128i *)res[1], b);
+  _mm_storeu_si128((__m128i *)res[2], c);
+  _mm_storeu_si128((__m128i *)res[3], d);
+  _mm_storeu_si128((__m128i *)res[4], e);
+
+  for (k = 0; k < numBlocks; k++)
+    for (i = 0; i < kDigestSizeInWords; i++)
+      destBlocks[k * kBlockSizeInWords + i] = state[i] + res[i][k];
+}
+
+#endif
+
+static SHA1_BLOCKS_FUNC g_Sha1_UpdateBlocks = Sha1_UpdateBlocks;
+static SHA1_BLOCKS_BE_FUNC g_Sha1_UpdateBlocksBe = Sha1_UpdateBlocksBe;
+static SHA1_LANES_FUNC g_Sha1_GetBlockDigests = Sha1_GetBlockDigests;
+
+static struct CSha1Prepare
+{
+  CSha1Prepare()
+  {
+    #ifdef USE_SSE2_LANES
+    if (CPU_Is_Sse2_Supported())
+      g_Sha1_GetBlockDigests = Sha1_GetBlockDigests_Sse2;
+    #endif
+    #ifdef USE_SHA_NI
+    if (CPU_Is_Sha_Supported())
+    {
+      g_Sha1_UpdateBlocks = Sha1_UpdateBlocks_Intel;
+      g_Sha1_UpdateBlocksBe = Sha1_UpdateBlocksBe_Intel;
+      g_Sha1_GetBlockDigests = Sha1_GetBlockDigests_Intel;
+    }
+    #endif
+  }
+} g_Sha1Prepare;
+
+void CContextBase::GetBlockDigest(UInt32 *data, UInt32 *destDigest, bool returnRes)
+{
+  if (returnRes)
+  {
+    GetBlockDigestPortable(_state, data, destDigest, true);
+    return;
+  }
+  for (unsigned i = 0; i < kDigestSizeInWords; i++)
+    destDigest[i] = _state[i];
+  g_Sha1_UpdateBlocks(destDigest, data, 1);
+}
+
+void CContextBase::GetBlockDigests(const UInt32 *blocks, UInt32 *destBlocks, unsigned numBlocks) const
+{
+  g_Sha1_GetBlockDigests(_state, blocks, destBlocks, numBlocks);
+}
+
 void CContextBase::PrepareBlock(UInt32 *block, unsigned size) const
 {
   unsigned curBufferPos = size & 0xF;
@@ -118,25 +392,52 @@ void CContext::Update(Byte *data, size_t size, bool rar350Mode)
 {
   bool returnRes = false;
   unsigned curBufferPos = _count2;
-  while (size-- > 0)
+  while (size > 0)
   {
+    if (curBufferPos == 0 && size >= kBlockSize && !rar350Mode)
+    {
+      // full blocks are processed directly from data
+      size_t numBlocks = size / kBlockSize;
+      g_Sha1_UpdateBlocksBe(_state, data, numBlocks);
+      _count += numBlocks;
+      numBlocks *= kBlockSize;
+      data += numBlocks;
+      size -= numBlocks;
+      continue;
+    }
     int pos = (int)(curBufferPos & 3);
-    if (pos == 0)
-      _buffer[curBufferPos >> 2] = 0;
-    _buffer[curBufferPos >> 2] |= ((UInt32)*data++) << (8 * (3 - pos));
-    if (++curBufferPos == kBlockSize)
+    if (pos == 0 && size >= 4)
+    {
+      _buffer[curBufferPos >> 2] = GetBe32(data);
+      data += 4;
+      size -= 4;
+      curBufferPos += 4;
+    }
+    else
+    {
+      size--;
+      if (pos == 0)
+        _buffer[curBufferPos >> 2] = 0;
+      _buffer[curBufferPos >> 2] |= ((UInt32)*data++) << (8 * (3 - pos));
+      curBufferPos++;
+    }
+    if (curBufferPos == kBlockSize)
     {
       curBufferPos = 0;
       CContextBase::UpdateBlock(_buffer, returnRes);
       if (returnRes)
-        for (int i = 0; i < kBlockSizeInWords; i++)
+      {
+        // (i * 4 - kBlockSize) is unsigned, so we use pointer to start of block
+        Byte *block = data - kBlockSize;
+        for (unsigned i = 0; i < kBlockSizeInWords; i++)
         {
           UInt32 d = _buffer[i];
-          data[i * 4 + 0 - kBlockSize] = (Byte)(d);
-          data[i * 4 + 1 - kBlockSize] = (Byte)(d >>  8);
-          data[i * 4 + 2 - kBlockSize] = (Byte)(d >> 16);
-          data[i * 4 + 3 - kBlockSize] = (Byte)(d >> 24);
+          block[i * 4 + 0] = (Byte)(d);
+          block[i * 4 + 1] = (Byte)(d >>  8);
+          block[i * 4 + 2] = (Byte)(d >> 16);
+          block[i * 4 + 3] = (Byte)(d >> 24);
         }
+      }
       returnRes = rar350Mode;
     }
   }
@@ -181,6 +482,15 @@ void CContext::Final(Byte *digest)
 
 void CContext32::Update(const UInt32 *data, size_t size)
 {
+  if (_count2 == 0 && size >= kBlockSizeInWords)
+  {
+    size_t numBlocks = size / kBlockSizeInWords;
+    g_Sha1_UpdateBlocks(_state, data, numBlocks);
+    _count += numBlocks;
+    numBlocks *= kBlockSizeInWords;
+    data += numBlocks;
+    size -= numBlocks;
+  }
   while (size-- > 0)
   {
     _buffer[_count2++] = *data++;
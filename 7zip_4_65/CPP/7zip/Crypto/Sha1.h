@@ -21,6 +21,9 @@ const unsigned kDigestSize = 20;
 const unsigned kBlockSizeInWords = (kBlockSize >> 2);
 const unsigned kDigestSizeInWords = (kDigestSize >> 2);
 
+// max number of blocks for one GetBlockDigests() call
+const unsigned kNumLanesMax = 4;
+
 class CContextBase
 {
 protected:
@@ -34,6 +37,10 @@ protected:
 public:
   void Init();
   void GetBlockDigest(UInt32 *blockData, UInt32 *destDigest, bool returnRes = false);
+  // it calculates digests of (numBlocks <= kNumLanesMax) independent blocks from same state.
+  // Blocks are (kBlockSizeInWords) words each. Digest of block (i) is written to
+  // first (kDigestSizeInWords) words of destBlocks[i * kBlockSizeInWords].
+  void GetBlockDigests(const UInt32 *blocks, UInt32 *destBlocks, unsigned numBlocks) const;
   // PrepareBlock can be used only when size <= 13. size in Words
   void PrepareBlock(UInt32 *block, unsigned int size) const;
 };
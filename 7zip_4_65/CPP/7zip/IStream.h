@@ -55,4 +55,16 @@ STREAM_INTERFACE(IOutStreamFlush, 0x07)
   STDMETHOD(Flush)() PURE;
 };
 
+/*
+IInStreamGetBuf::GetBuf() gives direct access to stream data without copying.
+  S_OK    : (*data) points to (size) bytes of stream at (offset).
+            The pointer is valid while stream object exists.
+  S_FALSE : range is not available: (*data) = NULL. Caller must use Read().
+*/
+
+STREAM_INTERFACE(IInStreamGetBuf, 0x08)
+{
+  STDMETHOD(GetBuf)(UInt64 offset, UInt32 size, const Byte **data) PURE;
+};
+
 #endif
@@ -702,7 +702,6 @@ void CArchiveCommandLineParser::Parse1(const UStringVector &commandStrings,
   options.EnableHeaders = !parser[NKey::kDisableHeaders].ThereIs;
   options.HelpMode = parser[NKey::kHelp1].ThereIs || parser[NKey::kHelp2].ThereIs  || parser[NKey::kHelp3].ThereIs;
 
-  #ifdef _WIN32
   options.LargePages = false;
   if (parser[NKey::kLargePages].ThereIs)
   {
@@ -710,7 +709,6 @@ void CArchiveCommandLineParser::Parse1(const UStringVector &commandStrings,
     if (postString.IsEmpty())
       options.LargePages = true;
   }
-  #endif
 }
 
 struct CCodePagePair
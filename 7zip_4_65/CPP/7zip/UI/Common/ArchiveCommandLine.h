@@ -47,9 +47,7 @@ struct CArchiveCommandLineOptions
 {
   bool HelpMode;
 
-  #ifdef _WIN32
   bool LargePages;
-  #endif
 
   bool IsInTerminal;
   bool IsStdOutTerminal;
@@ -22,6 +22,8 @@ struct CDirItem
   bool IsDir() const { return (Attrib & FILE_ATTRIBUTE_DIRECTORY) != 0 ; }
 };
 
+class CDirPrefetcher;
+
 class CDirItems
 {
   UStringVector Prefixes;
@@ -29,9 +31,19 @@ class CDirItems
   CIntVector LogParents;
 
   UString GetPrefixesPath(const CIntVector &parents, int index, const UString &name) const;
+  void EnumerateDirectory(int phyParent, int logParent, const UString &phyPrefix,
+    UStringVector &errorPaths, CRecordVector<DWORD> &errorCodes,
+    CDirPrefetcher *prefetcher, int taskIndex);
 public:
   CObjectVector<CDirItem> Items;
 
+  // number of threads that read directory listings. 1 - main thread only
+  UInt32 NumScanThreads;
+
+  CDirItems();
+  // it sets NumScanThreads for (numThreads) compression threads (-mmt). 1 disables scan threads.
+  void SetNumThreads(UInt32 numThreads);
+
   int GetNumFolders() const { return Prefixes.Size(); }
   UString GetPhyPath(int index) const;
   UString GetLogPath(int index) const;
@@ -39,9 +51,6 @@ public:
   int AddPrefix(int phyParent, int logParent, const UString &prefix);
   void DeleteLastPrefix();
 
-  void EnumerateDirectory(int phyParent, int logParent, const UString &phyPrefix,
-    UStringVector &errorPaths, CRecordVector<DWORD> &errorCodes);
-
   void EnumerateDirItems2(
     const UString &phyPrefix,
     const UString &logPrefix,
@@ -8,6 +8,12 @@
 #include "Common/Wildcard.h"
 #include "Common/MyCom.h"
 
+#ifdef COMPRESS_MT
+#include "Windows/System.h"
+#endif
+
+#include "../../Common/MtThreadPool.h"
+
 #include "EnumDirItems.h"
 
 using namespace NWindows;
@@ -29,6 +35,238 @@ void AddDirFileInfo(int phyParent, int logParent,
   dirItems.Add(di);
 }
 
+struct CDirListing
+{
+  CObjectVector<NFind::CFileInfoW> Files;
+  DWORD ErrorCode;
+  bool Error;
+};
+
+static void ReadDirListing(const UString &phyPrefix, CDirListing &listing)
+{
+  listing.Error = false;
+  NFind::CEnumeratorW enumerator(phyPrefix + (wchar_t)kAnyStringWildcard);
+  for (;;)
+  {
+    NFind::CFileInfoW fi;
+    bool found;
+    if (!enumerator.Next(fi, found))
+    {
+      listing.ErrorCode = ::GetLastError();
+      listing.Error = true;
+      return;
+    }
+    if (!found)
+      return;
+    listing.Files.Add(fi);
+  }
+}
+
+/*
+CDirPrefetcher reads listings of directories in worker threads.
+Main thread walks directory tree in same order as without threads.
+When main thread gets listing of directory, it adds tasks for subdirectories
+that it will enter, and then it gets listings of these subdirectories from tasks.
+So Items and Prefixes in CDirItems are same as in single-threaded mode.
+Pending tasks are in stack, so threads read first subdirectory at first.
+If no thread has started task yet, main thread reads that directory itself.
+*/
+
+static const UInt32 kNumScanThreadsMin = 4;
+static const UInt32 kNumScanThreadsMax = 16;
+static const UInt32 kNumReadyTasksMax = 1 << 10;
+
+class CDirPrefetcher: public CMtThreadPool
+{
+  enum
+  {
+    kTaskQueued,
+    kTaskRunning,
+    kTaskFinished,
+    kTaskReadByMain
+  };
+
+  struct CTask
+  {
+    UString Path;
+    CDirListing Listing;
+    int State;
+  };
+
+  NWindows::NSynchronization::CAutoResetEvent _taskFinishedEvent;
+  CRecordVector<CTask *> _tasks; // NULL - released task
+  CIntVector _stack;
+  UInt32 _numReadyTasks; // running and finished tasks that were not released
+  UInt32 _numWaitingThreads;
+
+  void WakeThreads();
+public:
+  CDirPrefetcher(): _numReadyTasks(0), _numWaitingThreads(0) {}
+  ~CDirPrefetcher();
+  HRESULT Create(UInt32 numThreads);
+
+  int GetNumTasks() const { return _tasks.Size(); }
+  int AddTask(const UString &phyPrefix);
+  void StartTasks(int firstTask);
+  const CDirListing &GetListing(int taskIndex);
+  void ReleaseTask(int taskIndex);
+  void ThreadFunc();
+};
+
+CDirPrefetcher::~CDirPrefetcher()
+{
+  StopAndWait();
+  for (int i = 0; i < _tasks.Size(); i++)
+    delete _tasks[i];
+}
+
+HRESULT CDirPrefetcher::Create(UInt32 numThreads)
+{
+  RINOK_THREAD(_taskFinishedEvent.CreateIfNotCreated());
+  return CMtThreadPool::Create(numThreads, numThreads);
+}
+
+// it must be called in critical section
+void CDirPrefetcher::WakeThreads()
+{
+  if (_numWaitingThreads == 0)
+    return;
+  _canStartSemaphore.Release(_numWaitingThreads);
+  _numWaitingThreads = 0;
+}
+
+int CDirPrefetcher::AddTask(const UString &phyPrefix)
+{
+  CTask *task = new CTask;
+  task->Path = phyPrefix;
+  task->State = kTaskQueued;
+  NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+  return _tasks.Add(task);
+}
+
+void CDirPrefetcher::StartTasks(int firstTask)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+  for (int i = _tasks.Size() - 1; i >= firstTask; i--)
+    _stack.Add(i);
+  WakeThreads();
+}
+
+const CDirListing &CDirPrefetcher::GetListing(int taskIndex)
+{
+  CTask *task;
+  for (;;)
+  {
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+      task = _tasks[taskIndex];
+      if (task->State == kTaskFinished)
+        return task->Listing;
+      if (task->State == kTaskQueued)
+      {
+        task->State = kTaskReadByMain;
+        break;
+      }
+    }
+    _taskFinishedEvent.Lock();
+  }
+  ReadDirListing(task->Path, task->Listing);
+  return task->Listing;
+}
+
+void CDirPrefetcher::ReleaseTask(int taskIndex)
+{
+  NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+  CTask *task = _tasks[taskIndex];
+  if (task->State == kTaskFinished)
+    _numReadyTasks--;
+  delete task;
+  _tasks[taskIndex] = 0;
+  WakeThreads();
+}
+
+void CDirPrefetcher::ThreadFunc()
+{
+  for (;;)
+  {
+    CTask *task = 0;
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+      if (_stop)
+        return;
+      while (!_stack.IsEmpty() && _numReadyTasks < kNumReadyTasksMax)
+      {
+        CTask *t = _tasks[_stack.Back()];
+        _stack.DeleteBack();
+        if (t != 0 && t->State == kTaskQueued)
+        {
+          t->State = kTaskRunning;
+          _numReadyTasks++;
+          task = t;
+          break;
+        }
+      }
+      if (task == 0)
+        _numWaitingThreads++;
+    }
+    if (task == 0)
+    {
+      _canStartSemaphore.Lock();
+      continue;
+    }
+    try
+    {
+      ReadDirListing(task->Path, task->Listing);
+    }
+    catch(...)
+    {
+      task->Listing.Files.Clear();
+      task->Listing.ErrorCode = ERROR_NOT_ENOUGH_MEMORY;
+      task->Listing.Error = true;
+    }
+    {
+      NWindows::NSynchronization::CCriticalSectionLock lock(_criticalSection);
+      task->State = kTaskFinished;
+    }
+    _taskFinishedEvent.Set();
+  }
+}
+
+static void CreatePrefetcher(CDirPrefetcher &prefetcherSpec, UInt32 numThreads, CDirPrefetcher *&prefetcher)
+{
+  prefetcher = 0;
+  if (numThreads <= 1)
+    return;
+  if (prefetcherSpec.Create(numThreads) == S_OK)
+    prefetcher = &prefetcherSpec;
+  else
+    prefetcherSpec.StopAndWait();
+}
+
+CDirItems::CDirItems(): NumScanThreads(1)
+{
+  #ifdef COMPRESS_MT
+  SetNumThreads(NSystem::GetNumberOfProcessors());
+  #endif
+}
+
+void CDirItems::SetNumThreads(UInt32 numThreads)
+{
+  NumScanThreads = 1;
+  #ifdef COMPRESS_MT
+  if (numThreads <= 1)
+    return;
+  // threads mostly wait for file system, so we use more threads than processors
+  if (numThreads > kNumScanThreadsMax)
+    numThreads = kNumScanThreadsMax;
+  NumScanThreads = numThreads * 2;
+  if (NumScanThreads < kNumScanThreadsMin)
+    NumScanThreads = kNumScanThreadsMin;
+  if (NumScanThreads > kNumScanThreadsMax)
+    NumScanThreads = kNumScanThreadsMax;
+  #endif
+}
+
 UString CDirItems::GetPrefixesPath(const CIntVector &parents, int index, const UString &name) const
 {
   UString path;
@@ -86,29 +324,49 @@ void CDirItems::DeleteLastPrefix()
 }
 
 void CDirItems::EnumerateDirectory(int phyParent, int logParent, const UString &phyPrefix,
-    UStringVector &errorPaths, CRecordVector<DWORD> &errorCodes)
+    UStringVector &errorPaths, CRecordVector<DWORD> &errorCodes,
+    CDirPrefetcher *prefetcher, int taskIndex)
 {
-  NFind::CEnumeratorW enumerator(phyPrefix + (wchar_t)kAnyStringWildcard);
-  for (;;)
+  CDirListing localListing;
+  const CDirListing *listing = &localListing;
+  if (taskIndex >= 0)
+    listing = &prefetcher->GetListing(taskIndex);
+  else
+    ReadDirListing(phyPrefix, localListing);
+  const CObjectVector<NFind::CFileInfoW> &files = listing->Files;
+
+  int i;
+  CIntVector tasks;
+  if (prefetcher)
   {
-    NFind::CFileInfoW fi;
-    bool found;
-    if (!enumerator.Next(fi, found))
+    int firstTask = prefetcher->GetNumTasks();
+    for (i = 0; i < files.Size(); i++)
     {
-      errorCodes.Add(::GetLastError());
-      errorPaths.Add(phyPrefix);
-      return;
+      const NFind::CFileInfoW &fi = files[i];
+      tasks.Add(fi.IsDir() ? prefetcher->AddTask(phyPrefix + fi.Name + (wchar_t)kDirDelimiter) : -1);
     }
-    if (!found)
-      break;
+    prefetcher->StartTasks(firstTask);
+  }
+
+  for (i = 0; i < files.Size(); i++)
+  {
+    const NFind::CFileInfoW &fi = files[i];
     AddDirFileInfo(phyParent, logParent, fi, Items);
     if (fi.IsDir())
     {
       const UString name2 = fi.Name + (wchar_t)kDirDelimiter;
       int parent = AddPrefix(phyParent, logParent, name2);
-      EnumerateDirectory(parent, parent, phyPrefix + name2, errorPaths, errorCodes);
+      EnumerateDirectory(parent, parent, phyPrefix + name2, errorPaths, errorCodes,
+          prefetcher, prefetcher ? tasks[i] : -1);
     }
   }
+  if (listing->Error)
+  {
+    errorCodes.Add(listing->ErrorCode);
+    errorPaths.Add(phyPrefix);
+  }
+  if (taskIndex >= 0)
+    prefetcher->ReleaseTask(taskIndex);
 }
 
 void CDirItems::EnumerateDirItems2(const UString &phyPrefix, const UString &logPrefix,
@@ -117,6 +375,10 @@ void CDirItems::EnumerateDirItems2(const UString &phyPrefix, const UString &logP
   int phyParent = phyPrefix.IsEmpty() ? -1 : AddPrefix(-1, -1, phyPrefix);
   int logParent = logPrefix.IsEmpty() ? -1 : AddPrefix(-1, -1, logPrefix);
 
+  CDirPrefetcher prefetcherSpec;
+  CDirPrefetcher *prefetcher;
+  CreatePrefetcher(prefetcherSpec, NumScanThreads, prefetcher);
+
   for (int i = 0; i < filePaths.Size(); i++)
   {
     const UString &filePath = filePaths[i];
@@ -141,12 +403,37 @@ void CDirItems::EnumerateDirItems2(const UString &phyPrefix, const UString &logP
     {
       const UString name2 = fi.Name + (wchar_t)kDirDelimiter;
       int parent = AddPrefix(phyParentCur, logParent, name2);
-      EnumerateDirectory(parent, parent, phyPrefix + phyPrefixCur + name2, errorPaths, errorCodes);
+      EnumerateDirectory(parent, parent, phyPrefix + phyPrefixCur + name2, errorPaths, errorCodes,
+          prefetcher, -1);
     }
   }
   ReserveDown();
 }
 
+struct CDirEntryAction
+{
+  const NWildcard::CCensorNode *NextNode; // NULL - we don't enter to that directory
+  int TaskIndex;
+  bool Add;
+  bool AddName; // add name to addArchivePrefix for NextNode
+  bool EnterToSubFolders;
+};
+
+// it checks that all names are direct (no wildcards)
+static bool AreDirectNames(const NWildcard::CCensorNode &curNode)
+{
+  for (int i = 0; i < curNode.IncludeItems.Size(); i++)
+  {
+    const NWildcard::CItem &item = curNode.IncludeItems[i];
+    if (item.Recursive || item.PathParts.Size() != 1)
+      return false;
+    const UString &name = item.PathParts.Front();
+    if (name.IsEmpty() || DoesNameContainWildCard(name))
+      return false;
+  }
+  return true;
+}
+
 static HRESULT EnumerateDirItems(const NWildcard::CCensorNode &curNode,
     int phyParent, int logParent, const UString &phyPrefix,
     const UStringVector &addArchivePrefix,
@@ -154,7 +441,9 @@ static HRESULT EnumerateDirItems(const NWildcard::CCensorNode &curNode,
     bool enterToSubFolders,
     IEnumDirItemCallback *callback,
     UStringVector &errorPaths,
-    CRecordVector<DWORD> &errorCodes);
+    CRecordVector<DWORD> &errorCodes,
+    CDirPrefetcher *prefetcher,
+    int taskIndex);
 
 static HRESULT EnumerateDirItems_Spec(const NWildcard::CCensorNode &curNode,
     int phyParent, int logParent, const UString &curFolderName,
@@ -164,14 +453,17 @@ static HRESULT EnumerateDirItems_Spec(const NWildcard::CCensorNode &curNode,
     bool enterToSubFolders,
     IEnumDirItemCallback *callback,
     UStringVector &errorPaths,
-    CRecordVector<DWORD> &errorCodes)
+    CRecordVector<DWORD> &errorCodes,
+    CDirPrefetcher *prefetcher,
+    int taskIndex)
   
 {
   const UString name2 = curFolderName + (wchar_t)kDirDelimiter;
   int parent = dirItems.AddPrefix(phyParent, logParent, name2);
   int numItems = dirItems.Items.Size();
   HRESULT res = EnumerateDirItems(curNode, parent, parent, phyPrefix + name2,
-    addArchivePrefix, dirItems, enterToSubFolders, callback, errorPaths, errorCodes);
+    addArchivePrefix, dirItems, enterToSubFolders, callback, errorPaths, errorCodes,
+    prefetcher, taskIndex);
   if (numItems == dirItems.Items.Size())
     dirItems.DeleteLastPrefix();
   return res;
@@ -185,7 +477,9 @@ static HRESULT EnumerateDirItems(const NWildcard::CCensorNode &curNode,
     bool enterToSubFolders,
     IEnumDirItemCallback *callback,
     UStringVector &errorPaths,
-    CRecordVector<DWORD> &errorCodes)
+    CRecordVector<DWORD> &errorCodes,
+    CDirPrefetcher *prefetcher,
+    int taskIndex)
 {
   if (!enterToSubFolders)
     if (curNode.NeedCheckSubDirs())
@@ -196,18 +490,8 @@ static HRESULT EnumerateDirItems(const NWildcard::CCensorNode &curNode,
   // try direct_names case at first
   if (addArchivePrefix.IsEmpty() && !enterToSubFolders)
   {
-    // check that all names are direct
     int i;
-    for (i = 0; i < curNode.IncludeItems.Size(); i++)
-    {
-      const NWildcard::CItem &item = curNode.IncludeItems[i];
-      if (item.Recursive || item.PathParts.Size() != 1)
-        break;
-      const UString &name = item.PathParts.Front();
-      if (name.IsEmpty() || DoesNameContainWildCard(name))
-        break;
-    }
-    if (i == curNode.IncludeItems.Size())
+    if (AreDirectNames(curNode))
     {
       // all names are direct (no wildcards)
       // so we don't need file_system's dir enumerator
@@ -258,7 +542,7 @@ static HRESULT EnumerateDirItems(const NWildcard::CCensorNode &curNode,
         }
 
         RINOK(EnumerateDirItems_Spec(*nextNode, phyParent, logParent, fi.Name, phyPrefix,
-            addArchivePrefixNew, dirItems, true, callback, errorPaths, errorCodes));
+            addArchivePrefixNew, dirItems, true, callback, errorPaths, errorCodes, prefetcher, -1));
       }
       for (i = 0; i < curNode.SubNodes.Size(); i++)
       {
@@ -284,67 +568,107 @@ static HRESULT EnumerateDirItems(const NWildcard::CCensorNode &curNode,
         }
 
         RINOK(EnumerateDirItems_Spec(nextNode, phyParent, logParent, fi.Name, phyPrefix,
-            UStringVector(), dirItems, false, callback, errorPaths, errorCodes));
+            UStringVector(), dirItems, false, callback, errorPaths, errorCodes, prefetcher, -1));
       }
       return S_OK;
     }
   }
 
 
-  NFind::CEnumeratorW enumerator(phyPrefix + wchar_t(kAnyStringWildcard));
-  for (int ttt = 0; ; ttt++)
+  CDirListing localListing;
+  const CDirListing *listing = &localListing;
+  if (taskIndex >= 0)
+    listing = &prefetcher->GetListing(taskIndex);
+  else
+    ReadDirListing(phyPrefix, localListing);
+  const CObjectVector<NFind::CFileInfoW> &files = listing->Files;
+
+  // at first we check all items, so listings of subdirectories can be read by other threads
+  CRecordVector<CDirEntryAction> actions;
+  actions.Reserve(files.Size());
+  int firstTask = prefetcher ? prefetcher->GetNumTasks() : 0;
+  int i;
+  for (i = 0; i < files.Size(); i++)
   {
-    NFind::CFileInfoW fi;
-    bool found;
-    if (!enumerator.Next(fi, found))
-    {
-      errorCodes.Add(::GetLastError());
-      errorPaths.Add(phyPrefix);
-      break;
-    }
-    if (!found)
-      break;
+    const NFind::CFileInfoW &fi = files[i];
+    CDirEntryAction action;
+    action.NextNode = 0;
+    action.TaskIndex = -1;
+    action.Add = false;
+    action.AddName = false;
+    action.EnterToSubFolders = enterToSubFolders;
 
-    if (callback && (ttt & 0xFF) == 0xFF)
-      RINOK(callback->ScanProgress(dirItems.GetNumFolders(), dirItems.Items.Size(), phyPrefix));
     const UString &name = fi.Name;
-    bool enterToSubFolders2 = enterToSubFolders;
     UStringVector addArchivePrefixNew = addArchivePrefix;
     addArchivePrefixNew.Add(name);
     {
       UStringVector addArchivePrefixNewTemp(addArchivePrefixNew);
       if (curNode.CheckPathToRoot(false, addArchivePrefixNewTemp, !fi.IsDir()))
+      {
+        actions.Add(action);
         continue;
+      }
     }
     if (curNode.CheckPathToRoot(true, addArchivePrefixNew, !fi.IsDir()))
     {
-      AddDirFileInfo(phyParent, logParent, fi, dirItems.Items);
+      action.Add = true;
       if (fi.IsDir())
-        enterToSubFolders2 = true;
+        action.EnterToSubFolders = true;
     }
-    if (!fi.IsDir())
-      continue;
-
-    const NWildcard::CCensorNode *nextNode = 0;
-    if (addArchivePrefix.IsEmpty())
+    if (fi.IsDir())
     {
-      int index = curNode.FindSubNode(name);
-      if (index >= 0)
-        nextNode = &curNode.SubNodes[index];
+      const NWildcard::CCensorNode *nextNode = 0;
+      if (addArchivePrefix.IsEmpty())
+      {
+        int index = curNode.FindSubNode(name);
+        if (index >= 0)
+          nextNode = &curNode.SubNodes[index];
+      }
+      if (action.EnterToSubFolders || nextNode != 0)
+      {
+        if (nextNode == 0)
+        {
+          nextNode = &curNode;
+          action.AddName = true;
+        }
+        action.NextNode = nextNode;
+        // we don't read listing, if next node will use direct_names case
+        if (prefetcher && (action.AddName || action.EnterToSubFolders ||
+            nextNode->NeedCheckSubDirs() || !AreDirectNames(*nextNode)))
+          action.TaskIndex = prefetcher->AddTask(phyPrefix + name + (wchar_t)kDirDelimiter);
+      }
     }
-    if (!enterToSubFolders2 && nextNode == 0)
+    actions.Add(action);
+  }
+  if (prefetcher)
+    prefetcher->StartTasks(firstTask);
+
+  for (i = 0; i < files.Size(); i++)
+  {
+    if (callback && (i & 0xFF) == 0xFF)
+      RINOK(callback->ScanProgress(dirItems.GetNumFolders(), dirItems.Items.Size(), phyPrefix));
+    const NFind::CFileInfoW &fi = files[i];
+    const CDirEntryAction &action = actions[i];
+    if (action.Add)
+      AddDirFileInfo(phyParent, logParent, fi, dirItems.Items);
+    if (action.NextNode == 0)
       continue;
 
-    addArchivePrefixNew = addArchivePrefix;
-    if (nextNode == 0)
-    {
-      nextNode = &curNode;
-      addArchivePrefixNew.Add(name);
-    }
+    UStringVector addArchivePrefixNew = addArchivePrefix;
+    if (action.AddName)
+      addArchivePrefixNew.Add(fi.Name);
 
-    RINOK(EnumerateDirItems_Spec(*nextNode, phyParent, logParent, name, phyPrefix,
-        addArchivePrefixNew, dirItems, enterToSubFolders2, callback, errorPaths, errorCodes));
+    RINOK(EnumerateDirItems_Spec(*action.NextNode, phyParent, logParent, fi.Name, phyPrefix,
+        addArchivePrefixNew, dirItems, action.EnterToSubFolders, callback, errorPaths, errorCodes,
+        prefetcher, action.TaskIndex));
+  }
+  if (listing->Error)
+  {
+    errorCodes.Add(listing->ErrorCode);
+    errorPaths.Add(phyPrefix);
   }
+  if (taskIndex >= 0)
+    prefetcher->ReleaseTask(taskIndex);
   return S_OK;
 }
 
@@ -355,12 +679,15 @@ HRESULT EnumerateItems(
     UStringVector &errorPaths,
     CRecordVector<DWORD> &errorCodes)
 {
+  CDirPrefetcher prefetcherSpec;
+  CDirPrefetcher *prefetcher;
+  CreatePrefetcher(prefetcherSpec, dirItems.NumScanThreads, prefetcher);
   for (int i = 0; i < censor.Pairs.Size(); i++)
   {
     const NWildcard::CPair &pair = censor.Pairs[i];
     int phyParent = pair.Prefix.IsEmpty() ? -1 : dirItems.AddPrefix(-1, -1, pair.Prefix);
     RINOK(EnumerateDirItems(pair.Head, phyParent, -1, pair.Prefix, UStringVector(), dirItems, false,
-        callback, errorPaths, errorCodes));
+        callback, errorPaths, errorCodes, prefetcher, -1));
   }
   dirItems.ReserveDown();
   return S_OK;
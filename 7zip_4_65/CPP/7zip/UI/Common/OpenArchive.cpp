@@ -92,11 +92,23 @@ HRESULT IsArchiveItemAnti(IInArchive *archive, UInt32 index, bool &result)
 // Static-SFX (for Linux) can be big.
 const UInt64 kMaxCheckStartPosition = 1 << 22;
 
-HRESULT ReOpenArchive(IInArchive *archive, const UString &fileName, IArchiveOpenCallback *openArchiveCallback)
+// It uses memory mapped stream for regular file on local fixed drive.
+// Network and removable files are read with CInFileStream.
+static bool OpenInFileStream(const UString &filePath, CMyComPtr<IInStream> &inStream)
 {
+  CInMappedFileStream *mappedStreamSpec = new CInMappedFileStream;
+  inStream = mappedStreamSpec;
+  if (mappedStreamSpec->Open(filePath))
+    return true;
   CInFileStream *inStreamSpec = new CInFileStream;
-  CMyComPtr<IInStream> inStream(inStreamSpec);
-  inStreamSpec->Open(fileName);
+  inStream = inStreamSpec;
+  return inStreamSpec->Open(filePath);
+}
+
+HRESULT ReOpenArchive(IInArchive *archive, const UString &fileName, IArchiveOpenCallback *openArchiveCallback)
+{
+  CMyComPtr<IInStream> inStream;
+  OpenInFileStream(fileName, inStream);
   return archive->Open(inStream, &kMaxCheckStartPosition, openArchiveCallback);
 }
 
@@ -310,9 +322,8 @@ HRESULT OpenArchive(
     UString &defaultItemName,
     IArchiveOpenCallback *openArchiveCallback)
 {
-  CInFileStream *inStreamSpec = new CInFileStream;
-  CMyComPtr<IInStream> inStream(inStreamSpec);
-  if (!inStreamSpec->Open(filePath))
+  CMyComPtr<IInStream> inStream;
+  if (!OpenInFileStream(filePath, inStream))
     return GetLastError();
   return OpenArchive(codecs, arcTypeIndex, inStream, ExtractFileNameFromPath(filePath),
     archiveResult, formatIndex,
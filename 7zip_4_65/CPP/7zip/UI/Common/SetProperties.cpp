@@ -26,6 +26,27 @@ static void ParseNumberString(const UString &s, NCOM::CPropVariant &prop)
     prop = result;
 }
 
+void GetPropertyNameAndValue(const CProperty &property, UString &name, NCOM::CPropVariant &value)
+{
+  name = property.Name;
+  value.Clear();
+  if (property.Value.IsEmpty())
+  {
+    if (!name.IsEmpty())
+    {
+      wchar_t c = name[name.Length() - 1];
+      if (c == L'-')
+        value = false;
+      else if (c == L'+')
+        value = true;
+      if (value.vt != VT_EMPTY)
+        name = name.Left(name.Length() - 1);
+    }
+  }
+  else
+    ParseNumberString(property.Value, value);
+}
+
 HRESULT SetProperties(IUnknown *unknown, const CObjectVector<CProperty> &properties)
 {
   if (properties.IsEmpty())
@@ -42,24 +63,9 @@ HRESULT SetProperties(IUnknown *unknown, const CObjectVector<CProperty> &propert
     int i;
     for(i = 0; i < properties.Size(); i++)
     {
-      const CProperty &property = properties[i];
       NCOM::CPropVariant propVariant;
-      UString name = property.Name;
-      if (property.Value.IsEmpty())
-      {
-        if (!name.IsEmpty())
-        {
-          wchar_t c = name[name.Length() - 1];
-          if (c == L'-')
-            propVariant = false;
-          else if (c == L'+')
-            propVariant = true;
-          if (propVariant.vt != VT_EMPTY)
-            name = name.Left(name.Length() - 1);
-        }
-      }
-      else
-        ParseNumberString(property.Value, propVariant);
+      UString name;
+      GetPropertyNameAndValue(properties[i], name, propVariant);
       realNames.Add(name);
       values[i] = propVariant;
     }
@@ -3,8 +3,14 @@
 #ifndef __SETPROPERTIES_H
 #define __SETPROPERTIES_H
 
+#include "Windows/PropVariant.h"
+
 #include "Property.h"
 
+// It converts command line property to the name and value that are sent to handler:
+// "x-" -> ("x", false), "x+" -> ("x", true), "x=5" -> ("x", 5), "x=s" -> ("x", "s").
+void GetPropertyNameAndValue(const CProperty &property, UString &name, NWindows::NCOM::CPropVariant &value);
+
 HRESULT SetProperties(IUnknown *unknown, const CObjectVector<CProperty> &properties);
 
 #endif
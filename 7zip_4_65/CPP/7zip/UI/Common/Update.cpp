@@ -6,6 +6,7 @@
 
 #include "Common/IntToString.h"
 #include "Common/StringConvert.h"
+#include "Common/StringToInt.h"
 
 #ifdef _WIN32
 #include "Windows/DLL.h"
@@ -16,12 +17,15 @@
 #include "Windows/FileName.h"
 #include "Windows/PropVariant.h"
 #include "Windows/PropVariantConversions.h"
+#include "Windows/System.h"
 #include "Windows/Time.h"
 
 #include "../../Common/FileStreams.h"
 
 #include "../../Compress/CopyCoder.h"
 
+#include "../../Archive/Common/ParseProperties.h"
+
 #include "../Common/DirItem.h"
 #include "../Common/EnumDirItems.h"
 #include "../Common/OpenArchive.h"
@@ -638,6 +642,28 @@ struct CEnumDirItemUpdateCallback: public IEnumDirItemCallback
   }
 };
 
+// It reads number of threads from "mt" property (-mmt, -mmt=4, -mmt4, -mmt=off)
+// in same way as archive handlers do it.
+// It returns false, if there is no such property.
+
+static bool GetNumThreadsProp(const CObjectVector<CProperty> &properties, UInt32 &numThreads)
+{
+  bool found = false;
+  const UInt32 numProcessors = NSystem::GetNumberOfProcessors();
+  for (int i = 0; i < properties.Size(); i++)
+  {
+    UString name;
+    NCOM::CPropVariant value;
+    GetPropertyNameAndValue(properties[i], name, value);
+    name.MakeUpper();
+    if (name.Left(2) != L"MT")
+      continue;
+    if (ParseMtProp(name.Mid(2), value, numProcessors, numThreads) == S_OK)
+      found = true;
+  }
+  return found;
+}
+
 #ifdef _WIN32
 typedef ULONG (FAR PASCAL MY_MAPISENDDOCUMENTS)(
   ULONG_PTR ulUIParam,
@@ -721,6 +747,9 @@ HRESULT UpdateArchive(
   }
 
   CDirItems dirItems;
+  UInt32 numThreads;
+  if (GetNumThreadsProp(options.MethodMode.Properties, numThreads))
+    dirItems.SetNumThreads(numThreads);
   if (options.StdInMode)
   {
     CDirItem di;
@@ -222,6 +222,9 @@ int Main2(
     SetLargePageSize();
     NSecurity::EnableLockMemoryPrivilege();
   }
+  #elif !defined(_WIN32)
+  if (options.LargePages)
+    SetLargePageSize();
   #endif
 
   CStdOutStream &stdStream = options.StdOutMode ? g_StdErr : g_StdOut;
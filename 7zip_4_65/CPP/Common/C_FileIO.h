@@ -22,6 +22,7 @@ public:
   CFileBase(): _handle(-1) {};
   ~CFileBase() { Close(); }
   bool Close();
+  int GetHandle() const { return _handle; }
   bool GetLength(UInt64 &length) const;
   off_t Seek(off_t distanceToMove, int moveMethod) const;
 };
@@ -187,6 +187,8 @@ public:
   T& Back() { return operator[](_size - 1); }
   const T& Back() const { return operator[](_size - 1); }
   int Add(const T& item) { return CPointerVector::Add(new T(item)); }
+  // constructs new item in place (for items that can not be copied)
+  T& AddNew() { T *p = new T; CPointerVector::Add(p); return *p; }
   void Insert(int index, const T& item) { CPointerVector::Insert(index, new T(item)); }
   virtual void Delete(int index, int num = 1)
   {
@@ -26,7 +26,8 @@ BSTR SysAllocStringByteLen(LPCSTR psz, UINT len)
     return 0;
   *(UINT *)p = len;
   BSTR bstr = (BSTR)((UINT *)p + 1);
-  memmove(bstr, psz, len);
+  if (psz != 0)
+    memmove(bstr, psz, len);
   Byte *pb = ((Byte *)bstr) + len;
   for (int i = 0; i < sizeof(OLECHAR) * 2; i++)
     pb[i] = 0;
@@ -37,6 +37,10 @@ typedef unsigned short USHORT;
 typedef unsigned short WORD;
 typedef short VARIANT_BOOL;
 
+typedef int BOOL;
+#define FALSE 0
+#define TRUE 1
+
 typedef int INT;
 typedef Int32 INT32;
 typedef unsigned int UINT;
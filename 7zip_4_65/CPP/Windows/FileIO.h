@@ -38,6 +38,7 @@ public:
 
   bool Close();
 
+  HANDLE GetHandle() const { return _handle; }
   bool GetPosition(UInt64 &position) const;
   bool GetLength(UInt64 &length) const;
 
@@ -12,6 +12,8 @@ extern "C"
 
 #ifdef _WIN32
 #include "Handle.h"
+#else
+#include <errno.h>
 #endif
 
 namespace NWindows {
@@ -23,7 +25,9 @@ protected:
   ::CEvent _object;
 public:
   bool IsCreated() { return Event_IsCreated(&_object) != 0; }
+  #ifdef _WIN32
   operator HANDLE() { return _object.handle; }
+  #endif
   CBaseEvent() { Event_Construct(&_object); }
   ~CBaseEvent() { Close(); }
   WRes Close() { return Event_Close(&_object); }
@@ -134,7 +138,9 @@ public:
   CSemaphore() { Semaphore_Construct(&_object); }
   ~CSemaphore() { Close(); }
   WRes Close() {  return Semaphore_Close(&_object); }
+  #ifdef _WIN32
   operator HANDLE() { return _object.handle; }
+  #endif
   WRes Create(UInt32 initiallyCount, UInt32 maxCount)
   {
     return Semaphore_Create(&_object, initiallyCount, maxCount);
@@ -163,6 +169,257 @@ public:
   ~CCriticalSectionLock() { Unlock(); }
 };
 
+
+/*
+WaitForMultiObj_Any_Infinite() waits for any of (count) objects and
+returns (WAIT_OBJECT_0 + index) of signaled object.
+Windows version calls WaitForMultipleObjects().
+POSIX version has no such system call, so all _WFMO objects that can be
+waited together must be created with same CSynchro object: they keep
+their state under synchro's mutex and signal synchro's condition variable.
+*/
+
+#ifdef _WIN32
+
+class CSynchro
+{
+public:
+  WRes Create() { return 0; }
+};
+
+class CManualResetEvent_WFMO: public CManualResetEvent
+{
+public:
+  WRes Create(CSynchro * /* synchro */, bool initiallyOwn = false)
+    { return CManualResetEvent::Create(initiallyOwn); }
+  WRes CreateIfNotCreated(CSynchro * /* synchro */)
+    { return CManualResetEvent::CreateIfNotCreated(); }
+};
+
+class CAutoResetEvent_WFMO: public CAutoResetEvent
+{
+public:
+  WRes Create(CSynchro * /* synchro */)
+    { return CAutoResetEvent::Create(); }
+  WRes CreateIfNotCreated(CSynchro * /* synchro */)
+    { return CAutoResetEvent::CreateIfNotCreated(); }
+};
+
+class CSemaphore_WFMO: public CSemaphore
+{
+public:
+  WRes Create(CSynchro * /* synchro */, UInt32 initiallyCount, UInt32 maxCount)
+    { return CSemaphore::Create(initiallyCount, maxCount); }
+};
+
+typedef HANDLE CHandle_WFMO;
+
+inline DWORD WaitForMultiObj_Any_Infinite(DWORD count, const CHandle_WFMO *handles)
+{
+  return ::WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+}
+
+#else
+
+#ifndef WAIT_OBJECT_0
+#define WAIT_OBJECT_0 0
+#endif
+#ifndef WAIT_FAILED
+#define WAIT_FAILED ((DWORD)0xFFFFFFFF)
+#endif
+
+class CSynchro
+{
+  pthread_mutex_t _mutex;
+  pthread_cond_t _cond;
+  bool _isValid;
+  void operator=(const CSynchro &);
+public:
+  CSynchro(): _isValid(false) {}
+  // objects with CSynchro member are copied to CObjectVector before Create()
+  CSynchro(const CSynchro &): _isValid(false) {}
+  ~CSynchro()
+  {
+    if (_isValid)
+    {
+      ::pthread_mutex_destroy(&_mutex);
+      ::pthread_cond_destroy(&_cond);
+    }
+    _isValid = false;
+  }
+  WRes Create()
+  {
+    if (_isValid)
+      return 0;
+    WRes res = ::pthread_mutex_init(&_mutex, NULL);
+    if (res != 0)
+      return res;
+    res = ::pthread_cond_init(&_cond, NULL);
+    if (res != 0)
+    {
+      ::pthread_mutex_destroy(&_mutex);
+      return res;
+    }
+    _isValid = true;
+    return 0;
+  }
+  void Enter() { ::pthread_mutex_lock(&_mutex); }
+  void Leave() { ::pthread_mutex_unlock(&_mutex); }
+  void WaitCond() { ::pthread_cond_wait(&_cond, &_mutex); }
+  // waiters of different objects share one condition, so we wake all of them
+  void LeaveAndSignal()
+  {
+    ::pthread_cond_broadcast(&_cond);
+    ::pthread_mutex_unlock(&_mutex);
+  }
+};
+
+class CBaseHandle_WFMO
+{
+protected:
+  CSynchro *_sync;
+  CBaseHandle_WFMO(): _sync(NULL) {}
+public:
+  virtual ~CBaseHandle_WFMO() {}
+  // it's called under _sync lock
+  virtual bool IsSignaledAndUpdate() = 0;
+  CSynchro *GetSynchro() const { return _sync; }
+  operator CBaseHandle_WFMO *() { return this; }
+  bool IsCreated() const { return _sync != NULL; }
+  WRes Close() { _sync = NULL; return 0; }
+  WRes Lock()
+  {
+    _sync->Enter();
+    while (!IsSignaledAndUpdate())
+      _sync->WaitCond();
+    _sync->Leave();
+    return 0;
+  }
+};
+
+class CBaseEvent_WFMO: public CBaseHandle_WFMO
+{
+  bool _manualReset;
+  bool _state;
+protected:
+  WRes Create2(CSynchro *synchro, bool manualReset, bool initiallyOwn)
+  {
+    _sync = synchro;
+    _manualReset = manualReset;
+    _state = initiallyOwn;
+    return 0;
+  }
+public:
+  bool IsSignaledAndUpdate()
+  {
+    if (!_state)
+      return false;
+    if (!_manualReset)
+      _state = false;
+    return true;
+  }
+  WRes Set()
+  {
+    _sync->Enter();
+    _state = true;
+    _sync->LeaveAndSignal();
+    return 0;
+  }
+  WRes Reset()
+  {
+    _sync->Enter();
+    _state = false;
+    _sync->Leave();
+    return 0;
+  }
+};
+
+class CManualResetEvent_WFMO: public CBaseEvent_WFMO
+{
+public:
+  WRes Create(CSynchro *synchro, bool initiallyOwn = false)
+    { return Create2(synchro, true, initiallyOwn); }
+  WRes CreateIfNotCreated(CSynchro *synchro)
+  {
+    if (IsCreated())
+      return 0;
+    return Create2(synchro, true, false);
+  }
+};
+
+class CAutoResetEvent_WFMO: public CBaseEvent_WFMO
+{
+public:
+  WRes Create(CSynchro *synchro)
+    { return Create2(synchro, false, false); }
+  WRes CreateIfNotCreated(CSynchro *synchro)
+  {
+    if (IsCreated())
+      return 0;
+    return Create2(synchro, false, false);
+  }
+};
+
+class CSemaphore_WFMO: public CBaseHandle_WFMO
+{
+  UInt32 _count;
+  UInt32 _maxCount;
+public:
+  WRes Create(CSynchro *synchro, UInt32 initiallyCount, UInt32 maxCount)
+  {
+    if (initiallyCount > maxCount || maxCount < 1)
+      return EINVAL;
+    _sync = synchro;
+    _count = initiallyCount;
+    _maxCount = maxCount;
+    return 0;
+  }
+  bool IsSignaledAndUpdate()
+  {
+    if (_count == 0)
+      return false;
+    _count--;
+    return true;
+  }
+  WRes Release(UInt32 releaseCount = 1)
+  {
+    if (releaseCount < 1)
+      return EINVAL;
+    _sync->Enter();
+    UInt32 newCount = _count + releaseCount;
+    if (newCount > _maxCount || newCount < releaseCount)
+    {
+      _sync->Leave();
+      return EINVAL;
+    }
+    _count = newCount;
+    _sync->LeaveAndSignal();
+    return 0;
+  }
+};
+
+typedef CBaseHandle_WFMO *CHandle_WFMO;
+
+inline DWORD WaitForMultiObj_Any_Infinite(DWORD count, const CHandle_WFMO *handles)
+{
+  if (count < 1)
+    return WAIT_FAILED;
+  CSynchro *synchro = handles[0]->GetSynchro();
+  synchro->Enter();
+  for (;;)
+  {
+    for (DWORD i = 0; i < count; i++)
+      if (handles[i]->IsSignaledAndUpdate())
+      {
+        synchro->Leave();
+        return WAIT_OBJECT_0 + i;
+      }
+    synchro->WaitCond();
+  }
+}
+
+#endif
+
 }}
 
 #endif
@@ -2,11 +2,17 @@
 
 #include "StdAfx.h"
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #include "System.h"
 
 namespace NWindows {
 namespace NSystem {
 
+#ifdef _WIN32
+
 UInt32 GetNumberOfProcessors()
 {
   SYSTEM_INFO systemInfo;
@@ -61,4 +67,23 @@ UInt64 GetRamSize()
   #endif
 }
 
+#else
+
+UInt32 GetNumberOfProcessors()
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (UInt32)n : 1;
+}
+
+UInt64 GetRamSize()
+{
+  long numPages = sysconf(_SC_PHYS_PAGES);
+  long pageSize = sysconf(_SC_PAGESIZE);
+  if (numPages <= 0 || pageSize <= 0)
+    return (UInt64)128 << 20;
+  return (UInt64)numPages * (UInt64)pageSize;
+}
+
+#endif
+
 }}